@@ -76,6 +76,36 @@ int model_driver_init(void* km, char* paramfile_names, int* nmstrlen,
   return ier;
 }
 
+//******************************************************************************
+int model_driver_hessian_vector_product(void* km, double const* v, double* hv)
+{
+  return ANN::HessianVectorProduct(km, v, hv);
+}
+
+//******************************************************************************
+int model_driver_begin_local_moves(void* km, double* energy)
+{
+  return ANN::BeginLocalMoves(km, energy);
+}
+
+//******************************************************************************
+int model_driver_trial_local_moves(void* km, int numberTrials,
+                                   int const* numberMoved,
+                                   int const* particles,
+                                   double const* coordinates,
+                                   int const* species,
+                                   double* deltaEnergy)
+{
+  return ANN::TrialLocalMoves(km, numberTrials, numberMoved, particles,
+                              coordinates, species, deltaEnergy);
+}
+
+//******************************************************************************
+int model_driver_accept_local_move(void* km, int trial)
+{
+  return ANN::AcceptLocalMove(km, trial);
+}
+
 //==============================================================================
 //
 // Implementation of ANN public wrapper functions
@@ -162,3 +192,78 @@ int ANN::Compute(void* kimmdl)  // static member function
 
   return modelObject->implementation_->Compute(pkim);
 }
+
+//******************************************************************************
+int ANN::HessianVectorProduct(void* kimmdl,  // static member function
+                              double const* v, double* hv)
+{
+  KIM_API_model* const pkim = *static_cast<KIM_API_model**>(kimmdl);
+  int ier;
+  ANN* const modelObject
+      = static_cast<ANN*>(pkim->get_model_buffer(&ier));
+  if (ier < KIM_STATUS_OK)
+  {
+    pkim->report_error(__LINE__, __FILE__, "get_model_buffer", ier);
+    return ier;
+  }
+
+  return modelObject->implementation_->HessianVectorProduct(pkim, v, hv);
+}
+
+//******************************************************************************
+int ANN::BeginLocalMoves(void* kimmdl,  // static member function
+                         double* energy)
+{
+  KIM_API_model* const pkim = *static_cast<KIM_API_model**>(kimmdl);
+  int ier;
+  ANN* const modelObject
+      = static_cast<ANN*>(pkim->get_model_buffer(&ier));
+  if (ier < KIM_STATUS_OK)
+  {
+    pkim->report_error(__LINE__, __FILE__, "get_model_buffer", ier);
+    return ier;
+  }
+
+  return modelObject->implementation_->BeginLocalMoves(pkim, energy);
+}
+
+//******************************************************************************
+int ANN::TrialLocalMoves(void* kimmdl,  // static member function
+                         int numberTrials,
+                         int const* numberMoved,
+                         int const* particles,
+                         double const* coordinates,
+                         int const* species,
+                         double* deltaEnergy)
+{
+  KIM_API_model* const pkim = *static_cast<KIM_API_model**>(kimmdl);
+  int ier;
+  ANN* const modelObject
+      = static_cast<ANN*>(pkim->get_model_buffer(&ier));
+  if (ier < KIM_STATUS_OK)
+  {
+    pkim->report_error(__LINE__, __FILE__, "get_model_buffer", ier);
+    return ier;
+  }
+
+  return modelObject->implementation_->TrialLocalMoves(
+      pkim, numberTrials, numberMoved, particles, coordinates, species,
+      deltaEnergy);
+}
+
+//******************************************************************************
+int ANN::AcceptLocalMove(void* kimmdl,  // static member function
+                         int trial)
+{
+  KIM_API_model* const pkim = *static_cast<KIM_API_model**>(kimmdl);
+  int ier;
+  ANN* const modelObject
+      = static_cast<ANN*>(pkim->get_model_buffer(&ier));
+  if (ier < KIM_STATUS_OK)
+  {
+    pkim->report_error(__LINE__, __FILE__, "get_model_buffer", ier);
+    return ier;
+  }
+
+  return modelObject->implementation_->AcceptLocalMove(pkim, trial);
+}
@@ -36,6 +36,19 @@ extern "C"
 {
   int model_driver_init(void* km, char* paramfile_names, int* nmstrlen,
                         int* numparamfiles);
+  // Hessian-vector product hv = H v of the energy w.r.t. the coordinates of
+  // the current configuration; v and hv are [numberOfParticles][3]
+  int model_driver_hessian_vector_product(void* km, double const* v,
+                                          double* hv);
+  // incremental evaluation of local Monte Carlo moves (see README)
+  int model_driver_begin_local_moves(void* km, double* energy);
+  int model_driver_trial_local_moves(void* km, int numberTrials,
+                                     int const* numberMoved,
+                                     int const* particles,
+                                     double const* coordinates,
+                                     int const* species,
+                                     double* deltaEnergy);
+  int model_driver_accept_local_move(void* km, int trial);
 }
 
 class ANNImplementation;
@@ -56,6 +69,13 @@ class ANN
   static int Destroy(void* kimmdl);
   static int Reinit(void* kimmdl);
   static int Compute(void* kimmdl);
+  static int HessianVectorProduct(void* kimmdl, double const* v, double* hv);
+  static int BeginLocalMoves(void* kimmdl, double* energy);
+  static int TrialLocalMoves(void* kimmdl, int numberTrials,
+                             int const* numberMoved, int const* particles,
+                             double const* coordinates, int const* species,
+                             double* deltaEnergy);
+  static int AcceptLocalMove(void* kimmdl, int trial);
 
  private:
   ANNImplementation* implementation_;
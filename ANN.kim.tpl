@@ -102,6 +102,10 @@ forces                      double       force               [numberOfParticles,
 
 particleEnergy              double       energy              [numberOfParticles]    optional
 
+virial                      double       energy              [6]                    optional
+
+particleVirial              double       energy              [numberOfParticles,6]  optional
+
 
 ################################################################################
 MODEL_PARAMETERS:
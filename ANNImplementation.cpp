@@ -31,13 +31,16 @@
 #include <cstdlib>
 #include <cstring>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <unordered_map>
 
 #include "KIM_API_status.h"
 #include "ANN.hpp"
 #include "ANNImplementation.hpp"
 #include "descriptor.h"
 #include "helper.h"
+#include "modelio.h"
 
 #define MAXLINE 1024
 #define IGNORE_RESULT(fn) if(fn){}
@@ -56,35 +59,13 @@ ANNImplementation::ANNImplementation(
     int const parameterFileNameLength,
     int const numberParameterFiles,
     int* const ier)
-    : numberOfSpeciesIndex_(-1),  // initizlize index, pointer, and cached
-      numberOfParticlesIndex_(-1),    // member variables
-      particleSpeciesIndex_(-1),
-			particleStatusIndex_(-1),
-      coordinatesIndex_(-1),
-      get_neighIndex_(-1),
-      process_dEdrIndex_(-1),
-      process_d2Edr2Index_(-1),
-      cutoffIndex_(-1),
-      energyIndex_(-1),
-      forcesIndex_(-1),
-      particleEnergyIndex_(-1),
-      numberModelSpecies_(0),
-      numberUniqueSpeciesPairs_(0),
-      cutoffs_(0),
-			cutoffsSq2D_(0),
-      cachedNumberOfParticles_(0),
-      cachedNumberContributingParticles_(0)
-			// add potential parameters
-
-
+    : ANNImplementation()
 {
-	// create descriptor and network classes
-	descriptor_ = new Descriptor();
-	network_ = new NeuralNetwork();
-
   *ier = SetConstantValues(pkim);
   if (*ier < KIM_STATUS_OK) return;
 
+  SetRuntimeOptions();
+
   AllocateFreeParameterMemory();
 
   FILE* parameterFilePointers[MAX_PARAMETER_FILES];
@@ -92,11 +73,26 @@ ANNImplementation::ANNImplementation(
                             numberParameterFiles, parameterFilePointers);
   if (*ier < KIM_STATUS_OK) return;
 
-  *ier = ProcessParameterFiles(pkim, parameterFilePointers, numberParameterFiles);
+  // reuse the model of an identical parameter file if one is loaded already,
+  // otherwise read it and make it available to other instances
+  parameterFileName_ = parameterFileNames;
+  fstat(fileno(parameterFilePointers[0]), &parameterFileStat_);
+  ModelCache::Key const key = ModelCache::hash_file(parameterFilePointers[0]);
+  std::shared_ptr<ANNModel const> model = ModelCache::find(key);
+  if (!model) {
+    std::shared_ptr<ANNModel> newModel = std::make_shared<ANNModel>();
+    *ier = ProcessParameterFiles(pkim, parameterFilePointers,
+                                 numberParameterFiles, *newModel);
+    if (*ier >= KIM_STATUS_OK) {
+      model = ModelCache::insert(key, newModel);
+    }
+  }
 
   CloseParameterFiles(parameterFilePointers, numberParameterFiles);
   if (*ier < KIM_STATUS_OK) return;
 
+  SetModel(model, key);
+
 //TODO enable later
 //  *ier = ConvertUnits(pkim);
 //  if (*ier < KIM_STATUS_OK) return;
@@ -115,23 +111,22 @@ ANNImplementation::ANNImplementation(
   return;
 }
 
-//******************************************************************************
-ANNImplementation::~ANNImplementation()
-{ // note: it is ok to delete a null pointer and we have ensured that
-  // everything is initialized to null
-  delete [] cutoffs_;
-  Deallocate2DArray(cutoffsSq2D_);
-}
-
 //******************************************************************************
 int ANNImplementation::Reinit(KIM_API_model* const pkim)
 {
   int ier;
 
+  // pick up new weights if the parameter file was changed
+  ier = ReloadModel(pkim, true);
+  if (ier < KIM_STATUS_OK) return ier;
+
   ier = SetReinitMutableValues(pkim);
   if (ier < KIM_STATUS_OK) return ier;
 
-  // nothing else to do for this case
+  // the cutoffs may have been changed
+  InvalidateResults();
+  delete localMoves_;
+  localMoves_ = 0;
 
   // everything is good
   ier = KIM_STATUS_OK;
@@ -151,6 +146,8 @@ int ANNImplementation::Compute(KIM_API_model* const pkim)
   bool isComputeEnergy;
   bool isComputeForces;
   bool isComputeParticleEnergy;
+  bool isComputeVirial;
+  bool isComputeParticleVirial;
   //
   // KIM API Model Input
   int const* particleSpecies = 0;
@@ -161,20 +158,429 @@ int ANNImplementation::Compute(KIM_API_model* const pkim)
   double* energy = 0;
   double* particleEnergy = 0;
   VectorOfSizeDIM* forces = 0;
-  ier = SetComputeMutableValues(pkim, isComputeProcess_dEdr,
+  VectorOfSizeSix* virial = 0;
+  VectorOfSizeSix* particleVirial = 0;
+
+  // reload the model at this step boundary if the parameter file changed
+  if (watchParameterFile_) {
+    ier = ReloadModel(pkim, false);
+    if (ier < KIM_STATUS_OK) return ier;
+  }
+
+  std::chrono::steady_clock::time_point lap = std::chrono::steady_clock::now();
+
+  // per-call mutable state
+  ComputeContext* const context = AcquireContext();
+  long const bytes = profile_ ? context->bytes() : 0;
+
+  ier = SetComputeMutableValues(pkim, *context, isComputeProcess_dEdr,
                                 isComputeProcess_d2Edr2, isComputeEnergy,
                                 isComputeForces, isComputeParticleEnergy,
                                 particleSpecies, get_neigh,
-                                coordinates, energy, particleEnergy, forces);
-  if (ier < KIM_STATUS_OK) return ier;
+                                coordinates, energy, particleEnergy, forces,
+                                isComputeVirial, isComputeParticleVirial,
+                                virial, particleVirial);
+  if (ier < KIM_STATUS_OK) {
+    ReleaseContext(context);
+    return ier;
+  }
+  KIMNeighbors const neighbors = {pkim, get_neigh};
+
+  if (captureFile_ != 0) {
+    int const flags
+        = (isComputeEnergy ? CAPTURE_ENERGY : 0)
+        | (isComputeForces ? CAPTURE_FORCES : 0)
+        | (isComputeParticleEnergy ? CAPTURE_PARTICLE_ENERGY : 0)
+        | (isComputeVirial ? CAPTURE_VIRIAL : 0)
+        | (isComputeParticleVirial ? CAPTURE_PARTICLE_VIRIAL : 0)
+        | (isComputeProcess_dEdr ? CAPTURE_PROCESS_DEDR : 0)
+        | (isComputeProcess_d2Edr2 ? CAPTURE_PROCESS_D2EDR2 : 0);
+    CaptureCall(pkim, *context, flags, particleSpecies, neighbors,
+                coordinates);
+  }
 
   // Skip this check for efficiency
   //
-  // ier = CheckParticleSpecies(pkim, particleSpecies);
+  // ier = CheckParticleSpecies(pkim, context->numberOfParticles,
+  //                            particleSpecies);
   // if (ier < KIM_STATUS_OK) return ier;
 
+  // Copy the outputs held by the result cache for this configuration; only
+  // the others are computed.  The process_dEdr and process_d2Edr2 callbacks
+  // are always made, so such calls do not use the cache.
+  ResultCache& results = context->results;
+  results.isActive = (resultCache_ == true && isComputeProcess_dEdr == false
+                      && isComputeProcess_d2Edr2 == false);
+  if (results.isActive == true) {
+    TakeResults(*context, particleSpecies, coordinates);
+    ++resultCalls_;
+    if (results.isValid == true) {
+      int const Nparticles = context->numberOfParticles;
+      int const Ncontrib = context->numberContributingParticles;
+      // summed in the same order as in Compute
+      if (isComputeEnergy == true) {
+        *energy = 0.0;
+        for (int i = 0; i < Ncontrib; ++i) *energy += results.energy[i];
+        isComputeEnergy = false;
+      }
+      if (isComputeParticleEnergy == true) {
+        std::fill(particleEnergy, particleEnergy + Nparticles, 0.0);
+        std::copy(results.energy.begin(), results.energy.end(),
+                  particleEnergy);
+        isComputeParticleEnergy = false;
+      }
+      if (isComputeForces == true && results.hasForces == true) {
+        std::copy(results.forces.begin(), results.forces.end(), forces[0]);
+        isComputeForces = false;
+      }
+      if (isComputeVirial == true && results.hasVirial == true) {
+        std::copy(results.virial, results.virial + 6, *virial);
+        isComputeVirial = false;
+      }
+      if (isComputeParticleVirial == true
+          && results.hasParticleVirial == true) {
+        std::copy(results.particleVirial.begin(),
+                  results.particleVirial.end(), particleVirial[0]);
+        isComputeParticleVirial = false;
+      }
+      if (isComputeForces || isComputeVirial || isComputeParticleVirial) {
+        ++resultResumes_;
+      }
+      else {
+        ++resultHits_;
+      }
+    }
+
+    // room for the state recorded by the dispatched Compute
+    int const size = context->numberContributingParticles
+        * descriptor_->get_num_descriptors();
+    if (isComputeForces || isComputeVirial || isComputeParticleVirial) {
+      if (results.hasDerivative == false) {
+        results.dEdGeneralizedCoords.resize(size);
+      }
+    }
+    else if (results.isValid == false) {
+      results.generalizedCoords.resize(size);
+    }
+  }
 
 #include "ANNImplementationComputeDispatch.cpp"
+
+  if (results.isActive == true) {
+    if (ier >= KIM_STATUS_OK) {
+      bool const isComputeDerivative
+          = (isComputeForces || isComputeVirial || isComputeParticleVirial);
+      if (results.isValid == false && (isComputeDerivative == true
+                                       || isComputeEnergy == true
+                                       || isComputeParticleEnergy == true)) {
+        results.isValid = true;
+        results.hasGeneralizedCoords = !isComputeDerivative;
+      }
+      if (isComputeDerivative == true) results.hasDerivative = true;
+      if (isComputeForces == true) {
+        results.forces.assign(forces[0],
+                              forces[0] + context->numberOfParticles*DIM);
+        results.hasForces = true;
+      }
+      if (isComputeVirial == true) {
+        std::copy(*virial, *virial + 6, results.virial);
+        results.hasVirial = true;
+      }
+      if (isComputeParticleVirial == true) {
+        results.particleVirial.assign(
+            particleVirial[0],
+            particleVirial[0] + context->numberOfParticles*6);
+        results.hasParticleVirial = true;
+      }
+      if (results.isValid == true) StoreResults(*context);
+    }
+    results.isActive = false;
+  }
+
+  if (ier >= KIM_STATUS_OK && isComputeProcess_d2Edr2 == true) {
+    ier = ProcessSecondDerivatives<LocatorIterator>(pkim, *context,
+                                                    particleSpecies,
+                                                    neighbors, coordinates);
+  }
+
+  ++context->times.calls;
+  context->times.particles += context->numberContributingParticles;
+  if (profile_) {
+    context->counts.bytesAllocated += std::max(0L, context->bytes() - bytes);
+  }
+  EndStage("compute", lap, context->times.compute, context->events);
+  ReleaseContext(context);
+  return ier;
+}
+
+//******************************************************************************
+int ANNImplementation::HessianVectorProduct(KIM_API_model* const pkim,
+                                            double const* const v,
+                                            double* const hv)
+{
+  int ier;
+
+  bool isComputeProcess_dEdr;
+  bool isComputeProcess_d2Edr2;
+  bool isComputeEnergy;
+  bool isComputeForces;
+  bool isComputeParticleEnergy;
+  bool isComputeVirial;
+  bool isComputeParticleVirial;
+  int const* particleSpecies = 0;
+  GetNeighborFunction * get_neigh = 0;
+  VectorOfSizeDIM const* coordinates = 0;
+  double* energy = 0;
+  double* particleEnergy = 0;
+  VectorOfSizeDIM* forces = 0;
+  VectorOfSizeSix* virial = 0;
+  VectorOfSizeSix* particleVirial = 0;
+
+  // reload the model at this step boundary if the parameter file changed
+  if (watchParameterFile_) {
+    ier = ReloadModel(pkim, false);
+    if (ier < KIM_STATUS_OK) return ier;
+  }
+
+  ComputeContext* const context = AcquireContext();
+
+  // only the model inputs are used; the outputs are left alone
+  ier = SetComputeMutableValues(pkim, *context, isComputeProcess_dEdr,
+                                isComputeProcess_d2Edr2, isComputeEnergy,
+                                isComputeForces, isComputeParticleEnergy,
+                                particleSpecies, get_neigh,
+                                coordinates, energy, particleEnergy, forces,
+                                isComputeVirial, isComputeParticleVirial,
+                                virial, particleVirial);
+  if (ier >= KIM_STATUS_OK) {
+    KIMNeighbors const neighbors = {pkim, get_neigh};
+    ier = HessianVectorProduct<LocatorIterator>(
+        *context, particleSpecies, neighbors, coordinates,
+        reinterpret_cast<VectorOfSizeDIM const*>(v),
+        reinterpret_cast<VectorOfSizeDIM*>(hv));
+  }
+
+  ReleaseContext(context);
+  return ier;
+}
+
+//******************************************************************************
+int ANNImplementation::BeginLocalMoves(KIM_API_model* const pkim,
+                                       double* const energy)
+{
+  int ier;
+
+  bool isComputeProcess_dEdr;
+  bool isComputeProcess_d2Edr2;
+  bool isComputeEnergy;
+  bool isComputeForces;
+  bool isComputeParticleEnergy;
+  bool isComputeVirial;
+  bool isComputeParticleVirial;
+  int const* particleSpecies = 0;
+  GetNeighborFunction * get_neigh = 0;
+  VectorOfSizeDIM const* coordinates = 0;
+  double* energyOut = 0;
+  double* particleEnergy = 0;
+  VectorOfSizeDIM* forces = 0;
+  VectorOfSizeSix* virial = 0;
+  VectorOfSizeSix* particleVirial = 0;
+
+  ComputeContext* const context = AcquireContext();
+
+  // only the model inputs are used; the outputs are left alone
+  ier = SetComputeMutableValues(pkim, *context, isComputeProcess_dEdr,
+                                isComputeProcess_d2Edr2, isComputeEnergy,
+                                isComputeForces, isComputeParticleEnergy,
+                                particleSpecies, get_neigh,
+                                coordinates, energyOut, particleEnergy, forces,
+                                isComputeVirial, isComputeParticleVirial,
+                                virial, particleVirial);
+  if (ier < KIM_STATUS_OK) {
+    ReleaseContext(context);
+    return ier;
+  }
+
+  if (localMoves_ == 0) localMoves_ = new LocalMoveState();
+  LocalMoveState& state = *localMoves_;
+  int const Nparticles = context->numberOfParticles;
+  int const Ncontrib = context->numberContributingParticles;
+  int const Ndescriptors = descriptor_->get_num_descriptors();
+
+  state.numberOfParticles = Nparticles;
+  state.numberContributingParticles = Ncontrib;
+  state.numberDescriptors = Ndescriptors;
+  state.cutoff = 0.0;
+  for (int i = 0; i < numberModelSpecies_; ++i) {
+    for (int j = 0; j < numberModelSpecies_; ++j) {
+      state.cutoff = std::max(state.cutoff, sqrt(cutoffsSq2D_[i][j]));
+    }
+  }
+  state.coordinates.assign(&coordinates[0][0],
+                           &coordinates[0][0] + Nparticles*DIM);
+  state.species.assign(particleSpecies, particleSpecies + Nparticles);
+  state.bin_particles();
+  state.trials.clear();
+
+  // Generalized coords of the contributing particles, with neighbors found
+  // from the bins as in the trials.  The particles are split evenly among
+  // the threads.
+  state.generalizedCoords.assign(Ncontrib*Ndescriptors, 0.0);
+  double const cutoffSq = state.cutoff*state.cutoff;
+  VectorOfSizeDIM const* const x
+      = reinterpret_cast<VectorOfSizeDIM const*>(&state.coordinates[0]);
+  int const Nparts = (threadPool_ != 0) ? numThreads_ : 1;
+  std::function<void(int)> const task = [&](int const part) {
+    std::vector<int> neigh;
+    for (int i = (Ncontrib*part)/Nparts; i < (Ncontrib*(part+1))/Nparts; ++i)
+    {
+      neigh.clear();
+      state.for_each_candidate(x[i], [&](int const j) {
+        if (j != i && DistanceSquared(x[i], x[j]) <= cutoffSq) {
+          neigh.push_back(j);
+        }
+      });
+      ComputeGeneralizedCoords(i, neigh.size(), neigh.data(),
+                               &state.species[0], x,
+                               &state.generalizedCoords[i*Ndescriptors], 0);
+    }
+  };
+  if (threadPool_ != 0) {
+    threadPool_->run(Nparts, task);
+  }
+  else {
+    task(0);
+  }
+
+  state.energy.assign(Ncontrib, 0.0);
+  state.totalEnergy = 0.0;
+  if (Ncontrib > 0) {
+    network_->forward(&state.generalizedCoords[0], Ncontrib, Ndescriptors,
+                      context->network);
+    double const* const Epart = context->network.get_output();
+    for (int i = 0; i < Ncontrib; ++i) {
+      state.energy[i] = Epart[i];
+      state.totalEnergy += Epart[i];
+    }
+  }
+  *energy = state.totalEnergy;
+
+  ReleaseContext(context);
+
+  // everything is good
+  ier = KIM_STATUS_OK;
+  return ier;
+}
+
+//******************************************************************************
+int ANNImplementation::TrialLocalMoves(KIM_API_model* const pkim,
+                                       int const numberTrials,
+                                       int const* const numberMoved,
+                                       int const* const particles,
+                                       double const* const coordinates,
+                                       int const* const species,
+                                       double* const deltaEnergy)
+{
+  int ier;
+
+  if (localMoves_ == 0) {
+    ier = KIM_STATUS_FAIL;
+    pkim->report_error(__LINE__, __FILE__,
+                       "TrialLocalMoves called before BeginLocalMoves or "
+                       "after the model was changed", ier);
+    return ier;
+  }
+  LocalMoveState& state = *localMoves_;
+
+  // set up the trials; particle indices are converted to model indexing
+  state.trials.resize(numberTrials);
+  int offset = 0;
+  for (int t = 0; t < numberTrials; ++t) {
+    LocalMoveTrial& trial = state.trials[t];
+    int const Nmoved = numberMoved[t];
+    trial.moved.resize(Nmoved);
+    trial.movedCoordinates.assign(coordinates + offset*DIM,
+                                  coordinates + (offset + Nmoved)*DIM);
+    trial.movedSpecies.resize(Nmoved);
+    for (int m = 0; m < Nmoved; ++m) {
+      int const p = particles[offset + m] + baseconvert_;
+      if (p < 0 || p >= state.numberOfParticles) {
+        state.trials.clear();
+        ier = KIM_STATUS_FAIL;
+        pkim->report_error(__LINE__, __FILE__,
+                           "moved particle out of range", ier);
+        return ier;
+      }
+      int const s = (species != 0) ? species[offset + m] : state.species[p];
+      if (s < 0 || s >= numberModelSpecies_) {
+        state.trials.clear();
+        ier = KIM_STATUS_FAIL;
+        pkim->report_error(__LINE__, __FILE__,
+                           "species of moved particle out of range", ier);
+        return ier;
+      }
+      trial.moved[m] = p;
+      trial.movedSpecies[m] = s;
+    }
+    offset += Nmoved;
+  }
+
+  // the trials are independent
+  std::function<void(int)> const task = [&](int const t) {
+    EvaluateLocalMove(state, state.trials[t]);
+  };
+  if (threadPool_ != 0) {
+    threadPool_->run(numberTrials, task);
+  }
+  else {
+    for (int t = 0; t < numberTrials; ++t) task(t);
+  }
+
+  for (int t = 0; t < numberTrials; ++t) {
+    deltaEnergy[t] = state.trials[t].deltaEnergy;
+  }
+
+  // everything is good
+  ier = KIM_STATUS_OK;
+  return ier;
+}
+
+//******************************************************************************
+int ANNImplementation::AcceptLocalMove(KIM_API_model* const pkim,
+                                       int const trial)
+{
+  int ier;
+
+  if (localMoves_ == 0 || trial < 0
+      || trial >= static_cast<int>(localMoves_->trials.size())) {
+    ier = KIM_STATUS_FAIL;
+    pkim->report_error(__LINE__, __FILE__,
+                       "AcceptLocalMove: no such trial", ier);
+    return ier;
+  }
+  LocalMoveState& state = *localMoves_;
+  LocalMoveTrial const& accepted = state.trials[trial];
+  int const Ndescriptors = state.numberDescriptors;
+
+  for (size_t m = 0; m < accepted.moved.size(); ++m) {
+    int const p = accepted.moved[m];
+    state.move_particle(p, &accepted.movedCoordinates[m*DIM]);
+    state.species[p] = accepted.movedSpecies[m];
+  }
+  for (size_t a = 0; a < accepted.affected.size(); ++a) {
+    int const i = accepted.affected[a];
+    std::copy(&accepted.generalizedCoords[a*Ndescriptors],
+              &accepted.generalizedCoords[a*Ndescriptors] + Ndescriptors,
+              &state.generalizedCoords[i*Ndescriptors]);
+    state.energy[i] = accepted.energy[a];
+  }
+  state.totalEnergy += accepted.deltaEnergy;
+
+  // the other trials were relative to the old configuration
+  state.trials.clear();
+
+  // everything is good
+  ier = KIM_STATUS_OK;
   return ier;
 }
 
@@ -194,7 +600,7 @@ int ANNImplementation::SetConstantValues(KIM_API_model* const pkim)
 
   // obtain indices for various KIM API Object arguments
   pkim->getm_index(
-      &ier, 3 * 12,
+      &ier, 3 * 14,
       "numberOfSpecies",             &numberOfSpeciesIndex_,             1,
       "numberOfParticles",           &numberOfParticlesIndex_,           1,
       "particleSpecies",             &particleSpeciesIndex_,             1,
@@ -206,7 +612,9 @@ int ANNImplementation::SetConstantValues(KIM_API_model* const pkim)
       "cutoff",                      &cutoffIndex_,                      1,
       "energy",                      &energyIndex_,                      1,
       "forces",                      &forcesIndex_,                      1,
-      "particleEnergy",              &particleEnergyIndex_,              1);
+      "particleEnergy",              &particleEnergyIndex_,              1,
+      "virial",                      &virialIndex_,                      1,
+      "particleVirial",              &particleVirialIndex_,              1);
   if (ier < KIM_STATUS_OK) {
     pkim->report_error(__LINE__, __FILE__, "getm_index", ier);
     return ier;
@@ -273,494 +681,24 @@ int ANNImplementation::OpenParameterFiles(
 int ANNImplementation::ProcessParameterFiles(
     KIM_API_model* const pkim,
     FILE* const parameterFilePointers[MAX_PARAMETER_FILES],
-    int const numberParameterFiles)
+    int const numberParameterFiles,
+    ANNModel& model)
 {
   int ier;
-  //int N;
-  int endOfFileFlag = 0;
-  char nextLine[MAXLINE];
-  char errorMsg[MAXLINE];
-  char name[MAXLINE];
-	double cutoff;
-
-  // descriptor
-	int numDescTypes;
-	int numDescs;
-	int numParams;
-	int numParamSets;
-	double** descParams = nullptr;
-
-  // network
-  int numLayers;
-  int* numPerceptrons;
-	double** weight;
-	double* bias;
-
-  //char spec1[MAXLINE], spec2[MAXLINE];
-  //int iIndex, jIndex , indx, iiIndex, jjIndex;
-  //double nextCutoff;
-
-	// cutoff
-  getNextDataLine(parameterFilePointers[0], nextLine, MAXLINE, &endOfFileFlag);
-  ier = sscanf(nextLine, "%s %lf", name, &cutoff);
-  if (ier != 2) {
-    sprintf(errorMsg, "unable to read cutoff from line:\n");
-    strcat(errorMsg, nextLine);
-    ier = KIM_STATUS_FAIL;
-    pkim->report_error(__LINE__, __FILE__, errorMsg, ier);
-    fclose(parameterFilePointers[0]);
-    return ier;
-  }
-
-  // register cutoff
-  lowerCase(name);
-  if (strcmp(name, "cos") != 0
-      && strcmp(name, "exp") != 0)
-  {
-    sprintf(errorMsg, "unsupported cutoff type. Expecting `cos', or `exp' "
-        "given %s.\n", name);
-    ier = KIM_STATUS_FAIL;
-    pkim->report_error(__LINE__, __FILE__, errorMsg, ier);
-    fclose(parameterFilePointers[0]);
-  }
-	descriptor_->set_cutfunc(name);
+  std::string error;
 
-//TODO modifiy this such that each pair has its own cutoff
-  for (int i=0; i<numberUniqueSpeciesPairs_; i++) {
-	  cutoffs_[i] = cutoff;
-  }
-
-	// number of descriptor types
-  getNextDataLine(parameterFilePointers[0], nextLine, MAXLINE, &endOfFileFlag);
-  ier = sscanf(nextLine, "%d", &numDescTypes);
-  if (ier != 1) {
-    sprintf(errorMsg, "unable to read number of descriptor types from line:\n");
-    strcat(errorMsg, nextLine);
+  ier = load_model(parameterFilePointers[0], model, error);
+  if (ier != 0) {
     ier = KIM_STATUS_FAIL;
-    pkim->report_error(__LINE__, __FILE__, errorMsg, ier);
-    fclose(parameterFilePointers[0]);
+    pkim->report_error(__LINE__, __FILE__, error.c_str(), ier);
     return ier;
   }
 
-  // descriptor
-  for (int i=0; i<numDescTypes; i++) {
-    // descriptor name and parameter dimensions
-    getNextDataLine(parameterFilePointers[0], nextLine, MAXLINE, &endOfFileFlag);
-
-    // name of descriptor
-    ier = sscanf(nextLine, "%s", name);
-    if (ier != 1) {
-      sprintf(errorMsg, "unable to read descriptor from line:\n");
-      strcat(errorMsg, nextLine);
-      ier = KIM_STATUS_FAIL;
-      pkim->report_error(__LINE__, __FILE__, errorMsg, ier);
-      fclose(parameterFilePointers[0]);
-      return ier;
-    }
-    lowerCase(name); // change to lower case name
-    if (strcmp(name, "g1") == 0) {  // G1
-      descriptor_->add_descriptor(name, nullptr, 1, 0);
-    }
-    else{
-      // re-read name, and read number of param sets and number of params
-      ier = sscanf(nextLine, "%s %d %d", name, &numParamSets, &numParams);
-      if (ier != 3) {
-        sprintf(errorMsg, "unable to read descriptor from line:\n");
-        strcat(errorMsg, nextLine);
-        ier = KIM_STATUS_FAIL;
-        pkim->report_error(__LINE__, __FILE__, errorMsg, ier);
-        fclose(parameterFilePointers[0]);
-        return ier;
-      }
-      // change name to lower case
-      lowerCase(name);
-
-      // check size of params is correct w.r.t its name
-      if (strcmp(name, "g2") == 0) {
-        if (numParams != 2) {
-          sprintf(errorMsg, "number of params for descriptor G2 is incorrect, "
-              "expecting 2, but given %d.\n", numParams);
-          ier = KIM_STATUS_FAIL;
-          pkim->report_error(__LINE__, __FILE__, errorMsg, ier);
-          fclose(parameterFilePointers[0]);
-          return ier;
-        }
-      }
-      else if (strcmp(name, "g3") == 0) {
-        if (numParams != 1) {
-          sprintf(errorMsg, "number of params for descriptor G3 is incorrect, "
-              "expecting 1, but given %d.\n", numParams);
-          ier = KIM_STATUS_FAIL;
-          pkim->report_error(__LINE__, __FILE__, errorMsg, ier);
-          fclose(parameterFilePointers[0]);
-          return ier;
-        }
-      }
-      else if (strcmp(name, "g4") == 0) {
-        if (numParams != 3) {
-          sprintf(errorMsg, "number of params for descriptor G4 is incorrect, "
-              "expecting 3, but given %d.\n", numParams);
-          ier = KIM_STATUS_FAIL;
-          pkim->report_error(__LINE__, __FILE__, errorMsg, ier);
-          fclose(parameterFilePointers[0]);
-          return ier;
-        }
-      }
-      else if (strcmp(name, "g5") == 0) {
-        if (numParams != 3) {
-          sprintf(errorMsg, "number of params for descriptor G5 is incorrect, "
-              "expecting 3, but given %d.\n", numParams);
-          ier = KIM_STATUS_FAIL;
-          pkim->report_error(__LINE__, __FILE__, errorMsg, ier);
-          fclose(parameterFilePointers[0]);
-          return ier;
-        }
-      }
-      else {
-        sprintf(errorMsg, "unsupported descriptor `%s' from line:\n", name);
-        strcat(errorMsg, nextLine);
-        ier = KIM_STATUS_FAIL;
-        pkim->report_error(__LINE__, __FILE__, errorMsg, ier);
-        fclose(parameterFilePointers[0]);
-        return ier;
-      }
-
-      // read descriptor params
-      AllocateAndInitialize2DArray(descParams, numParamSets, numParams);
-      for (int j=0; j<numParamSets; j++) {
-        getNextDataLine(parameterFilePointers[0], nextLine, MAXLINE, &endOfFileFlag);
-        ier = getXdouble(nextLine, numParams, descParams[j]);
-        if (ier != KIM_STATUS_OK) {
-          sprintf(errorMsg, "unable to read descriptor parameters from line:\n");
-          strcat(errorMsg, nextLine);
-          ier = KIM_STATUS_FAIL;
-          pkim->report_error(__LINE__, __FILE__, errorMsg, ier);
-          fclose(parameterFilePointers[0]);
-          return ier;
-        }
-      }
-
-      // copy data to Descriptor
-      descriptor_->add_descriptor(name, descParams, numParamSets, numParams);
-      Deallocate2DArray(descParams);
-    }
-  }
-  // number of descriptors
-  numDescs = descriptor_->get_num_descriptors();
-
-
-  // centering and normalizing params
-  // flag, whether we use this feature
-  getNextDataLine(parameterFilePointers[0], nextLine, MAXLINE, &endOfFileFlag);
-  ier = sscanf(nextLine, "%*s %s", name);
-  if (ier != 1) {
-    sprintf(errorMsg, "unable to read centering and normalization info from line:\n");
-    strcat(errorMsg, nextLine);
-    ier = KIM_STATUS_FAIL;
-    pkim->report_error(__LINE__, __FILE__, errorMsg, ier);
-    fclose(parameterFilePointers[0]);
-    return ier;
-  }
-  lowerCase(name);
-  bool do_center_and_normalize;
-  if (strcmp(name, "true") == 0) {
-    do_center_and_normalize = true;
-  } else {
-    do_center_and_normalize = false;
-  }
-
-  int size=0;
-  double* means = nullptr;
-  double* stds = nullptr;
-  if (do_center_and_normalize)
-  {
-    // size of the data, this should be equal to numDescs
-    getNextDataLine(parameterFilePointers[0], nextLine, MAXLINE, &endOfFileFlag);
-    ier = sscanf(nextLine, "%d", &size);
-    if (ier != 1) {
-      sprintf(errorMsg, "unable to read the size of centering and normalization "
-          "data info from line:\n");
-      strcat(errorMsg, nextLine);
-      ier = KIM_STATUS_FAIL;
-      pkim->report_error(__LINE__, __FILE__, errorMsg, ier);
-      fclose(parameterFilePointers[0]);
-      return ier;
-    }
-    if (size != numDescs) {
-      sprintf(errorMsg, "Size of centering and normalizing data inconsistent with "
-          "the number of descriptors. Size = %d, num_descriptors=%d\n", size, numDescs);
-      ier = KIM_STATUS_FAIL;
-      pkim->report_error(__LINE__, __FILE__, errorMsg, ier);
-      fclose(parameterFilePointers[0]);
-    }
-
-    // read means
-    AllocateAndInitialize1DArray(means, size);
-    for (int i=0; i<size; i++) {
-      getNextDataLine(parameterFilePointers[0], nextLine, MAXLINE, &endOfFileFlag);
-      ier = sscanf(nextLine, "%lf", &means[i]);
-      if (ier != 1) {
-        sprintf(errorMsg, "unable to read `means' from line:\n");
-        strcat(errorMsg, nextLine);
-        ier = KIM_STATUS_FAIL;
-        pkim->report_error(__LINE__, __FILE__, errorMsg, ier);
-        fclose(parameterFilePointers[0]);
-        return ier;
-      }
-    }
-
-    // read standard deviations
-    AllocateAndInitialize1DArray(stds, size);
-    for (int i=0; i<size; i++) {
-      getNextDataLine(parameterFilePointers[0], nextLine, MAXLINE, &endOfFileFlag);
-      ier = sscanf(nextLine, "%lf", &stds[i]);
-      if (ier != 1) {
-        sprintf(errorMsg, "unable to read `means' from line:\n");
-        strcat(errorMsg, nextLine);
-        ier = KIM_STATUS_FAIL;
-        pkim->report_error(__LINE__, __FILE__, errorMsg, ier);
-        fclose(parameterFilePointers[0]);
-        return ier;
-      }
-    }
-  }
-
-  // store info into descriptor class
-	descriptor_->set_center_and_normalize(do_center_and_normalize, size, means, stds);
-  Deallocate1DArray(means);
-  Deallocate1DArray(stds);
-
-
-//TODO delete
-//  descriptor_->echo_input();
-
-
-  // network structure
-  // number of layers
-  getNextDataLine(parameterFilePointers[0], nextLine, MAXLINE, &endOfFileFlag);
-  ier = sscanf(nextLine, "%d", &numLayers);
-  if (ier != 1) {
-    sprintf(errorMsg, "unable to read number of layers from line:\n");
-    strcat(errorMsg, nextLine);
-    ier = KIM_STATUS_FAIL;
-    pkim->report_error(__LINE__, __FILE__, errorMsg, ier);
-    fclose(parameterFilePointers[0]);
-    return ier;
-  }
-  // number of perceptrons in each layer
-  numPerceptrons = new int[numLayers];
-  getNextDataLine(parameterFilePointers[0], nextLine, MAXLINE, &endOfFileFlag);
-  ier = getXint(nextLine, numLayers, numPerceptrons);
-  if (ier != KIM_STATUS_OK) {
-    sprintf(errorMsg, "unable to read number of perceptrons from line:\n");
-    strcat(errorMsg, nextLine);
-    ier = KIM_STATUS_FAIL;
-    pkim->report_error(__LINE__, __FILE__, errorMsg, ier);
-    fclose(parameterFilePointers[0]);
-    return ier;
-  }
-  // copy to network class
-  network_->set_nn_structure(numDescs, numLayers, numPerceptrons);
-
-
-  // activation function
-  getNextDataLine(parameterFilePointers[0], nextLine, MAXLINE, &endOfFileFlag);
-  ier = sscanf(nextLine, "%s", name);
-  if (ier != 1) {
-    sprintf(errorMsg, "unable to read activation function from line:\n");
-    strcat(errorMsg, nextLine);
-    ier = KIM_STATUS_FAIL;
-    pkim->report_error(__LINE__, __FILE__, errorMsg, ier);
-    fclose(parameterFilePointers[0]);
-    return ier;
-  }
-
-  // register activation function
-  lowerCase(name);
-  if (strcmp(name, "sigmoid") != 0
-      && strcmp(name, "tanh") != 0
-      && strcmp(name, "relu") != 0
-      && strcmp(name, "elu") != 0)
-  {
-    sprintf(errorMsg, "unsupported activation function. Expecting `sigmoid', `tanh' "
-        " `relu' or `elu', given %s.\n", name);
-    ier = KIM_STATUS_FAIL;
-    pkim->report_error(__LINE__, __FILE__, errorMsg, ier);
-    fclose(parameterFilePointers[0]);
-  }
-  network_->set_activation(name);
-
-
-  // weights and biases
-  for (int i=0; i<numLayers; i++) {
-
-    // weights
-    int row;
-    int col;
-    if (i==0) {
-      row = numDescs;
-      col = numPerceptrons[i];
-    } else {
-      row = numPerceptrons[i-1];
-      col = numPerceptrons[i];
-    }
-
-    AllocateAndInitialize2DArray(weight, row, col);
-    for (int j=0; j<row; j++) {
-      getNextDataLine(parameterFilePointers[0], nextLine, MAXLINE, &endOfFileFlag);
-      ier = getXdouble(nextLine, col, weight[j]);
-      if (ier != KIM_STATUS_OK) {
-        sprintf(errorMsg, "unable to read weight from line:\n");
-        strcat(errorMsg, nextLine);
-        ier = KIM_STATUS_FAIL;
-        pkim->report_error(__LINE__, __FILE__, errorMsg, ier);
-        fclose(parameterFilePointers[0]);
-        return ier;
-      }
-    }
-
-    // bias
-    AllocateAndInitialize1DArray(bias, col);
-    getNextDataLine(parameterFilePointers[0], nextLine, MAXLINE, &endOfFileFlag);
-    ier = getXdouble(nextLine, col, bias);
-    if (ier != KIM_STATUS_OK) {
-      sprintf(errorMsg, "unable to read bias from line:\n");
-      strcat(errorMsg, nextLine);
-      ier = KIM_STATUS_FAIL;
-      pkim->report_error(__LINE__, __FILE__, errorMsg, ier);
-      fclose(parameterFilePointers[0]);
-      return ier;
-    }
-
-    // copy to network class
-    network_->add_weight_bias(weight, bias, i);
-    Deallocate2DArray(weight);
-    Deallocate1DArray(bias);
-  }
-
-
-
-  delete [] numPerceptrons;
-
-//TODO delete
-//  network_->echo_input();
-
   // everything is good
   ier = KIM_STATUS_OK;
   return ier;
 }
 
-//******************************************************************************
-void ANNImplementation::getNextDataLine(
-    FILE* const filePtr, char* nextLinePtr, int const maxSize,
-    int *endOfFileFlag)
-{
-  char* pch;
-
-  do
-  {
-    if(fgets(nextLinePtr, maxSize, filePtr) == NULL)
-    {
-       *endOfFileFlag = 1;
-       break;
-    }
-    while ((nextLinePtr[0] == ' ' || nextLinePtr[0] == '\t') ||
-           (nextLinePtr[0] == '\n' || nextLinePtr[0] == '\r' ))
-    {
-      nextLinePtr = (nextLinePtr + 1);
-    }
-  }
-  while ((strncmp("#", nextLinePtr, 1) == 0) || (strlen(nextLinePtr) == 0));
-
-  // remove comments starting with `#' in a line
-  pch = strchr(nextLinePtr, '#');
-  if (pch != NULL) {
-    *pch = '\0';
-  }
-
-}
-
-//******************************************************************************
-int ANNImplementation::getXdouble(char* linePtr, const int N, double* list)
-{
-  int ier;
-  char * pch;
-  char line[MAXLINE];
-  int i = 0;
-
-  strcpy(line, linePtr);
-  pch = strtok(line, " \t\n\r");
-  while (pch != NULL) {
-    ier = sscanf(pch, "%lf", &list[i]);
-    if (ier != 1) {
-      ier = KIM_STATUS_FAIL;
-      return ier;
-    }
-    pch = strtok(NULL, " \t\n\r");
-    i += 1;
-  }
-  if (i != N) {
-    ier = KIM_STATUS_FAIL;
-    return ier;
-  }
-
-  ier = KIM_STATUS_OK;
-  return ier;
-}
-
-
-//******************************************************************************
-int ANNImplementation::getXint(char* linePtr, const int N, int* list)
-{
-  int ier;
-  char * pch;
-  char line[MAXLINE];
-  int i = 0;
-
-  strcpy(line, linePtr);
-  pch = strtok(line, " \t\n\r");
-  while (pch != NULL) {
-    ier = sscanf(pch, "%d", &list[i]);
-    if (ier != 1) {
-      ier = KIM_STATUS_FAIL;
-      return ier;
-    }
-    pch = strtok(NULL, " \t\n\r");
-    i += 1;
-  }
-  if (i != N) {
-    ier = KIM_STATUS_FAIL;
-    return ier;
-  }
-
-  ier = KIM_STATUS_OK;
-  return ier;
-}
-
-//******************************************************************************
-void ANNImplementation::lowerCase(char* linePtr)
-{
-  for(int i=0; linePtr[i]; i++){
-    linePtr[i] = tolower(linePtr[i]);
-  }
-}
-
-//******************************************************************************
-void ANNImplementation::CloseParameterFiles(
-    FILE* const parameterFilePointers[MAX_PARAMETER_FILES],
-    int const numberParameterFiles)
-{
-  for (int i = 0; i < numberParameterFiles; ++i)
-    fclose(parameterFilePointers[i]);
-}
-
-//******************************************************************************
-void ANNImplementation::AllocateFreeParameterMemory()
-{ // allocate memory for data
-  cutoffs_ = new double[numberUniqueSpeciesPairs_];
-	AllocateAndInitialize2DArray(cutoffsSq2D_, numberModelSpecies_, numberModelSpecies_);
-}
-
 //******************************************************************************
 int ANNImplementation::ConvertUnits(KIM_API_model* const pkim)
 {
@@ -869,12 +807,7 @@ int ANNImplementation::SetReinitMutableValues(
 
 	// update cutoffsSq (This requires PECIES_001_NAME_STR needs to have code 0,
 	// SPECIES_002_NAME_STR needs to have code 1 ... in .kim file)
-	for (int i = 0; i < numberModelSpecies_; ++i) {
-		for (int j = 0; j <= i ; ++j) {
-			int const index = j*numberModelSpecies_ + i - (j*j + j)/2;
-			cutoffsSq2D_[i][j] = cutoffsSq2D_[j][i] = (cutoffs_[index]*cutoffs_[index]);
-		}
-	}
+	SetCutoffsSq();
 
   // get cutoff pointer
   double* const cutoff
@@ -933,9 +866,163 @@ int ANNImplementation::SetReinitMutableValues(
   return ier;
 }
 
+//******************************************************************************
+int ANNImplementation::ReloadModel(KIM_API_model* const pkim,
+                                   bool const isReinit)
+{
+  int ier;
+
+  // The model is only replaced while no Compute() call is running, and
+  // AcquireContext() waits until it is done.  Reinit() waits for the running
+  // calls to finish; Compute() checks again at its next call.
+  std::unique_lock<std::mutex> lock(contextsMutex_);
+  if (isReinit) {
+    while (activeComputes_ > 0) computesDone_.wait(lock);
+  }
+  else if (activeComputes_ > 0 || !ParameterFileModified()) {
+    return KIM_STATUS_OK;
+  }
+
+  // Reinit() fails if the file cannot be loaded.  Compute() keeps the current
+  // model instead, such that e.g. a partly written file does not stop the
+  // simulation, and tries again once the file changes.
+  struct stat st;
+  std::function<int(char const*)> const fail = [&](char const* message) {
+    if (isReinit) {
+      pkim->report_error(__LINE__, __FILE__, message, KIM_STATUS_FAIL);
+      return KIM_STATUS_FAIL;
+    }
+    std::cerr << message << "; keeping the current model" << std::endl;
+    rejectedFileStat_ = st;
+    return KIM_STATUS_OK;
+  };
+
+  FILE* parameterFilePointers[MAX_PARAMETER_FILES];
+  parameterFilePointers[0] = fopen(parameterFileName_.c_str(), "r");
+  if (parameterFilePointers[0] == 0) {
+    if (stat(parameterFileName_.c_str(), &st) != 0) return KIM_STATUS_OK;
+    return fail("ANN parameter file cannot be opened for reloading");
+  }
+  fstat(fileno(parameterFilePointers[0]), &st);
+
+  // nothing to do if only the time stamp changed
+  ModelCache::Key const key = ModelCache::hash_file(parameterFilePointers[0]);
+  if (key == modelKey_) {
+    CloseParameterFiles(parameterFilePointers, 1);
+    parameterFileStat_ = st;
+    return KIM_STATUS_OK;
+  }
+
+  // The binary model mapped from this very file was rewritten in place (see
+  // map_binary_model): the cached model no longer has the content of its key
+  // and must not be shared with new instances.
+  if (model_->mapping != 0 && model_->mappingDevice == st.st_dev
+      && model_->mappingInode == st.st_ino) {
+    std::cerr << "ANN binary parameter file " << parameterFileName_
+              << " was modified in place; replace it by renaming a new file"
+              << " over it instead" << std::endl;
+    ModelCache::remove(modelKey_);
+  }
+
+  std::shared_ptr<ANNModel const> model = ModelCache::find(key);
+  if (!model) {
+    std::shared_ptr<ANNModel> newModel = std::make_shared<ANNModel>();
+    ier = ProcessParameterFiles(pkim, parameterFilePointers, 1, *newModel);
+    if (ier < KIM_STATUS_OK) {
+      CloseParameterFiles(parameterFilePointers, 1);
+      return fail("ANN modified parameter file cannot be loaded");
+    }
+    model = ModelCache::insert(key, newModel);
+  }
+  CloseParameterFiles(parameterFilePointers, 1);
+
+  // the simulator builds its neighbor lists with the published cutoff, which
+  // is only updated by reinit()
+  if (!isReinit && model->cutoff != model_->cutoff) {
+    return fail("ANN cutoff of the modified parameter file differs; call "
+                "reinit to change it");
+  }
+
+  // The idle contexts keep their buffers and cost model if the descriptors
+  // are unchanged; otherwise they are discarded.
+  Descriptor const& newDescriptor = model->descriptor;
+  bool const sameDescriptors
+      = (newDescriptor.name == descriptor_->name
+         && newDescriptor.num_param_sets == descriptor_->num_param_sets);
+
+  SetModel(model, key);
+  parameterFileStat_ = st;
+  if (!sameDescriptors) {
+    for (size_t i = 0; i < contexts_.size(); ++i) {
+      delete contexts_[i];
+    }
+    contexts_.clear();
+  }
+
+  // everything is good
+  ier = KIM_STATUS_OK;
+  return ier;
+}
+
+//******************************************************************************
+// append the inputs of a compute call to the capture file; the neighbor lists
+// are requested from get_neigh as Compute does, in an extra pass
+void ANNImplementation::CaptureCall(KIM_API_model* const pkim,
+                                    ComputeContext const& context,
+                                    int const flags,
+                                    const int* const particleSpecies,
+                                    KIMNeighbors const& neighbors,
+                                    const VectorOfSizeDIM* const coordinates)
+{
+  int const Nparticles = context.numberOfParticles;
+  int const Ncontrib = context.numberContributingParticles;
+  int ier;
+  int const* const particleStatus = static_cast<int const*>(
+      pkim->get_data_by_index(particleStatusIndex_, &ier));
+  if (ier < KIM_STATUS_OK) {
+    pkim->report_error(__LINE__, __FILE__, "get_data_by_index", ier);
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(captureMutex_);
+  if (captureFile_ == 0) return;
+  CapturedCall& call = capture_;
+  call.flags = flags;
+  call.particleStatus.assign(particleStatus, particleStatus + Nparticles);
+  call.particleSpecies.assign(particleSpecies, particleSpecies + Nparticles);
+  call.coordinates.assign(coordinates[0], coordinates[0] + Nparticles*DIM);
+  call.particle.clear();
+  call.numNei.clear();
+  call.neighbors.clear();
+
+  int ii = 0;
+  int numnei = 0;
+  int* n1atom = 0;
+  double* pRij = 0;
+  for (LocatorIterator iterator(neighbors, baseconvert_, 0, Ncontrib,
+                                &ii, &numnei, &n1atom, &pRij);
+       iterator.done() == false;
+       iterator.next(&ii, &numnei, &n1atom, &pRij))
+  {
+    call.particle.push_back(ii);
+    call.numNei.push_back(numnei);
+    for (int jj = 0; jj < numnei; ++jj) {
+      call.neighbors.push_back(n1atom[jj] + baseconvert_);
+    }
+  }
+
+  std::string error;
+  if (write_captured_call(captureFile_, call, error) != 0) {
+    std::cerr << "ANN: " << error << "; capture stopped" << std::endl;
+    fclose(captureFile_);
+    captureFile_ = 0;
+  }
+}
+
 //******************************************************************************
 int ANNImplementation::SetComputeMutableValues(
     KIM_API_model* const pkim,
+    ComputeContext& context,
     bool& isComputeProcess_dEdr,
     bool& isComputeProcess_d2Edr2,
     bool& isComputeEnergy,
@@ -946,7 +1033,11 @@ int ANNImplementation::SetComputeMutableValues(
     VectorOfSizeDIM const*& coordinates,
     double*& energy,
     double*& particleEnergy,
-    VectorOfSizeDIM*& forces)
+    VectorOfSizeDIM*& forces,
+    bool& isComputeVirial,
+    bool& isComputeParticleVirial,
+    VectorOfSizeSix*& virial,
+    VectorOfSizeSix*& particleVirial)
 {
   int ier = KIM_STATUS_FAIL;
 
@@ -956,10 +1047,14 @@ int ANNImplementation::SetComputeMutableValues(
   int compParticleEnergy;
   int compProcess_dEdr;
   int compProcess_d2Edr2;
-  pkim->getm_compute_by_index(&ier, 3 * 5,
+  int compVirial;
+  int compParticleVirial;
+  pkim->getm_compute_by_index(&ier, 3 * 7,
                               energyIndex_,         &compEnergy,         1,
                               forcesIndex_,         &compForces,         1,
                               particleEnergyIndex_, &compParticleEnergy, 1,
+                              virialIndex_,         &compVirial,         1,
+                              particleVirialIndex_, &compParticleVirial, 1,
                               process_dEdrIndex_,   &compProcess_dEdr,   1,
                               process_d2Edr2Index_, &compProcess_d2Edr2, 1);
   if (ier < KIM_STATUS_OK) {
@@ -970,6 +1065,8 @@ int ANNImplementation::SetComputeMutableValues(
   isComputeEnergy = (compEnergy == KIM_COMPUTE_TRUE);
   isComputeForces = (compForces == KIM_COMPUTE_TRUE);
   isComputeParticleEnergy = (compParticleEnergy == KIM_COMPUTE_TRUE);
+  isComputeVirial = (compVirial == KIM_COMPUTE_TRUE);
+  isComputeParticleVirial = (compParticleVirial == KIM_COMPUTE_TRUE);
   isComputeProcess_dEdr = (compProcess_dEdr == KIM_COMPUTE_TRUE);
   isComputeProcess_d2Edr2 = (compProcess_d2Edr2 == KIM_COMPUTE_TRUE);
 
@@ -977,14 +1074,16 @@ int ANNImplementation::SetComputeMutableValues(
   int const* numberOfParticles;
   int const* particleStatus = 0;
   pkim->getm_data_by_index(
-      &ier, 3 * 7,
+      &ier, 3 * 9,
       numberOfParticlesIndex_, &numberOfParticles, 1,
       particleSpeciesIndex_,	 &particleSpecies,	 1,
       particleStatusIndex_,		 &particleStatus,		 1,
       coordinatesIndex_,			 &coordinates,			 1,
       energyIndex_,						 &energy,						 compEnergy,
       particleEnergyIndex_,		 &particleEnergy,		 compParticleEnergy,
-      forcesIndex_,						 &forces,						 compForces);
+      forcesIndex_,						 &forces,						 compForces,
+      virialIndex_,						 &virial,						 compVirial,
+      particleVirialIndex_,		 &particleVirial,		 compParticleVirial);
   if (ier < KIM_STATUS_OK) {
     pkim->report_error(__LINE__, __FILE__, "getm_data_by_index", ier);
     return ier;
@@ -998,13 +1097,13 @@ int ANNImplementation::SetComputeMutableValues(
 	}
 
   // update values
-  cachedNumberOfParticles_ = *numberOfParticles;
+  context.numberOfParticles = *numberOfParticles;
 
 	// set so that it can be used even with a full neighbor list
-	cachedNumberContributingParticles_ = 0;
+	context.numberContributingParticles = 0;
 	for (int i=0; i<*numberOfParticles; i++) {
 		if (particleStatus[i] == 1) {
-			cachedNumberContributingParticles_ += 1;
+			context.numberContributingParticles += 1;
 		}
 	}
 
@@ -1016,11 +1115,12 @@ int ANNImplementation::SetComputeMutableValues(
 //******************************************************************************
 int ANNImplementation::CheckParticleSpecies(
     KIM_API_model* const pkim,
+    int const numberOfParticles,
     int const* const particleSpecies)
     const
 {
   int ier;
-  for (int i = 0; i < cachedNumberOfParticles_; ++i)
+  for (int i = 0; i < numberOfParticles; ++i)
   {
     if ((particleSpecies[i] < 0) || (particleSpecies[i] >= numberModelSpecies_))
     {
@@ -1035,41 +1135,3 @@ int ANNImplementation::CheckParticleSpecies(
   ier = KIM_STATUS_OK;
   return ier;
 }
-
-//******************************************************************************
-int ANNImplementation::GetComputeIndex(
-    const bool& isComputeProcess_dEdr,
-    const bool& isComputeProcess_d2Edr2,
-    const bool& isComputeEnergy,
-    const bool& isComputeForces,
-    const bool& isComputeParticleEnergy) const
-{
-  //const int processdE = 2;
-  const int processd2E = 2;
-  const int energy = 2;
-  const int force = 2;
-  const int particleEnergy = 2;
-
-
-  int index = 0;
-
-  // processdE
-  index += (int(isComputeProcess_dEdr))
-      * processd2E * energy * force * particleEnergy;
-
-  // processd2E
-  index += (int(isComputeProcess_d2Edr2)) * energy * force * particleEnergy;
-
-  // energy
-  index += (int(isComputeEnergy)) * force * particleEnergy;
-
-  // force
-  index += (int(isComputeForces)) * particleEnergy;
-
-  // particleEnergy
-  index += (int(isComputeParticleEnergy));
-
-
-  return index;
-}
-
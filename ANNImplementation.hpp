@@ -30,11 +30,25 @@
 #ifndef ANN_IMPLEMENTATION_HPP_
 #define ANN_IMPLEMENTATION_HPP_
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <sys/stat.h>
 #include "KIM_API_status.h"
 #include "ANN.hpp"
+#include "capture.h"
 #include "descriptor.h"
 #include "network.h"
 #include "helper.h"
+#include "modelcache.h"
+#include "scheduler.h"
 
 #define DIM 3
 #define ONE 1.0
@@ -42,6 +56,11 @@
 
 #define MAX_PARAMETER_FILES 1
 
+// default number of contributing particles processed per chunk in Compute
+#define DEFAULT_CHUNK_SIZE 256
+// number of chunk buffers; at least 3 such that all stages can run at once
+#define NUMBER_CHUNK_BUFFERS 4
+
 
 //==============================================================================
 //
@@ -54,6 +73,7 @@ typedef int (GetNeighborFunction)(void**, int*, int*, int*, int*, int**,
                                   double**);
 // type declaration for vector of constant dimension
 typedef double VectorOfSizeDIM[DIM];
+typedef double VectorOfSizeSix[6];
 
 
 //==============================================================================
@@ -62,46 +82,67 @@ typedef double VectorOfSizeDIM[DIM];
 //
 //==============================================================================
 
+// Neighbor lists obtained from the get_neigh function of the KIM API
+struct KIMNeighbors
+{
+  KIM_API_model* pkim;
+  GetNeighborFunction* get_neigh;
+};
+
+// Neighbor lists of the contributing particles in caller-owned arrays (model
+// indexing): the numNei[i] neighbors of particle i are list[start[i]], ...
+struct NeighborArrays
+{
+  int const* numNei;
+  int const* start;
+  int const* list;
+};
+
 // Iterator object for Locator mode access to neighbor list
+//
+// Visits the contributing particles firstParticle, ..., lastParticle-1 (model
+// indexing), so that the particles can be processed in chunks.  Each iterator
+// class names the source of its neighbor lists as Neighbors.
 class LocatorIterator
 {
  private:
   KIM_API_model* const pkim_;
   GetNeighborFunction* const get_neigh_;
   int const baseconvert_;
-  int const cachedNumberContributingParticles_;
+  int const lastParticle_;
   int request_;
   int const mode_;
  public:
-  LocatorIterator(KIM_API_model* const pkim,
-                  GetNeighborFunction* const get_neigh,
+  typedef KIMNeighbors Neighbors;
+
+  LocatorIterator(Neighbors const& neighbors,
                   int const baseconvert,
-                  int const cachedNumberContributingParticles,
+                  int const firstParticle,
+                  int const lastParticle,
                   int* const i,
                   int* const numnei,
                   int** const n1atom,
                   double** const pRij)
-      : pkim_(pkim),
-        get_neigh_(get_neigh),
+      : pkim_(neighbors.pkim),
+        get_neigh_(neighbors.get_neigh),
         baseconvert_(baseconvert),
-        cachedNumberContributingParticles_(cachedNumberContributingParticles),
-        request_(-baseconvert_),  // set to first value (test-based indexing)
+        lastParticle_(lastParticle),
+        request_(firstParticle-baseconvert_),  // set to first value
     mode_(1)  // locator mode
   {
     next(i, numnei, n1atom, pRij);
   }
   bool done() const
   {
-    return !(request_ + baseconvert_ <= cachedNumberContributingParticles_);
+    return !(request_ + baseconvert_ <= lastParticle_);
   }
   int next(int* const i, int* const numnei, int** const n1atom,
            double** const pRij)
   {
     int ier;
-    // Allow for request_ to be incremented to one more than contributing
+    // Allow for request_ to be incremented to one more than lastParticle_
     // without causing an error/warning from the openkim-api
-    int req = std::min(request_,
-                       cachedNumberContributingParticles_-baseconvert_-1);
+    int req = std::min(request_, lastParticle_-baseconvert_-1);
     ier = (*get_neigh_)(
         reinterpret_cast<void**>(const_cast<KIM_API_model**>(&pkim_)),
         (int*) &mode_,
@@ -118,6 +159,630 @@ class LocatorIterator
 };
 
 
+// Iterator object for neighbor lists held in arrays
+//
+// Visits the contributing particles firstParticle, ..., lastParticle-1 like
+// LocatorIterator, without a function call per particle.  The arrays use
+// model indexing, so baseconvert is not used.
+class ArrayIterator
+{
+ private:
+  NeighborArrays const neighbors_;
+  int const lastParticle_;
+  int particle_;
+ public:
+  typedef NeighborArrays Neighbors;
+
+  ArrayIterator(Neighbors const& neighbors,
+                int const /* baseconvert */,
+                int const firstParticle,
+                int const lastParticle,
+                int* const i,
+                int* const numnei,
+                int** const n1atom,
+                double** const pRij)
+      : neighbors_(neighbors),
+        lastParticle_(lastParticle),
+        particle_(firstParticle - 1)
+  {
+    next(i, numnei, n1atom, pRij);
+  }
+  bool done() const
+  {
+    return !(particle_ < lastParticle_);
+  }
+  int next(int* const i, int* const numnei, int** const n1atom,
+           double** const pRij)
+  {
+    ++particle_;
+    if (particle_ < lastParticle_) {
+      *i = particle_;
+      *numnei = neighbors_.numNei[particle_];
+      *n1atom = const_cast<int*>(neighbors_.list
+                                 + neighbors_.start[particle_]);
+      *pRij = 0;
+    }
+    return KIM_STATUS_OK;
+  }
+};
+
+
+// A term of the energy that depends on the distance of particles i and j
+struct PairTerm
+{
+  int i;
+  int j;
+  double dEdr;
+
+  PairTerm(int const i_, int const j_, double const dEdr_)
+      : i(i_), j(j_), dEdr(dEdr_)
+  {}
+};
+
+
+// Inputs and outputs of a Compute call on caller-owned arrays
+//
+// Particles 0, ..., numberContributingParticles-1 contribute to the energy and
+// have full neighbor lists.  Outputs that are not wanted are null.
+struct ComputeArguments
+{
+  int numberOfParticles;
+  int numberContributingParticles;
+  int const* particleSpecies;          // [numberOfParticles]
+  VectorOfSizeDIM const* coordinates;  // [numberOfParticles]
+  NeighborArrays neighbors;
+  double* energy;
+  VectorOfSizeDIM* forces;             // [numberOfParticles]
+  double* particleEnergy;              // [numberOfParticles]
+  VectorOfSizeSix* virial;             // [1]
+  VectorOfSizeSix* particleVirial;     // [numberOfParticles]
+};
+
+// Atoms in an (optionally periodic) cell, for Compute with the neighbor
+// lists built by the driver (see neighbors.h).  The outputs are those of the
+// atoms, with the contributions of their periodic images added to them.
+// Outputs that are not wanted are null.
+struct AtomsArguments
+{
+  int numberOfAtoms;
+  int const* particleSpecies;          // [numberOfAtoms]
+  VectorOfSizeDIM const* coordinates;  // [numberOfAtoms]
+  double const* lattice;               // [9], rows are the cell vectors
+  int periodic[DIM];                   // along each cell vector
+  double* energy;
+  VectorOfSizeDIM* forces;             // [numberOfAtoms]
+  double* particleEnergy;              // [numberOfAtoms]
+  VectorOfSizeSix* virial;             // [1]
+  VectorOfSizeSix* particleVirial;     // [numberOfAtoms]
+};
+
+// Wall time (in seconds) spent in each stage of Compute
+struct StageTimes
+{
+  long calls;          // number of Compute calls
+  long particles;      // contributing particles, summed over the calls
+  double compute;      // whole Compute calls
+  double neighbor;     // copying the neighbor lists from get_neigh
+  double descriptor;   // generalized coords
+  double forward;      // network feedforward
+  double backward;     // network backpropagation
+  double force;        // energies, forces and virials
+
+  StageTimes() { clear(); }
+
+  void clear()
+  {
+    calls = 0;
+    particles = 0;
+    compute = 0.0;
+    neighbor = 0.0;
+    descriptor = 0.0;
+    forward = 0.0;
+    backward = 0.0;
+    force = 0.0;
+  }
+
+  void add(StageTimes const& other)
+  {
+    calls += other.calls;
+    particles += other.particles;
+    compute += other.compute;
+    neighbor += other.neighbor;
+    descriptor += other.descriptor;
+    forward += other.forward;
+    backward += other.backward;
+    force += other.force;
+  }
+};
+
+// seconds since `start', which is then reset to now
+inline double Lap(std::chrono::steady_clock::time_point& start)
+{
+  std::chrono::steady_clock::time_point const now
+      = std::chrono::steady_clock::now();
+  double const seconds = std::chrono::duration<double>(now - start).count();
+  start = now;
+  return seconds;
+}
+
+// Work done in the stages of Compute (counted with ANN_PROFILE or
+// ANN_TRACE_FILE only)
+struct StageCounts
+{
+  long pairsVisited;       // neighbors looked at by the descriptor stage
+  long pairsWithinCutoff;  // of which within the cutoff
+  long triplets;           // pairs of neighbors within the cutoff
+  long bytesAllocated;     // growth of the buffers of the compute contexts
+
+  StageCounts() { clear(); }
+
+  void clear()
+  {
+    pairsVisited = 0;
+    pairsWithinCutoff = 0;
+    triplets = 0;
+    bytesAllocated = 0;
+  }
+
+  void add(StageCounts const& other)
+  {
+    pairsVisited += other.pairsVisited;
+    pairsWithinCutoff += other.pairsWithinCutoff;
+    triplets += other.triplets;
+    bytesAllocated += other.bytesAllocated;
+  }
+};
+
+// A stage of a chunk, or a Compute call, in the trace file (ANN_TRACE_FILE)
+struct TraceEvent
+{
+  char const* name;
+  double start;      // microseconds since the model was created
+  double duration;   // microseconds
+  int thread;        // see ThreadIndex
+
+  TraceEvent(char const* const name_, double const start_,
+             double const duration_, int const thread_)
+      : name(name_), start(start_), duration(duration_), thread(thread_)
+  {}
+};
+
+// small number that identifies the calling thread in the trace file
+inline int ThreadIndex()
+{
+  static std::atomic<int> next(0);
+  thread_local int const index = next++;
+  return index;
+}
+
+
+// Scratch storage for one chunk of contributing particles
+//
+// The buffer is sized for `capacity' particles and reused by all the chunks of
+// a Compute call, such that the memory needed does not grow with the number
+// of particles.  The neighbor lists of the chunk are copied (with model
+// indexing) so that they can be visited again in the force pass without
+// calling get_neigh a second time.
+class ChunkBuffer
+{
+ public:
+  int capacity;                    // max number of particles in a chunk
+  int numberDescriptors;           // number of generalized coords per particle
+  int numberParticles;             // number of particles in current chunk
+  std::vector<int> particle;       // index of each particle
+  std::vector<int> numNei;         // number of neighbors of each particle
+  std::vector<int> neighStart;     // start of each neighbor list in neighList
+  std::vector<int> neighList;      // neighbors of all particles in chunk
+  double** generalizedCoords;      // [capacity][numberDescriptors]
+  double** dEdGeneralizedCoords;   // [capacity][numberDescriptors]
+  std::vector<double> energy;      // energy of each particle
+  std::vector<int> bounds;         // partition of the particles among threads
+  std::vector<double> selfForce;   // [capacity*DIM] force on each particle
+  std::vector<double> neighForce;  // [neighList.size()*DIM] force on each
+                                   // entry of neighList
+  std::vector<double> dEdr;        // [neighList.size()] dE/dr of the pair of
+                                   // a particle and each of its neighbors
+  std::vector<double> selfVirial;  // [capacity*6] virial of each particle
+  std::vector<double> neighVirial; // [neighList.size()*6] virial of each
+                                   // entry of neighList
+  std::vector<double> partVirial;  // [6*number of partitions] virial of the
+                                   // particles of each partition
+  // neighbor-neighbor pair terms of the three-body descriptors of the
+  // particles of each partition (recorded for process_dEdr only)
+  std::vector<std::vector<PairTerm> > partPairTerms;
+  // derivatives in the direction of a Hessian-vector product (allocated by
+  // HessianVectorProduct only)
+  std::vector<double> generalizedCoordsTangent;    // [capacity*numberDescriptors]
+  std::vector<double> dEdGeneralizedCoordsTangent; // [capacity*numberDescriptors]
+  std::vector<double> dEdrTangent;                 // [neighList.size()]
+  // distinct rows of generalizedCoords (descriptor memoization only)
+  std::vector<int> distinctRow;         // [capacity] distinct row of each
+                                        // particle
+  std::vector<long long> distinctKeys;  // rounded distinct rows
+  std::vector<double> distinctCoords;   // distinct rows
+  std::unordered_map<unsigned long long, int> distinctIndex;  // hash of
+                                        // rounded row -> distinct row
+  StageTimes times;                // time of the stages run on this buffer
+  StageCounts counts;              // work of the stages run on this buffer
+  std::vector<TraceEvent> events;  // stages run on this buffer
+
+  ChunkBuffer()
+      : capacity(0),
+        numberDescriptors(0),
+        numberParticles(0),
+        generalizedCoords(0),
+        dEdGeneralizedCoords(0)
+  {}
+  ~ChunkBuffer()
+  {
+    Deallocate2DArray(generalizedCoords);
+    Deallocate2DArray(dEdGeneralizedCoords);
+  }
+
+  // (re)allocate memory only if the size changes
+  void resize(int const chunkCapacity, int const Ndescriptors)
+  {
+    if (chunkCapacity == capacity && Ndescriptors == numberDescriptors) return;
+    Deallocate2DArray(generalizedCoords);
+    Deallocate2DArray(dEdGeneralizedCoords);
+    AllocateAndInitialize2DArray(generalizedCoords, chunkCapacity,
+                                 Ndescriptors);
+    AllocateAndInitialize2DArray(dEdGeneralizedCoords, chunkCapacity,
+                                 Ndescriptors);
+    capacity = chunkCapacity;
+    numberDescriptors = Ndescriptors;
+    particle.resize(capacity);
+    numNei.resize(capacity);
+    neighStart.resize(capacity);
+    energy.resize(capacity);
+    selfForce.resize(capacity*DIM);
+    selfVirial.resize(capacity*6);
+  }
+
+  // memory held by the buffer, in bytes
+  long bytes() const
+  {
+    long const rows = 2L*capacity*numberDescriptors*sizeof(double);
+    long const ints = particle.capacity() + numNei.capacity()
+        + neighStart.capacity() + neighList.capacity() + bounds.capacity()
+        + distinctRow.capacity();
+    long const doubles = energy.capacity() + selfForce.capacity()
+        + neighForce.capacity() + dEdr.capacity() + selfVirial.capacity()
+        + neighVirial.capacity() + partVirial.capacity()
+        + generalizedCoordsTangent.capacity()
+        + dEdGeneralizedCoordsTangent.capacity() + dEdrTangent.capacity()
+        + distinctCoords.capacity();
+    return rows + ints*sizeof(int) + doubles*sizeof(double)
+        + distinctKeys.capacity()*sizeof(long long);
+  }
+
+  // copy the neighbor lists of particles [first, last) into the buffer
+  template<class Iter>
+  int gather(typename Iter::Neighbors const& neighbors,
+             int const baseConvert, int const first, int const last)
+  {
+    int ii = 0;
+    int numnei = 0;
+    int* n1atom = 0;
+    double* pRij = 0;
+
+    numberParticles = 0;
+    neighList.clear();
+    for (Iter iterator(neighbors, baseConvert, first, last, &ii,
+                       &numnei, &n1atom, &pRij);
+         iterator.done() == false;
+         iterator.next(&ii, &numnei, &n1atom, &pRij))
+    {
+      int const c = numberParticles;
+      particle[c] = ii;
+      numNei[c] = numnei;
+      neighStart[c] = neighList.size();
+      for (int jj = 0; jj < numnei; ++jj) {
+        neighList.push_back(n1atom[jj] + baseConvert);
+      }
+      ++numberParticles;
+    }
+
+    // zero generalized coords of the particles in this chunk
+    for (int c = 0; c < numberParticles; ++c) {
+      for (int j = 0; j < numberDescriptors; ++j) {
+        generalizedCoords[c][j] = 0.0;
+      }
+    }
+
+    return numberParticles;
+  }
+
+ private:
+  // owns raw memory; not copyable
+  ChunkBuffer(ChunkBuffer const&);
+  ChunkBuffer& operator=(ChunkBuffer const&);
+};
+
+
+// Hand-off of chunk buffers between the stages of a pipelined Compute
+//
+// Chunk k lives in buffer k % numberBuffers and moves through the states
+// FREE -> DESCRIBED -> EVALUATED -> FREE.  Each stage handles the chunks in
+// order and blocks until the buffer of its next chunk reaches the state it
+// needs, so the buffers form bounded queues between the stages.
+class ChunkPipeline
+{
+ public:
+  enum State {FREE, DESCRIBED, EVALUATED};
+
+  explicit ChunkPipeline(int const numberBuffers)
+      : state_(numberBuffers, FREE)
+  {}
+
+  // block until buffer b is in `state'
+  void wait(int const b, State const state)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (state_[b] != state) condition_.wait(lock);
+  }
+
+  // move buffer b to `state' and wake up the stage waiting for it
+  void post(int const b, State const state)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      state_[b] = state;
+    }
+    condition_.notify_all();
+  }
+
+ private:
+  std::vector<State> state_;
+  std::mutex mutex_;
+  std::condition_variable condition_;
+};
+
+
+// Results of a Compute call, kept to answer later calls on the same
+// configuration
+//
+// The configuration is identified by the coordinates and species of all
+// particles and the number of contributing particles.  The particle energies
+// are always kept, together with either the derivative of the energy w.r.t.
+// the generalized coords (if it was computed) or the generalized coords, such
+// that outputs requested later can be computed without the descriptor stage,
+// or without both the descriptor and network stages.
+class ResultCache
+{
+ public:
+  bool isActive;           // used by the current Compute call
+  bool isValid;            // holds the energies of the configuration
+  bool hasGeneralizedCoords;
+  bool hasDerivative;
+  bool hasForces;
+  bool hasVirial;
+  bool hasParticleVirial;
+  // configuration
+  int numberOfParticles;
+  int numberContributingParticles;
+  int numberDescriptors;
+  std::vector<double> coordinates;           // [numberOfParticles*DIM]
+  std::vector<int> species;                  // [numberOfParticles]
+  // state of the evaluation of the contributing particles
+  std::vector<double> energy;                // [numberContributingParticles]
+  std::vector<double> generalizedCoords;     // [numberContributing...*
+                                             //  numberDescriptors]
+  std::vector<double> dEdGeneralizedCoords;  // [numberContributing...*
+                                             //  numberDescriptors]
+  // outputs
+  std::vector<double> forces;                // [numberOfParticles*DIM]
+  double virial[6];
+  std::vector<double> particleVirial;        // [numberOfParticles*6]
+
+  ResultCache()
+      : isActive(false),
+        isValid(false),
+        hasGeneralizedCoords(false),
+        hasDerivative(false),
+        hasForces(false),
+        hasVirial(false),
+        hasParticleVirial(false),
+        numberOfParticles(0),
+        numberContributingParticles(0),
+        numberDescriptors(0)
+  {}
+
+  // whether the results are those of the given configuration
+  bool matches(int const Nparticles, int const Ncontrib,
+               int const Ndescriptors,
+               int const* const particleSpecies,
+               double const* const coords) const
+  {
+    return (isValid == true
+            && numberOfParticles == Nparticles
+            && numberContributingParticles == Ncontrib
+            && numberDescriptors == Ndescriptors
+            && std::equal(species.begin(), species.end(), particleSpecies)
+            && std::equal(coordinates.begin(), coordinates.end(), coords));
+  }
+
+  // forget the results and take the given configuration
+  void reset(int const Nparticles, int const Ncontrib, int const Ndescriptors,
+             int const* const particleSpecies, double const* const coords)
+  {
+    isValid = false;
+    hasGeneralizedCoords = false;
+    hasDerivative = false;
+    hasForces = false;
+    hasVirial = false;
+    hasParticleVirial = false;
+    numberOfParticles = Nparticles;
+    numberContributingParticles = Ncontrib;
+    numberDescriptors = Ndescriptors;
+    species.assign(particleSpecies, particleSpecies + Nparticles);
+    coordinates.assign(coords, coords + Nparticles*DIM);
+    energy.resize(Ncontrib);
+  }
+
+  // copy the state of the particles of a chunk, starting with particle first
+  void record(int const first, ChunkBuffer const& chunk,
+              bool const isDerivative)
+  {
+    int const Nchunk = chunk.numberParticles;
+    int const Nd = chunk.numberDescriptors;
+    std::copy(chunk.energy.begin(), chunk.energy.begin() + Nchunk,
+              energy.begin() + first);
+    if (isDerivative == true) {
+      std::copy(chunk.dEdGeneralizedCoords[0],
+                chunk.dEdGeneralizedCoords[0] + Nchunk*Nd,
+                dEdGeneralizedCoords.begin() + first*Nd);
+    }
+    else {
+      std::copy(chunk.generalizedCoords[0],
+                chunk.generalizedCoords[0] + Nchunk*Nd,
+                generalizedCoords.begin() + first*Nd);
+    }
+  }
+};
+
+
+// Mutable state of one Compute call
+//
+// ANNImplementation itself (descriptor, network weights, cutoffs) is not
+// modified by Compute, and everything that is lives here.  Each concurrent
+// call to Compute uses its own context, so one model can be evaluated from
+// many threads at the same time.  Contexts are pooled by ANNImplementation
+// and reused, such that the buffers stay allocated across calls.
+class ComputeContext
+{
+ public:
+  int numberOfParticles;
+  int numberContributingParticles;
+  ChunkBuffer chunks[NUMBER_CHUNK_BUFFERS];
+  NetworkWorkspace network;
+  CostModel costModel;
+  ResultCache results;
+  StageTimes times;   // calls and particles; the chunks hold the times
+  StageCounts counts;  // bytes allocated; the chunks hold the other counts
+  std::vector<TraceEvent> events;  // Compute calls
+  // dE/dr of the pairs of all chunks of a Compute with process_dEdr, passed
+  // to process_dEdr once per distinct pair at its end
+  std::vector<PairTerm> pairTerms;
+  // runs the network and force stages of a pipelined Compute; created on
+  // first use and kept, such that no threads are started per call
+  ThreadPool* pipelineWorkers;
+
+  explicit ComputeContext(CostModel const& model)
+      : numberOfParticles(0),
+        numberContributingParticles(0),
+        costModel(model),
+        pipelineWorkers(0)
+  {}
+
+  ~ComputeContext() { delete pipelineWorkers; }
+
+  // memory held by the chunk buffers and the network workspace, in bytes
+  long bytes() const
+  {
+    long n = 0;
+    for (int b = 0; b < NUMBER_CHUNK_BUFFERS; ++b) n += chunks[b].bytes();
+    long entries = network.activOutputLayer.size() + network.gradInput.size()
+        + network.gradInputTangent.size();
+    for (size_t l = 0; l < network.preactiv.size(); ++l) {
+      entries += network.preactiv[l].size();
+    }
+    for (size_t l = 0; l < network.preactivTangent.size(); ++l) {
+      entries += network.preactivTangent[l].size();
+    }
+    return n + entries*sizeof(double);
+  }
+};
+
+
+// A trial move of the incremental evaluation of local Monte Carlo moves
+class LocalMoveTrial
+{
+ public:
+  std::vector<int> moved;                 // particles that are moved
+  std::vector<double> movedCoordinates;   // [moved.size()*DIM] new positions
+  std::vector<int> movedSpecies;          // new species of moved particles
+  std::vector<int> affected;              // contributing particles whose
+                                          // energy may change
+  std::vector<double> generalizedCoords;  // [affected.size()*numberDescriptors]
+  std::vector<double> energy;             // new energy of affected particles
+  double deltaEnergy;
+  NetworkWorkspace network;
+};
+
+
+// Configuration, generalized coords and particle energies of a sequence of
+// local Monte Carlo moves
+//
+// A move only changes the energies of the contributing particles within the
+// cutoff of the moved particles, so a trial recomputes the generalized coords
+// and network outputs of those particles only.  Their neighbors are found
+// with bins of the particles of at least the cutoff size, which are updated
+// when a move is accepted.
+class LocalMoveState
+{
+ public:
+  int numberOfParticles;
+  int numberContributingParticles;   // particles [0, numberContributing...)
+  int numberDescriptors;
+  double cutoff;                     // largest cutoff of all species pairs
+  std::vector<double> coordinates;   // [numberOfParticles*DIM]
+  std::vector<int> species;          // [numberOfParticles]
+  std::vector<double> generalizedCoords;  // [numberContributing...*
+                                          //  numberDescriptors]
+  std::vector<double> energy;        // [numberContributingParticles]
+  double totalEnergy;
+  std::vector<LocalMoveTrial> trials;  // trials of the last TrialLocalMoves
+
+  LocalMoveState()
+      : numberOfParticles(0),
+        numberContributingParticles(0),
+        numberDescriptors(0),
+        cutoff(0.0),
+        totalEnergy(0.0)
+  {}
+
+  // sort all particles into bins
+  void bin_particles();
+  // set the coordinates of particle i to x and update its bin
+  void move_particle(int const i, double const* const x);
+  // call f(j) for each particle j in the bins around position x; these
+  // include all particles within the cutoff of x
+  template<class F>
+  void for_each_candidate(double const* const x, F const& f) const
+  {
+    int cell[DIM];
+    bin_index(x, cell);
+    int lo[DIM];
+    int hi[DIM];
+    for (int d = 0; d < DIM; ++d) {
+      lo[d] = std::max(cell[d] - 1, 0);
+      hi[d] = std::min(cell[d] + 1, numBins_[d] - 1);
+    }
+    for (int a = lo[0]; a <= hi[0]; ++a) {
+      for (int b = lo[1]; b <= hi[1]; ++b) {
+        for (int c = lo[2]; c <= hi[2]; ++c) {
+          std::vector<int> const& bin = bins_[(a*numBins_[1] + b)*numBins_[2]
+                                              + c];
+          for (size_t n = 0; n < bin.size(); ++n) f(bin[n]);
+        }
+      }
+    }
+  }
+
+ private:
+  double origin_[DIM];
+  double binSize_[DIM];
+  int numBins_[DIM];
+  std::vector<std::vector<int> > bins_;
+  std::vector<int> binOf_;  // bin of each particle
+
+  // bin of position x (positions outside of the bins are clamped to the
+  // outermost bins); the bin's cell indices are stored in `cell'
+  int bin_index(double const* const x, int* const cell) const;
+};
+
+
 //==============================================================================
 //
 // Declaration of ANNImplementation class
@@ -134,10 +799,51 @@ class ANNImplementation
       int const parameterFileNameLength,
       int const numberParameterFiles,
       int* const ier);
+  // A model used without the KIM API (see ann_api.h); particle species are
+  // 0, ..., numberSpecies-1
+  ANNImplementation(char const* const parameterFileName,
+                    int const numberSpecies,
+                    std::string& error,
+                    int* const ier);
   ~ANNImplementation();  // no explicit Destroy() needed here
 
   int Reinit(KIM_API_model* pkim);
   int Compute(KIM_API_model* pkim);
+  // hv = H v, where H is the Hessian of the energy w.r.t. the coordinates of
+  // the configuration held by pkim; v and hv are [numberOfParticles][DIM]
+  int HessianVectorProduct(KIM_API_model* pkim, double const* v, double* hv);
+  // Incremental evaluation of local Monte Carlo moves (see README).
+  // BeginLocalMoves takes a snapshot of the configuration held by pkim; each
+  // TrialLocalMoves call evaluates independent trials relative to it, one of
+  // which may be applied by AcceptLocalMove.
+  int BeginLocalMoves(KIM_API_model* pkim, double* energy);
+  int TrialLocalMoves(KIM_API_model* pkim,
+                      int numberTrials,
+                      int const* numberMoved,
+                      int const* particles,
+                      double const* coordinates,
+                      int const* species,
+                      double* deltaEnergy);
+  int AcceptLocalMove(KIM_API_model* pkim, int trial);
+  // Compute on caller-owned arrays, for models created without the KIM API
+  int Compute(ComputeArguments const& arguments);
+  // Compute on many (typically small) configurations; the rows of whole
+  // configurations are grouped into chunks that go through the network
+  // together
+  int ComputeBatch(int const numberConfigurations,
+                   ComputeArguments const* const arguments);
+  // ComputeBatch on atoms in cells, building the neighbor lists
+  int ComputeAtoms(int const numberConfigurations,
+                   AtomsArguments const* const arguments);
+  // largest cutoff of all species pairs
+  double GetCutoff() const;
+  // time spent in the stages of the Compute calls since the model was
+  // created or ResetStageTimes was called
+  StageTimes GetStageTimes();
+  void ResetStageTimes();
+  // work done in the stages of the same calls; all zero unless ANN_PROFILE or
+  // ANN_TRACE_FILE is set
+  StageCounts GetStageCounts();
 
  private:
   // Constant values that never change
@@ -163,6 +869,8 @@ class ANNImplementation
   int energyIndex_;
   int forcesIndex_;
   int particleEnergyIndex_;
+  int virialIndex_;
+  int particleVirialIndex_;
   //
   // LennardJones612Implementation: constants
   int numberModelSpecies_;
@@ -199,17 +907,112 @@ class ANNImplementation
   // ANNImplementation: values
   double** cutoffsSq2D_;
 
-  // Mutable values that can change with each call to Reinit() and Compute()
-  //   Memory may be reallocated on each call
+  // Mutable values that can change with each call to Compute()
+  //   Kept in a ComputeContext, one per concurrent call.  Idle contexts are
+  //   stored in contexts_ (see AcquireContext/ReleaseContext).
   //
   //
   // ANNImplementation: values that change
-  int cachedNumberOfParticles_;
-  int cachedNumberContributingParticles_;
-
-	// descriptor;
-	Descriptor* descriptor_;
-	NeuralNetwork* network_;
+  std::vector<ComputeContext*> contexts_;
+  std::mutex contextsMutex_;
+  int activeComputes_;   // number of contexts in use; guarded by contextsMutex_
+  std::condition_variable computesDone_;  // activeComputes_ dropped to 0
+  StageTimes stageTimes_;  // of the released contexts; guarded by
+                           // contextsMutex_
+  StageCounts stageCounts_;  // likewise
+
+	// descriptor and network
+	//   Owned by model_, which may be shared with other instances created
+	//   from the same parameter file (see ModelCache)
+	std::shared_ptr<ANNModel const> model_;
+	Descriptor const* descriptor_;
+	NeuralNetwork const* network_;
+
+  // ANNImplementation: chunked evaluation
+  //   chunkSize_ set in constructor (via SetRuntimeOptions); <= 0 means all
+  //   contributing particles are processed as a single chunk
+  int chunkSize_;
+  //
+  // ANNImplementation: pipelined evaluation
+  //   set in constructor (via SetRuntimeOptions); if true, the descriptor,
+  //   network and force stages of consecutive chunks run concurrently
+  bool pipeline_;
+  //
+  // ANNImplementation: threaded evaluation
+  //   numThreads_ set in constructor (via SetRuntimeOptions).  The particles
+  //   of a chunk are split among the threads by the cost model, which is
+  //   refined with the measured times of each Compute call.  costModel_ is
+  //   the initial model copied into each new ComputeContext.
+  int numThreads_;
+  ThreadPool* threadPool_;
+  CostModel costModel_;
+  //
+  // ANNImplementation: descriptor memoization
+  //   memoTolerance_ set in constructor (via SetRuntimeOptions).  If > 0,
+  //   the network is evaluated once per distinct generalized coords row of a
+  //   chunk, where rows that are equal after rounding to multiples of
+  //   memoTolerance_ are taken as equal.  The number of rows and of reused
+  //   evaluations are reported when the model is destroyed.
+  double memoTolerance_;
+  mutable std::atomic<long> memoRows_;
+  mutable std::atomic<long> memoHits_;
+  //
+  // ANNImplementation: result cache
+  //   resultCache_ set in constructor (via SetRuntimeOptions).  If true, the
+  //   results of the last Compute call are kept in results_, and a call on
+  //   the same configuration only computes the outputs that are not in
+  //   there (see TakeResults/StoreResults).  The number of calls, of calls
+  //   answered from results_ alone, and of calls resumed from its state are
+  //   reported when the model is destroyed.
+  bool resultCache_;
+  ResultCache results_;
+  std::mutex resultsMutex_;
+  std::atomic<long> resultCalls_;
+  std::atomic<long> resultHits_;
+  std::atomic<long> resultResumes_;
+  //
+  // ANNImplementation: instrumentation
+  //   Set in constructor (via SetRuntimeOptions).  If profile_, the stages
+  //   count their work in StageCounts and, if profileInterval_ > 0, a summary
+  //   of the last profileInterval_ calls (profileTimes_, profileCounts_) is
+  //   printed every profileInterval_ calls.  If traceFileName_ is not empty,
+  //   the stages also record TraceEvents, which are written to the file in
+  //   the Chrome trace format when the model is destroyed.  profileTimes_,
+  //   profileCounts_ and traceEvents_ are guarded by contextsMutex_.
+  bool profile_;
+  int profileInterval_;
+  std::string traceFileName_;
+  std::chrono::steady_clock::time_point traceStart_;
+  StageTimes profileTimes_;
+  StageCounts profileCounts_;
+  std::vector<TraceEvent> traceEvents_;
+  //
+  // ANNImplementation: capture of the Compute calls
+  //   Opened in constructor (via SetRuntimeOptions) if ANN_CAPTURE_FILE is
+  //   set; 0 otherwise.  The inputs of each Compute call are appended to it
+  //   (see capture.h).  capture_ is the record being written; both are
+  //   guarded by captureMutex_.
+  FILE* captureFile_;
+  CapturedCall capture_;
+  std::mutex captureMutex_;
+  //
+  // ANNImplementation: local Monte Carlo moves
+  //   Created by BeginLocalMoves; 0 before and after a change of the model
+  //   or the cutoffs (SetModel, Reinit)
+  LocalMoveState* localMoves_;
+  //
+  // ANNImplementation: model reloading
+  //   Set in constructor.  Reinit() reloads the model if the content of the
+  //   parameter file changed.  If watchParameterFile_ is set (via
+  //   SetRuntimeOptions), Compute() also reloads it when the modification
+  //   time, size or inode of the file changed since the last (re)load.  A
+  //   modified file that Compute() cannot load is recorded in
+  //   rejectedFileStat_ and tried again once it changes.
+  std::string parameterFileName_;
+  ModelCache::Key modelKey_;
+  bool watchParameterFile_;
+  struct stat parameterFileStat_;
+  struct stat rejectedFileStat_;
 
 
 
@@ -217,7 +1020,10 @@ class ANNImplementation
   //
   //
   // Related to constructor
+  ANNImplementation();  // initializes the members for the constructors
   int SetConstantValues(KIM_API_model* const pkim);
+  void SetRuntimeOptions();
+  void SetCostModel();
   void AllocateFreeParameterMemory();
   static int OpenParameterFiles(
       KIM_API_model* const pkim,
@@ -231,21 +1037,46 @@ class ANNImplementation
   int ProcessParameterFiles(
       KIM_API_model* const pkim,
       FILE* const parameterFilePointers[MAX_PARAMETER_FILES],
-      int const numberParameterFiles);
-  void getNextDataLine(FILE* const filePtr, char* const nextLine,
-                       int const maxSize, int* endOfFileFlag);
-  int getXdouble(char* linePtr, const int N, double* list);
-  int getXint(char* linePtr, const int N, int* list);
-  void lowerCase(char* linePtr);
+      int const numberParameterFiles,
+      ANNModel& model);
   int ConvertUnits(KIM_API_model* const pkim);
   int RegisterKIMParameters(KIM_API_model* const pkim) const;
   int RegisterKIMFunctions(KIM_API_model* const pkim) const;
   //
   // Related to Reinit()
   int SetReinitMutableValues(KIM_API_model* const pkim);
+  void SetCutoffsSq();
+  int ReloadModel(KIM_API_model* const pkim, bool const isReinit);
+  void SetModel(std::shared_ptr<ANNModel const> const& model,
+                ModelCache::Key const key);
+  bool ParameterFileModified() const;
   //
   // Related to Compute()
+  // whether all species are in 0, ..., numberModelSpecies_-1 (the arrays of
+  // the KIM API are checked by the simulator)
+  bool ValidSpecies(int const numberOfParticles,
+                    int const* const particleSpecies) const;
+  ComputeContext* AcquireContext();
+  void ReleaseContext(ComputeContext* const context);
+  void TakeResults(ComputeContext& context,
+                   const int* const particleSpecies,
+                   const VectorOfSizeDIM* const coordinates);
+  void StoreResults(ComputeContext& context);
+  void InvalidateResults();
+  void CaptureCall(KIM_API_model* const pkim,
+                   ComputeContext const& context,
+                   int const flags,
+                   const int* const particleSpecies,
+                   KIMNeighbors const& neighbors,
+                   const VectorOfSizeDIM* const coordinates);
+  void EndStage(char const* const name,
+                std::chrono::steady_clock::time_point& lap,
+                double& seconds,
+                std::vector<TraceEvent>& events) const;
+  void PrintProfile(StageTimes const& times, StageCounts const& counts) const;
+  void WriteTraceFile() const;
   int SetComputeMutableValues(KIM_API_model* const pkim,
+                              ComputeContext& context,
                               bool& isComputeProcess_dEdr,
                               bool& isComputeProcess_d2Edr2,
                               bool& isComputeEnergy,
@@ -256,30 +1087,223 @@ class ANNImplementation
                               VectorOfSizeDIM const*& coordinates,
                               double*& energy,
                               double*& particleEnergy,
-                              VectorOfSizeDIM*& forces);
+                              VectorOfSizeDIM*& forces,
+                              bool& isComputeVirial,
+                              bool& isComputeParticleVirial,
+                              VectorOfSizeSix*& virial,
+                              VectorOfSizeSix*& particleVirial);
   int CheckParticleSpecies(KIM_API_model* const pkim,
+                           int const numberOfParticles,
                            int const* const particleSpecies) const;
   int GetComputeIndex(const bool& isComputeProcess_dEdr,
-                      const bool& isComputeProcess_d2Edr2,
                       const bool& isComputeEnergy,
                       const bool& isComputeForces,
-                      const bool& isComputeParticleEnergy) const;
+                      const bool& isComputeParticleEnergy,
+                      const bool& isComputeVirial,
+                      const bool& isComputeParticleVirial) const;
 
   // compute functions
   template< class Iter,
             bool isComputeProcess_dEdr, bool isComputeProcess_d2Edr2,
             bool isComputeEnergy, bool isComputeForces,
-            bool isComputeParticleEnergy>
+            bool isComputeParticleEnergy, bool isComputeVirial,
+            bool isComputeParticleVirial>
   int Compute(KIM_API_model* const pkim,
+              ComputeContext& context,
               const int* const particleSpecies,
-              GetNeighborFunction* const get_neigh,
+              typename Iter::Neighbors const& neighbors,
               const VectorOfSizeDIM* const coordinates,
               double* const energy,
               VectorOfSizeDIM* const forces,
-              double* const particleEnergy);
+              double* const particleEnergy,
+              VectorOfSizeSix* const virial,
+              VectorOfSizeSix* const particleVirial) const;
+  template<class Iter>
+  void DescriptorStage(typename Iter::Neighbors const& neighbors,
+                       int const first,
+                       int const last,
+                       const int* const particleSpecies,
+                       const VectorOfSizeDIM* const coordinates,
+                       CostModel& costModel,
+                       ChunkBuffer& chunk) const;
+  template<class Iter>
+  void RestoreStage(typename Iter::Neighbors const& neighbors,
+                    int const first,
+                    int const last,
+                    ResultCache const& results,
+                    CostModel& costModel,
+                    ChunkBuffer& chunk) const;
+  template<bool isComputeDerivative>
+  void NetworkStage(NetworkWorkspace& ws, ChunkBuffer& chunk) const;
+  template<bool isComputeDerivative>
+  void MemoizedNetworkStage(NetworkWorkspace& ws, ChunkBuffer& chunk) const;
+  template<bool isComputeProcess_dEdr,
+           bool isComputeEnergy, bool isComputeForces,
+           bool isComputeParticleEnergy, bool isComputeVirial,
+           bool isComputeParticleVirial>
+  void ForceStage(ChunkBuffer& chunk,
+                  const int* const particleSpecies,
+                  const VectorOfSizeDIM* const coordinates,
+                  double* const energy,
+                  VectorOfSizeDIM* const forces,
+                  double* const particleEnergy,
+                  VectorOfSizeSix* const virial,
+                  VectorOfSizeSix* const particleVirial,
+                  std::vector<PairTerm>* const pairTerms) const;
+  int BatchGroup(ComputeContext& context,
+                 int const numberConfigurations,
+                 ComputeArguments const* const arguments);
+  template<bool isComputeForces, bool isComputeVirial,
+           bool isComputeParticleVirial>
+  void BatchForces(ChunkBuffer& chunk,
+                   int const firstRow,
+                   ComputeArguments const& arguments) const;
+  void ComputeGeneralizedCoords(int const i,
+                                int const numNei,
+                                int const* const n1Atom,
+                                const int* const particleSpecies,
+                                const VectorOfSizeDIM* const coordinates,
+                                double* const gc,
+                                StageCounts* const counts) const;
+  template<bool isComputeProcess_dEdr, bool isComputeForces,
+           bool isComputeVirial, bool isComputeParticleVirial>
+  void AccumulateForces(int const i,
+                        int const numNei,
+                        int const* const n1Atom,
+                        const int* const particleSpecies,
+                        const VectorOfSizeDIM* const coordinates,
+                        double const* const dEdGc,
+                        double* const dEdr,
+                        double* const fi,
+                        double* const fnei,
+                        double* const virial,
+                        double* const vi,
+                        double* const vnei,
+                        std::vector<PairTerm>* const pairTerms) const;
+  int ProcessPairTerm(KIM_API_model* const pkim,
+                      const VectorOfSizeDIM* const coordinates,
+                      int const i,
+                      int const j,
+                      double const dEdr) const;
+  int ProcessPairTerms(KIM_API_model* const pkim,
+                       const VectorOfSizeDIM* const coordinates,
+                       std::vector<PairTerm>& pairTerms) const;
+
+  // second derivatives
+  template<class Iter>
+  int ProcessSecondDerivatives(KIM_API_model* const pkim,
+                               ComputeContext& context,
+                               const int* const particleSpecies,
+                               typename Iter::Neighbors const& neighbors,
+                               const VectorOfSizeDIM* const coordinates) const;
+  int ProcessParticleSecondDerivatives(
+      KIM_API_model* const pkim,
+      int const i,
+      int const numNei,
+      int const* const n1Atom,
+      const int* const particleSpecies,
+      const VectorOfSizeDIM* const coordinates,
+      double const* const dEdGc,
+      double const* const d2EdGc2) const;
+  template<class Iter>
+  int HessianVectorProduct(ComputeContext& context,
+                           const int* const particleSpecies,
+                           typename Iter::Neighbors const& neighbors,
+                           const VectorOfSizeDIM* const coordinates,
+                           const VectorOfSizeDIM* const v,
+                           VectorOfSizeDIM* const hv) const;
+  void EvaluateLocalMove(LocalMoveState const& state,
+                         LocalMoveTrial& trial) const;
+  void ComputeGeneralizedCoordsTangent(int const i,
+                                       int const numNei,
+                                       int const* const n1Atom,
+                                       const int* const particleSpecies,
+                                       const VectorOfSizeDIM* const coordinates,
+                                       const VectorOfSizeDIM* const v,
+                                       double* const dgc) const;
+  void AccumulateHessianVectorProduct(int const i,
+                                      int const numNei,
+                                      int const* const n1Atom,
+                                      const int* const particleSpecies,
+                                      const VectorOfSizeDIM* const coordinates,
+                                      const VectorOfSizeDIM* const v,
+                                      double const* const dEdGc,
+                                      double const* const ddEdGc,
+                                      double* const dEdr,
+                                      double* const ddEdr,
+                                      double* const hvi,
+                                      double* const hvnei) const;
+};
 
+// squared distance of positions a and b
+inline double DistanceSquared(double const* const a, double const* const b)
+{
+  double const dx = b[0] - a[0];
+  double const dy = b[1] - a[1];
+  double const dz = b[2] - a[2];
+  return dx*dx + dy*dy + dz*dz;
+}
 
-};
+// Add the contribution of a pair term with derivative dEdr w.r.t. the distance
+// rmag = |r| of particles a and b (r = x_b - x_a) to the forces fa and fb, the
+// virial, and the particle virials va and vb (half to each particle).
+template<bool isComputeForces, bool isComputeVirial,
+         bool isComputeParticleVirial>
+inline void AccumulatePairTerm(double const dEdr, double const rmag,
+                               double const* const r,
+                               double* const fa, double* const fb,
+                               double* const virial,
+                               double* const va, double* const vb)
+{
+  if (isComputeForces == true) {
+    for (int kdim = 0; kdim < DIM; ++kdim) {
+      double const f = dEdr*r[kdim]/rmag;
+      fa[kdim] += f;
+      fb[kdim] -= f;
+    }
+  }
+
+  if (isComputeVirial == true || isComputeParticleVirial == true) {
+    double const v = dEdr/rmag;
+    double const vir[6] = {v*r[0]*r[0], v*r[1]*r[1], v*r[2]*r[2],
+                           v*r[1]*r[2], v*r[0]*r[2], v*r[0]*r[1]};
+    for (int m = 0; m < 6; ++m) {
+      if (isComputeVirial == true) virial[m] += vir[m];
+      if (isComputeParticleVirial == true) {
+        va[m] += HALF*vir[m];
+        vb[m] += HALF*vir[m];
+      }
+    }
+  }
+}
+
+// Add the derivative in direction v of the gradient of a pair term (see
+// AccumulatePairTerm) to the Hessian-vector products hva and hvb of particles
+// a and b, where ddEdr is the derivative of dEdr in direction v, and va and vb
+// are the entries of v of a and b.
+inline void AccumulatePairTermTangent(double const dEdr, double const ddEdr,
+                                      double const rmag,
+                                      double const* const r,
+                                      double const* const va,
+                                      double const* const vb,
+                                      double* const hva, double* const hvb)
+{
+  if (dEdr == 0.0 && ddEdr == 0.0) return;
+
+  double dr[DIM];
+  double rdotdr = 0.0;
+  for (int kdim = 0; kdim < DIM; ++kdim) {
+    dr[kdim] = vb[kdim] - va[kdim];
+    rdotdr += r[kdim]*dr[kdim];
+  }
+  for (int kdim = 0; kdim < DIM; ++kdim) {
+    double const rhat = r[kdim]/rmag;
+    double const drhat = (dr[kdim] - rhat*rdotdr/rmag)/rmag;
+    double const g = ddEdr*rhat + dEdr*drhat;
+    hva[kdim] -= g;
+    hvb[kdim] += g;
+  }
+}
 
 //==============================================================================
 //
@@ -294,23 +1318,30 @@ class ANNImplementation
 template< class Iter,
           bool isComputeProcess_dEdr, bool isComputeProcess_d2Edr2,
           bool isComputeEnergy, bool isComputeForces,
-          bool isComputeParticleEnergy>
+          bool isComputeParticleEnergy, bool isComputeVirial,
+          bool isComputeParticleVirial>
 int ANNImplementation::Compute(
     KIM_API_model* const pkim,
+    ComputeContext& context,
     const int* const particleSpecies,
-    GetNeighborFunction* const get_neigh,
+    typename Iter::Neighbors const& neighbors,
     const VectorOfSizeDIM* const coordinates,
     double* const energy,
     VectorOfSizeDIM* const forces,
-    double* const particleEnergy)
+    double* const particleEnergy,
+    VectorOfSizeSix* const virial,
+    VectorOfSizeSix* const particleVirial) const
 {
   int ier = KIM_STATUS_OK;
-  const int Nparticles = cachedNumberOfParticles_;
-  const int Ncontrib = cachedNumberContributingParticles_;
+  const int Nparticles = context.numberOfParticles;
+  const int Ncontrib = context.numberContributingParticles;
+  ChunkBuffer* const chunks = context.chunks;
 
   if ((isComputeEnergy == false) &&
       (isComputeParticleEnergy == false) &&
       (isComputeForces == false) &&
+      (isComputeVirial == false) &&
+      (isComputeParticleVirial == false) &&
       (isComputeProcess_dEdr == false) &&
       (isComputeProcess_d2Edr2 == false))
     return ier;
@@ -330,98 +1361,896 @@ int ANNImplementation::Compute(
         forces[i][j] = 0.0;
     }
   }
+  if (isComputeVirial == true) {
+    for (int i = 0; i < 6; ++i) (*virial)[i] = 0.0;
+  }
+  if (isComputeParticleVirial == true) {
+    for (int i = 0; i < Nparticles; ++i) {
+      for (int j = 0; j < 6; ++j)
+        particleVirial[i][j] = 0.0;
+    }
+  }
 
-  // setting up generalzied coords matrix and the derivative matrix
-  double** generalizedCoords;
-//  double*** dGeneralizedCoords;
-  int Ndescriptors = descriptor_->get_num_descriptors();
-  AllocateAndInitialize2DArray(generalizedCoords, Ncontrib, Ndescriptors);
-
-  // calculate generalized coordiantes
-  //
-  // Setup loop over contributing particles
-  int ii = 0;
-  int numnei = 0;
-  int* n1atom = 0;
-  double* pRij = 0;
-  int const baseConvert = baseconvert_;
-	double const* const* const  constCutoffsSq2D = cutoffsSq2D_;
-
-	for (Iter iterator(pkim, get_neigh, baseConvert, Ncontrib, &ii, &numnei,
-                     &n1atom, &pRij);
-       iterator.done() == false;
-       iterator.next(&ii, &numnei, &n1atom, &pRij))
+  // the derivative of the energy w.r.t. the generalized coords is needed by
+  // everything but the energies
+  bool const isComputeDerivative = (isComputeForces || isComputeVirial
+                                    || isComputeParticleVirial
+                                    || isComputeProcess_dEdr);
+
+  // setting up chunk buffers for generalized coords
+  int const Ndescriptors = descriptor_->get_num_descriptors();
+  int const chunkSize = (chunkSize_ > 0 && chunkSize_ < Ncontrib) ?
+      chunkSize_ : Ncontrib;
+  if (chunkSize == 0) return ier;
+  int const Nchunks = (Ncontrib + chunkSize - 1) / chunkSize;
+
+  // With the result cache, the state kept from an earlier call on the same
+  // configuration replaces the descriptor stage (and the network stage if it
+  // holds the derivative), and the state of this call is recorded.
+  ResultCache& results = context.results;
+  bool const isRestore = (results.isActive == true
+                          && (results.hasDerivative == true
+                              || results.hasGeneralizedCoords == true));
+  bool const isEvaluate = !(isRestore == true
+                            && results.hasDerivative == true);
+  bool const isRecord = (results.isActive == true && isEvaluate == true);
+
+  // Process contributing particles chunk by chunk: descriptors -> NN
+  // feedforward -> NN backpropagation -> forces.  Only chunk-sized
+  // intermediate data is alive at any time.  process_dEdr is only called
+  // from the calling thread, so it is not pipelined.
+  if (pipeline_ == false || Nchunks < 3 || isComputeProcess_dEdr == true)
   {
-    int const numNei = numnei;
-    int const * const n1Atom = n1atom;
-    int const i = ii;
-    int const iSpecies = particleSpecies[i];
+    ChunkBuffer& chunk = chunks[0];
+    chunk.resize(chunkSize, Ndescriptors);
+    std::vector<PairTerm>* const pairTerms
+        = (isComputeProcess_dEdr == true) ? &context.pairTerms : 0;
+    context.pairTerms.clear();
 
-    // Setup loop over neighbors of current particle
-    for (int jj = 0; jj < numNei; ++jj)
+    for (int first = 0; first < Ncontrib; first += chunkSize)
     {
-      // adjust index of particle neighbor
-      int const j = n1Atom[jj] + baseConvert;
-      int const jSpecies = particleSpecies[j];
-      double rij[DIM];
-
-			// Compute rij
-			for (int dim = 0; dim < DIM; ++dim) {
-				rij[dim] = coordinates[j][dim] - coordinates[i][dim];
-			}
-
-      // compute distance squared
-      double const rijmag = sqrt(rij[0]*rij[0] + rij[1]*rij[1] + rij[2]*rij[2]);
-      double const rcutij = sqrt(constCutoffsSq2D[iSpecies][jSpecies]);
+      int const last = std::min(first + chunkSize, Ncontrib);
+      if (isRestore == true) {
+        RestoreStage<Iter>(neighbors, first, last, results,
+                           context.costModel, chunk);
+      }
+      else {
+        DescriptorStage<Iter>(neighbors, first, last, particleSpecies,
+                              coordinates, context.costModel, chunk);
+      }
+      if (isEvaluate == true) {
+        NetworkStage<isComputeDerivative>(context.network, chunk);
+      }
+      if (isRecord == true) results.record(first, chunk, isComputeDerivative);
+      ForceStage<isComputeProcess_dEdr, isComputeEnergy, isComputeForces,
+                 isComputeParticleEnergy, isComputeVirial,
+                 isComputeParticleVirial>(
+          chunk, particleSpecies, coordinates, energy, forces,
+          particleEnergy, virial, particleVirial, pairTerms);
+    }
 
-      // if particles i and j not interact
-      if (rijmag > rcutij) continue;
+    if (isComputeProcess_dEdr == true) {
+      ier = ProcessPairTerms(pkim, coordinates, context.pairTerms);
+      if (ier < KIM_STATUS_OK) return ier;
+    }
+  }
+  else
+  {
+    // Software pipeline: while chunk k goes through the network, the
+    // descriptors of chunk k+1 and the forces of chunk k-1 are computed.
+    // The descriptor stage runs in the calling thread, since it is the only
+    // one that calls get_neigh.  Each stage handles the chunks in order, such
+    // that the result does not depend on the scheduling.
+    for (int b = 0; b < NUMBER_CHUNK_BUFFERS; ++b) {
+      chunks[b].resize(chunkSize, Ndescriptors);
+    }
+    ChunkPipeline pipeline(NUMBER_CHUNK_BUFFERS);
+
+    // the network stage (task 0) and force stage (task 1) on the two
+    // workers of the context
+    std::function<void()> const networkStage = [&]() {
+      for (int k = 0; k < Nchunks; ++k) {
+        int const b = k % NUMBER_CHUNK_BUFFERS;
+        pipeline.wait(b, ChunkPipeline::DESCRIBED);
+        if (isEvaluate == true) {
+          NetworkStage<isComputeDerivative>(context.network, chunks[b]);
+        }
+        if (isRecord == true) {
+          results.record(k*chunkSize, chunks[b], isComputeDerivative);
+        }
+        pipeline.post(b, ChunkPipeline::EVALUATED);
+      }
+    };
+    std::function<void()> const forceStage = [&]() {
+      for (int k = 0; k < Nchunks; ++k) {
+        int const b = k % NUMBER_CHUNK_BUFFERS;
+        pipeline.wait(b, ChunkPipeline::EVALUATED);
+        ForceStage<false, isComputeEnergy, isComputeForces,
+                   isComputeParticleEnergy, isComputeVirial,
+                   isComputeParticleVirial>(
+            chunks[b], particleSpecies, coordinates, energy, forces,
+            particleEnergy, virial, particleVirial, 0);
+        pipeline.post(b, ChunkPipeline::FREE);
+      }
+    };
+    if (context.pipelineWorkers == 0) {
+      context.pipelineWorkers = new ThreadPool(3);
+    }
+    context.pipelineWorkers->start(2, [&](int const t) {
+      if (t == 0) {
+        networkStage();
+      }
+      else {
+        forceStage();
+      }
+    });
+
+    for (int k = 0; k < Nchunks; ++k) {
+      int const b = k % NUMBER_CHUNK_BUFFERS;
+      int const first = k*chunkSize;
+      int const last = std::min(first + chunkSize, Ncontrib);
+      pipeline.wait(b, ChunkPipeline::FREE);
+      if (isRestore == true) {
+        RestoreStage<Iter>(neighbors, first, last, results,
+                           context.costModel, chunks[b]);
+      }
+      else {
+        DescriptorStage<Iter>(neighbors, first, last, particleSpecies,
+                              coordinates, context.costModel, chunks[b]);
+      }
+      pipeline.post(b, ChunkPipeline::DESCRIBED);
+    }
 
-      // two-body descriptors
-      for (size_t p=0; p<descriptor_->name.size(); p++) {
+    context.pipelineWorkers->wait();
+  }
 
-        if (descriptor_->name[p] != "g1" &&
-            descriptor_->name[p] != "g2" &&
-            descriptor_->name[p] != "g3") {
-          continue;
-        }
-        int idx = descriptor_->starting_index[p];
 
-        for(int q=0; q<descriptor_->num_param_sets[p]; q++) {
+  // everything is good
+  ier = KIM_STATUS_OK;
+  return ier;
+}
 
-          double gc;
-          if (descriptor_->name[p] == "g1") {
-            descriptor_->sym_g1(rijmag, rcutij, gc);
-          }
-          else if (descriptor_->name[p] == "g2") {
-            double eta = descriptor_->params[p][q][0];
-            double Rs = descriptor_->params[p][q][1];
-            descriptor_->sym_g2(eta, Rs, rijmag, rcutij, gc);
-          }
-          else if (descriptor_->name[p] == "g3") {
-            double kappa = descriptor_->params[p][q][0];
-            descriptor_->sym_g3(kappa, rijmag, rcutij, gc);
-          }
+//******************************************************************************
+// gather particles [first, last) and compute their generalized coords
+template<class Iter>
+void ANNImplementation::DescriptorStage(
+    typename Iter::Neighbors const& neighbors,
+    int const first,
+    int const last,
+    const int* const particleSpecies,
+    const VectorOfSizeDIM* const coordinates,
+    CostModel& costModel,
+    ChunkBuffer& chunk) const
+{
+  std::chrono::steady_clock::time_point lap = std::chrono::steady_clock::now();
+  int const Nchunk = chunk.gather<Iter>(neighbors, baseconvert_,
+                                        first, last);
+  double** const generalizedCoords = chunk.generalizedCoords;
+  EndStage("neighbor", lap, chunk.times.neighbor, chunk.events);
+
+  // split particles among threads such that each has about the same work
+  costModel.partition(&chunk.numNei[0], Nchunk, numThreads_, chunk.bounds);
+  int const Nparts = chunk.bounds.size() - 1;
+  std::vector<double> seconds(Nparts);
+  std::vector<StageCounts> counts(profile_ ? Nparts : 0);
+
+  std::function<void(int)> const task = [&](int const part) {
+    std::chrono::steady_clock::time_point const start
+        = std::chrono::steady_clock::now();
+    StageCounts* const partCounts = profile_ ? &counts[part] : 0;
+
+    for (int c = chunk.bounds[part]; c < chunk.bounds[part+1]; ++c) {
+      // calculate generalized coordiantes
+      ComputeGeneralizedCoords(chunk.particle[c], chunk.numNei[c],
+                               &chunk.neighList[chunk.neighStart[c]],
+                               particleSpecies, coordinates,
+                               generalizedCoords[c], partCounts);
+
+      // centering and normalization is folded into the first network layer
+      // (see ANNModel::compile)
+    }
 
-          generalizedCoords[i][idx] += gc;
-          idx += 1;
+    seconds[part] = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+  };
+  if (threadPool_ != 0) {
+    threadPool_->run(Nparts, task);
+    costModel.update(&chunk.numNei[0], chunk.bounds, seconds);
+  }
+  else {
+    task(0);
+  }
+  if (profile_) {
+    chunk.counts.pairsVisited += chunk.neighList.size();
+    for (int part = 0; part < Nparts; ++part) chunk.counts.add(counts[part]);
+  }
+  EndStage("descriptor", lap, chunk.times.descriptor, chunk.events);
+}
 
-        } // loop over same descriptor but different parameter set
-      } // loop over descriptors
+//******************************************************************************
+// gather particles [first, last) and copy their generalized coords, or their
+// energies and derivatives w.r.t. the generalized coords, from the result
+// cache
+template<class Iter>
+void ANNImplementation::RestoreStage(
+    typename Iter::Neighbors const& neighbors,
+    int const first,
+    int const last,
+    ResultCache const& results,
+    CostModel& costModel,
+    ChunkBuffer& chunk) const
+{
+  std::chrono::steady_clock::time_point lap = std::chrono::steady_clock::now();
+  int const Nchunk = chunk.gather<Iter>(neighbors, baseconvert_,
+                                        first, last);
+  int const Nd = chunk.numberDescriptors;
+  EndStage("neighbor", lap, chunk.times.neighbor, chunk.events);
+
+  // the cost model is only refined with the times of the descriptor stage
+  costModel.partition(&chunk.numNei[0], Nchunk, numThreads_, chunk.bounds);
+
+  if (results.hasDerivative == true) {
+    std::copy(results.energy.begin() + first,
+              results.energy.begin() + first + Nchunk, chunk.energy.begin());
+    std::copy(results.dEdGeneralizedCoords.begin() + first*Nd,
+              results.dEdGeneralizedCoords.begin() + (first + Nchunk)*Nd,
+              chunk.dEdGeneralizedCoords[0]);
+  }
+  else {
+    std::copy(results.generalizedCoords.begin() + first*Nd,
+              results.generalizedCoords.begin() + (first + Nchunk)*Nd,
+              chunk.generalizedCoords[0]);
+  }
+  EndStage("descriptor", lap, chunk.times.descriptor, chunk.events);
+}
 
+//******************************************************************************
+// evaluate the NN on a chunk, storing particle energies and (if needed) the
+// derivative of energy w.r.t. generalized coords in the chunk buffer
+template<bool isComputeDerivative>
+void ANNImplementation::NetworkStage(NetworkWorkspace& ws,
+                                     ChunkBuffer& chunk) const
+{
+  int const Nchunk = chunk.numberParticles;
+  int const Ndescriptors = chunk.numberDescriptors;
 
-      // three-body descriptors
-      if (descriptor_->has_three_body == false) continue;
+  if (memoTolerance_ > 0.0) {
+    MemoizedNetworkStage<isComputeDerivative>(ws, chunk);
+    return;
+  }
 
-      for (int kk = jj+1; kk < numNei; ++kk) {
+  // NN feedforward
+  std::chrono::steady_clock::time_point lap = std::chrono::steady_clock::now();
+  network_->forward(chunk.generalizedCoords[0], Nchunk, Ndescriptors, ws);
+  double const* const Epart = ws.get_output();
+  for (int c = 0; c < Nchunk; ++c) {
+    chunk.energy[c] = Epart[c];
+  }
+  EndStage("forward", lap, chunk.times.forward, chunk.events);
+
+  if (isComputeDerivative == true) {
+    // NN backpropagation to compute derivative of energy w.r.t generalized
+    // coords
+    network_->backward(ws);
+    double const* const dEdGc = ws.get_grad_input();
+    std::copy(dEdGc, dEdGc + Nchunk*Ndescriptors,
+              chunk.dEdGeneralizedCoords[0]);
+    EndStage("backward", lap, chunk.times.backward, chunk.events);
+  }
+}
 
-        // adjust index of particle neighbor
-        int const k = n1Atom[kk] + baseConvert;
-        int const kSpecies = particleSpecies[k];
+//******************************************************************************
+// NetworkStage with one evaluation per distinct generalized coords row of the
+// chunk, e.g. for the equivalent particles of a crystal.  Rows are compared
+// after rounding to multiples of memoTolerance_, and all particles with the
+// same rounded row get the energy and derivative of the first of them.
+template<bool isComputeDerivative>
+void ANNImplementation::MemoizedNetworkStage(NetworkWorkspace& ws,
+                                             ChunkBuffer& chunk) const
+{
+  int const Nchunk = chunk.numberParticles;
+  int const Ndescriptors = chunk.numberDescriptors;
+  double const scale = 1.0/memoTolerance_;
+  std::chrono::steady_clock::time_point lap = std::chrono::steady_clock::now();
+
+  chunk.distinctRow.resize(Nchunk);
+  chunk.distinctKeys.clear();
+  chunk.distinctCoords.clear();
+  chunk.distinctIndex.clear();
+  std::vector<long long> key(Ndescriptors);
+  int Ndistinct = 0;
+  for (int c = 0; c < Nchunk; ++c) {
+    double const* const gc = chunk.generalizedCoords[c];
+    unsigned long long hash = 0;
+    for (int j = 0; j < Ndescriptors; ++j) {
+      key[j] = llround(gc[j]*scale);
+      hash ^= static_cast<unsigned long long>(key[j]) + 0x9e3779b97f4a7c15ULL
+          + (hash << 6) + (hash >> 2);
+    }
 
-        // Compute rik, rjk and their squares
-        double rik[DIM];
-        double rjk[DIM];
+    std::unordered_map<unsigned long long, int>::const_iterator const it
+        = chunk.distinctIndex.find(hash);
+    int d = -1;
+    if (it != chunk.distinctIndex.end()
+        && std::equal(key.begin(), key.end(),
+                      &chunk.distinctKeys[it->second*Ndescriptors])) {
+      d = it->second;
+    }
+    if (d < 0) {
+      // on a hash collision the new row is simply not shared
+      d = Ndistinct++;
+      if (it == chunk.distinctIndex.end()) chunk.distinctIndex[hash] = d;
+      chunk.distinctKeys.insert(chunk.distinctKeys.end(), key.begin(),
+                                key.end());
+      chunk.distinctCoords.insert(chunk.distinctCoords.end(), gc,
+                                  gc + Ndescriptors);
+    }
+    chunk.distinctRow[c] = d;
+  }
+  memoRows_ += Nchunk;
+  memoHits_ += Nchunk - Ndistinct;
+
+  // NN feedforward of the distinct rows
+  network_->forward(&chunk.distinctCoords[0], Ndistinct, Ndescriptors, ws);
+  double const* const Epart = ws.get_output();
+  for (int c = 0; c < Nchunk; ++c) {
+    chunk.energy[c] = Epart[chunk.distinctRow[c]];
+  }
+  EndStage("forward", lap, chunk.times.forward, chunk.events);
+
+  if (isComputeDerivative == true) {
+    network_->backward(ws);
+    double const* const dEdGc = ws.get_grad_input();
+    for (int c = 0; c < Nchunk; ++c) {
+      double const* const row = dEdGc + chunk.distinctRow[c]*Ndescriptors;
+      std::copy(row, row + Ndescriptors, chunk.dEdGeneralizedCoords[c]);
+    }
+    EndStage("backward", lap, chunk.times.backward, chunk.events);
+  }
+}
+
+//******************************************************************************
+// add the energy, force and virial contributions of a chunk, and append the
+// derivatives of its energy w.r.t. pair distances to pairTerms (process_dEdr
+// only)
+template<bool isComputeProcess_dEdr,
+         bool isComputeEnergy, bool isComputeForces,
+         bool isComputeParticleEnergy, bool isComputeVirial,
+         bool isComputeParticleVirial>
+void ANNImplementation::ForceStage(
+    ChunkBuffer& chunk,
+    const int* const particleSpecies,
+    const VectorOfSizeDIM* const coordinates,
+    double* const energy,
+    VectorOfSizeDIM* const forces,
+    double* const particleEnergy,
+    VectorOfSizeSix* const virial,
+    VectorOfSizeSix* const particleVirial,
+    std::vector<PairTerm>* const pairTerms) const
+{
+  int const Nchunk = chunk.numberParticles;
+  std::chrono::steady_clock::time_point lap = std::chrono::steady_clock::now();
+
+  // Contribution to energy
+  if (isComputeEnergy == true) {
+    for (int c = 0; c < Nchunk; ++c) {
+      *energy += chunk.energy[c];
+    }
+  }
+
+  // Contribution to particle energy
+  if (isComputeParticleEnergy == true) {
+    for (int c = 0; c < Nchunk; ++c) {
+      particleEnergy[chunk.particle[c]] = chunk.energy[c];
+    }
+  }
+
+  // Compute derivative of energy w.r.t coords
+  if (isComputeForces == true || isComputeVirial == true
+      || isComputeParticleVirial == true || isComputeProcess_dEdr == true) {
+    // Each particle writes only to its own entries of the chunk buffer, and
+    // each partition to its own part of partVirial, so the partitions can be
+    // processed concurrently.
+    int const Nparts = chunk.bounds.size() - 1;
+    size_t const Nneigh = chunk.neighList.size();
+    chunk.dEdr.resize(Nneigh);
+    chunk.neighForce.resize(Nneigh*DIM);
+    chunk.neighVirial.resize(Nneigh*6);
+    chunk.partVirial.resize(Nparts*6);
+    if (isComputeForces == true) {
+      std::fill(chunk.neighForce.begin(), chunk.neighForce.end(), 0.0);
+      std::fill(chunk.selfForce.begin(), chunk.selfForce.end(), 0.0);
+    }
+    if (isComputeVirial == true) {
+      std::fill(chunk.partVirial.begin(), chunk.partVirial.end(), 0.0);
+    }
+    if (isComputeParticleVirial == true) {
+      std::fill(chunk.neighVirial.begin(), chunk.neighVirial.end(), 0.0);
+      std::fill(chunk.selfVirial.begin(), chunk.selfVirial.end(), 0.0);
+    }
+    if (isComputeProcess_dEdr == true) {
+      chunk.partPairTerms.resize(Nparts);
+      for (int part = 0; part < Nparts; ++part) {
+        chunk.partPairTerms[part].clear();
+      }
+    }
+
+    std::function<void(int)> const task = [&](int const part) {
+      std::vector<PairTerm>* const partPairTerms
+          = (isComputeProcess_dEdr == true) ? &chunk.partPairTerms[part] : 0;
+      for (int c = chunk.bounds[part]; c < chunk.bounds[part+1]; ++c) {
+        int const start = chunk.neighStart[c];
+        AccumulateForces<isComputeProcess_dEdr, isComputeForces,
+                         isComputeVirial, isComputeParticleVirial>(
+            chunk.particle[c], chunk.numNei[c], &chunk.neighList[start],
+            particleSpecies, coordinates, chunk.dEdGeneralizedCoords[c],
+            &chunk.dEdr[start], &chunk.selfForce[c*DIM],
+            &chunk.neighForce[start*DIM], &chunk.partVirial[part*6],
+            &chunk.selfVirial[c*6], &chunk.neighVirial[start*6],
+            partPairTerms);
+      }
+    };
+    if (threadPool_ != 0) {
+      threadPool_->run(Nparts, task);
+    }
+    else {
+      task(0);
+    }
+
+    // scatter to forces and virials
+    if (isComputeForces == true) {
+      for (int c = 0; c < Nchunk; ++c) {
+        int const i = chunk.particle[c];
+        for (int kdim = 0; kdim < DIM; ++kdim) {
+          forces[i][kdim] += chunk.selfForce[c*DIM + kdim];
+        }
+      }
+      for (size_t s = 0; s < chunk.neighList.size(); ++s) {
+        int const j = chunk.neighList[s];
+        for (int kdim = 0; kdim < DIM; ++kdim) {
+          forces[j][kdim] += chunk.neighForce[s*DIM + kdim];
+        }
+      }
+    }
+    if (isComputeVirial == true) {
+      for (int part = 0; part < Nparts; ++part) {
+        for (int m = 0; m < 6; ++m) {
+          (*virial)[m] += chunk.partVirial[part*6 + m];
+        }
+      }
+    }
+    if (isComputeParticleVirial == true) {
+      for (int c = 0; c < Nchunk; ++c) {
+        int const i = chunk.particle[c];
+        for (int m = 0; m < 6; ++m) {
+          particleVirial[i][m] += chunk.selfVirial[c*6 + m];
+        }
+      }
+      for (size_t s = 0; s < chunk.neighList.size(); ++s) {
+        int const j = chunk.neighList[s];
+        for (int m = 0; m < 6; ++m) {
+          particleVirial[j][m] += chunk.neighVirial[s*6 + m];
+        }
+      }
+    }
+
+    // the pair of a particle and each neighbor (summed over all
+    // descriptors), and the neighbor-neighbor pairs of its triplets (summed
+    // over the three-body descriptors); ProcessPairTerms merges them
+    if (isComputeProcess_dEdr == true) {
+      for (int part = 0; part < Nparts; ++part) {
+        for (int c = chunk.bounds[part]; c < chunk.bounds[part+1]; ++c) {
+          int const i = chunk.particle[c];
+          for (int jj = 0; jj < chunk.numNei[c]; ++jj) {
+            int const s = chunk.neighStart[c] + jj;
+            if (chunk.dEdr[s] == 0.0) continue;  // e.g. beyond the cutoff
+            pairTerms->push_back(PairTerm(i, chunk.neighList[s],
+                                          chunk.dEdr[s]));
+          }
+        }
+        pairTerms->insert(pairTerms->end(), chunk.partPairTerms[part].begin(),
+                          chunk.partPairTerms[part].end());
+      }
+    }
+  }
+  EndStage("force", lap, chunk.times.force, chunk.events);
+}
+
+//******************************************************************************
+// add the force and virial contributions of the rows [firstRow, firstRow +
+// numberContributingParticles) of a chunk of ComputeBatch, which hold the
+// particles of one configuration, to the (zeroed) outputs of the
+// configuration
+template<bool isComputeForces, bool isComputeVirial,
+         bool isComputeParticleVirial>
+void ANNImplementation::BatchForces(ChunkBuffer& chunk,
+                                    int const firstRow,
+                                    ComputeArguments const& arguments) const
+{
+  int const lastRow = firstRow + arguments.numberContributingParticles;
+  if (lastRow == firstRow) return;
+  int const firstNeigh = chunk.neighStart[firstRow];
+  int const lastNeigh
+      = chunk.neighStart[lastRow - 1] + chunk.numNei[lastRow - 1];
+
+  if (isComputeForces == true) {
+    std::fill(chunk.selfForce.begin() + firstRow*DIM,
+              chunk.selfForce.begin() + lastRow*DIM, 0.0);
+    std::fill(chunk.neighForce.begin() + firstNeigh*DIM,
+              chunk.neighForce.begin() + lastNeigh*DIM, 0.0);
+  }
+  if (isComputeParticleVirial == true) {
+    std::fill(chunk.selfVirial.begin() + firstRow*6,
+              chunk.selfVirial.begin() + lastRow*6, 0.0);
+    std::fill(chunk.neighVirial.begin() + firstNeigh*6,
+              chunk.neighVirial.begin() + lastNeigh*6, 0.0);
+  }
+  double* const virial = (isComputeVirial == true)
+      ? arguments.virial[0] : 0;
+
+  for (int c = firstRow; c < lastRow; ++c) {
+    int const start = chunk.neighStart[c];
+    AccumulateForces<false, isComputeForces, isComputeVirial,
+                     isComputeParticleVirial>(
+        chunk.particle[c], chunk.numNei[c], &chunk.neighList[start],
+        arguments.particleSpecies, arguments.coordinates,
+        chunk.dEdGeneralizedCoords[c], &chunk.dEdr[start],
+        &chunk.selfForce[c*DIM], &chunk.neighForce[start*DIM], virial,
+        &chunk.selfVirial[c*6], &chunk.neighVirial[start*6], 0);
+  }
+
+  // scatter to forces and particle virials
+  if (isComputeForces == true) {
+    VectorOfSizeDIM* const forces = arguments.forces;
+    for (int c = firstRow; c < lastRow; ++c) {
+      int const i = chunk.particle[c];
+      for (int kdim = 0; kdim < DIM; ++kdim) {
+        forces[i][kdim] += chunk.selfForce[c*DIM + kdim];
+      }
+    }
+    for (int s = firstNeigh; s < lastNeigh; ++s) {
+      int const j = chunk.neighList[s];
+      for (int kdim = 0; kdim < DIM; ++kdim) {
+        forces[j][kdim] += chunk.neighForce[s*DIM + kdim];
+      }
+    }
+  }
+  if (isComputeParticleVirial == true) {
+    VectorOfSizeSix* const particleVirial = arguments.particleVirial;
+    for (int c = firstRow; c < lastRow; ++c) {
+      int const i = chunk.particle[c];
+      for (int m = 0; m < 6; ++m) {
+        particleVirial[i][m] += chunk.selfVirial[c*6 + m];
+      }
+    }
+    for (int s = firstNeigh; s < lastNeigh; ++s) {
+      int const j = chunk.neighList[s];
+      for (int m = 0; m < 6; ++m) {
+        particleVirial[j][m] += chunk.neighVirial[s*6 + m];
+      }
+    }
+  }
+}
+
+//******************************************************************************
+inline int ANNImplementation::ProcessPairTerm(
+    KIM_API_model* const pkim,
+    const VectorOfSizeDIM* const coordinates,
+    int const i,
+    int const j,
+    double const dEdr) const
+{
+  double rij[DIM];
+  for (int dim = 0; dim < DIM; ++dim) {
+    rij[dim] = coordinates[j][dim] - coordinates[i][dim];
+  }
+  double rijmag = sqrt(rij[0]*rij[0] + rij[1]*rij[1] + rij[2]*rij[2]);
+  double dEidr = dEdr;
+  double* const pRij = &(rij[0]);
+  int iSim = i - baseconvert_;
+  int jSim = j - baseconvert_;
+
+  KIM_API_model* pkimLocal = pkim;
+  int const ier = pkim->process_dEdr(&pkimLocal, &dEidr, &rijmag,
+                                     const_cast<double**>(&pRij),
+                                     &iSim, &jSim);
+  if (ier < KIM_STATUS_OK) {
+    pkim->report_error(__LINE__, __FILE__, "process_dEdr", ier);
+  }
+  return ier;
+}
+
+//******************************************************************************
+// Sum the terms of each distinct pair and call process_dEdr once per pair,
+// such that the number of calls is the number of pairs, rather than that of
+// neighbor list entries and triplets.  The terms are merged in a fixed order,
+// so the sums do not depend on the number of threads.
+inline int ANNImplementation::ProcessPairTerms(
+    KIM_API_model* const pkim,
+    const VectorOfSizeDIM* const coordinates,
+    std::vector<PairTerm>& pairTerms) const
+{
+  int ier = KIM_STATUS_OK;
+
+  for (size_t t = 0; t < pairTerms.size(); ++t) {
+    if (pairTerms[t].j < pairTerms[t].i) std::swap(pairTerms[t].i,
+                                                   pairTerms[t].j);
+  }
+  std::stable_sort(pairTerms.begin(), pairTerms.end(),
+                   [](PairTerm const& a, PairTerm const& b) {
+                     return (a.i < b.i) || (a.i == b.i && a.j < b.j);
+                   });
+
+  for (size_t t = 0; t < pairTerms.size();) {
+    int const i = pairTerms[t].i;
+    int const j = pairTerms[t].j;
+    double dEdr = 0.0;
+    for (; t < pairTerms.size() && pairTerms[t].i == i && pairTerms[t].j == j;
+         ++t) {
+      dEdr += pairTerms[t].dEdr;
+    }
+    ier = ProcessPairTerm(pkim, coordinates, i, j, dEdr);
+    if (ier < KIM_STATUS_OK) return ier;
+  }
+
+  // everything is good
+  ier = KIM_STATUS_OK;
+  return ier;
+}
+
+//******************************************************************************
+// add the time since `lap' to `seconds' and reset `lap' to now; with a trace
+// file, the interval is also recorded as event `name'
+inline void ANNImplementation::EndStage(
+    char const* const name,
+    std::chrono::steady_clock::time_point& lap,
+    double& seconds,
+    std::vector<TraceEvent>& events) const
+{
+  std::chrono::steady_clock::time_point const start = lap;
+  double const elapsed = Lap(lap);
+  seconds += elapsed;
+  if (traceFileName_.empty() == false) {
+    double const startMicroseconds = std::chrono::duration<double, std::micro>(
+        start - traceStart_).count();
+    events.push_back(TraceEvent(name, startMicroseconds, 1e6*elapsed,
+                                ThreadIndex()));
+  }
+}
+
+//******************************************************************************
+// generalized coords of particle i (`gc' should be zeroed by the caller); the
+// pairs and triplets are added to `counts' unless it is 0
+inline void ANNImplementation::ComputeGeneralizedCoords(
+    int const i,
+    int const numNei,
+    int const* const n1Atom,
+    const int* const particleSpecies,
+    const VectorOfSizeDIM* const coordinates,
+    double* const gc,
+    StageCounts* const counts) const
+{
+  double const* const* const  constCutoffsSq2D = cutoffsSq2D_;
+  int const iSpecies = particleSpecies[i];
+
+  // Setup loop over neighbors of current particle
+  for (int jj = 0; jj < numNei; ++jj)
+  {
+    int const j = n1Atom[jj];
+    int const jSpecies = particleSpecies[j];
+    double rij[DIM];
+
+    // Compute rij
+    for (int dim = 0; dim < DIM; ++dim) {
+      rij[dim] = coordinates[j][dim] - coordinates[i][dim];
+    }
+
+    // compute distance squared
+    double const rijmag = sqrt(rij[0]*rij[0] + rij[1]*rij[1] + rij[2]*rij[2]);
+    double const rcutij = sqrt(constCutoffsSq2D[iSpecies][jSpecies]);
+
+    // if particles i and j not interact
+    if (rijmag > rcutij) continue;
+    if (counts != 0) ++counts->pairsWithinCutoff;
+
+    // two-body descriptors
+    for (size_t p=0; p<descriptor_->name.size(); p++) {
+
+      DescriptorType const type = descriptor_->type[p];
+      if (type != DESCRIPTOR_G1 &&
+          type != DESCRIPTOR_G2 &&
+          type != DESCRIPTOR_G3) {
+        continue;
+      }
+      int idx = descriptor_->starting_index[p];
+
+      for(int q=0; q<descriptor_->num_param_sets[p]; q++) {
+
+        double gcij;
+        if (type == DESCRIPTOR_G1) {
+          descriptor_->sym_g1(rijmag, rcutij, gcij);
+        }
+        else if (type == DESCRIPTOR_G2) {
+          double eta = descriptor_->params[p][q][0];
+          double Rs = descriptor_->params[p][q][1];
+          descriptor_->sym_g2(eta, Rs, rijmag, rcutij, gcij);
+        }
+        else if (type == DESCRIPTOR_G3) {
+          double kappa = descriptor_->params[p][q][0];
+          descriptor_->sym_g3(kappa, rijmag, rcutij, gcij);
+        }
+
+        gc[idx] += gcij;
+        idx += 1;
+
+      } // loop over same descriptor but different parameter set
+    } // loop over descriptors
+
+
+    // three-body descriptors
+    if (descriptor_->has_three_body == false) continue;
+
+    for (int kk = jj+1; kk < numNei; ++kk) {
+
+      int const k = n1Atom[kk];
+      int const kSpecies = particleSpecies[k];
+
+      // Compute rik, rjk and their squares
+      double rik[DIM];
+      double rjk[DIM];
+      for (int dim = 0; dim < DIM; ++dim) {
+        rik[dim] = coordinates[k][dim] - coordinates[i][dim];
+        rjk[dim] = coordinates[k][dim] - coordinates[j][dim];
+      }
+      double const rikmag = sqrt(rik[0]*rik[0] + rik[1]*rik[1] + rik[2]*rik[2]);
+      double const rjkmag = sqrt(rjk[0]*rjk[0] + rjk[1]*rjk[1] + rjk[2]*rjk[2]);
+      double const rcutik = sqrt(constCutoffsSq2D[iSpecies][kSpecies]);
+      double const rcutjk = sqrt(constCutoffsSq2D[jSpecies][kSpecies]);
+
+      double const rvec[3] = {rijmag, rikmag, rjkmag};
+      double const rcutvec[3] = {rcutij, rcutik, rcutjk};
+
+      if (rikmag > rcutik) continue; // three-dody not interacting
+      if (counts != 0) ++counts->triplets;
+
+      for (size_t p=0; p<descriptor_->name.size(); p++) {
+
+        DescriptorType const type = descriptor_->type[p];
+        if (type != DESCRIPTOR_G4 &&
+            type != DESCRIPTOR_G5) {
+          continue;
+        }
+        int idx = descriptor_->starting_index[p];
+
+        for(int q=0; q<descriptor_->num_param_sets[p]; q++) {
+
+          double gcijk;
+          if (type == DESCRIPTOR_G4) {
+            double zeta = descriptor_->params[p][q][0];
+            double lambda = descriptor_->params[p][q][1];
+            double eta = descriptor_->params[p][q][2];
+            double pre = descriptor_->prefactor[p][q];
+            descriptor_->sym_g4(zeta, lambda, eta, pre, rvec, rcutvec, gcijk);
+          }
+          else if (type == DESCRIPTOR_G5) {
+            double zeta = descriptor_->params[p][q][0];
+            double lambda = descriptor_->params[p][q][1];
+            double eta = descriptor_->params[p][q][2];
+            double pre = descriptor_->prefactor[p][q];
+            descriptor_->sym_g5(zeta, lambda, eta, pre, rvec, rcutvec, gcijk);
+          }
+
+          gc[idx] += gcijk;
+          idx += 1;
+
+        } // loop over same descriptor but different parameter set
+      }  // loop over descriptors
+    }  // loop over kk (three body neighbors)
+  }  // end of first neighbor loop
+}
+
+//******************************************************************************
+// contribution of particle i's energy to forces and virials, given the
+// derivative of its energy w.r.t. its generalized coords `dEdGc'.
+//
+// The energy of i depends on the distances to its neighbors and, through the
+// three-body descriptors, on the distances between pairs of neighbors.  The
+// derivatives w.r.t. the distances of i to its neighbors are summed over all
+// descriptors in dEdr[jj] (which is overwritten) before the pair term is
+// applied, and those w.r.t. the neighbor-neighbor distances over the
+// three-body descriptors of each triplet.  The force on i is added to `fi'
+// and the force on neighbor n1Atom[jj] to fnei[jj*DIM], ...; the virial to
+// `virial', and the particle virials of i and n1Atom[jj] to `vi' and
+// vnei[jj*6], ...
+template<bool isComputeProcess_dEdr, bool isComputeForces,
+         bool isComputeVirial, bool isComputeParticleVirial>
+inline void ANNImplementation::AccumulateForces(
+    int const i,
+    int const numNei,
+    int const* const n1Atom,
+    const int* const particleSpecies,
+    const VectorOfSizeDIM* const coordinates,
+    double const* const dEdGc,
+    double* const dEdr,
+    double* const fi,
+    double* const fnei,
+    double* const virial,
+    double* const vi,
+    double* const vnei,
+    std::vector<PairTerm>* const pairTerms) const
+{
+  double const* const* const  constCutoffsSq2D = cutoffsSq2D_;
+  int const iSpecies = particleSpecies[i];
+
+  for (int jj = 0; jj < numNei; ++jj) {
+    dEdr[jj] = 0.0;
+  }
+
+  // Setup loop over neighbors of current particle
+  for (int jj = 0; jj < numNei; ++jj)
+  {
+    int const j = n1Atom[jj];
+    int const jSpecies = particleSpecies[j];
+    double rij[DIM];
+
+    // Compute rij
+    for (int dim = 0; dim < DIM; ++dim) {
+      rij[dim] = coordinates[j][dim] - coordinates[i][dim];
+    }
+
+    // compute distance squared
+    double const rijmag = sqrt(rij[0]*rij[0] + rij[1]*rij[1] + rij[2]*rij[2]);
+    double const rcutij = sqrt(constCutoffsSq2D[iSpecies][jSpecies]);
+
+    // if particles i and j not interact
+    if (rijmag > rcutij) continue;
+
+    // two-body descriptors
+    for (size_t p=0; p<descriptor_->name.size(); p++) {
+
+      DescriptorType const type = descriptor_->type[p];
+      if (type != DESCRIPTOR_G1 &&
+          type != DESCRIPTOR_G2 &&
+          type != DESCRIPTOR_G3) {
+        continue;
+      }
+      int idx = descriptor_->starting_index[p];
+
+      for(int q=0; q<descriptor_->num_param_sets[p]; q++) {
+
+        double gcij;
+        double dgcdr_two;
+        if (type == DESCRIPTOR_G1) {
+          descriptor_->sym_d_g1(rijmag, rcutij, gcij, dgcdr_two);
+        }
+        else if (type == DESCRIPTOR_G2) {
+          double eta = descriptor_->params[p][q][0];
+          double Rs = descriptor_->params[p][q][1];
+          descriptor_->sym_d_g2(eta, Rs, rijmag, rcutij, gcij, dgcdr_two);
+        }
+        else if (type == DESCRIPTOR_G3) {
+          double kappa = descriptor_->params[p][q][0];
+          descriptor_->sym_d_g3(kappa, rijmag, rcutij, gcij, dgcdr_two);
+        }
+
+        dEdr[jj] += dEdGc[idx]*dgcdr_two;
+        idx += 1;
+
+      } // loop over same descriptor but different parameter set
+    } // loop over descriptors
+
+
+    // three-body descriptors
+    if (descriptor_->has_three_body == true) {
+
+      for (int kk = jj+1; kk < numNei; ++kk) {
+
+        int const k = n1Atom[kk];
+        int const kSpecies = particleSpecies[k];
+
+        // Compute rik, rjk and their squares
+        double rik[DIM];
+        double rjk[DIM];
         for (int dim = 0; dim < DIM; ++dim) {
           rik[dim] = coordinates[k][dim] - coordinates[i][dim];
           rjk[dim] = coordinates[k][dim] - coordinates[j][dim];
@@ -436,242 +2265,810 @@ int ANNImplementation::Compute(
 
         if (rikmag > rcutik) continue; // three-dody not interacting
 
+        double dEdrjk = 0.0;
         for (size_t p=0; p<descriptor_->name.size(); p++) {
 
-          if (descriptor_->name[p] != "g4" &&
-              descriptor_->name[p] != "g5") {
+          DescriptorType const type = descriptor_->type[p];
+          if (type != DESCRIPTOR_G4 &&
+              type != DESCRIPTOR_G5) {
             continue;
           }
           int idx = descriptor_->starting_index[p];
 
           for(int q=0; q<descriptor_->num_param_sets[p]; q++) {
 
-            double gc;
-            if (descriptor_->name[p] == "g4") {
+            double gcijk;
+            double dgcdr_three[3];
+            if (type == DESCRIPTOR_G4) {
               double zeta = descriptor_->params[p][q][0];
               double lambda = descriptor_->params[p][q][1];
               double eta = descriptor_->params[p][q][2];
-              descriptor_->sym_g4(zeta, lambda, eta, rvec, rcutvec, gc);
+              double pre = descriptor_->prefactor[p][q];
+              descriptor_->sym_d_g4(zeta, lambda, eta, pre, rvec, rcutvec,
+                  gcijk, dgcdr_three);
             }
-            else if (descriptor_->name[p] == "g5") {
+            else if (type == DESCRIPTOR_G5) {
               double zeta = descriptor_->params[p][q][0];
               double lambda = descriptor_->params[p][q][1];
               double eta = descriptor_->params[p][q][2];
-              descriptor_->sym_g5(zeta, lambda, eta, rvec, rcutvec, gc);
+              double pre = descriptor_->prefactor[p][q];
+              descriptor_->sym_d_g5(zeta, lambda, eta, pre, rvec, rcutvec,
+                  gcijk, dgcdr_three);
             }
 
-            generalizedCoords[i][idx] += gc;
+            dEdr[jj] += dEdGc[idx]*dgcdr_three[0];
+            dEdr[kk] += dEdGc[idx]*dgcdr_three[1];
+            dEdrjk += dEdGc[idx]*dgcdr_three[2];
             idx += 1;
 
           } // loop over same descriptor but different parameter set
         }  // loop over descriptors
+
+        // pair term of neighbors j and k
+        AccumulatePairTerm<isComputeForces, isComputeVirial,
+                           isComputeParticleVirial>(
+            dEdrjk, rjkmag, rjk, &fnei[jj*DIM], &fnei[kk*DIM], virial,
+            &vnei[jj*6], &vnei[kk*6]);
+        if (isComputeProcess_dEdr == true && dEdrjk != 0.0) {
+          pairTerms->push_back(PairTerm(j, k, dEdrjk));
+        }
       }  // loop over kk (three body neighbors)
-    }  // end of first neighbor loop
-  }  // end of loop over contributing particles
+    }
 
+    // pair term of i and j; all contributions to dEdr[jj] are in, since
+    // those from triplets (jj', jj) with jj' < jj were added before
+    AccumulatePairTerm<isComputeForces, isComputeVirial,
+                       isComputeParticleVirial>(
+        dEdr[jj], rijmag, rij, fi, &fnei[jj*DIM], virial, vi, &vnei[jj*6]);
+  }  // loop over first neighbor
+}
 
-  // centering and normalization
-  if (descriptor_->center_and_normalize) {
-    for (int i=0; i<Ncontrib; i++) {
-      for (int j=0; j<Ndescriptors; j++) {
-        generalizedCoords[i][j] = (generalizedCoords[i][j] -
-            descriptor_->features_mean[j]) / descriptor_->features_std[j];
+//******************************************************************************
+// Call process_d2Edr2 for each ordered pair of distances that the energy of a
+// contributing particle depends on.  This is a pass of its own after the
+// dispatched Compute (the template flag isComputeProcess_d2Edr2 is always
+// false), and all calls are made from the calling thread.
+template<class Iter>
+int ANNImplementation::ProcessSecondDerivatives(
+    KIM_API_model* const pkim,
+    ComputeContext& context,
+    const int* const particleSpecies,
+    typename Iter::Neighbors const& neighbors,
+    const VectorOfSizeDIM* const coordinates) const
+{
+  int ier = KIM_STATUS_OK;
+  int const Ncontrib = context.numberContributingParticles;
+  int const Ndescriptors = descriptor_->get_num_descriptors();
+  int const chunkSize = (chunkSize_ > 0 && chunkSize_ < Ncontrib) ?
+      chunkSize_ : Ncontrib;
+  if (chunkSize == 0) return ier;
+
+  ChunkBuffer& chunk = context.chunks[0];
+  chunk.resize(chunkSize, Ndescriptors);
+
+  // The Hessian of the energy of a particle w.r.t. its generalized coords is
+  // obtained by evaluating the network on Ndescriptors copies of them, with
+  // the unit vectors as directions of backward_tangent.
+  NetworkWorkspace ws;
+  RowMatrixXd const directions
+      = RowMatrixXd::Identity(Ndescriptors, Ndescriptors);
+  RowMatrixXd gcCopies(Ndescriptors, Ndescriptors);
+
+  for (int first = 0; first < Ncontrib; first += chunkSize)
+  {
+    int const last = std::min(first + chunkSize, Ncontrib);
+    DescriptorStage<Iter>(neighbors, first, last, particleSpecies,
+                          coordinates, context.costModel, chunk);
+    NetworkStage<true>(context.network, chunk);
+
+    for (int c = 0; c < chunk.numberParticles; ++c) {
+      for (int a = 0; a < Ndescriptors; ++a) {
+        std::copy(chunk.generalizedCoords[c],
+                  chunk.generalizedCoords[c] + Ndescriptors, &gcCopies(a, 0));
       }
+      network_->forward(gcCopies.data(), Ndescriptors, Ndescriptors, ws);
+      network_->backward_tangent(directions.data(), ws);
+
+      ier = ProcessParticleSecondDerivatives(
+          pkim, chunk.particle[c], chunk.numNei[c],
+          &chunk.neighList[chunk.neighStart[c]], particleSpecies, coordinates,
+          chunk.dEdGeneralizedCoords[c], ws.get_grad_input_tangent());
+      if (ier < KIM_STATUS_OK) return ier;
     }
   }
 
+  return ier;
+}
 
-  // NN feedforward
-  network_->forward(generalizedCoords[0], Ncontrib, Ndescriptors);
-  // NN backpropagation to compute derivative of energy w.r.t generalized coords
-  network_->backward();
+//******************************************************************************
+// second derivatives of the energy of particle i w.r.t. the distances it
+// depends on, given the first (`dEdGc') and second (`d2EdGc2', row major)
+// derivatives of its energy w.r.t. its generalized coords.
+//
+// d2E/dr_m dr_n = sum_ab d2E/dGc_a dGc_b dGc_a/dr_m dGc_b/dr_n
+//                 + sum_a dE/dGc_a d2Gc_a/dr_m dr_n
+//
+// where the distances r_m are those of i and each neighbor, and of the two
+// neighbors of each interacting triplet.
+inline int ANNImplementation::ProcessParticleSecondDerivatives(
+    KIM_API_model* const pkim,
+    int const i,
+    int const numNei,
+    int const* const n1Atom,
+    const int* const particleSpecies,
+    const VectorOfSizeDIM* const coordinates,
+    double const* const dEdGc,
+    double const* const d2EdGc2) const
+{
+  double const* const* const  constCutoffsSq2D = cutoffsSq2D_;
+  int const iSpecies = particleSpecies[i];
+  int const Ndescriptors = descriptor_->get_num_descriptors();
+
+  // end points of each distance: distance jj is that of i and neighbor jj,
+  // and distance tripletIndex[jj*numNei+kk] that of neighbors jj and kk
+  std::vector<int> partA(numNei, i);
+  std::vector<int> partB(n1Atom, n1Atom + numNei);
+  std::vector<int> tripletIndex;
+  if (descriptor_->has_three_body == true) {
+    tripletIndex.assign(numNei*numNei, -1);
+    for (int jj = 0; jj < numNei; ++jj) {
+      int const j = n1Atom[jj];
+      double rijsq = 0.0;
+      for (int dim = 0; dim < DIM; ++dim) {
+        double const d = coordinates[j][dim] - coordinates[i][dim];
+        rijsq += d*d;
+      }
+      if (rijsq > constCutoffsSq2D[iSpecies][particleSpecies[j]]) continue;
 
-  // get access to derivatives of energy w.r.t generalized coords
-  double** dEdGeneralizedCoords;
-  int extentZero = Ncontrib;
-  int extentOne = Ndescriptors;
-  dEdGeneralizedCoords = new double*[extentZero];
-  dEdGeneralizedCoords[0] = network_->get_grad_input();
-  for (int i = 1; i < extentZero; ++i) {
-    dEdGeneralizedCoords[i] = dEdGeneralizedCoords[i-1] + extentOne;
+      for (int kk = jj+1; kk < numNei; ++kk) {
+        int const k = n1Atom[kk];
+        double riksq = 0.0;
+        for (int dim = 0; dim < DIM; ++dim) {
+          double const d = coordinates[k][dim] - coordinates[i][dim];
+          riksq += d*d;
+        }
+        if (riksq > constCutoffsSq2D[iSpecies][particleSpecies[k]]) continue;
+
+        tripletIndex[jj*numNei + kk] = partA.size();
+        partA.push_back(j);
+        partB.push_back(k);
+      }
+    }
   }
+  int const Ndist = partA.size();
 
+  // derivatives of the generalized coords w.r.t. the distances, and the
+  // second term of d2E/dr_m dr_n
+  RowMatrixXd dGcdr = RowMatrixXd::Zero(Ndescriptors, Ndist);
+  RowMatrixXd d2Edr2 = RowMatrixXd::Zero(Ndist, Ndist);
 
-  // Contribution to energy
-  if (isComputeEnergy == true) {
-    *energy = network_->get_sum_output();
+  // Setup loop over neighbors of current particle
+  for (int jj = 0; jj < numNei; ++jj)
+  {
+    int const j = n1Atom[jj];
+    int const jSpecies = particleSpecies[j];
+    double rij[DIM];
+
+    // Compute rij
+    for (int dim = 0; dim < DIM; ++dim) {
+      rij[dim] = coordinates[j][dim] - coordinates[i][dim];
+    }
+
+    // compute distance squared
+    double const rijmag = sqrt(rij[0]*rij[0] + rij[1]*rij[1] + rij[2]*rij[2]);
+    double const rcutij = sqrt(constCutoffsSq2D[iSpecies][jSpecies]);
+
+    // if particles i and j not interact
+    if (rijmag > rcutij) continue;
+
+    // two-body descriptors
+    for (size_t p=0; p<descriptor_->name.size(); p++) {
+
+      DescriptorType const type = descriptor_->type[p];
+      if (type != DESCRIPTOR_G1 &&
+          type != DESCRIPTOR_G2 &&
+          type != DESCRIPTOR_G3) {
+        continue;
+      }
+      int idx = descriptor_->starting_index[p];
+
+      for(int q=0; q<descriptor_->num_param_sets[p]; q++) {
+
+        double gcij;
+        double dgcdr_two;
+        double d2gcdr_two;
+        if (type == DESCRIPTOR_G1) {
+          descriptor_->sym_d2_g1(rijmag, rcutij, gcij, dgcdr_two, d2gcdr_two);
+        }
+        else if (type == DESCRIPTOR_G2) {
+          double eta = descriptor_->params[p][q][0];
+          double Rs = descriptor_->params[p][q][1];
+          descriptor_->sym_d2_g2(eta, Rs, rijmag, rcutij, gcij, dgcdr_two,
+              d2gcdr_two);
+        }
+        else if (type == DESCRIPTOR_G3) {
+          double kappa = descriptor_->params[p][q][0];
+          descriptor_->sym_d2_g3(kappa, rijmag, rcutij, gcij, dgcdr_two,
+              d2gcdr_two);
+        }
+
+        dGcdr(idx, jj) += dgcdr_two;
+        d2Edr2(jj, jj) += dEdGc[idx]*d2gcdr_two;
+        idx += 1;
+
+      } // loop over same descriptor but different parameter set
+    } // loop over descriptors
+
+
+    // three-body descriptors
+    if (descriptor_->has_three_body == false) continue;
+
+    for (int kk = jj+1; kk < numNei; ++kk) {
+
+      int const t = tripletIndex[jj*numNei + kk];
+      if (t < 0) continue; // three-dody not interacting
+
+      int const k = n1Atom[kk];
+      int const kSpecies = particleSpecies[k];
+
+      // Compute rik, rjk and their squares
+      double rik[DIM];
+      double rjk[DIM];
+      for (int dim = 0; dim < DIM; ++dim) {
+        rik[dim] = coordinates[k][dim] - coordinates[i][dim];
+        rjk[dim] = coordinates[k][dim] - coordinates[j][dim];
+      }
+      double const rikmag = sqrt(rik[0]*rik[0] + rik[1]*rik[1] + rik[2]*rik[2]);
+      double const rjkmag = sqrt(rjk[0]*rjk[0] + rjk[1]*rjk[1] + rjk[2]*rjk[2]);
+      double const rcutik = sqrt(constCutoffsSq2D[iSpecies][kSpecies]);
+      double const rcutjk = sqrt(constCutoffsSq2D[jSpecies][kSpecies]);
+
+      double const rvec[3] = {rijmag, rikmag, rjkmag};
+      double const rcutvec[3] = {rcutij, rcutik, rcutjk};
+      int const column[3] = {jj, kk, t};
+
+      for (size_t p=0; p<descriptor_->name.size(); p++) {
+
+        DescriptorType const type = descriptor_->type[p];
+        if (type != DESCRIPTOR_G4 &&
+            type != DESCRIPTOR_G5) {
+          continue;
+        }
+        int idx = descriptor_->starting_index[p];
+
+        for(int q=0; q<descriptor_->num_param_sets[p]; q++) {
+
+          double gcijk;
+          double dgcdr_three[3];
+          double d2gcdr_three[9];
+          double zeta = descriptor_->params[p][q][0];
+          double lambda = descriptor_->params[p][q][1];
+          double eta = descriptor_->params[p][q][2];
+          double pre = descriptor_->prefactor[p][q];
+          if (type == DESCRIPTOR_G4) {
+            descriptor_->sym_d2_g4(zeta, lambda, eta, pre, rvec, rcutvec,
+                gcijk, dgcdr_three, d2gcdr_three);
+          }
+          else {
+            descriptor_->sym_d2_g5(zeta, lambda, eta, pre, rvec, rcutvec,
+                gcijk, dgcdr_three, d2gcdr_three);
+          }
+
+          for (int a = 0; a < 3; ++a) {
+            dGcdr(idx, column[a]) += dgcdr_three[a];
+            for (int b = 0; b < 3; ++b) {
+              d2Edr2(column[a], column[b]) += dEdGc[idx]*d2gcdr_three[a*3+b];
+            }
+          }
+          idx += 1;
+
+        } // loop over same descriptor but different parameter set
+      }  // loop over descriptors
+    }  // loop over kk (three body neighbors)
+  }  // end of first neighbor loop
+
+  // first term, through the network
+  Map<const RowMatrixXd> hessian(d2EdGc2, Ndescriptors, Ndescriptors);
+  d2Edr2.noalias() += dGcdr.transpose() * hessian * dGcdr;
+
+  // one call per ordered pair of distances
+  std::vector<double> rmag(Ndist);
+  std::vector<double> rvec(Ndist*DIM);
+  for (int m = 0; m < Ndist; ++m) {
+    for (int dim = 0; dim < DIM; ++dim) {
+      rvec[m*DIM + dim] = coordinates[partB[m]][dim]
+          - coordinates[partA[m]][dim];
+    }
+    double const* const r = &rvec[m*DIM];
+    rmag[m] = sqrt(r[0]*r[0] + r[1]*r[1] + r[2]*r[2]);
   }
 
-  // Contribution to particle energy
-  if (isComputeParticleEnergy == true) {
-    double* Epart;
-    Epart = network_->get_output();
-    for (int i=0; i<Ncontrib; i++) {
-      particleEnergy[i] = Epart[i];
+  for (int m = 0; m < Ndist; ++m) {
+    for (int n = 0; n < Ndist; ++n) {
+      double d2Eidr2 = d2Edr2(m, n);
+      if (d2Eidr2 == 0.0) continue;  // e.g. beyond the cutoff
+
+      double R_pairs[2] = {rmag[m], rmag[n]};
+      double Rij_pairs[2][DIM];
+      for (int dim = 0; dim < DIM; ++dim) {
+        Rij_pairs[0][dim] = rvec[m*DIM + dim];
+        Rij_pairs[1][dim] = rvec[n*DIM + dim];
+      }
+      int i_pairs[2] = {partA[m] - baseconvert_, partA[n] - baseconvert_};
+      int j_pairs[2] = {partB[m] - baseconvert_, partB[n] - baseconvert_};
+      double* const pRs = &R_pairs[0];
+      double* const pRijs = &Rij_pairs[0][0];
+      int* const pis = &i_pairs[0];
+      int* const pjs = &j_pairs[0];
+
+      KIM_API_model* pkimLocal = pkim;
+      int const ier = pkim->process_d2Edr2(&pkimLocal, &d2Eidr2,
+                                           const_cast<double**>(&pRs),
+                                           const_cast<double**>(&pRijs),
+                                           const_cast<int**>(&pis),
+                                           const_cast<int**>(&pjs));
+      if (ier < KIM_STATUS_OK) {
+        pkim->report_error(__LINE__, __FILE__, "process_d2Edr2", ier);
+        return ier;
+      }
     }
   }
 
+  return KIM_STATUS_OK;
+}
 
-  // Compute derivative of energy w.r.t coords
-  if ((isComputeProcess_dEdr == true) || (isComputeForces == true))
+//******************************************************************************
+// hv = H v for the contributing particles, by forward-over-reverse
+// differentiation: the derivatives in direction v of the generalized coords
+// are pushed through backward_tangent of the network, and the derivative of
+// each pair term of the force pass is accumulated.  This costs about as much
+// as two force evaluations.
+template<class Iter>
+int ANNImplementation::HessianVectorProduct(
+    ComputeContext& context,
+    const int* const particleSpecies,
+    typename Iter::Neighbors const& neighbors,
+    const VectorOfSizeDIM* const coordinates,
+    const VectorOfSizeDIM* const v,
+    VectorOfSizeDIM* const hv) const
+{
+  int const Nparticles = context.numberOfParticles;
+  int const Ncontrib = context.numberContributingParticles;
+
+  for (int i = 0; i < Nparticles; ++i) {
+    for (int j = 0; j < DIM; ++j)
+      hv[i][j] = 0.0;
+  }
+
+  int const Ndescriptors = descriptor_->get_num_descriptors();
+  int const chunkSize = (chunkSize_ > 0 && chunkSize_ < Ncontrib) ?
+      chunkSize_ : Ncontrib;
+  if (chunkSize == 0) return KIM_STATUS_OK;
+
+  ChunkBuffer& chunk = context.chunks[0];
+  chunk.resize(chunkSize, Ndescriptors);
+
+  for (int first = 0; first < Ncontrib; first += chunkSize)
+  {
+    int const last = std::min(first + chunkSize, Ncontrib);
+    DescriptorStage<Iter>(neighbors, first, last, particleSpecies,
+                          coordinates, context.costModel, chunk);
+
+    int const Nchunk = chunk.numberParticles;
+    int const Nparts = chunk.bounds.size() - 1;
+    size_t const Nneigh = chunk.neighList.size();
+    chunk.generalizedCoordsTangent.assign(Nchunk*Ndescriptors, 0.0);
+    chunk.dEdGeneralizedCoordsTangent.resize(Nchunk*Ndescriptors);
+    chunk.dEdr.resize(Nneigh);
+    chunk.dEdrTangent.resize(Nneigh);
+    // selfForce and neighForce hold the contributions to hv
+    chunk.neighForce.assign(Nneigh*DIM, 0.0);
+    std::fill(chunk.selfForce.begin(), chunk.selfForce.end(), 0.0);
+
+    // derivative of generalized coords in direction v
+    std::function<void(int)> const tangentTask = [&](int const part) {
+      for (int c = chunk.bounds[part]; c < chunk.bounds[part+1]; ++c) {
+        ComputeGeneralizedCoordsTangent(
+            chunk.particle[c], chunk.numNei[c],
+            &chunk.neighList[chunk.neighStart[c]], particleSpecies,
+            coordinates, v, &chunk.generalizedCoordsTangent[c*Ndescriptors]);
+      }
+    };
+    if (threadPool_ != 0) {
+      threadPool_->run(Nparts, tangentTask);
+    }
+    else {
+      tangentTask(0);
+    }
+
+    // derivative of energy w.r.t generalized coords, and its derivative in
+    // direction v
+    network_->forward(chunk.generalizedCoords[0], Nchunk, Ndescriptors,
+                      context.network);
+    network_->backward_tangent(&chunk.generalizedCoordsTangent[0],
+                               context.network);
+    double const* const dEdGc = context.network.get_grad_input();
+    double const* const ddEdGc = context.network.get_grad_input_tangent();
+    std::copy(dEdGc, dEdGc + Nchunk*Ndescriptors,
+              chunk.dEdGeneralizedCoords[0]);
+    std::copy(ddEdGc, ddEdGc + Nchunk*Ndescriptors,
+              chunk.dEdGeneralizedCoordsTangent.begin());
+
+    std::function<void(int)> const productTask = [&](int const part) {
+      for (int c = chunk.bounds[part]; c < chunk.bounds[part+1]; ++c) {
+        int const start = chunk.neighStart[c];
+        AccumulateHessianVectorProduct(
+            chunk.particle[c], chunk.numNei[c], &chunk.neighList[start],
+            particleSpecies, coordinates, v, chunk.dEdGeneralizedCoords[c],
+            &chunk.dEdGeneralizedCoordsTangent[c*Ndescriptors],
+            &chunk.dEdr[start], &chunk.dEdrTangent[start],
+            &chunk.selfForce[c*DIM], &chunk.neighForce[start*DIM]);
+      }
+    };
+    if (threadPool_ != 0) {
+      threadPool_->run(Nparts, productTask);
+    }
+    else {
+      productTask(0);
+    }
+
+    // scatter to hv
+    for (int c = 0; c < Nchunk; ++c) {
+      int const i = chunk.particle[c];
+      for (int kdim = 0; kdim < DIM; ++kdim) {
+        hv[i][kdim] += chunk.selfForce[c*DIM + kdim];
+      }
+    }
+    for (size_t s = 0; s < Nneigh; ++s) {
+      int const j = chunk.neighList[s];
+      for (int kdim = 0; kdim < DIM; ++kdim) {
+        hv[j][kdim] += chunk.neighForce[s*DIM + kdim];
+      }
+    }
+  }
+
+  return KIM_STATUS_OK;
+}
+
+//******************************************************************************
+// derivative of the generalized coords of particle i in direction v (`dgc'
+// should be zeroed by the caller)
+inline void ANNImplementation::ComputeGeneralizedCoordsTangent(
+    int const i,
+    int const numNei,
+    int const* const n1Atom,
+    const int* const particleSpecies,
+    const VectorOfSizeDIM* const coordinates,
+    const VectorOfSizeDIM* const v,
+    double* const dgc) const
+{
+  double const* const* const  constCutoffsSq2D = cutoffsSq2D_;
+  int const iSpecies = particleSpecies[i];
+
+  // Setup loop over neighbors of current particle
+  for (int jj = 0; jj < numNei; ++jj)
   {
+    int const j = n1Atom[jj];
+    int const jSpecies = particleSpecies[j];
+    double rij[DIM];
 
-    for (Iter iterator(pkim, get_neigh, baseConvert, Ncontrib, &ii, &numnei,
-                     &n1atom, &pRij);
-        iterator.done() == false;
-        iterator.next(&ii, &numnei, &n1atom, &pRij))
-    {
-      int const numNei = numnei;
-      int const * const n1Atom = n1atom;
-      int const i = ii;
-      int const iSpecies = particleSpecies[i];
-
-      // Setup loop over neighbors of current particle
-      for (int jj = 0; jj < numNei; ++jj)
-      {
-        // adjust index of particle neighbor
-        int const j = n1Atom[jj] + baseConvert;
-        int const jSpecies = particleSpecies[j];
-        double rij[DIM];
-
-        // Compute rij
-        for (int dim = 0; dim < DIM; ++dim) {
-          rij[dim] = coordinates[j][dim] - coordinates[i][dim];
+    // Compute rij
+    for (int dim = 0; dim < DIM; ++dim) {
+      rij[dim] = coordinates[j][dim] - coordinates[i][dim];
+    }
+
+    // compute distance squared
+    double const rijmag = sqrt(rij[0]*rij[0] + rij[1]*rij[1] + rij[2]*rij[2]);
+    double const rcutij = sqrt(constCutoffsSq2D[iSpecies][jSpecies]);
+
+    // if particles i and j not interact
+    if (rijmag > rcutij) continue;
+
+    // derivative of rijmag in direction v
+    double drij = 0.0;
+    for (int dim = 0; dim < DIM; ++dim) {
+      drij += rij[dim]*(v[j][dim] - v[i][dim]);
+    }
+    drij /= rijmag;
+
+    // two-body descriptors
+    for (size_t p=0; p<descriptor_->name.size(); p++) {
+
+      DescriptorType const type = descriptor_->type[p];
+      if (type != DESCRIPTOR_G1 &&
+          type != DESCRIPTOR_G2 &&
+          type != DESCRIPTOR_G3) {
+        continue;
+      }
+      int idx = descriptor_->starting_index[p];
+
+      for(int q=0; q<descriptor_->num_param_sets[p]; q++) {
+
+        double gcij;
+        double dgcdr_two;
+        if (type == DESCRIPTOR_G1) {
+          descriptor_->sym_d_g1(rijmag, rcutij, gcij, dgcdr_two);
+        }
+        else if (type == DESCRIPTOR_G2) {
+          double eta = descriptor_->params[p][q][0];
+          double Rs = descriptor_->params[p][q][1];
+          descriptor_->sym_d_g2(eta, Rs, rijmag, rcutij, gcij, dgcdr_two);
+        }
+        else if (type == DESCRIPTOR_G3) {
+          double kappa = descriptor_->params[p][q][0];
+          descriptor_->sym_d_g3(kappa, rijmag, rcutij, gcij, dgcdr_two);
         }
 
-        // compute distance squared
-        double const rijmag = sqrt(rij[0]*rij[0] + rij[1]*rij[1] + rij[2]*rij[2]);
-        double const rcutij = sqrt(constCutoffsSq2D[iSpecies][jSpecies]);
+        dgc[idx] += dgcdr_two*drij;
+        idx += 1;
 
-        // if particles i and j not interact
-        if (rijmag > rcutij) continue;
+      } // loop over same descriptor but different parameter set
+    } // loop over descriptors
 
-        // two-body descriptors
-        for (size_t p=0; p<descriptor_->name.size(); p++) {
 
-          if (descriptor_->name[p] != "g1" &&
-              descriptor_->name[p] != "g2" &&
-              descriptor_->name[p] != "g3") {
-            continue;
+    // three-body descriptors
+    if (descriptor_->has_three_body == false) continue;
+
+    for (int kk = jj+1; kk < numNei; ++kk) {
+
+      int const k = n1Atom[kk];
+      int const kSpecies = particleSpecies[k];
+
+      // Compute rik, rjk and their squares
+      double rik[DIM];
+      double rjk[DIM];
+      for (int dim = 0; dim < DIM; ++dim) {
+        rik[dim] = coordinates[k][dim] - coordinates[i][dim];
+        rjk[dim] = coordinates[k][dim] - coordinates[j][dim];
+      }
+      double const rikmag = sqrt(rik[0]*rik[0] + rik[1]*rik[1] + rik[2]*rik[2]);
+      double const rjkmag = sqrt(rjk[0]*rjk[0] + rjk[1]*rjk[1] + rjk[2]*rjk[2]);
+      double const rcutik = sqrt(constCutoffsSq2D[iSpecies][kSpecies]);
+      double const rcutjk = sqrt(constCutoffsSq2D[jSpecies][kSpecies]);
+
+      double const rvec[3] = {rijmag, rikmag, rjkmag};
+      double const rcutvec[3] = {rcutij, rcutik, rcutjk};
+
+      if (rikmag > rcutik) continue; // three-dody not interacting
+
+      // derivatives of rikmag and rjkmag in direction v
+      double drik = 0.0;
+      double drjk = 0.0;
+      for (int dim = 0; dim < DIM; ++dim) {
+        drik += rik[dim]*(v[k][dim] - v[i][dim]);
+        drjk += rjk[dim]*(v[k][dim] - v[j][dim]);
+      }
+      drik /= rikmag;
+      drjk /= rjkmag;
+
+      for (size_t p=0; p<descriptor_->name.size(); p++) {
+
+        DescriptorType const type = descriptor_->type[p];
+        if (type != DESCRIPTOR_G4 &&
+            type != DESCRIPTOR_G5) {
+          continue;
+        }
+        int idx = descriptor_->starting_index[p];
+
+        for(int q=0; q<descriptor_->num_param_sets[p]; q++) {
+
+          double gcijk;
+          double dgcdr_three[3];
+          double zeta = descriptor_->params[p][q][0];
+          double lambda = descriptor_->params[p][q][1];
+          double eta = descriptor_->params[p][q][2];
+          double pre = descriptor_->prefactor[p][q];
+          if (type == DESCRIPTOR_G4) {
+            descriptor_->sym_d_g4(zeta, lambda, eta, pre, rvec, rcutvec,
+                gcijk, dgcdr_three);
+          }
+          else {
+            descriptor_->sym_d_g5(zeta, lambda, eta, pre, rvec, rcutvec,
+                gcijk, dgcdr_three);
           }
-          int idx = descriptor_->starting_index[p];
 
-          for(int q=0; q<descriptor_->num_param_sets[p]; q++) {
+          dgc[idx] += dgcdr_three[0]*drij + dgcdr_three[1]*drik
+              + dgcdr_three[2]*drjk;
+          idx += 1;
 
-            double gc;
-            double dgcdr_two;
-            if (descriptor_->name[p] == "g1") {
-              descriptor_->sym_d_g1(rijmag, rcutij, gc, dgcdr_two);
-            }
-            else if (descriptor_->name[p] == "g2") {
-              double eta = descriptor_->params[p][q][0];
-              double Rs = descriptor_->params[p][q][1];
-              descriptor_->sym_d_g2(eta, Rs, rijmag, rcutij, gc, dgcdr_two);
-            }
-            else if (descriptor_->name[p] == "g3") {
-              double kappa = descriptor_->params[p][q][0];
-              descriptor_->sym_d_g3(kappa, rijmag, rcutij, gc, dgcdr_two);
-            }
+        } // loop over same descriptor but different parameter set
+      }  // loop over descriptors
+    }  // loop over kk (three body neighbors)
+  }  // end of first neighbor loop
+}
 
-            // centering and normalization
-            if (descriptor_->center_and_normalize) {
-              dgcdr_two /= descriptor_->features_std[idx];
-            }
+//******************************************************************************
+// contribution of particle i's energy to hv = H v, given the derivative of its
+// energy w.r.t. its generalized coords `dEdGc' and the derivative of that in
+// direction v `ddEdGc'.
+//
+// Follows AccumulateForces: dEdr[jj] and its derivative in direction v
+// ddEdr[jj] (both overwritten) are summed over all descriptors before the
+// pair term of i and neighbor jj is differentiated.  The contribution to hv
+// of i is added to `hvi', and that of neighbor n1Atom[jj] to hvnei[jj*DIM],
+// ...
+inline void ANNImplementation::AccumulateHessianVectorProduct(
+    int const i,
+    int const numNei,
+    int const* const n1Atom,
+    const int* const particleSpecies,
+    const VectorOfSizeDIM* const coordinates,
+    const VectorOfSizeDIM* const v,
+    double const* const dEdGc,
+    double const* const ddEdGc,
+    double* const dEdr,
+    double* const ddEdr,
+    double* const hvi,
+    double* const hvnei) const
+{
+  double const* const* const  constCutoffsSq2D = cutoffsSq2D_;
+  int const iSpecies = particleSpecies[i];
 
-            for (int kdim = 0; kdim < DIM; ++kdim) {
-              double phi = dEdGeneralizedCoords[i][idx]*dgcdr_two*rij[kdim]/rijmag;
-              forces[i][kdim] += phi;
-              forces[j][kdim] -= phi;
-            }
-            idx += 1;
+  for (int jj = 0; jj < numNei; ++jj) {
+    dEdr[jj] = 0.0;
+    ddEdr[jj] = 0.0;
+  }
 
-          } // loop over same descriptor but different parameter set
-        } // loop over descriptors
+  // Setup loop over neighbors of current particle
+  for (int jj = 0; jj < numNei; ++jj)
+  {
+    int const j = n1Atom[jj];
+    int const jSpecies = particleSpecies[j];
+    double rij[DIM];
 
+    // Compute rij
+    for (int dim = 0; dim < DIM; ++dim) {
+      rij[dim] = coordinates[j][dim] - coordinates[i][dim];
+    }
 
-        // three-body descriptors
-        if (descriptor_->has_three_body == false) continue;
+    // compute distance squared
+    double const rijmag = sqrt(rij[0]*rij[0] + rij[1]*rij[1] + rij[2]*rij[2]);
+    double const rcutij = sqrt(constCutoffsSq2D[iSpecies][jSpecies]);
 
-        for (int kk = jj+1; kk < numNei; ++kk) {
+    // if particles i and j not interact
+    if (rijmag > rcutij) continue;
 
-          // adjust index of particle neighbor
-          int const k = n1Atom[kk] + baseConvert;
-          int const kSpecies = particleSpecies[k];
+    // derivative of rijmag in direction v
+    double drij = 0.0;
+    for (int dim = 0; dim < DIM; ++dim) {
+      drij += rij[dim]*(v[j][dim] - v[i][dim]);
+    }
+    drij /= rijmag;
 
-          // Compute rik, rjk and their squares
-          double rik[DIM];
-          double rjk[DIM];
-          for (int dim = 0; dim < DIM; ++dim) {
-            rik[dim] = coordinates[k][dim] - coordinates[i][dim];
-            rjk[dim] = coordinates[k][dim] - coordinates[j][dim];
-          }
-          double const rikmag = sqrt(rik[0]*rik[0] + rik[1]*rik[1] + rik[2]*rik[2]);
-          double const rjkmag = sqrt(rjk[0]*rjk[0] + rjk[1]*rjk[1] + rjk[2]*rjk[2]);
-          double const rcutik = sqrt(constCutoffsSq2D[iSpecies][kSpecies]);
-          double const rcutjk = sqrt(constCutoffsSq2D[jSpecies][kSpecies]);
+    // two-body descriptors
+    for (size_t p=0; p<descriptor_->name.size(); p++) {
 
-          double const rvec[3] = {rijmag, rikmag, rjkmag};
-          double const rcutvec[3] = {rcutij, rcutik, rcutjk};
+      DescriptorType const type = descriptor_->type[p];
+      if (type != DESCRIPTOR_G1 &&
+          type != DESCRIPTOR_G2 &&
+          type != DESCRIPTOR_G3) {
+        continue;
+      }
+      int idx = descriptor_->starting_index[p];
 
-          if (rikmag > rcutik) continue; // three-dody not interacting
+      for(int q=0; q<descriptor_->num_param_sets[p]; q++) {
 
-          for (size_t p=0; p<descriptor_->name.size(); p++) {
+        double gcij;
+        double dgcdr_two;
+        double d2gcdr_two;
+        if (type == DESCRIPTOR_G1) {
+          descriptor_->sym_d2_g1(rijmag, rcutij, gcij, dgcdr_two, d2gcdr_two);
+        }
+        else if (type == DESCRIPTOR_G2) {
+          double eta = descriptor_->params[p][q][0];
+          double Rs = descriptor_->params[p][q][1];
+          descriptor_->sym_d2_g2(eta, Rs, rijmag, rcutij, gcij, dgcdr_two,
+              d2gcdr_two);
+        }
+        else if (type == DESCRIPTOR_G3) {
+          double kappa = descriptor_->params[p][q][0];
+          descriptor_->sym_d2_g3(kappa, rijmag, rcutij, gcij, dgcdr_two,
+              d2gcdr_two);
+        }
+
+        dEdr[jj] += dEdGc[idx]*dgcdr_two;
+        ddEdr[jj] += ddEdGc[idx]*dgcdr_two + dEdGc[idx]*d2gcdr_two*drij;
+        idx += 1;
+
+      } // loop over same descriptor but different parameter set
+    } // loop over descriptors
+
+
+    // three-body descriptors
+    if (descriptor_->has_three_body == true) {
+
+      for (int kk = jj+1; kk < numNei; ++kk) {
 
-            if (descriptor_->name[p] != "g4" &&
-                descriptor_->name[p] != "g5") {
-              continue;
+        int const k = n1Atom[kk];
+        int const kSpecies = particleSpecies[k];
+
+        // Compute rik, rjk and their squares
+        double rik[DIM];
+        double rjk[DIM];
+        for (int dim = 0; dim < DIM; ++dim) {
+          rik[dim] = coordinates[k][dim] - coordinates[i][dim];
+          rjk[dim] = coordinates[k][dim] - coordinates[j][dim];
+        }
+        double const rikmag = sqrt(rik[0]*rik[0] + rik[1]*rik[1] + rik[2]*rik[2]);
+        double const rjkmag = sqrt(rjk[0]*rjk[0] + rjk[1]*rjk[1] + rjk[2]*rjk[2]);
+        double const rcutik = sqrt(constCutoffsSq2D[iSpecies][kSpecies]);
+        double const rcutjk = sqrt(constCutoffsSq2D[jSpecies][kSpecies]);
+
+        double const rvec[3] = {rijmag, rikmag, rjkmag};
+        double const rcutvec[3] = {rcutij, rcutik, rcutjk};
+
+        if (rikmag > rcutik) continue; // three-dody not interacting
+
+        // derivatives of rikmag and rjkmag in direction v
+        double drik = 0.0;
+        double drjk = 0.0;
+        for (int dim = 0; dim < DIM; ++dim) {
+          drik += rik[dim]*(v[k][dim] - v[i][dim]);
+          drjk += rjk[dim]*(v[k][dim] - v[j][dim]);
+        }
+        drik /= rikmag;
+        drjk /= rjkmag;
+        double const dr[3] = {drij, drik, drjk};
+
+        double dEdrjk = 0.0;
+        double ddEdrjk = 0.0;
+        for (size_t p=0; p<descriptor_->name.size(); p++) {
+
+          DescriptorType const type = descriptor_->type[p];
+          if (type != DESCRIPTOR_G4 &&
+              type != DESCRIPTOR_G5) {
+            continue;
+          }
+          int idx = descriptor_->starting_index[p];
+
+          for(int q=0; q<descriptor_->num_param_sets[p]; q++) {
+
+            double gcijk;
+            double dgcdr_three[3];
+            double d2gcdr_three[9];
+            double zeta = descriptor_->params[p][q][0];
+            double lambda = descriptor_->params[p][q][1];
+            double eta = descriptor_->params[p][q][2];
+            double pre = descriptor_->prefactor[p][q];
+            if (type == DESCRIPTOR_G4) {
+              descriptor_->sym_d2_g4(zeta, lambda, eta, pre, rvec, rcutvec,
+                  gcijk, dgcdr_three, d2gcdr_three);
+            }
+            else {
+              descriptor_->sym_d2_g5(zeta, lambda, eta, pre, rvec, rcutvec,
+                  gcijk, dgcdr_three, d2gcdr_three);
             }
-            int idx = descriptor_->starting_index[p];
-
-            for(int q=0; q<descriptor_->num_param_sets[p]; q++) {
-
-              double gc;
-              double dgcdr_three[3];
-              if (descriptor_->name[p] == "g4") {
-                double zeta = descriptor_->params[p][q][0];
-                double lambda = descriptor_->params[p][q][1];
-                double eta = descriptor_->params[p][q][2];
-                descriptor_->sym_d_g4(zeta, lambda, eta, rvec, rcutvec, gc, dgcdr_three);
-              }
-              else if (descriptor_->name[p] == "g5") {
-                double zeta = descriptor_->params[p][q][0];
-                double lambda = descriptor_->params[p][q][1];
-                double eta = descriptor_->params[p][q][2];
-                descriptor_->sym_d_g5(zeta, lambda, eta, rvec, rcutvec, gc, dgcdr_three);
-              }
-
-              // centering and normalization
-              if (descriptor_->center_and_normalize) {
-                dgcdr_three[0] /= descriptor_->features_std[idx];
-                dgcdr_three[1] /= descriptor_->features_std[idx];
-                dgcdr_three[2] /= descriptor_->features_std[idx];
-              }
-
-              for (int kdim = 0; kdim < DIM; ++kdim) {
-                double phi_ij = dEdGeneralizedCoords[i][idx]*
-                  dgcdr_three[0]*rij[kdim]/rijmag;
-                double phi_ik = dEdGeneralizedCoords[i][idx]*
-                  dgcdr_three[1]*rik[kdim]/rikmag;
-                double phi_jk = dEdGeneralizedCoords[i][idx]*
-                  dgcdr_three[2]*rjk[kdim]/rjkmag;
-                forces[i][kdim] += phi_ij + phi_ik;
-                forces[j][kdim] += -phi_ij + phi_jk;
-                forces[k][kdim] += -phi_ik - phi_jk;
-              }
-              idx += 1;
-
-            } // loop over same descriptor but different parameter set
-          }  // loop over descriptors
-        }  // loop over kk (three body neighbors)
-      }  // loop over first neighbor
-    }  // loop over i atoms
-  } // compute force
 
+            // derivatives of dgcdr_three in direction v
+            double ddgcdr_three[3];
+            for (int a = 0; a < 3; ++a) {
+              ddgcdr_three[a] = d2gcdr_three[a*3]*dr[0]
+                  + d2gcdr_three[a*3+1]*dr[1] + d2gcdr_three[a*3+2]*dr[2];
+            }
 
+            dEdr[jj] += dEdGc[idx]*dgcdr_three[0];
+            dEdr[kk] += dEdGc[idx]*dgcdr_three[1];
+            dEdrjk += dEdGc[idx]*dgcdr_three[2];
+            ddEdr[jj] += ddEdGc[idx]*dgcdr_three[0]
+                + dEdGc[idx]*ddgcdr_three[0];
+            ddEdr[kk] += ddEdGc[idx]*dgcdr_three[1]
+                + dEdGc[idx]*ddgcdr_three[1];
+            ddEdrjk += ddEdGc[idx]*dgcdr_three[2] + dEdGc[idx]*ddgcdr_three[2];
+            idx += 1;
 
-  // everything is good
-  ier = KIM_STATUS_OK;
-  return ier;
+          } // loop over same descriptor but different parameter set
+        }  // loop over descriptors
+
+        // pair term of neighbors j and k
+        AccumulatePairTermTangent(dEdrjk, ddEdrjk, rjkmag, rjk, v[j], v[k],
+                                  &hvnei[jj*DIM], &hvnei[kk*DIM]);
+      }  // loop over kk (three body neighbors)
+    }
+
+    // pair term of i and j
+    AccumulatePairTermTangent(dEdr[jj], ddEdr[jj], rijmag, rij, v[i], v[j],
+                              hvi, &hvnei[jj*DIM]);
+  }  // loop over first neighbor
 }
 
 #endif  // ANN_IMPLEMENTATION_HPP_
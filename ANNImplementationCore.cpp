@@ -0,0 +1,1196 @@
+//
+// CDDL HEADER START
+//
+// The contents of this file are subject to the terms of the Common Development
+// and Distribution License Version 1.0 (the "License").
+//
+// You can obtain a copy of the license at
+// http://www.opensource.org/licenses/CDDL-1.0.  See the License for the
+// specific language governing permissions and limitations under the License.
+//
+// When distributing Covered Code, include this CDDL HEADER in each file and
+// include the License file in a prominent location with the name LICENSE.CDDL.
+// If applicable, add the following below this CDDL HEADER, with the fields
+// enclosed by brackets "[]" replaced with your own identifying information:
+//
+// Portions Copyright (c) [yyyy] [name of copyright owner]. All rights reserved.
+//
+// CDDL HEADER END
+//
+
+
+//
+// Copyright (c) 2017, Regents of the University of Minnesota.
+// All rights reserved.
+//
+// Contributors:
+//    Mingjian Wen
+//
+
+
+// Members of ANNImplementation that do not use the KIM API.  They are shared
+// by the KIM API driver (ANN.cpp, ANNImplementation.cpp) and the standalone
+// library (ann_api.h), which therefore does not need the KIM API library.
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <unordered_map>
+
+#include "KIM_API_status.h"
+#include "ANNImplementation.hpp"
+#include "descriptor.h"
+#include "helper.h"
+#include "modelio.h"
+#include "neighbors.h"
+
+//==============================================================================
+//
+// Implementation of ANNImplementation public member functions
+//
+//==============================================================================
+
+//******************************************************************************
+ANNImplementation::ANNImplementation()
+    : baseconvert_(0),
+      numberOfSpeciesIndex_(-1),  // initizlize index, pointer, and cached
+      numberOfParticlesIndex_(-1),    // member variables
+      particleSpeciesIndex_(-1),
+			particleStatusIndex_(-1),
+      coordinatesIndex_(-1),
+      get_neighIndex_(-1),
+      process_dEdrIndex_(-1),
+      process_d2Edr2Index_(-1),
+      cutoffIndex_(-1),
+      energyIndex_(-1),
+      forcesIndex_(-1),
+      particleEnergyIndex_(-1),
+      virialIndex_(-1),
+      particleVirialIndex_(-1),
+      numberModelSpecies_(0),
+      numberUniqueSpeciesPairs_(0),
+      cutoffs_(0),
+			cutoffsSq2D_(0),
+      activeComputes_(0),
+      descriptor_(0),
+      network_(0),
+      chunkSize_(DEFAULT_CHUNK_SIZE),
+      pipeline_(false),
+      numThreads_(1),
+      threadPool_(0),
+      memoTolerance_(0.0),
+      memoRows_(0),
+      memoHits_(0),
+      resultCache_(false),
+      resultCalls_(0),
+      resultHits_(0),
+      resultResumes_(0),
+      profile_(false),
+      profileInterval_(0),
+      traceStart_(std::chrono::steady_clock::now()),
+      captureFile_(0),
+      localMoves_(0),
+      modelKey_(0),
+      watchParameterFile_(false),
+      rejectedFileStat_()
+			// add potential parameters
+{
+}
+
+//******************************************************************************
+ANNImplementation::ANNImplementation(
+    char const* const parameterFileName,
+    int const numberSpecies,
+    std::string& error,
+    int* const ier)
+    : ANNImplementation()
+{
+  *ier = KIM_STATUS_FAIL;
+  if (numberSpecies < 1) {
+    error = "ANN number of species must be positive";
+    return;
+  }
+  numberModelSpecies_ = numberSpecies;
+  numberUniqueSpeciesPairs_ = ((numberModelSpecies_+1)*numberModelSpecies_)/2;
+
+  SetRuntimeOptions();
+
+  AllocateFreeParameterMemory();
+
+  FILE* const parameterFile = fopen(parameterFileName, "r");
+  if (parameterFile == 0) {
+    error = std::string("ANN parameter file cannot be opened: ")
+        + parameterFileName;
+    return;
+  }
+
+  // reuse the model of an identical parameter file if one is loaded already,
+  // otherwise read it and make it available to other instances
+  parameterFileName_ = parameterFileName;
+  fstat(fileno(parameterFile), &parameterFileStat_);
+  ModelCache::Key const key = ModelCache::hash_file(parameterFile);
+  std::shared_ptr<ANNModel const> model = ModelCache::find(key);
+  if (!model) {
+    std::shared_ptr<ANNModel> newModel = std::make_shared<ANNModel>();
+    if (load_model(parameterFile, *newModel, error) != 0) {
+      fclose(parameterFile);
+      return;
+    }
+    model = ModelCache::insert(key, newModel);
+  }
+  fclose(parameterFile);
+
+  SetModel(model, key);
+  SetCutoffsSq();
+
+  // everything is good
+  *ier = KIM_STATUS_OK;
+}
+//******************************************************************************
+ANNImplementation::~ANNImplementation()
+{ // note: it is ok to delete a null pointer and we have ensured that
+  // everything is initialized to null
+  if (memoTolerance_ > 0.0 && memoRows_ > 0) {
+    std::cerr << "ANN descriptor memoization: tolerance " << memoTolerance_
+              << ", " << memoHits_ << " of " << memoRows_
+              << " network evaluations reused ("
+              << 100.0*memoHits_/memoRows_ << "% hit rate)" << std::endl;
+  }
+  if (resultCache_ && resultCalls_ > 0) {
+    std::cerr << "ANN result cache: " << resultHits_ << " of "
+              << resultCalls_ << " compute calls answered from the cache, "
+              << resultResumes_ << " resumed from its state" << std::endl;
+  }
+  if (profile_ && stageTimes_.calls > 0) {
+    PrintProfile(stageTimes_, stageCounts_);
+  }
+  if (traceFileName_.empty() == false) WriteTraceFile();
+  if (captureFile_ != 0) fclose(captureFile_);
+  delete [] cutoffs_;
+  Deallocate2DArray(cutoffsSq2D_);
+  delete threadPool_;
+  delete localMoves_;
+  for (size_t i = 0; i < contexts_.size(); ++i) {
+    delete contexts_[i];
+  }
+}
+
+//******************************************************************************
+// The result cache, the capture file and the reloading of the parameter file
+// are features of the KIM API Compute only.
+int ANNImplementation::Compute(ComputeArguments const& arguments)
+{
+  int ier;
+
+  bool const isComputeProcess_dEdr = false;
+  bool const isComputeEnergy = (arguments.energy != 0);
+  bool const isComputeForces = (arguments.forces != 0);
+  bool const isComputeParticleEnergy = (arguments.particleEnergy != 0);
+  bool const isComputeVirial = (arguments.virial != 0);
+  bool const isComputeParticleVirial = (arguments.particleVirial != 0);
+
+  KIM_API_model* const pkim = 0;  // no process_dEdr callback
+  int const* const particleSpecies = arguments.particleSpecies;
+  NeighborArrays const& neighbors = arguments.neighbors;
+  VectorOfSizeDIM const* const coordinates = arguments.coordinates;
+  double* const energy = arguments.energy;
+  double* const particleEnergy = arguments.particleEnergy;
+  VectorOfSizeDIM* const forces = arguments.forces;
+  VectorOfSizeSix* const virial = arguments.virial;
+  VectorOfSizeSix* const particleVirial = arguments.particleVirial;
+  if (!ValidSpecies(arguments.numberOfParticles, particleSpecies)) {
+    return KIM_STATUS_FAIL;
+  }
+
+  std::chrono::steady_clock::time_point lap = std::chrono::steady_clock::now();
+
+  // per-call mutable state
+  ComputeContext* const context = AcquireContext();
+  long const bytes = profile_ ? context->bytes() : 0;
+  context->numberOfParticles = arguments.numberOfParticles;
+  context->numberContributingParticles = arguments.numberContributingParticles;
+
+#include "ANNImplementationArrayDispatch.cpp"
+
+  ++context->times.calls;
+  context->times.particles += context->numberContributingParticles;
+  if (profile_) {
+    context->counts.bytesAllocated += std::max(0L, context->bytes() - bytes);
+  }
+  EndStage("compute", lap, context->times.compute, context->events);
+  ReleaseContext(context);
+  return ier;
+}
+
+//******************************************************************************
+// The configurations are processed in groups of whole configurations with up
+// to chunkSize_ contributing particles in all (a single configuration may
+// exceed it), such that the network runs on one batch of rows per group
+// instead of one small batch per configuration.
+int ANNImplementation::ComputeBatch(int const numberConfigurations,
+                                    ComputeArguments const* const arguments)
+{
+  int ier = KIM_STATUS_OK;
+  for (int k = 0; k < numberConfigurations; ++k) {
+    if (!ValidSpecies(arguments[k].numberOfParticles,
+                      arguments[k].particleSpecies)) {
+      return KIM_STATUS_FAIL;
+    }
+  }
+  std::chrono::steady_clock::time_point lap = std::chrono::steady_clock::now();
+
+  ComputeContext* const context = AcquireContext();
+  long const bytes = profile_ ? context->bytes() : 0;
+
+  int first = 0;
+  while (first < numberConfigurations && ier >= KIM_STATUS_OK) {
+    int last = first + 1;
+    int rows = arguments[first].numberContributingParticles;
+    while (last < numberConfigurations
+           && (chunkSize_ <= 0
+               || rows + arguments[last].numberContributingParticles
+                  <= chunkSize_)) {
+      rows += arguments[last].numberContributingParticles;
+      ++last;
+    }
+    ier = BatchGroup(*context, last - first, arguments + first);
+    first = last;
+  }
+
+  // each configuration counts as a call
+  context->times.calls += numberConfigurations;
+  for (int k = 0; k < numberConfigurations; ++k) {
+    context->times.particles += arguments[k].numberContributingParticles;
+  }
+  if (profile_) {
+    context->counts.bytesAllocated += std::max(0L, context->bytes() - bytes);
+  }
+  EndStage("compute", lap, context->times.compute, context->events);
+  ReleaseContext(context);
+  return ier;
+}
+
+//******************************************************************************
+// The neighbor lists of one configuration are built with the threads of the
+// pool, those of several configurations one per thread.
+int ANNImplementation::ComputeAtoms(int const numberConfigurations,
+                                    AtomsArguments const* const arguments)
+{
+  if (numberConfigurations <= 0) return KIM_STATUS_OK;
+  std::vector<NeighborBuilder> builders(numberConfigurations);
+  std::vector<int> status(numberConfigurations, KIM_STATUS_OK);
+  std::function<void(int)> const build = [&](int const k) {
+    AtomsArguments const& atoms = arguments[k];
+    if (!ValidSpecies(atoms.numberOfAtoms, atoms.particleSpecies)) {
+      status[k] = KIM_STATUS_FAIL;
+      return;
+    }
+    std::string error;
+    NeighborBuilder& builder = builders[k];
+    builder.set_cutoffs(numberModelSpecies_, cutoffsSq2D_);
+    if (builder.set_atoms(atoms.numberOfAtoms, atoms.particleSpecies,
+                          reinterpret_cast<double const*>(atoms.coordinates),
+                          atoms.lattice,
+                          atoms.periodic, error) != 0) {
+      status[k] = KIM_STATUS_FAIL;
+      return;
+    }
+    builder.build(false, (numberConfigurations == 1) ? threadPool_ : 0);
+  };
+  if (numberConfigurations > 1 && threadPool_ != 0) {
+    threadPool_->run(numberConfigurations, build);
+  }
+  else {
+    for (int k = 0; k < numberConfigurations; ++k) build(k);
+  }
+  for (int k = 0; k < numberConfigurations; ++k) {
+    if (status[k] < KIM_STATUS_OK) return status[k];
+  }
+
+  // the outputs of the images are computed into scratch arrays and added to
+  // their atoms
+  std::vector<ComputeArguments> computeArguments(numberConfigurations);
+  std::vector<std::vector<double> > forces(numberConfigurations);
+  std::vector<std::vector<double> > particleEnergy(numberConfigurations);
+  std::vector<std::vector<double> > particleVirial(numberConfigurations);
+  for (int k = 0; k < numberConfigurations; ++k) {
+    AtomsArguments const& atoms = arguments[k];
+    NeighborBuilder const& builder = builders[k];
+    int const Nparticles = builder.get_number_of_particles();
+    ComputeArguments& config = computeArguments[k];
+    config.numberOfParticles = Nparticles;
+    config.numberContributingParticles = builder.get_number_contributing();
+    config.particleSpecies = builder.get_species().data();
+    config.coordinates = reinterpret_cast<VectorOfSizeDIM const*>(
+        builder.get_coordinates().data());
+    config.neighbors.numNei = builder.get_num_neighbors().data();
+    config.neighbors.start = builder.get_neighbor_start().data();
+    config.neighbors.list = builder.get_neighbors().data();
+    config.energy = atoms.energy;
+    config.virial = atoms.virial;
+    config.forces = 0;
+    config.particleEnergy = 0;
+    config.particleVirial = 0;
+    if (atoms.forces != 0) {
+      forces[k].resize(Nparticles*DIM);
+      config.forces = reinterpret_cast<VectorOfSizeDIM*>(forces[k].data());
+    }
+    if (atoms.particleEnergy != 0) {
+      particleEnergy[k].resize(Nparticles);
+      config.particleEnergy = particleEnergy[k].data();
+    }
+    if (atoms.particleVirial != 0) {
+      particleVirial[k].resize(Nparticles*6);
+      config.particleVirial
+          = reinterpret_cast<VectorOfSizeSix*>(particleVirial[k].data());
+    }
+  }
+  int const ier = ComputeBatch(numberConfigurations, &computeArguments[0]);
+  if (ier < KIM_STATUS_OK) return ier;
+
+  for (int k = 0; k < numberConfigurations; ++k) {
+    AtomsArguments const& atoms = arguments[k];
+    std::vector<int> const& owner = builders[k].get_owner();
+    int const Natoms = atoms.numberOfAtoms;
+    int const Nparticles = owner.size();
+    if (atoms.forces != 0) {
+      std::copy(forces[k].begin(), forces[k].begin() + Natoms*DIM,
+                atoms.forces[0]);
+      for (int i = Natoms; i < Nparticles; ++i) {
+        for (int d = 0; d < DIM; ++d) {
+          atoms.forces[owner[i]][d] += forces[k][i*DIM + d];
+        }
+      }
+    }
+    if (atoms.particleEnergy != 0) {
+      std::copy(particleEnergy[k].begin(), particleEnergy[k].begin() + Natoms,
+                atoms.particleEnergy);
+    }
+    if (atoms.particleVirial != 0) {
+      std::copy(particleVirial[k].begin(),
+                particleVirial[k].begin() + Natoms*6, atoms.particleVirial[0]);
+      for (int i = Natoms; i < Nparticles; ++i) {
+        for (int m = 0; m < 6; ++m) {
+          atoms.particleVirial[owner[i]][m] += particleVirial[k][i*6 + m];
+        }
+      }
+    }
+  }
+  return KIM_STATUS_OK;
+}
+
+//******************************************************************************
+double ANNImplementation::GetCutoff() const
+{
+  double cutoffSq = 0.0;
+  for (int i = 0; i < numberModelSpecies_; ++i) {
+    for (int j = 0; j < numberModelSpecies_; ++j) {
+      cutoffSq = std::max(cutoffSq, cutoffsSq2D_[i][j]);
+    }
+  }
+  return sqrt(cutoffSq);
+}
+//******************************************************************************
+StageTimes ANNImplementation::GetStageTimes()
+{
+  std::lock_guard<std::mutex> lock(contextsMutex_);
+  return stageTimes_;
+}
+
+//******************************************************************************
+void ANNImplementation::ResetStageTimes()
+{
+  std::lock_guard<std::mutex> lock(contextsMutex_);
+  stageTimes_.clear();
+  stageCounts_.clear();
+}
+
+//******************************************************************************
+StageCounts ANNImplementation::GetStageCounts()
+{
+  std::lock_guard<std::mutex> lock(contextsMutex_);
+  return stageCounts_;
+}
+
+//==============================================================================
+//
+// Implementation of ANNImplementation private member functions
+//
+//==============================================================================
+
+//******************************************************************************
+// one group of configurations of ComputeBatch: gather the rows of all of them
+// into one chunk, compute the descriptors with the configurations split among
+// threads, run the network on the whole chunk, and add the contributions of
+// each configuration to its outputs
+int ANNImplementation::BatchGroup(ComputeContext& context,
+                                  int const numberConfigurations,
+                                  ComputeArguments const* const arguments)
+{
+  ChunkBuffer& chunk = context.chunks[0];
+  std::chrono::steady_clock::time_point lap = std::chrono::steady_clock::now();
+
+  // first row of each configuration
+  std::vector<int> rowStart(numberConfigurations + 1);
+  rowStart[0] = 0;
+  bool isComputeDerivative = false;
+  for (int k = 0; k < numberConfigurations; ++k) {
+    ComputeArguments const& config = arguments[k];
+    if (config.numberContributingParticles < 0
+        || config.numberContributingParticles > config.numberOfParticles) {
+      return KIM_STATUS_FAIL;
+    }
+    rowStart[k+1] = rowStart[k] + config.numberContributingParticles;
+    isComputeDerivative = isComputeDerivative || config.forces != 0
+        || config.virial != 0 || config.particleVirial != 0;
+  }
+  int const Nrows = rowStart[numberConfigurations];
+
+  int const Ndescriptors = descriptor_->get_num_descriptors();
+  if (Nrows > chunk.capacity || Ndescriptors != chunk.numberDescriptors) {
+    chunk.resize(std::max(Nrows, chunkSize_), Ndescriptors);
+  }
+
+  // gather the neighbor lists
+  chunk.numberParticles = Nrows;
+  chunk.neighList.clear();
+  for (int k = 0; k < numberConfigurations; ++k) {
+    NeighborArrays const& neighbors = arguments[k].neighbors;
+    for (int i = 0; i < arguments[k].numberContributingParticles; ++i) {
+      int const c = rowStart[k] + i;
+      int const* const n1atom = neighbors.list + neighbors.start[i];
+      chunk.particle[c] = i;
+      chunk.numNei[c] = neighbors.numNei[i];
+      chunk.neighStart[c] = chunk.neighList.size();
+      chunk.neighList.insert(chunk.neighList.end(), n1atom,
+                             n1atom + neighbors.numNei[i]);
+    }
+  }
+  if (Nrows > 0) {
+    std::fill(chunk.generalizedCoords[0],
+              chunk.generalizedCoords[0] + Nrows*Ndescriptors, 0.0);
+  }
+  EndStage("neighbor", lap, chunk.times.neighbor, chunk.events);
+
+  // Split the configurations among threads: the rows are partitioned by the
+  // cost model, and each bound is moved to the start of a configuration.
+  std::vector<int> configBounds;
+  if (Nrows > 0) {
+    context.costModel.partition(&chunk.numNei[0], Nrows, numThreads_,
+                                chunk.bounds);
+  }
+  else {
+    chunk.bounds.assign(2, 0);
+  }
+  int const Nparts = chunk.bounds.size() - 1;
+  configBounds.resize(Nparts + 1);
+  for (int part = 0; part < Nparts; ++part) {
+    configBounds[part] = std::lower_bound(rowStart.begin(),
+                                          rowStart.end() - 1,
+                                          chunk.bounds[part])
+        - rowStart.begin();
+    chunk.bounds[part] = rowStart[configBounds[part]];
+  }
+  configBounds[0] = 0;
+  configBounds[Nparts] = numberConfigurations;
+  chunk.bounds[Nparts] = Nrows;
+
+  // descriptors
+  double** const generalizedCoords = chunk.generalizedCoords;
+  std::vector<double> seconds(Nparts);
+  std::vector<StageCounts> counts(profile_ ? Nparts : 0);
+  std::function<void(int)> const describe = [&](int const part) {
+    std::chrono::steady_clock::time_point const start
+        = std::chrono::steady_clock::now();
+    StageCounts* const partCounts = profile_ ? &counts[part] : 0;
+    for (int k = configBounds[part]; k < configBounds[part+1]; ++k) {
+      for (int c = rowStart[k]; c < rowStart[k+1]; ++c) {
+        ComputeGeneralizedCoords(chunk.particle[c], chunk.numNei[c],
+                                 &chunk.neighList[chunk.neighStart[c]],
+                                 arguments[k].particleSpecies,
+                                 arguments[k].coordinates,
+                                 generalizedCoords[c], partCounts);
+      }
+    }
+    seconds[part] = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+  };
+  if (threadPool_ != 0) {
+    threadPool_->run(Nparts, describe);
+    if (Nrows > 0) {
+      context.costModel.update(&chunk.numNei[0], chunk.bounds, seconds);
+    }
+  }
+  else {
+    describe(0);
+  }
+  if (profile_) {
+    chunk.counts.pairsVisited += chunk.neighList.size();
+    for (int part = 0; part < Nparts; ++part) chunk.counts.add(counts[part]);
+  }
+  EndStage("descriptor", lap, chunk.times.descriptor, chunk.events);
+
+  // network, on the rows of all configurations at once
+  if (Nrows > 0) {
+    if (isComputeDerivative == true) {
+      NetworkStage<true>(context.network, chunk);
+    }
+    else {
+      NetworkStage<false>(context.network, chunk);
+    }
+    lap = std::chrono::steady_clock::now();
+  }
+
+  // energies, forces and virials; each configuration is handled by one
+  // thread, which is the only one writing to its outputs and rows
+  size_t const Nneigh = chunk.neighList.size();
+  chunk.dEdr.resize(Nneigh);
+  chunk.neighForce.resize(Nneigh*DIM);
+  chunk.neighVirial.resize(Nneigh*6);
+  std::function<void(int)> const scatter = [&](int const part) {
+    for (int k = configBounds[part]; k < configBounds[part+1]; ++k) {
+      ComputeArguments const& config = arguments[k];
+      int const Nparticles = config.numberOfParticles;
+      if (config.energy != 0) {
+        *config.energy = 0.0;
+        for (int c = rowStart[k]; c < rowStart[k+1]; ++c) {
+          *config.energy += chunk.energy[c];
+        }
+      }
+      if (config.particleEnergy != 0) {
+        std::fill(config.particleEnergy, config.particleEnergy + Nparticles,
+                  0.0);
+        for (int c = rowStart[k]; c < rowStart[k+1]; ++c) {
+          config.particleEnergy[chunk.particle[c]] = chunk.energy[c];
+        }
+      }
+      if (config.forces != 0) {
+        std::fill(config.forces[0], config.forces[0] + Nparticles*DIM, 0.0);
+      }
+      if (config.virial != 0) {
+        std::fill(config.virial[0], config.virial[0] + 6, 0.0);
+      }
+      if (config.particleVirial != 0) {
+        std::fill(config.particleVirial[0],
+                  config.particleVirial[0] + Nparticles*6, 0.0);
+      }
+
+      int const index = 4*(config.forces != 0) + 2*(config.virial != 0)
+          + (config.particleVirial != 0);
+      switch (index) {
+        case 1:
+          BatchForces<false, false, true>(chunk, rowStart[k], config);
+          break;
+        case 2:
+          BatchForces<false, true, false>(chunk, rowStart[k], config);
+          break;
+        case 3:
+          BatchForces<false, true, true>(chunk, rowStart[k], config);
+          break;
+        case 4:
+          BatchForces<true, false, false>(chunk, rowStart[k], config);
+          break;
+        case 5:
+          BatchForces<true, false, true>(chunk, rowStart[k], config);
+          break;
+        case 6:
+          BatchForces<true, true, false>(chunk, rowStart[k], config);
+          break;
+        case 7:
+          BatchForces<true, true, true>(chunk, rowStart[k], config);
+          break;
+        default:
+          break;
+      }
+    }
+  };
+  if (threadPool_ != 0) {
+    threadPool_->run(Nparts, scatter);
+  }
+  else {
+    scatter(0);
+  }
+  EndStage("force", lap, chunk.times.force, chunk.events);
+
+  return KIM_STATUS_OK;
+}
+
+//******************************************************************************
+void ANNImplementation::SetRuntimeOptions()
+{
+  // number of contributing particles processed per chunk in Compute;
+  // 0 processes all of them at once
+  char const* const chunkSize = getenv("ANN_CHUNK_SIZE");
+  if (chunkSize != NULL) {
+    chunkSize_ = atoi(chunkSize);
+  }
+
+  // overlap the descriptor, network and force stages of consecutive chunks
+  char const* const pipeline = getenv("ANN_PIPELINE");
+  if (pipeline != NULL) {
+    pipeline_ = (atoi(pipeline) != 0);
+  }
+
+  // number of threads used for the descriptor and force stages
+  char const* const numThreads = getenv("ANN_NUM_THREADS");
+  if (numThreads != NULL) {
+    numThreads_ = std::max(1, atoi(numThreads));
+  }
+  if (numThreads_ > 1) {
+    threadPool_ = new ThreadPool(numThreads_);
+  }
+
+  // reload the parameter file in Compute when it is modified
+  char const* const watch = getenv("ANN_WATCH_PARAMETER_FILE");
+  if (watch != NULL) {
+    watchParameterFile_ = (atoi(watch) != 0);
+  }
+
+  // evaluate the network once per distinct generalized coords row
+  char const* const memoTolerance = getenv("ANN_MEMO_TOLERANCE");
+  if (memoTolerance != NULL) {
+    memoTolerance_ = std::max(0.0, atof(memoTolerance));
+  }
+
+  // keep the results of the last Compute call for repeated configurations
+  char const* const resultCache = getenv("ANN_RESULT_CACHE");
+  if (resultCache != NULL) {
+    resultCache_ = (atoi(resultCache) != 0);
+  }
+
+  // count the work of the stages and print a summary every ANN_PROFILE
+  // compute calls
+  char const* const profile = getenv("ANN_PROFILE");
+  if (profile != NULL) {
+    profileInterval_ = atoi(profile);
+    profile_ = (profileInterval_ > 0);
+  }
+
+  // record the stages of the compute calls in a Chrome trace file
+  char const* const traceFile = getenv("ANN_TRACE_FILE");
+  if (traceFile != NULL && traceFile[0] != '\0') {
+    traceFileName_ = traceFile;
+    profile_ = true;
+  }
+
+  // write the inputs of the compute calls to a capture file for ann_replay
+  char const* const captureFile = getenv("ANN_CAPTURE_FILE");
+  if (captureFile != NULL && captureFile[0] != '\0') {
+    std::string error;
+    captureFile_ = fopen(captureFile, "wb");
+    if (captureFile_ == 0 || write_capture_header(captureFile_, error) != 0) {
+      std::cerr << "ANN: cannot write capture file " << captureFile
+                << std::endl;
+      if (captureFile_ != 0) fclose(captureFile_);
+      captureFile_ = 0;
+    }
+  }
+}
+
+//******************************************************************************
+void ANNImplementation::SetModel(std::shared_ptr<ANNModel const> const& model,
+                                 ModelCache::Key const key)
+{
+  model_ = model;
+  modelKey_ = key;
+  descriptor_ = &model_->descriptor;
+  network_ = &model_->network;
+//TODO modifiy this such that each pair has its own cutoff
+  for (int i=0; i<numberUniqueSpeciesPairs_; i++) {
+	  cutoffs_[i] = model_->cutoff;
+  }
+
+  SetCostModel();
+  InvalidateResults();
+
+  // the snapshot of the local moves holds descriptors and energies of the
+  // previous model
+  delete localMoves_;
+  localMoves_ = 0;
+}
+
+//******************************************************************************
+void ANNImplementation::SetCostModel()
+{
+  int numTwoBody = 0;
+  int numThreeBody = 0;
+  for (size_t p=0; p<descriptor_->type.size(); p++) {
+    switch (descriptor_->type[p]) {
+      case DESCRIPTOR_G4:
+      case DESCRIPTOR_G5:
+        numThreeBody += descriptor_->num_param_sets[p];
+        break;
+      case DESCRIPTOR_G1:
+      case DESCRIPTOR_G2:
+      case DESCRIPTOR_G3:
+        numTwoBody += descriptor_->num_param_sets[p];
+        break;
+    }
+  }
+  costModel_.set_descriptor_sizes(numTwoBody, numThreeBody);
+}
+
+//******************************************************************************
+void ANNImplementation::CloseParameterFiles(
+    FILE* const parameterFilePointers[MAX_PARAMETER_FILES],
+    int const numberParameterFiles)
+{
+  for (int i = 0; i < numberParameterFiles; ++i)
+    fclose(parameterFilePointers[i]);
+}
+
+//******************************************************************************
+void ANNImplementation::AllocateFreeParameterMemory()
+{ // allocate memory for data
+  cutoffs_ = new double[numberUniqueSpeciesPairs_];
+	AllocateAndInitialize2DArray(cutoffsSq2D_, numberModelSpecies_, numberModelSpecies_);
+}
+
+//******************************************************************************
+// square of the cutoff of each species pair, from cutoffs_
+void ANNImplementation::SetCutoffsSq()
+{
+	for (int i = 0; i < numberModelSpecies_; ++i) {
+		for (int j = 0; j <= i ; ++j) {
+			int const index = j*numberModelSpecies_ + i - (j*j + j)/2;
+			cutoffsSq2D_[i][j] = cutoffsSq2D_[j][i] = (cutoffs_[index]*cutoffs_[index]);
+		}
+	}
+}
+
+//******************************************************************************
+// whether two stats are of the same file with the same modification time and
+// size
+static bool SameFileStat(struct stat const& a, struct stat const& b)
+{
+#ifdef __APPLE__
+  bool const sameTime
+      = (a.st_mtimespec.tv_sec == b.st_mtimespec.tv_sec
+         && a.st_mtimespec.tv_nsec == b.st_mtimespec.tv_nsec);
+#else
+  bool const sameTime
+      = (a.st_mtim.tv_sec == b.st_mtim.tv_sec
+         && a.st_mtim.tv_nsec == b.st_mtim.tv_nsec);
+#endif
+  return sameTime && a.st_size == b.st_size && a.st_ino == b.st_ino;
+}
+
+//******************************************************************************
+bool ANNImplementation::ParameterFileModified() const
+{
+  struct stat st;
+  if (stat(parameterFileName_.c_str(), &st) != 0) {
+    return false;  // e.g. being replaced; check again next time
+  }
+  return !SameFileStat(st, parameterFileStat_)
+      && !SameFileStat(st, rejectedFileStat_);
+}
+
+//******************************************************************************
+bool ANNImplementation::ValidSpecies(int const numberOfParticles,
+                                     int const* const particleSpecies) const
+{
+  for (int i = 0; i < numberOfParticles; ++i) {
+    if (particleSpecies[i] < 0 || particleSpecies[i] >= numberModelSpecies_) {
+      return false;
+    }
+  }
+  return true;
+}
+
+//******************************************************************************
+ComputeContext* ANNImplementation::AcquireContext()
+{
+  std::lock_guard<std::mutex> lock(contextsMutex_);
+  ++activeComputes_;
+  if (contexts_.empty()) {
+    return new ComputeContext(costModel_);
+  }
+  ComputeContext* const context = contexts_.back();
+  contexts_.pop_back();
+  return context;
+}
+
+//******************************************************************************
+void ANNImplementation::ReleaseContext(ComputeContext* const context)
+{
+  std::lock_guard<std::mutex> lock(contextsMutex_);
+  StageTimes times = context->times;
+  StageCounts counts = context->counts;
+  context->times.clear();
+  context->counts.clear();
+  traceEvents_.insert(traceEvents_.end(), context->events.begin(),
+                      context->events.end());
+  context->events.clear();
+  for (int b = 0; b < NUMBER_CHUNK_BUFFERS; ++b) {
+    ChunkBuffer& chunk = context->chunks[b];
+    times.add(chunk.times);
+    counts.add(chunk.counts);
+    chunk.times.clear();
+    chunk.counts.clear();
+    traceEvents_.insert(traceEvents_.end(), chunk.events.begin(),
+                        chunk.events.end());
+    chunk.events.clear();
+  }
+  stageTimes_.add(times);
+  stageCounts_.add(counts);
+  if (profile_ && profileInterval_ > 0) {
+    profileTimes_.add(times);
+    profileCounts_.add(counts);
+    if (profileTimes_.calls >= profileInterval_) {
+      PrintProfile(profileTimes_, profileCounts_);
+      profileTimes_.clear();
+      profileCounts_.clear();
+    }
+  }
+  contexts_.push_back(context);
+  if (--activeComputes_ == 0) computesDone_.notify_all();
+}
+
+//******************************************************************************
+// print the time and work per compute call to stderr
+void ANNImplementation::PrintProfile(StageTimes const& times,
+                                     StageCounts const& counts) const
+{
+  if (times.calls == 0) return;
+  double const calls = times.calls;
+  double const particles = std::max(1L, times.particles);
+  std::ostream& out = std::cerr;
+  std::ios_base::fmtflags const flags = out.flags();
+  std::streamsize const precision = out.precision(4);
+
+  out << "ANN profile: " << times.calls << " compute calls, "
+      << times.particles/calls << " contributing particles per call\n"
+      << "  ms per call: compute " << 1e3*times.compute/calls
+      << ", neighbor " << 1e3*times.neighbor/calls
+      << ", descriptor " << 1e3*times.descriptor/calls
+      << ", forward " << 1e3*times.forward/calls
+      << ", backward " << 1e3*times.backward/calls
+      << ", force " << 1e3*times.force/calls << "\n"
+      << "  per particle: " << counts.pairsVisited/particles
+      << " pairs visited, " << counts.pairsWithinCutoff/particles
+      << " within cutoff, " << counts.triplets/particles << " triplets\n"
+      << "  kernel calls per call:";
+  // each parameter set of a descriptor is evaluated once per pair (g1, g2,
+  // g3) or triplet (g4, g5) in the descriptor stage, and its derivative as
+  // often in the force stage
+  for (size_t p = 0; p < descriptor_->name.size(); ++p) {
+    DescriptorType const type = descriptor_->type[p];
+    long const n = (type == DESCRIPTOR_G4 || type == DESCRIPTOR_G5) ?
+        counts.triplets : counts.pairsWithinCutoff;
+    out << " " << descriptor_->name[p] << " "
+        << n*descriptor_->num_param_sets[p]/calls;
+  }
+  out << "\n"
+      << "  bytes allocated per call: " << counts.bytesAllocated/calls
+      << std::endl;
+
+  out.flags(flags);
+  out.precision(precision);
+}
+
+//******************************************************************************
+// write the recorded events as complete events of the Chrome trace format,
+// which chrome://tracing and Perfetto can display
+void ANNImplementation::WriteTraceFile() const
+{
+  FILE* const file = fopen(traceFileName_.c_str(), "w");
+  if (file == NULL) {
+    std::cerr << "ANN: cannot open trace file " << traceFileName_
+              << std::endl;
+    return;
+  }
+  fprintf(file, "{\"traceEvents\": [\n");
+  for (size_t e = 0; e < traceEvents_.size(); ++e) {
+    TraceEvent const& event = traceEvents_[e];
+    fprintf(file, "  {\"name\": \"%s\", \"cat\": \"ann\", \"ph\": \"X\", "
+            "\"ts\": %.3f, \"dur\": %.3f, \"pid\": 0, \"tid\": %d}%s\n",
+            event.name, event.start, event.duration, event.thread,
+            (e + 1 < traceEvents_.size()) ? "," : "");
+  }
+  fprintf(file, "],\n\"displayTimeUnit\": \"ms\"}\n");
+  fclose(file);
+}
+
+//******************************************************************************
+// take the results of the last Compute call, or reset them to the given
+// configuration if they are not those of it
+void ANNImplementation::TakeResults(ComputeContext& context,
+                                    const int* const particleSpecies,
+                                    const VectorOfSizeDIM* const coordinates)
+{
+  ResultCache& results = context.results;
+  {
+    std::lock_guard<std::mutex> lock(resultsMutex_);
+    std::swap(results, results_);
+  }
+
+  int const Nparticles = context.numberOfParticles;
+  int const Ncontrib = context.numberContributingParticles;
+  int const Ndescriptors = descriptor_->get_num_descriptors();
+  if (!results.matches(Nparticles, Ncontrib, Ndescriptors, particleSpecies,
+                       coordinates[0])) {
+    results.reset(Nparticles, Ncontrib, Ndescriptors, particleSpecies,
+                  coordinates[0]);
+  }
+}
+
+//******************************************************************************
+// keep the results of a Compute call for the next one; the results replaced
+// stay with the context only for their buffers
+void ANNImplementation::StoreResults(ComputeContext& context)
+{
+  std::lock_guard<std::mutex> lock(resultsMutex_);
+  std::swap(context.results, results_);
+  context.results.isValid = false;
+}
+
+//******************************************************************************
+void ANNImplementation::InvalidateResults()
+{
+  std::lock_guard<std::mutex> lock(resultsMutex_);
+  results_.isValid = false;
+}
+
+//******************************************************************************
+int ANNImplementation::GetComputeIndex(
+    const bool& isComputeProcess_dEdr,
+    const bool& isComputeEnergy,
+    const bool& isComputeForces,
+    const bool& isComputeParticleEnergy,
+    const bool& isComputeVirial,
+    const bool& isComputeParticleVirial) const
+{
+  //const int processdE = 2;
+  // process_d2Edr2 does not select a case; only `false' is generated by
+  // CreateDispatch.sh
+  const int processd2E = 1;
+  const int energy = 2;
+  const int force = 2;
+  const int particleEnergy = 2;
+  const int virial = 2;
+  const int particleVirial = 2;
+
+
+  int index = 0;
+
+  // processdE
+  index += (int(isComputeProcess_dEdr))
+      * processd2E * energy * force * particleEnergy * virial * particleVirial;
+
+  // energy
+  index += (int(isComputeEnergy))
+      * force * particleEnergy * virial * particleVirial;
+
+  // force
+  index += (int(isComputeForces)) * particleEnergy * virial * particleVirial;
+
+  // particleEnergy
+  index += (int(isComputeParticleEnergy)) * virial * particleVirial;
+
+  // virial
+  index += (int(isComputeVirial)) * particleVirial;
+
+  // particleVirial
+  index += (int(isComputeParticleVirial));
+
+
+  return index;
+}
+
+//******************************************************************************
+// energy change of a trial move: the generalized coords and energies of the
+// contributing particles within the cutoff of the old or new position of a
+// moved particle are recomputed, in a local copy of their environment.
+void ANNImplementation::EvaluateLocalMove(LocalMoveState const& state,
+                                          LocalMoveTrial& trial) const
+{
+  int const Nmoved = trial.moved.size();
+  int const Ncontrib = state.numberContributingParticles;
+  int const Ndescriptors = state.numberDescriptors;
+  double const cutoffSq = state.cutoff*state.cutoff;
+  VectorOfSizeDIM const* const x
+      = reinterpret_cast<VectorOfSizeDIM const*>(&state.coordinates[0]);
+  VectorOfSizeDIM const* const xMoved
+      = reinterpret_cast<VectorOfSizeDIM const*>(&trial.movedCoordinates[0]);
+
+  // index of particle p in trial.moved, or -1
+  std::function<int(int)> const movedIndex = [&](int const p) {
+    for (int m = 0; m < Nmoved; ++m) {
+      if (trial.moved[m] == p) return m;
+    }
+    return -1;
+  };
+
+  // contributing particles whose energy may change
+  std::vector<int>& affected = trial.affected;
+  affected.clear();
+  for (int m = 0; m < Nmoved; ++m) {
+    int const p = trial.moved[m];
+    if (p < Ncontrib) affected.push_back(p);
+    double const* const position[2] = {x[p], xMoved[m]};
+    for (int s = 0; s < 2; ++s) {
+      state.for_each_candidate(position[s], [&](int const j) {
+        if (j < Ncontrib && DistanceSquared(position[s], x[j]) <= cutoffSq) {
+          affected.push_back(j);
+        }
+      });
+    }
+  }
+  std::sort(affected.begin(), affected.end());
+  affected.erase(std::unique(affected.begin(), affected.end()),
+                 affected.end());
+  int const Naffected = affected.size();
+
+  // Local copy of the trial configuration: the affected particles (local
+  // indices 0, ..., Naffected-1) and their neighbors
+  std::vector<int> local(affected);
+  std::unordered_map<int, int> localIndex;
+  for (int a = 0; a < Naffected; ++a) {
+    localIndex[affected[a]] = a;
+  }
+  std::function<int(int)> const addLocal = [&](int const p) {
+    std::unordered_map<int, int>::const_iterator const it
+        = localIndex.find(p);
+    if (it != localIndex.end()) return it->second;
+    int const l = local.size();
+    localIndex[p] = l;
+    local.push_back(p);
+    return l;
+  };
+
+  std::vector<int> neighStart(Naffected + 1);
+  std::vector<int> neighList;
+  for (int a = 0; a < Naffected; ++a) {
+    int const p = affected[a];
+    int const mp = movedIndex(p);
+    double const* const xp = (mp >= 0) ? xMoved[mp] : x[p];
+    neighStart[a] = neighList.size();
+    // particles that are not moved are at their binned positions
+    state.for_each_candidate(xp, [&](int const j) {
+      if (j == p || movedIndex(j) >= 0) return;
+      if (DistanceSquared(xp, x[j]) <= cutoffSq) {
+        neighList.push_back(addLocal(j));
+      }
+    });
+    for (int m = 0; m < Nmoved; ++m) {
+      int const j = trial.moved[m];
+      if (j != p && DistanceSquared(xp, xMoved[m]) <= cutoffSq) {
+        neighList.push_back(addLocal(j));
+      }
+    }
+  }
+  neighStart[Naffected] = neighList.size();
+
+  std::vector<double> localCoordinates(local.size()*DIM);
+  std::vector<int> localSpecies(local.size());
+  for (size_t l = 0; l < local.size(); ++l) {
+    int const p = local[l];
+    int const mp = movedIndex(p);
+    double const* const xp = (mp >= 0) ? xMoved[mp] : x[p];
+    std::copy(xp, xp + DIM, &localCoordinates[l*DIM]);
+    localSpecies[l] = (mp >= 0) ? trial.movedSpecies[mp] : state.species[p];
+  }
+
+  // new generalized coords and energies of the affected particles
+  trial.generalizedCoords.assign(Naffected*Ndescriptors, 0.0);
+  for (int a = 0; a < Naffected; ++a) {
+    ComputeGeneralizedCoords(
+        a, neighStart[a+1] - neighStart[a], neighList.data() + neighStart[a],
+        &localSpecies[0],
+        reinterpret_cast<VectorOfSizeDIM const*>(&localCoordinates[0]),
+        &trial.generalizedCoords[a*Ndescriptors], 0);
+  }
+
+  trial.energy.resize(Naffected);
+  trial.deltaEnergy = 0.0;
+  if (Naffected > 0) {
+    network_->forward(&trial.generalizedCoords[0], Naffected, Ndescriptors,
+                      trial.network);
+    double const* const Epart = trial.network.get_output();
+    for (int a = 0; a < Naffected; ++a) {
+      trial.energy[a] = Epart[a];
+      trial.deltaEnergy += Epart[a] - state.energy[affected[a]];
+    }
+  }
+}
+
+//==============================================================================
+//
+// Implementation of LocalMoveState member functions
+//
+//==============================================================================
+
+//******************************************************************************
+void LocalMoveState::bin_particles()
+{
+  double lower[DIM];
+  double upper[DIM];
+  for (int d = 0; d < DIM; ++d) {
+    lower[d] = (numberOfParticles > 0) ? coordinates[d] : 0.0;
+    upper[d] = lower[d];
+  }
+  for (int i = 0; i < numberOfParticles; ++i) {
+    for (int d = 0; d < DIM; ++d) {
+      lower[d] = std::min(lower[d], coordinates[i*DIM + d]);
+      upper[d] = std::max(upper[d], coordinates[i*DIM + d]);
+    }
+  }
+
+  // bins of at least the cutoff size, and not many more bins than particles
+  int numberBins = 1;
+  for (int d = 0; d < DIM; ++d) {
+    double const extent = upper[d] - lower[d];
+    numBins_[d] = (cutoff > 0.0) ? std::max(1, int(extent/cutoff)) : 1;
+    numberBins *= numBins_[d];
+  }
+  while (numberBins > 2*numberOfParticles + 8) {
+    numberBins = 1;
+    for (int d = 0; d < DIM; ++d) {
+      numBins_[d] = (numBins_[d] + 1)/2;
+      numberBins *= numBins_[d];
+    }
+  }
+  for (int d = 0; d < DIM; ++d) {
+    origin_[d] = lower[d];
+    binSize_[d] = std::max((upper[d] - lower[d])/numBins_[d], cutoff);
+  }
+
+  bins_.assign(numberBins, std::vector<int>());
+  binOf_.resize(numberOfParticles);
+  int cell[DIM];
+  for (int i = 0; i < numberOfParticles; ++i) {
+    binOf_[i] = bin_index(&coordinates[i*DIM], cell);
+    bins_[binOf_[i]].push_back(i);
+  }
+}
+
+//******************************************************************************
+void LocalMoveState::move_particle(int const i, double const* const x)
+{
+  std::copy(x, x + DIM, &coordinates[i*DIM]);
+
+  int cell[DIM];
+  int const b = bin_index(x, cell);
+  if (b == binOf_[i]) return;
+
+  std::vector<int>& old = bins_[binOf_[i]];
+  *std::find(old.begin(), old.end(), i) = old.back();
+  old.pop_back();
+  bins_[b].push_back(i);
+  binOf_[i] = b;
+}
+
+//******************************************************************************
+int LocalMoveState::bin_index(double const* const x, int* const cell) const
+{
+  for (int d = 0; d < DIM; ++d) {
+    double const c = floor((x[d] - origin_[d])/binSize_[d]);
+    cell[d] = (c < 0.0) ? 0
+        : ((c >= numBins_[d]) ? numBins_[d] - 1 : int(c));
+  }
+  return (cell[0]*numBins_[1] + cell[1])*numBins_[2] + cell[2];
+}
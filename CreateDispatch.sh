@@ -31,36 +31,51 @@
 #
 
 
-flName=ANNImplementationComputeDispatch.cpp
+# write_dispatch file iterator processdE-values
+#
+# writes the switch over the compute flags that calls the Compute template
+# instantiated with the given iterator
+write_dispatch()
+{
+flName=$1
 
 printf "   switch(GetComputeIndex(isComputeProcess_dEdr,\n"    >  $flName
-printf "                          isComputeProcess_d2Edr2,\n"  >> $flName
 printf "                          isComputeEnergy,\n"          >> $flName
 printf "                          isComputeForces,\n"          >> $flName
-printf "                          isComputeParticleEnergy))\n" >> $flName
+printf "                          isComputeParticleEnergy,\n"  >> $flName
+printf "                          isComputeVirial,\n"          >> $flName
+printf "                          isComputeParticleVirial))\n" >> $flName
 printf "   {\n"                                                >> $flName
 
 i=0
-for iter in LocatorIterator; do
-	for processdE in false true; do
+for iter in $2; do
+	for processdE in $3; do
 		for processd2E in false; do
 			for energy in false true; do
 				for force in false true; do
 					for particleEnergy in false true; do
-						printf "      case $i:\n"                                              >> $flName
-						printf "         ier = Compute< $iter,\n"                 >> $flName
-						printf "                        $processdE, $processd2E,\n"            >> $flName
-						printf "                        $energy, $force,\n"                    >> $flName
-						printf "                        $particleEnergy>(\n"                   >> $flName
-						printf "                  pkim,\n"                                     >> $flName
-						printf "                  particleSpecies,\n"                          >> $flName
-						printf "                  get_neigh,\n"                                >> $flName
-						printf "                  coordinates,\n"                              >> $flName
-						printf "                  energy,\n"                                   >> $flName
-						printf "                  forces,\n"                                   >> $flName
-						printf "                  particleEnergy);\n"                          >> $flName
-						printf "         break;\n"                                             >> $flName
-						i=`expr $i + 1`
+						for virial in false true; do
+							for particleVirial in false true; do
+								printf "      case $i:\n"                                              >> $flName
+								printf "         ier = Compute< $iter,\n"                 >> $flName
+								printf "                        $processdE, $processd2E,\n"            >> $flName
+								printf "                        $energy, $force,\n"                    >> $flName
+								printf "                        $particleEnergy,\n"                    >> $flName
+								printf "                        $virial, $particleVirial>(\n"         >> $flName
+								printf "                  pkim,\n"                                     >> $flName
+								printf "                  *context,\n"                                 >> $flName
+								printf "                  particleSpecies,\n"                          >> $flName
+								printf "                  neighbors,\n"                                >> $flName
+								printf "                  coordinates,\n"                              >> $flName
+								printf "                  energy,\n"                                   >> $flName
+								printf "                  forces,\n"                                   >> $flName
+								printf "                  particleEnergy,\n"                           >> $flName
+								printf "                  virial,\n"                                   >> $flName
+								printf "                  particleVirial);\n"                          >> $flName
+								printf "         break;\n"                                             >> $flName
+								i=`expr $i + 1`
+							done # particleVirial
+						done # virial
 					done # particleEnergy
 				done # force
 			done # energy
@@ -73,3 +88,9 @@ printf "         std::cout << \"Unknown compute function index\" << std::endl;\n
 printf "         ier = KIM_STATUS_FAIL;\n"                                        >> $flName
 printf "         break;\n"                                                        >> $flName
 printf "   }\n"                                                                   >> $flName
+}
+
+# KIM API (get_neigh) and caller-owned neighbor lists; the latter have no
+# process_dEdr callback
+write_dispatch ANNImplementationComputeDispatch.cpp LocatorIterator "false true"
+write_dispatch ANNImplementationArrayDispatch.cpp ArrayIterator "false"
@@ -0,0 +1,195 @@
+//
+// CDDL HEADER START
+//
+// The contents of this file are subject to the terms of the Common Development
+// and Distribution License Version 1.0 (the "License").
+//
+// You can obtain a copy of the license at
+// http://www.opensource.org/licenses/CDDL-1.0.  See the License for the
+// specific language governing permissions and limitations under the License.
+//
+// When distributing Covered Code, include this CDDL HEADER in each file and
+// include the License file in a prominent location with the name LICENSE.CDDL.
+// If applicable, add the following below this CDDL HEADER, with the fields
+// enclosed by brackets "[]" replaced with your own identifying information:
+//
+// Portions Copyright (c) [yyyy] [name of copyright owner]. All rights reserved.
+//
+// CDDL HEADER END
+//
+
+
+//
+// Copyright (c) 2017, Regents of the University of Minnesota.
+// All rights reserved.
+//
+// Contributors:
+//    Mingjian Wen
+//
+
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "KIM_API_status.h"
+#include "ANNImplementation.hpp"
+#include "ann_api.h"
+
+
+struct ann_model
+{
+  ANNImplementation* implementation;
+};
+
+
+//******************************************************************************
+ann_model* ann_model_create(char const* const parameterFile,
+                            int const numberSpecies,
+                            char* const error,
+                            int const errorLength)
+{
+  int ier;
+  std::string message;
+  ANNImplementation* const implementation
+      = new ANNImplementation(parameterFile, numberSpecies, message, &ier);
+  if (ier < KIM_STATUS_OK) {
+    delete implementation;
+    if (error != 0 && errorLength > 0) {
+      strncpy(error, message.c_str(), errorLength - 1);
+      error[errorLength - 1] = '\0';
+    }
+    return 0;
+  }
+
+  ann_model* const model = new ann_model;
+  model->implementation = implementation;
+  return model;
+}
+
+//******************************************************************************
+void ann_model_destroy(ann_model* const model)
+{
+  if (model == 0) return;
+  delete model->implementation;
+  delete model;
+}
+
+//******************************************************************************
+double ann_model_cutoff(ann_model const* const model)
+{
+  return model->implementation->GetCutoff();
+}
+
+//******************************************************************************
+// the counts; the species are checked by ANNImplementation::Compute
+static bool IsValid(ann_configuration const& config)
+{
+  return (config.numberOfParticles >= 0
+          && config.numberContributingParticles >= 0
+          && config.numberContributingParticles <= config.numberOfParticles);
+}
+
+//******************************************************************************
+static void SetArguments(ann_configuration const& config,
+                         ann_results const* const results,
+                         ComputeArguments& arguments)
+{
+  arguments.numberOfParticles = config.numberOfParticles;
+  arguments.numberContributingParticles = config.numberContributingParticles;
+  arguments.particleSpecies = config.species;
+  arguments.coordinates
+      = reinterpret_cast<VectorOfSizeDIM const*>(config.coordinates);
+  arguments.neighbors.numNei = config.numberOfNeighbors;
+  arguments.neighbors.start = config.neighborStart;
+  arguments.neighbors.list = config.neighbors;
+  arguments.energy = results->energy;
+  arguments.forces = reinterpret_cast<VectorOfSizeDIM*>(results->forces);
+  arguments.particleEnergy = results->particleEnergy;
+  arguments.virial = reinterpret_cast<VectorOfSizeSix*>(results->virial);
+  arguments.particleVirial
+      = reinterpret_cast<VectorOfSizeSix*>(results->particleVirial);
+}
+
+//******************************************************************************
+int ann_model_compute(ann_model* const model,
+                      struct ann_configuration const* const configuration,
+                      struct ann_results const* const results)
+{
+  if (IsValid(*configuration) == false) return 1;
+
+  ComputeArguments arguments;
+  SetArguments(*configuration, results, arguments);
+  int const ier = model->implementation->Compute(arguments);
+  return (ier < KIM_STATUS_OK) ? 1 : 0;
+}
+
+//******************************************************************************
+int ann_model_compute_batch(ann_model* const model,
+                            int const numberConfigurations,
+                            struct ann_configuration const* const configurations,
+                            struct ann_results const* const results)
+{
+  if (numberConfigurations < 0) return 1;
+
+  std::vector<ComputeArguments> arguments(numberConfigurations);
+  for (int k = 0; k < numberConfigurations; ++k) {
+    if (IsValid(configurations[k]) == false) return 1;
+    SetArguments(configurations[k], &results[k], arguments[k]);
+  }
+  if (numberConfigurations == 0) return 0;
+  int const ier = model->implementation->ComputeBatch(numberConfigurations,
+                                                      &arguments[0]);
+  return (ier < KIM_STATUS_OK) ? 1 : 0;
+}
+
+//******************************************************************************
+static bool SetAtomsArguments(ann_atoms const& atoms,
+                              ann_results const* const results,
+                              AtomsArguments& arguments)
+{
+  bool const isPeriodic = (atoms.pbc[0] != 0 || atoms.pbc[1] != 0
+                           || atoms.pbc[2] != 0);
+  if (atoms.numberOfAtoms < 0 || (isPeriodic && atoms.lattice == 0)) {
+    return false;
+  }
+  arguments.numberOfAtoms = atoms.numberOfAtoms;
+  arguments.particleSpecies = atoms.species;
+  arguments.coordinates
+      = reinterpret_cast<VectorOfSizeDIM const*>(atoms.coordinates);
+  arguments.lattice = atoms.lattice;
+  for (int d = 0; d < 3; ++d) arguments.periodic[d] = atoms.pbc[d];
+  arguments.energy = results->energy;
+  arguments.forces = reinterpret_cast<VectorOfSizeDIM*>(results->forces);
+  arguments.particleEnergy = results->particleEnergy;
+  arguments.virial = reinterpret_cast<VectorOfSizeSix*>(results->virial);
+  arguments.particleVirial
+      = reinterpret_cast<VectorOfSizeSix*>(results->particleVirial);
+  return true;
+}
+
+//******************************************************************************
+int ann_model_compute_atoms(ann_model* const model,
+                            struct ann_atoms const* const atoms,
+                            struct ann_results const* const results)
+{
+  return ann_model_compute_atoms_batch(model, 1, atoms, results);
+}
+
+//******************************************************************************
+int ann_model_compute_atoms_batch(ann_model* const model,
+                                  int const numberConfigurations,
+                                  struct ann_atoms const* const atoms,
+                                  struct ann_results const* const results)
+{
+  if (numberConfigurations < 0) return 1;
+
+  std::vector<AtomsArguments> arguments(numberConfigurations);
+  for (int k = 0; k < numberConfigurations; ++k) {
+    if (!SetAtomsArguments(atoms[k], &results[k], arguments[k])) return 1;
+  }
+  if (numberConfigurations == 0) return 0;
+  int const ier = model->implementation->ComputeAtoms(numberConfigurations,
+                                                      &arguments[0]);
+  return (ier < KIM_STATUS_OK) ? 1 : 0;
+}
@@ -0,0 +1,146 @@
+//
+// CDDL HEADER START
+//
+// The contents of this file are subject to the terms of the Common Development
+// and Distribution License Version 1.0 (the "License").
+//
+// You can obtain a copy of the license at
+// http://www.opensource.org/licenses/CDDL-1.0.  See the License for the
+// specific language governing permissions and limitations under the License.
+//
+// When distributing Covered Code, include this CDDL HEADER in each file and
+// include the License file in a prominent location with the name LICENSE.CDDL.
+// If applicable, add the following below this CDDL HEADER, with the fields
+// enclosed by brackets "[]" replaced with your own identifying information:
+//
+// Portions Copyright (c) [yyyy] [name of copyright owner]. All rights reserved.
+//
+// CDDL HEADER END
+//
+
+
+//
+// Copyright (c) 2017, Regents of the University of Minnesota.
+// All rights reserved.
+//
+// Contributors:
+//    Mingjian Wen
+//
+
+
+// Standalone interface of the ANN driver, without the KIM API
+//
+// A program creates a model from a parameter file, and evaluates it on
+// configurations given as arrays that it owns.  The arrays are used in place.
+// The runtime options of the driver (ANN_CHUNK_SIZE, ANN_NUM_THREADS, ...,
+// see README) are read from the environment when the model is created.  A
+// model may be used from several threads at the same time.
+//
+//   char error[256];
+//   ann_model* model = ann_model_create("model.params", 2, error, 256);
+//   ... build neighbor lists within ann_model_cutoff(model) ...
+//   struct ann_configuration config = {N, Ncontrib, species, coordinates,
+//                                      numberOfNeighbors, neighborStart,
+//                                      neighbors};
+//   struct ann_results results = {&energy, forces, 0, virial, 0};
+//   ann_model_compute(model, &config, &results);
+//   ... or let the driver build them ...
+//   struct ann_atoms atoms = {N, species, coordinates, lattice, {1, 1, 1}};
+//   ann_model_compute_atoms(model, &atoms, &results);
+//   ann_model_destroy(model);
+//
+// Link with libann.a or libann.so and -pthread.
+
+#ifndef ANN_API_H_
+#define ANN_API_H_
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef struct ann_model ann_model;
+
+// A configuration.  Particles 0, ..., numberContributingParticles-1
+// contribute to the energy; the others (e.g. periodic images) only interact
+// with them.  Each contributing particle has a full neighbor list: the
+// numberOfNeighbors[i] particles within the cutoff of particle i are
+// neighbors[neighborStart[i]], ...
+struct ann_configuration
+{
+  int numberOfParticles;
+  int numberContributingParticles;
+  int const* species;            // [numberOfParticles], 0, ..., numberSpecies-1
+  double const* coordinates;     // [numberOfParticles*3]
+  int const* numberOfNeighbors;  // [numberContributingParticles]
+  int const* neighborStart;      // [numberContributingParticles]
+  int const* neighbors;
+};
+
+// Atoms in a cell, for which the neighbor lists are built by the driver.
+// The lattice holds the cell vectors a, b and c as rows (ax ay az bx by bz cx
+// cy cz; any cell, not only orthogonal ones); pbc[d] is nonzero if the atoms
+// are periodic along the d-th cell vector.  Without periodic directions the
+// lattice may be null.
+struct ann_atoms
+{
+  int numberOfAtoms;
+  int const* species;            // [numberOfAtoms], 0, ..., numberSpecies-1
+  double const* coordinates;     // [numberOfAtoms*3]
+  double const* lattice;         // [9]
+  int pbc[3];
+};
+
+// The outputs of a compute call; the ones that are null are not computed.
+// The virials are ordered xx, yy, zz, yz, xz, xy as in the KIM API.
+struct ann_results
+{
+  double* energy;
+  double* forces;          // [numberOfParticles*3]
+  double* particleEnergy;  // [numberOfParticles]
+  double* virial;          // [6]
+  double* particleVirial;  // [numberOfParticles*6]
+};
+
+// Returns the model of a parameter file (text or binary) for particles of
+// species 0, ..., numberSpecies-1, or null with a message in `error' (of
+// errorLength characters, if not null).
+ann_model* ann_model_create(char const* parameterFile, int numberSpecies,
+                            char* error, int errorLength);
+void ann_model_destroy(ann_model* model);
+
+// largest cutoff of all species pairs
+double ann_model_cutoff(ann_model const* model);
+
+// Computes the outputs of `results' for `configuration'.  Returns 0 on
+// success, nonzero e.g. for a species out of range.
+int ann_model_compute(ann_model* model,
+                      struct ann_configuration const* configuration,
+                      struct ann_results const* results);
+
+// Computes the outputs of results[k] for configurations[k], k = 0, ...,
+// numberConfigurations-1.  Meant for many small configurations (e.g. a
+// training set): the descriptors of the configurations are computed in
+// parallel and the network is evaluated on the particles of many
+// configurations at once.  Returns 0 on success.
+int ann_model_compute_batch(ann_model* model,
+                            int numberConfigurations,
+                            struct ann_configuration const* configurations,
+                            struct ann_results const* results);
+
+// ann_model_compute and ann_model_compute_batch for atoms in cells.  The
+// outputs (of numberOfAtoms particles) include the contributions of the
+// periodic images of the atoms.  Returns 0 on success.
+int ann_model_compute_atoms(ann_model* model,
+                            struct ann_atoms const* atoms,
+                            struct ann_results const* results);
+int ann_model_compute_atoms_batch(ann_model* model,
+                                  int numberConfigurations,
+                                  struct ann_atoms const* atoms,
+                                  struct ann_results const* results);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // ANN_API_H_
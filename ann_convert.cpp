@@ -0,0 +1,85 @@
+//
+// CDDL HEADER START
+//
+// The contents of this file are subject to the terms of the Common Development
+// and Distribution License Version 1.0 (the "License").
+//
+// You can obtain a copy of the license at
+// http://www.opensource.org/licenses/CDDL-1.0.  See the License for the
+// specific language governing permissions and limitations under the License.
+//
+// When distributing Covered Code, include this CDDL HEADER in each file and
+// include the License file in a prominent location with the name LICENSE.CDDL.
+// If applicable, add the following below this CDDL HEADER, with the fields
+// enclosed by brackets "[]" replaced with your own identifying information:
+//
+// Portions Copyright (c) [yyyy] [name of copyright owner]. All rights reserved.
+//
+// CDDL HEADER END
+//
+
+//
+// Copyright (c) 2017, Regents of the University of Minnesota.
+// All rights reserved.
+//
+// Contributors:
+//    Mingjian Wen
+//
+
+
+// Convert a text parameter file to the binary format (see modelio.h)
+//
+// usage: ann_convert <text parameter file> <binary parameter file>
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+#include "modelio.h"
+
+
+int main(int argc, char* argv[])
+{
+  if (argc != 3) {
+    std::cerr << "usage: " << argv[0]
+              << " <text parameter file> <binary parameter file>" << std::endl;
+    return 1;
+  }
+
+  FILE* in = fopen(argv[1], "r");
+  if (in == NULL) {
+    std::cerr << "cannot open `" << argv[1] << "'" << std::endl;
+    return 1;
+  }
+  if (is_binary_model(in)) {
+    std::cerr << "`" << argv[1] << "' is already in binary format" << std::endl;
+    fclose(in);
+    return 1;
+  }
+
+  std::string error;
+  ANNModel model;
+  int ier = read_text_model(in, model, error);
+  fclose(in);
+  if (ier != 0) {
+    std::cerr << "error reading `" << argv[1] << "': " << error << std::endl;
+    return 1;
+  }
+
+  FILE* out = fopen(argv[2], "wb");
+  if (out == NULL) {
+    std::cerr << "cannot open `" << argv[2] << "'" << std::endl;
+    return 1;
+  }
+  ier = write_binary_model(out, model, error);
+  if (fclose(out) != 0 && ier == 0) {
+    error = "unable to close file";
+    ier = 1;
+  }
+  if (ier != 0) {
+    std::cerr << "error writing `" << argv[2] << "': " << error << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
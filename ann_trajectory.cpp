@@ -0,0 +1,482 @@
+//
+// CDDL HEADER START
+//
+// The contents of this file are subject to the terms of the Common Development
+// and Distribution License Version 1.0 (the "License").
+//
+// You can obtain a copy of the license at
+// http://www.opensource.org/licenses/CDDL-1.0.  See the License for the
+// specific language governing permissions and limitations under the License.
+//
+// When distributing Covered Code, include this CDDL HEADER in each file and
+// include the License file in a prominent location with the name LICENSE.CDDL.
+// If applicable, add the following below this CDDL HEADER, with the fields
+// enclosed by brackets "[]" replaced with your own identifying information:
+//
+// Portions Copyright (c) [yyyy] [name of copyright owner]. All rights reserved.
+//
+// CDDL HEADER END
+//
+
+//
+// Copyright (c) 2017, Regents of the University of Minnesota.
+// All rights reserved.
+//
+// Contributors:
+//    Mingjian Wen
+//
+
+
+// Evaluate a model on the frames of a trajectory
+//
+// The frames of an extended XYZ or binary trajectory file (see trajectory.h),
+// e.g. a DFT data set or an MD trajectory, are read in batches.  For each
+// batch the driver builds the periodic images and neighbor lists and
+// evaluates the frames (ann_model_compute_atoms_batch), and the energy,
+// forces and stress of each frame are written before the next batch is read,
+// such that the memory needed does not grow with the number of frames.
+// Frames with reference energies or forces also give the errors of the
+// model.
+//
+// usage: ann_trajectory [options] <trajectory> <parameter file>
+//        ann_trajectory --convert FILE [--species LIST] <trajectory>
+//
+//   --species LIST   species of the model, in order (e.g. Si,C); the
+//                    species symbols of an extended XYZ file are looked up in
+//                    it.  Without it they must be species indices.
+//   --output FILE    results ("-" is the standard output).  Default: -.
+//   --format FORMAT  table (one line per frame) or xyz (extended XYZ with
+//                    energy, stress and forces).  Default: table.
+//   --batch N        frames evaluated together.  Default: 64.
+//   --threads N      threads of the driver (ANN_NUM_THREADS) unless
+//                    ANN_NUM_THREADS is set.  Default: 1.
+//   --convert FILE   write the frames to the binary trajectory FILE instead.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "ann_api.h"
+#include "trajectory.h"
+
+#define DIM 3
+
+
+struct Options
+{
+  std::string trajectoryFile;
+  std::string parameterFile;
+  std::vector<std::string> species;
+  std::string outputFile;
+  std::string format;
+  int batch;
+  int threads;
+  std::string convertFile;
+};
+
+// A frame and its results
+struct Evaluation
+{
+  TrajectoryFrame frame;
+  long index;                       // position in the trajectory
+  std::string error;                // empty if the frame was evaluated
+  double volume;                    // 0 unless periodic in all directions
+  // results
+  double energy;
+  std::vector<double> forces;       // [numberOfAtoms*DIM]
+  double virial[6];
+};
+
+// Errors of the model w.r.t. the reference values of the frames
+struct Statistics
+{
+  long frames;
+  long atoms;
+  long energyFrames;
+  double energySq;                  // per atom
+  double energyAbs;
+  long forceComponents;
+  double forceSq;
+  double forceMax;
+};
+
+
+//******************************************************************************
+static std::vector<std::string> SplitList(std::string const& list)
+{
+  std::vector<std::string> values;
+  std::istringstream stream(list);
+  std::string value;
+  while (std::getline(stream, value, ',')) {
+    if (!value.empty()) values.push_back(value);
+  }
+  return values;
+}
+
+//******************************************************************************
+static bool ParseOptions(int const argc, char* argv[], Options& options)
+{
+  options.outputFile = "-";
+  options.format = "table";
+  options.batch = 64;
+  options.threads = 1;
+
+  std::vector<std::string> files;
+  for (int i = 1; i < argc; ++i) {
+    std::string const arg = argv[i];
+    bool const hasValue = (i + 1 < argc);
+    if (arg == "--species" && hasValue) {
+      options.species = SplitList(argv[++i]);
+    }
+    else if (arg == "--output" && hasValue) {
+      options.outputFile = argv[++i];
+    }
+    else if (arg == "--format" && hasValue) {
+      options.format = argv[++i];
+    }
+    else if (arg == "--batch" && hasValue) {
+      options.batch = atoi(argv[++i]);
+    }
+    else if (arg == "--threads" && hasValue) {
+      options.threads = atoi(argv[++i]);
+    }
+    else if (arg == "--convert" && hasValue) {
+      options.convertFile = argv[++i];
+    }
+    else if (arg == "-" || arg[0] != '-') {
+      files.push_back(arg);
+    }
+    else {
+      return false;
+    }
+  }
+
+  if (files.empty()) return false;
+  options.trajectoryFile = files[0];
+  if (options.convertFile.empty()) {
+    if (files.size() != 2) return false;
+    options.parameterFile = files[1];
+  }
+  else if (files.size() != 1) {
+    return false;
+  }
+  return ((options.format == "table" || options.format == "xyz")
+          && options.batch > 0 && options.threads > 0);
+}
+
+//******************************************************************************
+// volume of the cell of a frame that is periodic in all directions, else 0
+static double GetVolume(TrajectoryFrame const& frame)
+{
+  for (int d = 0; d < DIM; ++d) {
+    if (!frame.is_periodic(d)) return 0.0;
+  }
+  double const* const L = frame.lattice;
+  return std::fabs(L[0]*(L[4]*L[8] - L[5]*L[7]) - L[1]*(L[3]*L[8] - L[5]*L[6])
+                   + L[2]*(L[3]*L[7] - L[4]*L[6]));
+}
+
+//******************************************************************************
+static void SetAtoms(Evaluation& evaluation, ann_atoms& atoms,
+                     ann_results& results)
+{
+  TrajectoryFrame const& frame = evaluation.frame;
+  int const N = frame.number_of_atoms();
+  evaluation.forces.resize(DIM*N);
+  evaluation.volume = GetVolume(frame);
+  atoms.numberOfAtoms = N;
+  atoms.species = frame.species.data();
+  atoms.coordinates = frame.positions.data();
+  atoms.lattice = frame.lattice;
+  for (int d = 0; d < DIM; ++d) atoms.pbc[d] = frame.is_periodic(d) ? 1 : 0;
+  results.energy = &evaluation.energy;
+  results.forces = evaluation.forces.data();
+  results.particleEnergy = 0;
+  results.virial = evaluation.virial;
+  results.particleVirial = 0;
+}
+
+//******************************************************************************
+// energy, forces and virial of the frames of a batch; the periodic images
+// and neighbor lists are made by the driver.  If the batch fails, the frames
+// are evaluated one by one to find those that cannot be evaluated.
+static void EvaluateBatch(ann_model* const model,
+                          std::vector<Evaluation>& batch, int const Nbatch)
+{
+  std::vector<ann_atoms> atoms(Nbatch);
+  std::vector<ann_results> results(Nbatch);
+  for (int b = 0; b < Nbatch; ++b) {
+    batch[b].error.clear();
+    SetAtoms(batch[b], atoms[b], results[b]);
+  }
+  if (Nbatch == 0
+      || ann_model_compute_atoms_batch(model, Nbatch, atoms.data(),
+                                       results.data()) == 0) {
+    return;
+  }
+  for (int b = 0; b < Nbatch; ++b) {
+    if (ann_model_compute_atoms(model, &atoms[b], &results[b]) != 0) {
+      batch[b].error = "the model failed (singular cell or unknown species)";
+    }
+  }
+}
+
+//******************************************************************************
+static void WriteTableHeader(FILE* const out)
+{
+  fprintf(out, "# frame atoms energy stress_xx stress_yy stress_zz stress_yz "
+          "stress_xz stress_xy energy_error_per_atom force_rmse\n");
+}
+
+//******************************************************************************
+// stress = virial / volume, in the Voigt order of the virial (nan if the
+// frame is not periodic in all directions)
+static void GetStress(Evaluation const& evaluation, double* const stress)
+{
+  for (int m = 0; m < 6; ++m) {
+    stress[m] = (evaluation.volume > 0.0)
+        ? evaluation.virial[m]/evaluation.volume : NAN;
+  }
+}
+
+//******************************************************************************
+// errors of one frame w.r.t. its reference values (nan if it has none)
+static void GetErrors(Evaluation const& evaluation, Statistics& statistics,
+                      double& energyError, double& forceRmse)
+{
+  TrajectoryFrame const& frame = evaluation.frame;
+  int const N = frame.number_of_atoms();
+  energyError = NAN;
+  forceRmse = NAN;
+  if ((frame.flags & TRAJECTORY_ENERGY) != 0 && N > 0) {
+    energyError = (evaluation.energy - frame.energy)/N;
+    ++statistics.energyFrames;
+    statistics.energySq += energyError*energyError;
+    statistics.energyAbs += std::fabs(energyError);
+  }
+  if ((frame.flags & TRAJECTORY_FORCES) != 0 && N > 0) {
+    double sq = 0.0;
+    for (int k = 0; k < DIM*N; ++k) {
+      double const e = evaluation.forces[k] - frame.forces[k];
+      sq += e*e;
+      statistics.forceMax = std::max(statistics.forceMax, std::fabs(e));
+    }
+    forceRmse = std::sqrt(sq/(DIM*N));
+    statistics.forceComponents += DIM*N;
+    statistics.forceSq += sq;
+  }
+}
+
+//******************************************************************************
+static void WriteFrame(FILE* const out, Options const& options,
+                       std::vector<std::string> const& speciesNames,
+                       Evaluation const& evaluation, Statistics& statistics)
+{
+  TrajectoryFrame const& frame = evaluation.frame;
+  int const N = frame.number_of_atoms();
+  double stress[6];
+  GetStress(evaluation, stress);
+  double energyError;
+  double forceRmse;
+  GetErrors(evaluation, statistics, energyError, forceRmse);
+  ++statistics.frames;
+  statistics.atoms += N;
+
+  if (options.format == "table") {
+    fprintf(out, "%ld %d %.12g", evaluation.index, N, evaluation.energy);
+    for (int m = 0; m < 6; ++m) fprintf(out, " %.10g", stress[m]);
+    fprintf(out, " %.6g %.6g\n", energyError, forceRmse);
+    return;
+  }
+
+  // extended XYZ; the stress as a 3 by 3 matrix
+  fprintf(out, "%d\n", N);
+  bool periodic = false;
+  for (int d = 0; d < DIM; ++d) periodic = periodic || frame.is_periodic(d);
+  if (periodic) {
+    fprintf(out, "Lattice=\"");
+    for (int k = 0; k < 9; ++k) {
+      fprintf(out, (k == 0) ? "%.10g" : " %.10g", frame.lattice[k]);
+    }
+    fprintf(out, "\" pbc=\"%c %c %c\" ", frame.is_periodic(0) ? 'T' : 'F',
+            frame.is_periodic(1) ? 'T' : 'F', frame.is_periodic(2) ? 'T' : 'F');
+  }
+  fprintf(out, "Properties=species:S:1:pos:R:3:forces:R:3 energy=%.12g",
+          evaluation.energy);
+  if (evaluation.volume > 0.0) {
+    int const voigt[9] = {0, 5, 4, 5, 1, 3, 4, 3, 2};
+    fprintf(out, " stress=\"");
+    for (int k = 0; k < 9; ++k) {
+      fprintf(out, (k == 0) ? "%.10g" : " %.10g", stress[voigt[k]]);
+    }
+    fprintf(out, "\"");
+  }
+  fprintf(out, " frame=%ld\n", evaluation.index);
+  for (int i = 0; i < N; ++i) {
+    int const s = frame.species[i];
+    if (speciesNames.empty()) {
+      fprintf(out, "%d", s);
+    }
+    else {
+      fprintf(out, "%s", speciesNames[s].c_str());
+    }
+    for (int d = 0; d < DIM; ++d) {
+      fprintf(out, " %.10g", frame.positions[DIM*i + d]);
+    }
+    for (int d = 0; d < DIM; ++d) {
+      fprintf(out, " %.10g", evaluation.forces[DIM*i + d]);
+    }
+    fprintf(out, "\n");
+  }
+}
+
+//******************************************************************************
+static int Convert(Options const& options, TrajectoryReader& reader)
+{
+  std::string error;
+  FILE* const out = fopen(options.convertFile.c_str(), "wb");
+  if (out == NULL) {
+    std::cerr << "cannot open `" << options.convertFile << "'" << std::endl;
+    return 1;
+  }
+  int ier = write_trajectory_header(out, reader.get_species_names(), error);
+  TrajectoryFrame frame;
+  bool done = false;
+  while (ier == 0) {
+    ier = reader.read(frame, done, error);
+    if (ier != 0 || done) break;
+    ier = write_trajectory_frame(out, frame, error);
+  }
+  if (fclose(out) != 0 && ier == 0) {
+    error = "unable to close file";
+    ier = 1;
+  }
+  if (ier != 0) {
+    std::cerr << "error converting `" << options.trajectoryFile << "': "
+              << error << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+//******************************************************************************
+int main(int argc, char* argv[])
+{
+  Options options;
+  if (!ParseOptions(argc, argv, options)) {
+    std::cerr << "usage: " << argv[0] << " [--species LIST] [--output FILE]"
+              << " [--format table|xyz] [--batch N] [--threads N]"
+              << " <trajectory> <parameter file>" << std::endl
+              << "       " << argv[0] << " --convert FILE [--species LIST]"
+              << " <trajectory>" << std::endl;
+    return 1;
+  }
+
+  std::string error;
+  TrajectoryReader reader;
+  if (reader.open(options.trajectoryFile, options.species, error) != 0) {
+    std::cerr << error << std::endl;
+    return 1;
+  }
+  if (!options.convertFile.empty()) return Convert(options, reader);
+
+  // the threads of the driver
+  if (getenv("ANN_NUM_THREADS") == NULL) {
+    std::ostringstream threads;
+    threads << options.threads;
+    setenv("ANN_NUM_THREADS", threads.str().c_str(), 1);
+  }
+  std::vector<std::string> const& speciesNames = reader.get_species_names();
+  int const numberSpecies = speciesNames.empty() ? 1 : speciesNames.size();
+  char message[256];
+  ann_model* const model = ann_model_create(options.parameterFile.c_str(),
+                                            numberSpecies, message,
+                                            sizeof(message));
+  if (model == 0) {
+    std::cerr << "cannot create the model from " << options.parameterFile
+              << ": " << message << std::endl;
+    return 1;
+  }
+
+  FILE* const out = (options.outputFile == "-")
+      ? stdout : fopen(options.outputFile.c_str(), "w");
+  if (out == NULL) {
+    std::cerr << "cannot open `" << options.outputFile << "'" << std::endl;
+    ann_model_destroy(model);
+    return 1;
+  }
+  if (options.format == "table") WriteTableHeader(out);
+
+  std::vector<Evaluation> batch(options.batch);
+  Statistics statistics = Statistics();
+  double seconds[3] = {0.0, 0.0, 0.0};  // read, model, write
+  long index = 0;
+  int ier = 0;
+  bool done = false;
+  while (!done && ier == 0) {
+    std::chrono::steady_clock::time_point lap
+        = std::chrono::steady_clock::now();
+    int Nbatch = 0;
+    while (Nbatch < options.batch) {
+      ier = reader.read(batch[Nbatch].frame, done, error);
+      if (ier != 0 || done) break;
+      batch[Nbatch].index = index++;
+      ++Nbatch;
+    }
+    std::chrono::steady_clock::time_point now
+        = std::chrono::steady_clock::now();
+    seconds[0] += std::chrono::duration<double>(now - lap).count();
+    lap = now;
+
+    EvaluateBatch(model, batch, Nbatch);
+    now = std::chrono::steady_clock::now();
+    seconds[1] += std::chrono::duration<double>(now - lap).count();
+    lap = now;
+
+    for (int b = 0; b < Nbatch; ++b) {
+      if (!batch[b].error.empty()) {
+        std::cerr << "frame " << batch[b].index << ": " << batch[b].error
+                  << std::endl;
+        continue;
+      }
+      WriteFrame(out, options, speciesNames, batch[b], statistics);
+    }
+    fflush(out);
+    seconds[2] += std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - lap).count();
+  }
+  if (out != stdout) fclose(out);
+  ann_model_destroy(model);
+  if (ier != 0) {
+    std::cerr << "error reading `" << options.trajectoryFile << "': " << error
+              << std::endl;
+    return 1;
+  }
+
+  // summary
+  double const total = seconds[0] + seconds[1] + seconds[2];
+  fprintf(stderr, "%ld frames, %ld atoms in %.3f s (%.1f frames/s, %.0f "
+          "atoms/s)\n", statistics.frames, statistics.atoms, total,
+          (total > 0.0) ? statistics.frames/total : 0.0,
+          (total > 0.0) ? statistics.atoms/total : 0.0);
+  fprintf(stderr, "  read %.3f s, model %.3f s, write %.3f s\n", seconds[0],
+          seconds[1], seconds[2]);
+  if (statistics.energyFrames > 0) {
+    fprintf(stderr, "energy error per atom: mae %.4e rmse %.4e (%ld frames)\n",
+            statistics.energyAbs/statistics.energyFrames,
+            std::sqrt(statistics.energySq/statistics.energyFrames),
+            statistics.energyFrames);
+  }
+  if (statistics.forceComponents > 0) {
+    fprintf(stderr, "force component error: rmse %.4e max %.4e\n",
+            std::sqrt(statistics.forceSq/statistics.forceComponents),
+            statistics.forceMax);
+  }
+  return 0;
+}
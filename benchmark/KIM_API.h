@@ -0,0 +1,282 @@
+//
+// CDDL HEADER START
+//
+// The contents of this file are subject to the terms of the Common Development
+// and Distribution License Version 1.0 (the "License").
+//
+// You can obtain a copy of the license at
+// http://www.opensource.org/licenses/CDDL-1.0.  See the License for the
+// specific language governing permissions and limitations under the License.
+//
+// When distributing Covered Code, include this CDDL HEADER in each file and
+// include the License file in a prominent location with the name LICENSE.CDDL.
+// If applicable, add the following below this CDDL HEADER, with the fields
+// enclosed by brackets "[]" replaced with your own identifying information:
+//
+// Portions Copyright (c) [yyyy] [name of copyright owner]. All rights reserved.
+//
+// CDDL HEADER END
+//
+
+//
+// Copyright (c) 2017, Regents of the University of Minnesota.
+// All rights reserved.
+//
+// Contributors:
+//    Mingjian Wen
+//
+
+
+
+// Stand-in for the part of the KIM API (version 1.6) used by the driver
+//
+// The driver can be built against this header instead of a KIM installation
+// and be run from a standalone program (see ann_benchmark.cpp).  The program
+// takes the role of the simulator: it sets the model inputs and outputs by
+// name (set_data, set_compute), and provides the get_neigh method and the
+// neighbor list object.  The driver accesses them by index as through the
+// KIM API.  Units are not converted.
+
+#ifndef KIM_API_H_
+#define KIM_API_H_
+
+#include <cstdarg>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "KIM_API_status.h"
+
+typedef void (*func_ptr)();
+
+class KIM_API_model
+{
+ public:
+  // handlers of process_dEdr and process_d2Edr2, called with the arguments
+  // of the driver
+  typedef int (ProcessDEdrFunction)(double dEdr, double r, double const* dx,
+                                    int i, int j);
+  typedef int (ProcessD2Edr2Function)(double d2Edr2, double const* r,
+                                      double const* dx, int const* i,
+                                      int const* j);
+
+  // a model with the given species (species code = position in the list)
+  explicit KIM_API_model(std::vector<std::string> const& speciesNames)
+      : species_(speciesNames),
+        modelBuffer_(0),
+        processDEdr_(0),
+        processD2Edr2_(0)
+  {}
+
+  //
+  // simulator side
+  //
+  // set the data of argument `name'; compute flags of outputs are set to true
+  void set_data(char const* const name, void* const data)
+  {
+    arguments_[index(name)].data = data;
+    arguments_[index(name)].compute = KIM_COMPUTE_TRUE;
+  }
+  void set_compute(char const* const name, bool const compute)
+  {
+    arguments_[index(name)].compute
+        = compute ? KIM_COMPUTE_TRUE : KIM_COMPUTE_FALSE;
+  }
+  void* get_data(char const* const name)
+  {
+    return arguments_[index(name)].data;
+  }
+  void set_process_dEdr(ProcessDEdrFunction* const f) { processDEdr_ = f; }
+  void set_process_d2Edr2(ProcessD2Edr2Function* const f)
+  {
+    processD2Edr2_ = f;
+  }
+
+  //
+  // model side (KIM API)
+  //
+  int get_model_index_shift() const { return 0; }  // zero-based lists
+
+  void getm_index(int* const ier, int const numargs, ...)
+  {
+    va_list ap;
+    va_start(ap, numargs);
+    for (int k = 0; k < numargs/3; ++k) {
+      char const* const name = va_arg(ap, char const*);
+      int* const ind = va_arg(ap, int*);
+      va_arg(ap, int);  // required
+      *ind = index(name);
+    }
+    va_end(ap);
+    *ier = KIM_STATUS_OK;
+  }
+
+  void getm_compute_by_index(int* const ier, int const numargs, ...)
+  {
+    va_list ap;
+    va_start(ap, numargs);
+    for (int k = 0; k < numargs/3; ++k) {
+      int const ind = va_arg(ap, int);
+      int* const compute = va_arg(ap, int*);
+      va_arg(ap, int);  // required
+      *compute = arguments_[ind].compute;
+    }
+    va_end(ap);
+    *ier = KIM_STATUS_OK;
+  }
+
+  void getm_data_by_index(int* const ier, int const numargs, ...)
+  {
+    va_list ap;
+    va_start(ap, numargs);
+    for (int k = 0; k < numargs/3; ++k) {
+      int const ind = va_arg(ap, int);
+      void** const data = va_arg(ap, void**);
+      int const required = va_arg(ap, int);
+      if (required) *data = arguments_[ind].data;
+    }
+    va_end(ap);
+    *ier = KIM_STATUS_OK;
+  }
+
+  void* get_data_by_index(int const ind, int* const ier)
+  {
+    *ier = KIM_STATUS_OK;
+    return arguments_[ind].data;
+  }
+
+  void* get_method_by_index(int const ind, int* const ier)
+  {
+    *ier = KIM_STATUS_OK;
+    return arguments_[ind].data;
+  }
+
+  void setm_data(int* const ier, int const numargs, ...)
+  {
+    va_list ap;
+    va_start(ap, numargs);
+    for (int k = 0; k < numargs/4; ++k) {
+      char const* const name = va_arg(ap, char const*);
+      va_arg(ap, int);  // size
+      void* const data = va_arg(ap, void*);
+      va_arg(ap, int);  // required
+      arguments_[index(name)].data = data;
+    }
+    va_end(ap);
+    *ier = KIM_STATUS_OK;
+  }
+
+  void setm_method(int* const ier, int const numargs, ...)
+  {
+    va_list ap;
+    va_start(ap, numargs);
+    for (int k = 0; k < numargs/4; ++k) {
+      char const* const name = va_arg(ap, char const*);
+      va_arg(ap, int);  // size
+      func_ptr const method = va_arg(ap, func_ptr);
+      va_arg(ap, int);  // required
+      arguments_[index(name)].data = reinterpret_cast<void*>(method);
+    }
+    va_end(ap);
+    *ier = KIM_STATUS_OK;
+  }
+
+  int get_num_model_species(int* const numberSpecies,
+                            int* const maxStringLength) const
+  {
+    *numberSpecies = species_.size();
+    *maxStringLength = 0;
+    for (size_t i = 0; i < species_.size(); ++i) {
+      if (int(species_[i].size()) > *maxStringLength) {
+        *maxStringLength = species_[i].size();
+      }
+    }
+    return KIM_STATUS_OK;
+  }
+
+  int get_num_sim_species(int* const numberSpecies,
+                          int* const maxStringLength) const
+  {
+    return get_num_model_species(numberSpecies, maxStringLength);
+  }
+
+  int get_sim_species(int const ind, char const** const species) const
+  {
+    if (ind < 0 || ind >= int(species_.size())) return KIM_STATUS_FAIL;
+    *species = species_[ind].c_str();
+    return KIM_STATUS_OK;
+  }
+
+  int get_species_code(char const* const species, int* const ier) const
+  {
+    for (size_t i = 0; i < species_.size(); ++i) {
+      if (species_[i] == species) {
+        *ier = KIM_STATUS_OK;
+        return i;
+      }
+    }
+    *ier = KIM_STATUS_FAIL;
+    return -1;
+  }
+
+  void set_model_buffer(void* const buffer, int* const ier)
+  {
+    modelBuffer_ = buffer;
+    *ier = KIM_STATUS_OK;
+  }
+
+  void* get_model_buffer(int* const ier) const
+  {
+    *ier = KIM_STATUS_OK;
+    return modelBuffer_;
+  }
+
+  static int process_dEdr(KIM_API_model** const ppkim, double* const dEdr,
+                          double* const r, double** const dx, int* const i,
+                          int* const j)
+  {
+    ProcessDEdrFunction* const f = (*ppkim)->processDEdr_;
+    return (f != 0) ? f(*dEdr, *r, *dx, *i, *j) : KIM_STATUS_OK;
+  }
+
+  static int process_d2Edr2(KIM_API_model** const ppkim,
+                            double* const d2Edr2, double** const r,
+                            double** const dx, int** const i, int** const j)
+  {
+    ProcessD2Edr2Function* const f = (*ppkim)->processD2Edr2_;
+    return (f != 0) ? f(*d2Edr2, *r, *dx, *i, *j) : KIM_STATUS_OK;
+  }
+
+  int report_error(int const line, char const* const file,
+                   char const* const message, int const error) const
+  {
+    fprintf(stderr, "* Error (%d) at line %d in %s: %s\n", error, line, file,
+            message);
+    return KIM_STATUS_OK;
+  }
+
+ private:
+  struct Argument
+  {
+    std::string name;
+    void* data;
+    int compute;
+  };
+  std::vector<Argument> arguments_;
+  std::vector<std::string> species_;
+  void* modelBuffer_;
+  ProcessDEdrFunction* processDEdr_;
+  ProcessD2Edr2Function* processD2Edr2_;
+
+  // index of argument `name', which is added if it is not known yet
+  int index(char const* const name)
+  {
+    for (size_t i = 0; i < arguments_.size(); ++i) {
+      if (arguments_[i].name == name) return i;
+    }
+    Argument const argument = {name, 0, KIM_COMPUTE_FALSE};
+    arguments_.push_back(argument);
+    return arguments_.size() - 1;
+  }
+};
+
+#endif  // KIM_API_H_
@@ -0,0 +1,42 @@
+//
+// CDDL HEADER START
+//
+// The contents of this file are subject to the terms of the Common Development
+// and Distribution License Version 1.0 (the "License").
+//
+// You can obtain a copy of the license at
+// http://www.opensource.org/licenses/CDDL-1.0.  See the License for the
+// specific language governing permissions and limitations under the License.
+//
+// When distributing Covered Code, include this CDDL HEADER in each file and
+// include the License file in a prominent location with the name LICENSE.CDDL.
+// If applicable, add the following below this CDDL HEADER, with the fields
+// enclosed by brackets "[]" replaced with your own identifying information:
+//
+// Portions Copyright (c) [yyyy] [name of copyright owner]. All rights reserved.
+//
+// CDDL HEADER END
+//
+
+//
+// Copyright (c) 2017, Regents of the University of Minnesota.
+// All rights reserved.
+//
+// Contributors:
+//    Mingjian Wen
+//
+
+
+
+// Stand-in for the status codes of the KIM API (see KIM_API.h)
+
+#ifndef KIM_API_STATUS_H_
+#define KIM_API_STATUS_H_
+
+#define KIM_STATUS_OK 1
+#define KIM_STATUS_FAIL 0
+
+#define KIM_COMPUTE_FALSE 0
+#define KIM_COMPUTE_TRUE 1
+
+#endif  // KIM_API_STATUS_H_
@@ -0,0 +1,565 @@
+//
+// CDDL HEADER START
+//
+// The contents of this file are subject to the terms of the Common Development
+// and Distribution License Version 1.0 (the "License").
+//
+// You can obtain a copy of the license at
+// http://www.opensource.org/licenses/CDDL-1.0.  See the License for the
+// specific language governing permissions and limitations under the License.
+//
+// When distributing Covered Code, include this CDDL HEADER in each file and
+// include the License file in a prominent location with the name LICENSE.CDDL.
+// If applicable, add the following below this CDDL HEADER, with the fields
+// enclosed by brackets "[]" replaced with your own identifying information:
+//
+// Portions Copyright (c) [yyyy] [name of copyright owner]. All rights reserved.
+//
+// CDDL HEADER END
+//
+
+//
+// Copyright (c) 2017, Regents of the University of Minnesota.
+// All rights reserved.
+//
+// Contributors:
+//    Mingjian Wen
+//
+
+
+// Audit of the approximations of the driver
+//
+// The configurations of a trajectory are evaluated with the reference
+// (exact) evaluation and with a fast one, which is the same model created
+// with additional runtime options (the "modes", e.g. ANN_MEMO_TOLERANCE=0.01).
+// The program reports the distribution of the energy and force errors of the
+// fast evaluation, its speedup, and the drift of the total energy of an NVE
+// segment run with each evaluation, such that a model can be certified for a
+// mode.
+//
+// The trajectory is either generated (molecular dynamics with the reference
+// evaluation from a synthetic structure, with unit masses and velocity
+// Verlet), or the Compute calls of a capture file (see ANN_CAPTURE_FILE),
+// for which there is no NVE segment.
+//
+// usage: ann_audit [options] --mode NAME=VALUE [--mode ...] <parameter file>
+//
+//   --mode NAME=VALUE  runtime option of the fast evaluation (see README);
+//                      it is removed from the environment of the reference.
+//   --capture FILE     take the configurations of a capture file.
+//   --structure NAME   bulk, surface, liquid or alloy (see ann_benchmark).
+//                      Default: liquid.
+//   --atoms N          approximate number of atoms.  Default: 256.
+//   --density RHO      atoms per unit volume.  Default: 0.05.
+//   --species N        number of species of the model.  Default: 2.
+//   --temperature T    initial temperature, in energy units.  Default: 0.02.
+//   --timestep DT      time step.  Default: 0.002.
+//   --frames N         configurations of the trajectory.  Default: 10.
+//   --interval N       time steps between them.  Default: 5.
+//   --nve-steps N      length of the NVE segment.  Default: 100.
+//   --repeat N         timed evaluations of each configuration.  Default: 3.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "KIM_API.h"
+#include "KIM_API_status.h"
+#include "ANNImplementation.hpp"
+#include "capture.h"
+#include "structures.h"
+
+
+struct Options
+{
+  std::string parameterFile;
+  std::vector<std::string> modes;
+  std::string captureFile;
+  std::string structure;
+  int atoms;
+  double density;
+  int numberSpecies;
+  double temperature;
+  double timestep;
+  int frames;
+  int interval;
+  int nveSteps;
+  int repeat;
+};
+
+// A configuration with its neighbor lists
+struct Frame
+{
+  Configuration config;
+  NeighborList neighbors;
+};
+
+
+// The model created with the runtime options of the environment, with the
+// names of `modes' removed (reference) or set to their values (fast), and its
+// own stand-in of the KIM API
+class Evaluator
+{
+ public:
+  double cutoff;
+
+  Evaluator(Options const& options, int const numberSpecies, bool const fast)
+      : cutoff(0.0),
+        kim_(SpeciesNames(numberSpecies)),
+        numberSpecies_(numberSpecies),
+        ann_(0)
+  {
+    // set the environment of the model, and restore it after its creation
+    std::vector<std::string> names;
+    std::vector<std::string> oldValues;
+    std::vector<bool> wasSet;
+    for (size_t m = 0; m < options.modes.size(); ++m) {
+      std::string const& mode = options.modes[m];
+      size_t const equal = mode.find('=');
+      std::string const name = mode.substr(0, equal);
+      char const* const oldValue = getenv(name.c_str());
+      names.push_back(name);
+      wasSet.push_back(oldValue != NULL);
+      oldValues.push_back(oldValue != NULL ? oldValue : "");
+      if (fast) {
+        setenv(name.c_str(), mode.substr(equal + 1).c_str(), 1);
+      }
+      else {
+        unsetenv(name.c_str());
+      }
+    }
+
+    kim_.set_data("cutoff", &cutoff);
+    kim_.set_data("get_neigh", reinterpret_cast<void*>(&GetNeigh));
+    kim_.set_data("numberOfSpecies", &numberSpecies_);
+    int ier;
+    std::string const& fileName = options.parameterFile;
+    ann_ = new ANNImplementation(&kim_, fileName.c_str(), fileName.size() + 1,
+                                 1, &ier);
+    if (ier < KIM_STATUS_OK) {
+      delete ann_;
+      ann_ = 0;
+    }
+
+    for (size_t m = 0; m < names.size(); ++m) {
+      if (wasSet[m]) {
+        setenv(names[m].c_str(), oldValues[m].c_str(), 1);
+      }
+      else {
+        unsetenv(names[m].c_str());
+      }
+    }
+  }
+
+  ~Evaluator() { delete ann_; }
+
+  bool ok() const { return ann_ != 0; }
+
+  // energy and forces of a frame, with the forces on the ghosts added to
+  // their contributing atoms; returns the seconds of the Compute call
+  double compute(Frame& frame, double& energy, std::vector<double>& forces)
+  {
+    Configuration& config = frame.config;
+    int numberOfParticles = config.size();
+    forces.resize(numberOfParticles*DIM);
+    kim_.set_data("numberOfParticles", &numberOfParticles);
+    kim_.set_data("particleSpecies", config.species.data());
+    kim_.set_data("particleStatus", config.status.data());
+    kim_.set_data("coordinates", config.coordinates.data());
+    kim_.set_data("neighObject", &frame.neighbors);
+    kim_.set_data("energy", &energy);
+    kim_.set_data("forces", forces.data());
+    kim_.set_compute("particleEnergy", false);
+    kim_.set_compute("virial", false);
+    kim_.set_compute("particleVirial", false);
+    kim_.set_compute("process_dEdr", false);
+    kim_.set_compute("process_d2Edr2", false);
+
+    std::chrono::steady_clock::time_point const start
+        = std::chrono::steady_clock::now();
+    int const ier = ann_->Compute(&kim_);
+    double const seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    if (ier < KIM_STATUS_OK) {
+      std::cerr << "Compute failed" << std::endl;
+      exit(1);
+    }
+
+    for (int i = config.numberContributing; i < numberOfParticles; ++i) {
+      int const owner = config.owner[i];
+      if (owner == i) continue;
+      for (int d = 0; d < DIM; ++d) {
+        forces[owner*DIM + d] += forces[i*DIM + d];
+        forces[i*DIM + d] = 0.0;
+      }
+    }
+    return seconds;
+  }
+
+ private:
+  KIM_API_model kim_;
+  int numberSpecies_;
+  ANNImplementation* ann_;
+
+  static std::vector<std::string> SpeciesNames(int const numberSpecies)
+  {
+    std::vector<std::string> names;
+    for (int s = 0; s < numberSpecies; ++s) {
+      names.push_back(std::string("S") + char('A' + s % 26));
+    }
+    return names;
+  }
+
+  Evaluator(Evaluator const&);
+  Evaluator& operator=(Evaluator const&);
+};
+
+
+// State of the molecular dynamics (unit masses)
+struct Dynamics
+{
+  Frame frame;
+  std::vector<double> velocities;  // [numberContributing*DIM]
+  std::vector<double> forces;      // [numberOfParticles*DIM]
+  double potentialEnergy;
+
+  double kinetic_energy() const
+  {
+    double sum = 0.0;
+    for (size_t k = 0; k < velocities.size(); ++k) {
+      sum += 0.5*velocities[k]*velocities[k];
+    }
+    return sum;
+  }
+};
+
+
+//******************************************************************************
+// one velocity Verlet step; the neighbor lists are rebuilt every step
+void Step(Evaluator& evaluator, double const dt, Dynamics& md)
+{
+  Configuration& config = md.frame.config;
+  int const N = config.numberContributing;
+  for (int k = 0; k < N*DIM; ++k) {
+    md.velocities[k] += 0.5*dt*md.forces[k];
+    config.coordinates[k] += dt*md.velocities[k];
+  }
+  UpdateGhosts(evaluator.cutoff, config);
+  BuildNeighborList(config, evaluator.cutoff, md.frame.neighbors);
+  evaluator.compute(md.frame, md.potentialEnergy, md.forces);
+  for (int k = 0; k < N*DIM; ++k) {
+    md.velocities[k] += 0.5*dt*md.forces[k];
+  }
+}
+
+//******************************************************************************
+// the frames of a capture file (without ghost owners, so their forces are
+// compared as they are)
+bool ReadCaptureFrames(std::string const& fileName, std::vector<Frame>& frames,
+                       int& numberSpecies)
+{
+  FILE* const file = fopen(fileName.c_str(), "rb");
+  if (file == NULL) return false;
+  std::string error;
+  CapturedCall call;
+  bool end = false;
+  bool ok = (read_capture_header(file, error) == 0);
+  while (ok && read_captured_call(file, call, end, error) == 0 && !end) {
+    Frame frame;
+    Configuration& config = frame.config;
+    int const N = call.number_of_particles();
+    int const M = call.number_of_lists();
+    config.coordinates = call.coordinates;
+    config.species = call.particleSpecies;
+    config.status = call.particleStatus;
+    config.numberContributing = M;
+    config.owner.resize(N);
+    for (int i = 0; i < N; ++i) {
+      config.owner[i] = i;
+      numberSpecies = std::max(numberSpecies, config.species[i] + 1);
+    }
+    frame.neighbors.numberContributing = M;
+    frame.neighbors.start = call.neighStart;
+    frame.neighbors.list = call.neighbors;
+    for (int m = 0; m < M; ++m) {
+      if (call.particle[m] != m) ok = false;  // GetNeigh returns list m for m
+    }
+    frames.push_back(frame);
+  }
+  fclose(file);
+  if (!error.empty() || !ok) {
+    std::cerr << fileName << ": "
+              << (error.empty() ? "unsupported neighbor list order" : error)
+              << std::endl;
+    return false;
+  }
+  return true;
+}
+
+//******************************************************************************
+// value below which a fraction q of the sorted values lie
+double Quantile(std::vector<double> const& sorted, double const q)
+{
+  if (sorted.empty()) return 0.0;
+  size_t const k = std::min(sorted.size() - 1, size_t(q*sorted.size()));
+  return sorted[k];
+}
+
+// slope of the least-squares line through (t[k], y[k])
+double Slope(std::vector<double> const& t, std::vector<double> const& y)
+{
+  double const n = t.size();
+  double st = 0.0, sy = 0.0, stt = 0.0, sty = 0.0;
+  for (size_t k = 0; k < t.size(); ++k) {
+    st += t[k];
+    sy += y[k];
+    stt += t[k]*t[k];
+    sty += t[k]*y[k];
+  }
+  double const denominator = n*stt - st*st;
+  return (denominator > 0.0) ? (n*sty - st*sy)/denominator : 0.0;
+}
+
+// NVE segment from `start'; sets the slope and largest deviation of the total
+// energy per atom
+void RunNVE(Evaluator& evaluator, Dynamics const& start, Options const& options,
+            double& slope, double& deviation)
+{
+  Dynamics md = start;
+  evaluator.compute(md.frame, md.potentialEnergy, md.forces);
+  double const N = md.frame.config.numberContributing;
+  std::vector<double> t;
+  std::vector<double> e;
+  double const e0 = (md.potentialEnergy + md.kinetic_energy())/N;
+  deviation = 0.0;
+  for (int step = 0; step <= options.nveSteps; ++step) {
+    if (step > 0) Step(evaluator, options.timestep, md);
+    double const energy = (md.potentialEnergy + md.kinetic_energy())/N;
+    t.push_back(step*options.timestep);
+    e.push_back(energy);
+    deviation = std::max(deviation, std::fabs(energy - e0));
+  }
+  slope = Slope(t, e);
+}
+
+//******************************************************************************
+bool ParseOptions(int argc, char* argv[], Options& options)
+{
+  options.structure = "liquid";
+  options.atoms = 256;
+  options.density = 0.05;
+  options.numberSpecies = 2;
+  options.temperature = 0.02;
+  options.timestep = 0.002;
+  options.frames = 10;
+  options.interval = 5;
+  options.nveSteps = 100;
+  options.repeat = 3;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string const arg = argv[i];
+    bool const hasValue = (i + 1 < argc);
+    if (arg == "--mode" && hasValue) {
+      std::string const mode = argv[++i];
+      if (mode.find('=') == std::string::npos || mode[0] == '=') return false;
+      options.modes.push_back(mode);
+    }
+    else if (arg == "--capture" && hasValue) {
+      options.captureFile = argv[++i];
+    }
+    else if (arg == "--structure" && hasValue) {
+      options.structure = argv[++i];
+    }
+    else if (arg == "--atoms" && hasValue) {
+      options.atoms = atoi(argv[++i]);
+    }
+    else if (arg == "--density" && hasValue) {
+      options.density = atof(argv[++i]);
+    }
+    else if (arg == "--species" && hasValue) {
+      options.numberSpecies = atoi(argv[++i]);
+    }
+    else if (arg == "--temperature" && hasValue) {
+      options.temperature = atof(argv[++i]);
+    }
+    else if (arg == "--timestep" && hasValue) {
+      options.timestep = atof(argv[++i]);
+    }
+    else if (arg == "--frames" && hasValue) {
+      options.frames = atoi(argv[++i]);
+    }
+    else if (arg == "--interval" && hasValue) {
+      options.interval = atoi(argv[++i]);
+    }
+    else if (arg == "--nve-steps" && hasValue) {
+      options.nveSteps = atoi(argv[++i]);
+    }
+    else if (arg == "--repeat" && hasValue) {
+      options.repeat = atoi(argv[++i]);
+    }
+    else if (arg[0] != '-' && options.parameterFile.empty()) {
+      options.parameterFile = arg;
+    }
+    else {
+      return false;
+    }
+  }
+
+  std::string const& s = options.structure;
+  return (!options.parameterFile.empty() && !options.modes.empty()
+          && (s == "bulk" || s == "surface" || s == "liquid" || s == "alloy")
+          && options.atoms > 0 && options.density > 0.0
+          && options.numberSpecies > 0 && options.temperature >= 0.0
+          && options.timestep > 0.0 && options.frames > 0
+          && options.interval > 0 && options.nveSteps >= 0
+          && options.repeat > 0);
+}
+
+//******************************************************************************
+int main(int argc, char* argv[])
+{
+  Options options;
+  if (!ParseOptions(argc, argv, options)) {
+    std::cerr << "usage: " << argv[0] << " --mode NAME=VALUE [--mode ...]"
+              << " [--capture FILE] [--structure NAME] [--atoms N]"
+              << " [--density RHO] [--species N] [--temperature T]"
+              << " [--timestep DT] [--frames N] [--interval N]"
+              << " [--nve-steps N] [--repeat N] <parameter file>"
+              << std::endl;
+    return 1;
+  }
+
+  // trajectory
+  std::vector<Frame> frames;
+  int numberSpecies = options.numberSpecies;
+  if (!options.captureFile.empty()) {
+    numberSpecies = 1;
+    if (!ReadCaptureFrames(options.captureFile, frames, numberSpecies)) {
+      return 1;
+    }
+  }
+
+  Evaluator reference(options, numberSpecies, false);
+  Evaluator fast(options, numberSpecies, true);
+  if (!reference.ok() || !fast.ok()) {
+    std::cerr << "cannot create the model from " << options.parameterFile
+              << std::endl;
+    return 1;
+  }
+
+  Dynamics md;
+  if (options.captureFile.empty()) {
+    std::mt19937 random(12345);
+    Configuration& config = md.frame.config;
+    config = MakeStructure(options.structure, options.atoms, options.density,
+                           options.numberSpecies, reference.cutoff, random);
+    BuildNeighborList(config, reference.cutoff, md.frame.neighbors);
+    reference.compute(md.frame, md.potentialEnergy, md.forces);
+
+    // Maxwell-Boltzmann velocities without net momentum
+    int const N = config.numberContributing;
+    std::normal_distribution<double> velocity(
+        0.0, std::sqrt(options.temperature));
+    md.velocities.resize(N*DIM);
+    for (int k = 0; k < N*DIM; ++k) md.velocities[k] = velocity(random);
+    for (int d = 0; d < DIM; ++d) {
+      double mean = 0.0;
+      for (int i = 0; i < N; ++i) mean += md.velocities[i*DIM + d]/N;
+      for (int i = 0; i < N; ++i) md.velocities[i*DIM + d] -= mean;
+    }
+
+    for (int f = 0; f < options.frames; ++f) {
+      for (int step = 0; step < options.interval; ++step) {
+        Step(reference, options.timestep, md);
+      }
+      frames.push_back(md.frame);
+    }
+  }
+
+  // errors and timings
+  std::vector<double> energyErrors;
+  std::vector<double> forceErrors;
+  double forceSq = 0.0;
+  double referenceSeconds = 0.0;
+  double fastSeconds = 0.0;
+  long calls = 0;
+  for (size_t f = 0; f < frames.size(); ++f) {
+    double energyRef = 0.0;
+    double energyFast = 0.0;
+    std::vector<double> forcesRef;
+    std::vector<double> forcesFast;
+    for (int r = 0; r < options.repeat; ++r) {
+      referenceSeconds += reference.compute(frames[f], energyRef, forcesRef);
+      fastSeconds += fast.compute(frames[f], energyFast, forcesFast);
+      ++calls;
+    }
+    int const N = frames[f].config.numberContributing;
+    energyErrors.push_back(std::fabs(energyFast - energyRef)/std::max(1, N));
+    for (size_t k = 0; k < forcesRef.size(); ++k) {
+      forceErrors.push_back(std::fabs(forcesFast[k] - forcesRef[k]));
+      forceSq += forcesRef[k]*forcesRef[k];
+    }
+  }
+  std::sort(energyErrors.begin(), energyErrors.end());
+  std::sort(forceErrors.begin(), forceErrors.end());
+  double errorSq = 0.0;
+  for (size_t k = 0; k < forceErrors.size(); ++k) {
+    errorSq += forceErrors[k]*forceErrors[k];
+  }
+  double const n = std::max<size_t>(1, forceErrors.size());
+  double const forceRms = std::sqrt(forceSq/n);
+  double const errorRms = std::sqrt(errorSq/n);
+  double energyMean = 0.0;
+  for (size_t k = 0; k < energyErrors.size(); ++k) {
+    energyMean += energyErrors[k]/energyErrors.size();
+  }
+
+  // report
+  printf("# approximation audit of %s\n", options.parameterFile.c_str());
+  printf("# modes:");
+  for (size_t m = 0; m < options.modes.size(); ++m) {
+    printf(" %s", options.modes[m].c_str());
+  }
+  printf("\n");
+  if (options.captureFile.empty()) {
+    printf("# %s, %d atoms, %d frames every %d steps of %g\n",
+           options.structure.c_str(), md.frame.config.numberContributing,
+           int(frames.size()), options.interval, options.timestep);
+  }
+  else {
+    printf("# %d frames of %s\n", int(frames.size()),
+           options.captureFile.c_str());
+  }
+  printf("energy error per atom:   mean %.3e  p90 %.3e  max %.3e\n",
+         energyMean, Quantile(energyErrors, 0.9),
+         energyErrors.empty() ? 0.0 : energyErrors.back());
+  printf("force component error:   rms %.3e (%.3g%% of rms force %.3e)\n",
+         errorRms, (forceRms > 0.0) ? 100.0*errorRms/forceRms : 0.0,
+         forceRms);
+  printf("                         p50 %.3e  p90 %.3e  p99 %.3e  max %.3e\n",
+         Quantile(forceErrors, 0.5), Quantile(forceErrors, 0.9),
+         Quantile(forceErrors, 0.99),
+         forceErrors.empty() ? 0.0 : forceErrors.back());
+  printf("speedup:                 %.3f (reference %.3f ms, fast %.3f ms per "
+         "call)\n", (fastSeconds > 0.0) ? referenceSeconds/fastSeconds : 0.0,
+         1e3*referenceSeconds/std::max(1L, calls),
+         1e3*fastSeconds/std::max(1L, calls));
+
+  if (options.captureFile.empty() && options.nveSteps > 0) {
+    double slopeRef, deviationRef, slopeFast, deviationFast;
+    RunNVE(reference, md, options, slopeRef, deviationRef);
+    RunNVE(fast, md, options, slopeFast, deviationFast);
+    printf("NVE energy per atom over %d steps (drift per unit time, largest "
+           "deviation):\n", options.nveSteps);
+    printf("  reference              %+.3e  %.3e\n", slopeRef, deviationRef);
+    printf("  fast                   %+.3e  %.3e\n", slopeFast, deviationFast);
+  }
+  return 0;
+}
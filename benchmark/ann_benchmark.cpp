@@ -0,0 +1,582 @@
+//
+// CDDL HEADER START
+//
+// The contents of this file are subject to the terms of the Common Development
+// and Distribution License Version 1.0 (the "License").
+//
+// You can obtain a copy of the license at
+// http://www.opensource.org/licenses/CDDL-1.0.  See the License for the
+// specific language governing permissions and limitations under the License.
+//
+// When distributing Covered Code, include this CDDL HEADER in each file and
+// include the License file in a prominent location with the name LICENSE.CDDL.
+// If applicable, add the following below this CDDL HEADER, with the fields
+// enclosed by brackets "[]" replaced with your own identifying information:
+//
+// Portions Copyright (c) [yyyy] [name of copyright owner]. All rights reserved.
+//
+// CDDL HEADER END
+//
+
+//
+// Copyright (c) 2017, Regents of the University of Minnesota.
+// All rights reserved.
+//
+// Contributors:
+//    Mingjian Wen
+//
+
+
+
+// Benchmark of the stages of Compute on synthetic structures
+//
+// The driver is run through the stand-in of the KIM API in this directory,
+// with neighbor lists built here, so no KIM installation or simulator is
+// needed.  For each structure, number of atoms and number of threads, the
+// time per step (one Compute call) is reported in nanoseconds per
+// contributing atom for the stages of Compute (see StageTimes) and in
+// total.
+//
+// usage: ann_benchmark [options] <parameter file>
+//
+//   --structures LIST  comma-separated list of bulk (periodic fcc crystal),
+//                      surface (fcc slab, periodic in x and y), liquid
+//                      (random packing, periodic) and alloy (periodic L1_2
+//                      crystal of the first two species).  The species of
+//                      the others are random.  Default: bulk, surface and
+//                      liquid.
+//   --atoms LIST       approximate numbers of contributing atoms.
+//                      Default: 256,2048,16384.
+//   --threads LIST     values of ANN_NUM_THREADS.  Default: 1.
+//   --density RHO      number of atoms per unit volume.  Default: 0.05.
+//   --species N        number of species of the model.  Default: 2.
+//   --steps N          timed Compute calls per case.  Default: 10.
+//   --skin D           added to the cutoff of the neighbor lists.
+//                      Default: 0.
+//   --virial           compute the virial in addition to energy and forces.
+//   --format FORMAT    table, csv or json.  Default: table.
+//
+// Regression checks:
+//
+//   --record FILE      write the energy, forces and stage times of each case
+//                      to FILE, as the reference of later --check runs.
+//   --check FILE       compare each case with the one of the same structure,
+//                      number of atoms and threads in FILE, and exit with
+//                      status 2 if any differs by more than the tolerances
+//                      or is missing.
+//   --energy-tolerance E  largest difference of the energy per atom.
+//                      Default: 1e-9.
+//   --force-tolerance F   largest difference of a force component.
+//                      Default: 1e-8.
+//   --max-slowdown S   largest increase of the total time per atom and step,
+//                      as a fraction of the reference (0.2 = 20%); 0 does not
+//                      check the time.  Default: 0.2.
+//
+// The default tolerances suit the exact (double precision) evaluation; they
+// are to be widened for approximations such as ANN_MEMO_TOLERANCE.
+//
+// The other runtime options of the driver (see README) are taken from the
+// environment as usual.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "KIM_API.h"
+#include "KIM_API_status.h"
+#include "ANNImplementation.hpp"
+#include "structures.h"
+
+
+struct Options
+{
+  std::string parameterFile;
+  std::vector<std::string> structures;
+  std::vector<int> atoms;
+  std::vector<int> threads;
+  double density;
+  int numberSpecies;
+  int steps;
+  double skin;
+  bool virial;
+  std::string format;
+  std::string recordFile;
+  std::string checkFile;
+  double energyTolerance;
+  double forceTolerance;
+  double maxSlowdown;
+};
+
+struct Result
+{
+  std::string structure;
+  int atoms;
+  int ghosts;
+  int threads;
+  int steps;
+  double neighborsPerAtom;
+  StageTimes times;
+  double total;  // seconds of the timed Compute calls
+  double energyPerAtom;
+  double coordinateSum;        // identifies the configuration
+  std::vector<double> forces;  // [numberOfParticles*DIM] of the last call
+};
+
+
+
+//******************************************************************************
+// run the timed steps of one case with model `ann'
+Result Run(ANNImplementation& ann, KIM_API_model& kim,
+           Configuration const& config, double const cutoff,
+           Options const& options)
+{
+  NeighborList neighbors;
+  BuildNeighborList(config, cutoff + options.skin, neighbors);
+
+  int numberOfParticles = config.size();
+  int numberOfSpecies = options.numberSpecies;
+  double energy = 0.0;
+  std::vector<double> forces(config.size()*DIM);
+  double virial[6];
+  kim.set_data("numberOfParticles", &numberOfParticles);
+  kim.set_data("numberOfSpecies", &numberOfSpecies);
+  kim.set_data("particleSpecies", const_cast<int*>(&config.species[0]));
+  kim.set_data("particleStatus", const_cast<int*>(&config.status[0]));
+  kim.set_data("coordinates", const_cast<double*>(&config.coordinates[0]));
+  kim.set_data("neighObject", &neighbors);
+  kim.set_data("energy", &energy);
+  kim.set_data("forces", &forces[0]);
+  kim.set_data("virial", virial);
+  kim.set_compute("virial", options.virial);
+
+  // the first call allocates the buffers and trains the cost model
+  ann.Compute(&kim);
+  ann.ResetStageTimes();
+
+  std::chrono::steady_clock::time_point const start
+      = std::chrono::steady_clock::now();
+  for (int step = 0; step < options.steps; ++step) {
+    int const ier = ann.Compute(&kim);
+    if (ier < KIM_STATUS_OK) {
+      std::cerr << "Compute failed" << std::endl;
+      exit(1);
+    }
+  }
+  double const total = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+
+  Result result;
+  result.atoms = config.numberContributing;
+  result.ghosts = config.size() - config.numberContributing;
+  result.steps = options.steps;
+  result.neighborsPerAtom = double(neighbors.list.size())
+      / std::max(1, config.numberContributing);
+  result.times = ann.GetStageTimes();
+  result.total = total;
+  result.energyPerAtom = energy/std::max(1, config.numberContributing);
+  result.coordinateSum = 0.0;
+  for (size_t k = 0; k < config.coordinates.size(); ++k) {
+    result.coordinateSum += config.coordinates[k];
+  }
+  result.forces = forces;
+  return result;
+}
+
+//******************************************************************************
+std::vector<std::string> SplitList(std::string const& list)
+{
+  std::vector<std::string> items;
+  std::stringstream stream(list);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    if (!item.empty()) items.push_back(item);
+  }
+  return items;
+}
+
+std::vector<int> SplitIntList(std::string const& list)
+{
+  std::vector<std::string> const items = SplitList(list);
+  std::vector<int> values;
+  for (size_t i = 0; i < items.size(); ++i) {
+    values.push_back(atoi(items[i].c_str()));
+  }
+  return values;
+}
+
+//******************************************************************************
+bool ParseOptions(int argc, char* argv[], Options& options)
+{
+  options.structures = SplitList("bulk,surface,liquid");
+  options.atoms = SplitIntList("256,2048,16384");
+  options.threads = SplitIntList("1");
+  options.density = 0.05;
+  options.numberSpecies = 2;
+  options.steps = 10;
+  options.skin = 0.0;
+  options.virial = false;
+  options.format = "table";
+  options.energyTolerance = 1e-9;
+  options.forceTolerance = 1e-8;
+  options.maxSlowdown = 0.2;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string const arg = argv[i];
+    bool const hasValue = (i + 1 < argc);
+    if (arg == "--structures" && hasValue) {
+      options.structures = SplitList(argv[++i]);
+    }
+    else if (arg == "--atoms" && hasValue) {
+      options.atoms = SplitIntList(argv[++i]);
+    }
+    else if (arg == "--threads" && hasValue) {
+      options.threads = SplitIntList(argv[++i]);
+    }
+    else if (arg == "--density" && hasValue) {
+      options.density = atof(argv[++i]);
+    }
+    else if (arg == "--species" && hasValue) {
+      options.numberSpecies = atoi(argv[++i]);
+    }
+    else if (arg == "--steps" && hasValue) {
+      options.steps = atoi(argv[++i]);
+    }
+    else if (arg == "--skin" && hasValue) {
+      options.skin = atof(argv[++i]);
+    }
+    else if (arg == "--virial") {
+      options.virial = true;
+    }
+    else if (arg == "--format" && hasValue) {
+      options.format = argv[++i];
+    }
+    else if (arg == "--record" && hasValue) {
+      options.recordFile = argv[++i];
+    }
+    else if (arg == "--check" && hasValue) {
+      options.checkFile = argv[++i];
+    }
+    else if (arg == "--energy-tolerance" && hasValue) {
+      options.energyTolerance = atof(argv[++i]);
+    }
+    else if (arg == "--force-tolerance" && hasValue) {
+      options.forceTolerance = atof(argv[++i]);
+    }
+    else if (arg == "--max-slowdown" && hasValue) {
+      options.maxSlowdown = atof(argv[++i]);
+    }
+    else if (arg[0] != '-' && options.parameterFile.empty()) {
+      options.parameterFile = arg;
+    }
+    else {
+      return false;
+    }
+  }
+
+  for (size_t s = 0; s < options.structures.size(); ++s) {
+    std::string const& name = options.structures[s];
+    if (name != "bulk" && name != "surface" && name != "liquid"
+        && name != "alloy") {
+      return false;
+    }
+  }
+  return (!options.parameterFile.empty() && options.density > 0.0
+          && options.numberSpecies > 0 && options.steps > 0
+          && (options.format == "table" || options.format == "csv"
+              || options.format == "json"));
+}
+
+//******************************************************************************
+void PrintResults(std::vector<Result> const& results,
+                  std::string const& format)
+{
+  char const* const stages[] = {"neighbor", "descriptor", "forward",
+                                "backward", "force", "total"};
+  if (format == "table") {
+    printf("# ns/atom/step\n");
+    printf("%-9s %8s %8s %7s %8s", "structure", "atoms", "ghosts", "threads",
+           "neigh/at");
+    for (int k = 0; k < 6; ++k) printf(" %10s", stages[k]);
+    printf(" %14s\n", "energy/atom");
+  }
+  else if (format == "csv") {
+    printf("structure,atoms,ghosts,threads,steps,neighbors_per_atom");
+    for (int k = 0; k < 6; ++k) printf(",%s_ns", stages[k]);
+    printf(",energy_per_atom\n");
+  }
+  else {
+    printf("[\n");
+  }
+
+  for (size_t r = 0; r < results.size(); ++r) {
+    Result const& result = results[r];
+    double const scale = 1e9/(double(result.atoms)*result.steps);
+    double const ns[6] = {result.times.neighbor*scale,
+                          result.times.descriptor*scale,
+                          result.times.forward*scale,
+                          result.times.backward*scale,
+                          result.times.force*scale,
+                          result.total*scale};
+    if (format == "table") {
+      printf("%-9s %8d %8d %7d %8.1f", result.structure.c_str(), result.atoms,
+             result.ghosts, result.threads, result.neighborsPerAtom);
+      for (int k = 0; k < 6; ++k) printf(" %10.1f", ns[k]);
+      printf(" %14.8f\n", result.energyPerAtom);
+    }
+    else if (format == "csv") {
+      printf("%s,%d,%d,%d,%d,%.3f", result.structure.c_str(), result.atoms,
+             result.ghosts, result.threads, result.steps,
+             result.neighborsPerAtom);
+      for (int k = 0; k < 6; ++k) printf(",%.3f", ns[k]);
+      printf(",%.12g\n", result.energyPerAtom);
+    }
+    else {
+      printf("  {\"structure\": \"%s\", \"atoms\": %d, \"ghosts\": %d, "
+             "\"threads\": %d, \"steps\": %d, \"neighbors_per_atom\": %.3f",
+             result.structure.c_str(), result.atoms, result.ghosts,
+             result.threads, result.steps, result.neighborsPerAtom);
+      for (int k = 0; k < 6; ++k) printf(", \"%s_ns\": %.3f", stages[k], ns[k]);
+      printf(", \"energy_per_atom\": %.12g}%s\n", result.energyPerAtom,
+             (r + 1 < results.size()) ? "," : "");
+    }
+  }
+  if (format == "json") printf("]\n");
+}
+
+
+//******************************************************************************
+// key of a case in the reference file
+std::string CaseKey(Result const& result)
+{
+  std::ostringstream key;
+  key << result.structure << " " << result.atoms << " " << result.threads;
+  return key.str();
+}
+
+// ns per atom and step of the stages of a case (as in PrintResults)
+void StageNanoseconds(Result const& result, double* const ns)
+{
+  double const scale = 1e9/(double(result.atoms)*result.steps);
+  ns[0] = result.times.neighbor*scale;
+  ns[1] = result.times.descriptor*scale;
+  ns[2] = result.times.forward*scale;
+  ns[3] = result.times.backward*scale;
+  ns[4] = result.times.force*scale;
+  ns[5] = result.total*scale;
+}
+
+//******************************************************************************
+// Reference file of --record and --check: for each case a line
+//   case <structure> <atoms> <threads> <particles> <coordinate sum>
+//        <energy per atom> <ns of the 6 stages of PrintResults>
+// followed by the forces of the particles, one per line.
+bool RecordResults(std::vector<Result> const& results,
+                   std::string const& fileName)
+{
+  FILE* const file = fopen(fileName.c_str(), "w");
+  if (file == NULL) return false;
+  fprintf(file, "# ann_benchmark reference values\n");
+  for (size_t r = 0; r < results.size(); ++r) {
+    Result const& result = results[r];
+    double ns[6];
+    StageNanoseconds(result, ns);
+    fprintf(file, "case %s %d %.17g %.17g", CaseKey(result).c_str(),
+            int(result.forces.size()/DIM), result.coordinateSum,
+            result.energyPerAtom);
+    for (int k = 0; k < 6; ++k) fprintf(file, " %.6g", ns[k]);
+    fprintf(file, "\n");
+    for (size_t i = 0; i < result.forces.size(); i += DIM) {
+      fprintf(file, "%.17g %.17g %.17g\n", result.forces[i],
+              result.forces[i + 1], result.forces[i + 2]);
+    }
+  }
+  return fclose(file) == 0;
+}
+
+struct Reference
+{
+  double coordinateSum;
+  double energyPerAtom;
+  double ns[6];
+  std::vector<double> forces;
+};
+
+bool ReadReferences(std::string const& fileName,
+                    std::map<std::string, Reference>& references)
+{
+  std::ifstream file(fileName.c_str());
+  if (!file) return false;
+  std::string line;
+  while (std::getline(file, line)) {
+    std::istringstream stream(line);
+    std::string word;
+    if (!(stream >> word) || word != "case") continue;
+    std::string structure;
+    int atoms;
+    int threads;
+    int particles;
+    Reference reference;
+    stream >> structure >> atoms >> threads >> particles
+           >> reference.coordinateSum >> reference.energyPerAtom;
+    for (int k = 0; k < 6; ++k) stream >> reference.ns[k];
+    if (!stream) return false;
+    reference.forces.resize(particles*DIM);
+    for (int i = 0; i < particles*DIM; ++i) {
+      if (!(file >> reference.forces[i])) return false;
+    }
+    std::ostringstream key;
+    key << structure << " " << atoms << " " << threads;
+    references[key.str()] = reference;
+  }
+  return true;
+}
+
+// compare the results with the reference file; returns the number of cases
+// that fail
+int CheckResults(std::vector<Result> const& results,
+                 std::map<std::string, Reference> const& references,
+                 Options const& options)
+{
+  int failures = 0;
+  printf("# check against %s\n", options.checkFile.c_str());
+  printf("%-6s %-9s %8s %7s %12s %12s %10s\n", "status", "structure", "atoms",
+         "threads", "energy diff", "force diff", "time ratio");
+  for (size_t r = 0; r < results.size(); ++r) {
+    Result const& result = results[r];
+    std::map<std::string, Reference>::const_iterator const it
+        = references.find(CaseKey(result));
+    std::string problem;
+    double energyDiff = 0.0;
+    double forceDiff = 0.0;
+    double ratio = 0.0;
+    double ns[6];
+    StageNanoseconds(result, ns);
+    if (it == references.end()) {
+      problem = "no reference";
+    }
+    else if (it->second.forces.size() != result.forces.size()
+             || std::fabs(it->second.coordinateSum - result.coordinateSum)
+                > 1e-9*std::fabs(result.coordinateSum)) {
+      problem = "different configuration";
+    }
+    else {
+      Reference const& reference = it->second;
+      energyDiff = std::fabs(result.energyPerAtom - reference.energyPerAtom);
+      for (size_t k = 0; k < result.forces.size(); ++k) {
+        forceDiff = std::max(forceDiff,
+                             std::fabs(result.forces[k] - reference.forces[k]));
+      }
+      ratio = ns[5]/reference.ns[5];
+      if (energyDiff > options.energyTolerance) problem += "energy ";
+      if (forceDiff > options.forceTolerance) problem += "forces ";
+      if (options.maxSlowdown > 0.0 && ratio > 1.0 + options.maxSlowdown) {
+        problem += "time";
+        // the stage that slowed down most
+        int worst = 0;
+        for (int k = 1; k < 5; ++k) {
+          if (ns[k] - reference.ns[k] > ns[worst] - reference.ns[worst]) {
+            worst = k;
+          }
+        }
+        char const* const stages[] = {"neighbor", "descriptor", "forward",
+                                      "backward", "force"};
+        problem += std::string(" (mostly ") + stages[worst] + ")";
+      }
+    }
+    if (!problem.empty()) ++failures;
+    printf("%-6s %-9s %8d %7d %12.3e %12.3e %10.3f %s\n",
+           problem.empty() ? "PASS" : "FAIL", result.structure.c_str(),
+           result.atoms, result.threads, energyDiff, forceDiff, ratio,
+           problem.c_str());
+  }
+  return failures;
+}
+
+//******************************************************************************
+int main(int argc, char* argv[])
+{
+  Options options;
+  if (!ParseOptions(argc, argv, options)) {
+    std::cerr << "usage: " << argv[0] << " [--structures bulk,surface,liquid,alloy]"
+              << " [--atoms N,...] [--threads N,...] [--density RHO]"
+              << " [--species N] [--steps N] [--skin D] [--virial]"
+              << " [--format table|csv|json] [--record FILE] [--check FILE]"
+              << " [--energy-tolerance E] [--force-tolerance F]"
+              << " [--max-slowdown S] <parameter file>" << std::endl;
+    return 1;
+  }
+
+  std::vector<std::string> speciesNames;
+  for (int s = 0; s < options.numberSpecies; ++s) {
+    speciesNames.push_back(std::string("S") + char('A' + s % 26));
+  }
+
+  std::vector<Result> results;
+  for (size_t t = 0; t < options.threads.size(); ++t) {
+    // the driver reads its runtime options when it is created
+    std::ostringstream threads;
+    threads << options.threads[t];
+    setenv("ANN_NUM_THREADS", threads.str().c_str(), 1);
+
+    KIM_API_model kim(speciesNames);
+    double cutoff = 0.0;
+    kim.set_data("cutoff", &cutoff);
+    kim.set_data("get_neigh", reinterpret_cast<void*>(&GetNeigh));
+    kim.set_compute("process_dEdr", false);
+    kim.set_compute("process_d2Edr2", false);
+    kim.set_compute("particleEnergy", false);
+    kim.set_compute("particleVirial", false);
+
+    int ier;
+    std::string const fileName = options.parameterFile;
+    ANNImplementation ann(&kim, fileName.c_str(), fileName.size() + 1, 1,
+                          &ier);
+    if (ier < KIM_STATUS_OK) {
+      std::cerr << "cannot create the model from " << fileName << std::endl;
+      return 1;
+    }
+
+    for (size_t s = 0; s < options.structures.size(); ++s) {
+      for (size_t a = 0; a < options.atoms.size(); ++a) {
+        std::string const& structure = options.structures[s];
+        double const listCutoff = cutoff + options.skin;
+        std::mt19937 random(12345);
+        Configuration const config = MakeStructure(
+            structure, options.atoms[a], options.density,
+            options.numberSpecies, listCutoff, random);
+
+        Result result = Run(ann, kim, config, cutoff, options);
+        result.structure = structure;
+        result.threads = options.threads[t];
+        results.push_back(result);
+      }
+    }
+  }
+
+  PrintResults(results, options.format);
+
+  if (!options.recordFile.empty()
+      && !RecordResults(results, options.recordFile)) {
+    std::cerr << "cannot write " << options.recordFile << std::endl;
+    return 1;
+  }
+  if (!options.checkFile.empty()) {
+    std::map<std::string, Reference> references;
+    if (!ReadReferences(options.checkFile, references)) {
+      std::cerr << "cannot read " << options.checkFile << std::endl;
+      return 1;
+    }
+    if (CheckResults(results, references, options) > 0) return 2;
+  }
+  return 0;
+}
@@ -0,0 +1,324 @@
+//
+// CDDL HEADER START
+//
+// The contents of this file are subject to the terms of the Common Development
+// and Distribution License Version 1.0 (the "License").
+//
+// You can obtain a copy of the license at
+// http://www.opensource.org/licenses/CDDL-1.0.  See the License for the
+// specific language governing permissions and limitations under the License.
+//
+// When distributing Covered Code, include this CDDL HEADER in each file and
+// include the License file in a prominent location with the name LICENSE.CDDL.
+// If applicable, add the following below this CDDL HEADER, with the fields
+// enclosed by brackets "[]" replaced with your own identifying information:
+//
+// Portions Copyright (c) [yyyy] [name of copyright owner]. All rights reserved.
+//
+// CDDL HEADER END
+//
+
+//
+// Copyright (c) 2017, Regents of the University of Minnesota.
+// All rights reserved.
+//
+// Contributors:
+//    Mingjian Wen
+//
+
+
+
+// Replay of the Compute calls recorded in a capture file
+//
+// The driver writes the inputs of its Compute calls (particles, species,
+// coordinates, neighbor lists as returned by get_neigh, and the requested
+// outputs) to a capture file when ANN_CAPTURE_FILE is set (see capture.h).
+// This program repeats those calls through the stand-in of the KIM API in
+// this directory, with any parameter file and any build of the driver, such
+// that the workload of a simulation can be profiled or compared offline.
+// The runtime options of the driver (see README) are taken from the
+// environment as usual.
+//
+// usage: ann_replay [options] <capture file> <parameter file>
+//
+//   --repeat N      replay the calls N times.  Default: 1.
+//   --species N     number of species of the model.  Default: the largest
+//                   species code in the capture file plus one.
+//   --calls         print the time and energy of each call.
+//   --dump FILE     write the energy and forces of each call of the last
+//                   repetition to FILE, to compare builds or models.
+//   --format FORMAT table or csv.  Default: table.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "KIM_API.h"
+#include "KIM_API_status.h"
+#include "ANNImplementation.hpp"
+#include "capture.h"
+
+
+struct Options
+{
+  std::string captureFile;
+  std::string parameterFile;
+  int repeat;
+  int numberSpecies;
+  bool calls;
+  std::string dumpFile;
+  std::string format;
+};
+
+
+//******************************************************************************
+// KIM API get_neigh method, locator mode only: the m-th request returns the
+// m-th list of the captured call
+int GetNeigh(void** kimmdl, int* mode, int* request, int* particle,
+             int* numnei, int** nei1particle, double** Rij)
+{
+  KIM_API_model* const pkim = *reinterpret_cast<KIM_API_model**>(kimmdl);
+  CapturedCall const* const call
+      = static_cast<CapturedCall const*>(pkim->get_data("neighObject"));
+
+  if (*mode != 1) return KIM_STATUS_FAIL;
+  int const m = *request;
+  if (m < 0 || m >= call->number_of_lists()) return KIM_STATUS_FAIL;
+
+  *particle = call->particle[m];
+  *numnei = call->numNei[m];
+  *nei1particle = const_cast<int*>(&call->neighbors[call->neighStart[m]]);
+  *Rij = 0;
+  return KIM_STATUS_OK;
+}
+
+//******************************************************************************
+std::string FlagNames(int const flags)
+{
+  char const* const names[] = {"energy", "forces", "particleEnergy", "virial",
+                               "particleVirial", "process_dEdr",
+                               "process_d2Edr2"};
+  std::string s;
+  for (int k = 0; k < 7; ++k) {
+    if (flags & (1 << k)) {
+      if (!s.empty()) s += "+";
+      s += names[k];
+    }
+  }
+  return s.empty() ? "none" : s;
+}
+
+//******************************************************************************
+bool ParseOptions(int argc, char* argv[], Options& options)
+{
+  options.repeat = 1;
+  options.numberSpecies = 0;
+  options.calls = false;
+  options.format = "table";
+
+  for (int i = 1; i < argc; ++i) {
+    std::string const arg = argv[i];
+    bool const hasValue = (i + 1 < argc);
+    if (arg == "--repeat" && hasValue) {
+      options.repeat = atoi(argv[++i]);
+    }
+    else if (arg == "--species" && hasValue) {
+      options.numberSpecies = atoi(argv[++i]);
+    }
+    else if (arg == "--calls") {
+      options.calls = true;
+    }
+    else if (arg == "--dump" && hasValue) {
+      options.dumpFile = argv[++i];
+    }
+    else if (arg == "--format" && hasValue) {
+      options.format = argv[++i];
+    }
+    else if (arg[0] != '-' && options.captureFile.empty()) {
+      options.captureFile = arg;
+    }
+    else if (arg[0] != '-' && options.parameterFile.empty()) {
+      options.parameterFile = arg;
+    }
+    else {
+      return false;
+    }
+  }
+
+  return (!options.parameterFile.empty() && options.repeat > 0
+          && options.numberSpecies >= 0
+          && (options.format == "table" || options.format == "csv"));
+}
+
+//******************************************************************************
+int main(int argc, char* argv[])
+{
+  Options options;
+  if (!ParseOptions(argc, argv, options)) {
+    std::cerr << "usage: " << argv[0] << " [--repeat N] [--species N]"
+              << " [--calls] [--dump FILE] [--format table|csv]"
+              << " <capture file> <parameter file>" << std::endl;
+    return 1;
+  }
+
+  // read all calls, such that the replay does no I/O
+  std::vector<CapturedCall> calls;
+  FILE* const file = fopen(options.captureFile.c_str(), "rb");
+  if (file == NULL) {
+    std::cerr << "cannot open " << options.captureFile << std::endl;
+    return 1;
+  }
+  std::string error;
+  if (read_capture_header(file, error) == 0) {
+    while (true) {
+      CapturedCall call;
+      bool end;
+      if (read_captured_call(file, call, end, error) != 0 || end) break;
+      calls.push_back(call);
+    }
+  }
+  fclose(file);
+  if (!error.empty()) {
+    std::cerr << options.captureFile << ": " << error << std::endl;
+    return 1;
+  }
+
+  int numberSpecies = options.numberSpecies;
+  if (numberSpecies == 0) {
+    for (size_t c = 0; c < calls.size(); ++c) {
+      std::vector<int> const& species = calls[c].particleSpecies;
+      for (size_t i = 0; i < species.size(); ++i) {
+        numberSpecies = std::max(numberSpecies, species[i] + 1);
+      }
+    }
+    numberSpecies = std::max(numberSpecies, 1);
+  }
+  std::vector<std::string> speciesNames;
+  for (int s = 0; s < numberSpecies; ++s) {
+    speciesNames.push_back(std::string("S") + char('A' + s % 26));
+  }
+
+  KIM_API_model kim(speciesNames);
+  double cutoff = 0.0;
+  kim.set_data("cutoff", &cutoff);
+  kim.set_data("get_neigh", reinterpret_cast<void*>(&GetNeigh));
+  kim.set_data("numberOfSpecies", &numberSpecies);
+
+  int ier;
+  std::string const fileName = options.parameterFile;
+  ANNImplementation ann(&kim, fileName.c_str(), fileName.size() + 1, 1, &ier);
+  if (ier < KIM_STATUS_OK) {
+    std::cerr << "cannot create the model from " << fileName << std::endl;
+    return 1;
+  }
+
+  FILE* dump = NULL;
+  if (!options.dumpFile.empty()) {
+    dump = fopen(options.dumpFile.c_str(), "w");
+    if (dump == NULL) {
+      std::cerr << "cannot open " << options.dumpFile << std::endl;
+      return 1;
+    }
+  }
+
+  if (options.calls) {
+    if (options.format == "table") {
+      printf("%6s %6s %9s %9s %10s %12s %20s  %s\n", "pass", "call",
+             "particles", "contrib", "neighbors", "ms", "energy", "outputs");
+    }
+    else {
+      printf("pass,call,particles,contributing,neighbors,ms,energy,outputs\n");
+    }
+  }
+
+  ann.ResetStageTimes();
+  double total = 0.0;
+  long particles = 0;
+  for (int pass = 0; pass < options.repeat; ++pass) {
+    for (size_t c = 0; c < calls.size(); ++c) {
+      CapturedCall& call = calls[c];
+      int numberOfParticles = call.number_of_particles();
+      double energy = 0.0;
+      std::vector<double> particleEnergy(numberOfParticles);
+      std::vector<double> forces(numberOfParticles*DIM);
+      double virial[6] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+      std::vector<double> particleVirial(numberOfParticles*6);
+      kim.set_data("numberOfParticles", &numberOfParticles);
+      kim.set_data("particleSpecies", call.particleSpecies.data());
+      kim.set_data("particleStatus", call.particleStatus.data());
+      kim.set_data("coordinates", call.coordinates.data());
+      kim.set_data("neighObject", &call);
+      kim.set_data("energy", &energy);
+      kim.set_data("particleEnergy", particleEnergy.data());
+      kim.set_data("forces", forces.data());
+      kim.set_data("virial", virial);
+      kim.set_data("particleVirial", particleVirial.data());
+      kim.set_compute("energy", call.flags & CAPTURE_ENERGY);
+      kim.set_compute("forces", call.flags & CAPTURE_FORCES);
+      kim.set_compute("particleEnergy", call.flags & CAPTURE_PARTICLE_ENERGY);
+      kim.set_compute("virial", call.flags & CAPTURE_VIRIAL);
+      kim.set_compute("particleVirial", call.flags & CAPTURE_PARTICLE_VIRIAL);
+      kim.set_compute("process_dEdr", call.flags & CAPTURE_PROCESS_DEDR);
+      kim.set_compute("process_d2Edr2", call.flags & CAPTURE_PROCESS_D2EDR2);
+
+      std::chrono::steady_clock::time_point const start
+          = std::chrono::steady_clock::now();
+      ier = ann.Compute(&kim);
+      double const seconds = std::chrono::duration<double>(
+          std::chrono::steady_clock::now() - start).count();
+      if (ier < KIM_STATUS_OK) {
+        std::cerr << "Compute failed on call " << c << std::endl;
+        return 1;
+      }
+      total += seconds;
+      particles += call.number_of_lists();
+
+      if (options.calls) {
+        char const* const format = (options.format == "table")
+            ? "%6d %6d %9d %9d %10d %12.4f %20.12f  %s\n"
+            : "%d,%d,%d,%d,%d,%.6f,%.15g,%s\n";
+        printf(format, pass, int(c), numberOfParticles,
+               call.number_of_lists(), int(call.neighbors.size()),
+               1e3*seconds, energy, FlagNames(call.flags).c_str());
+      }
+      if (dump != NULL && pass == options.repeat - 1) {
+        fprintf(dump, "call %d energy %.17g\n", int(c), energy);
+        if (call.flags & CAPTURE_FORCES) {
+          for (int i = 0; i < numberOfParticles; ++i) {
+            fprintf(dump, "%.17g %.17g %.17g\n", forces[i*DIM],
+                    forces[i*DIM + 1], forces[i*DIM + 2]);
+          }
+        }
+      }
+    }
+  }
+  if (dump != NULL) fclose(dump);
+
+  // summary
+  StageTimes const times = ann.GetStageTimes();
+  long const n = std::max(1L, times.calls);
+  double const scale = 1e9/std::max(1L, particles);
+  if (options.format == "table") {
+    printf("# %ld calls, %.4f ms per call, ns per contributing particle:\n",
+           times.calls, 1e3*total/n);
+    printf("%10s %10s %10s %10s %10s %10s\n", "neighbor", "descriptor",
+           "forward", "backward", "force", "total");
+    printf("%10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+           times.neighbor*scale, times.descriptor*scale, times.forward*scale,
+           times.backward*scale, times.force*scale, total*scale);
+  }
+  else {
+    printf("calls,ms_per_call,neighbor_ns,descriptor_ns,forward_ns,"
+           "backward_ns,force_ns,total_ns\n");
+    printf("%ld,%.6f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n", times.calls,
+           1e3*total/n, times.neighbor*scale, times.descriptor*scale,
+           times.forward*scale, times.backward*scale, times.force*scale,
+           total*scale);
+  }
+  return 0;
+}
@@ -0,0 +1,199 @@
+//
+// CDDL HEADER START
+//
+// The contents of this file are subject to the terms of the Common Development
+// and Distribution License Version 1.0 (the "License").
+//
+// You can obtain a copy of the license at
+// http://www.opensource.org/licenses/CDDL-1.0.  See the License for the
+// specific language governing permissions and limitations under the License.
+//
+// When distributing Covered Code, include this CDDL HEADER in each file and
+// include the License file in a prominent location with the name LICENSE.CDDL.
+// If applicable, add the following below this CDDL HEADER, with the fields
+// enclosed by brackets "[]" replaced with your own identifying information:
+//
+// Portions Copyright (c) [yyyy] [name of copyright owner]. All rights reserved.
+//
+// CDDL HEADER END
+//
+
+//
+// Copyright (c) 2017, Regents of the University of Minnesota.
+// All rights reserved.
+//
+// Contributors:
+//    Mingjian Wen
+//
+
+
+// Speed and consistency of the neighbor lists of NeighborBuilder
+//
+// The atoms of the synthetic structures of ann_benchmark are given to
+// NeighborBuilder::set_atoms with their periodic cell, optionally tilted
+// (triclinic), and the full and half lists are built.  Each row gives the
+// time of set_atoms and build in microseconds, and the neighbors per atom of
+// both lists.  A row passes if each half list is a subsequence of the full
+// list of its atom and the half lists hold half the entries of the full
+// lists, i.e. each pair of atoms, including the pairs with periodic images,
+// once.  Cells smaller than the cutoff (e.g. --atoms 4) check the pairs of an
+// atom with its own images.  The program exits with status 2 if a row fails.
+//
+// usage: nl_benchmark [--structures LIST] [--atoms LIST] [--density RHO]
+//                     [--cutoff RC] [--tilt T] [--threads N] [--repeat N]
+//
+//   --structures  bulk, surface, liquid and alloy, as in ann_benchmark.
+//                 Default: bulk,surface,liquid.
+//   --atoms       approximate numbers of atoms.  Default: 4,256,16384.
+//   --density     atoms per unit volume.  Default: 0.05.
+//   --cutoff      cutoff of the lists.  Default: 5.
+//   --tilt        the second cell vector is tilted by T times the first.
+//                 Default: 0.
+//   --threads     threads of the build (0: none).  Default: 0.
+//   --repeat      timed builds of each list.  Default: 5.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "neighbors.h"
+#include "scheduler.h"
+#include "structures.h"
+
+
+std::vector<std::string> SplitList(std::string const& list)
+{
+  std::vector<std::string> items;
+  std::stringstream stream(list);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    if (!item.empty()) items.push_back(item);
+  }
+  return items;
+}
+
+// microseconds per set_atoms and build of the lists of `config'
+double TimeBuild(NeighborBuilder& builder, Configuration const& config,
+                 double const* const lattice, int const* const periodic,
+                 bool const half, ThreadPool* const pool, int const repeat)
+{
+  std::string error;
+  std::chrono::steady_clock::time_point const start
+      = std::chrono::steady_clock::now();
+  for (int r = 0; r < repeat; ++r) {
+    if (builder.set_atoms(config.numberContributing, &config.species[0],
+                          &config.coordinates[0], lattice, periodic, error)
+        != 0) {
+      std::cerr << error << std::endl;
+      exit(1);
+    }
+    builder.build(half, pool);
+  }
+  return 1e6*std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count()/repeat;
+}
+
+// whether the half list of each atom is a subsequence of its full list
+bool IsSubsequence(NeighborBuilder const& full, NeighborBuilder const& half)
+{
+  for (int i = 0; i < full.get_number_contributing(); ++i) {
+    int const* f = &full.get_neighbors()[0] + full.get_neighbor_start()[i];
+    int const* const fEnd = f + full.get_num_neighbors()[i];
+    int const* h = &half.get_neighbors()[0] + half.get_neighbor_start()[i];
+    int const* const hEnd = h + half.get_num_neighbors()[i];
+    for (; h != hEnd; ++h) {
+      while (f != fEnd && *f != *h) ++f;
+      if (f == fEnd) return false;
+      ++f;
+    }
+  }
+  return true;
+}
+
+//******************************************************************************
+int main(int argc, char* argv[])
+{
+  std::vector<std::string> structures = SplitList("bulk,surface,liquid");
+  std::vector<std::string> atoms = SplitList("4,256,16384");
+  double density = 0.05;
+  double cutoff = 5.0;
+  double tilt = 0.0;
+  int threads = 0;
+  int repeat = 5;
+  bool valid = true;
+  for (int i = 1; i < argc; ++i) {
+    std::string const arg = argv[i];
+    if (arg == "--structures" && i + 1 < argc) {
+      structures = SplitList(argv[++i]);
+    }
+    else if (arg == "--atoms" && i + 1 < argc) atoms = SplitList(argv[++i]);
+    else if (arg == "--density" && i + 1 < argc) density = atof(argv[++i]);
+    else if (arg == "--cutoff" && i + 1 < argc) cutoff = atof(argv[++i]);
+    else if (arg == "--tilt" && i + 1 < argc) tilt = atof(argv[++i]);
+    else if (arg == "--threads" && i + 1 < argc) threads = atoi(argv[++i]);
+    else if (arg == "--repeat" && i + 1 < argc) repeat = atoi(argv[++i]);
+    else valid = false;
+  }
+  for (size_t s = 0; s < structures.size(); ++s) {
+    std::string const& name = structures[s];
+    if (name != "bulk" && name != "surface" && name != "liquid"
+        && name != "alloy") {
+      valid = false;
+    }
+  }
+  if (!valid || density <= 0.0 || cutoff <= 0.0 || threads < 0
+      || repeat <= 0) {
+    std::cerr << "usage: " << argv[0] << " [--structures LIST]"
+              << " [--atoms LIST] [--density RHO] [--cutoff RC] [--tilt T]"
+              << " [--threads N] [--repeat N]" << std::endl;
+    return 1;
+  }
+
+  ThreadPool* const pool = (threads > 0) ? new ThreadPool(threads) : 0;
+  NeighborBuilder full;
+  NeighborBuilder half;
+  full.set_cutoff(cutoff);
+  half.set_cutoff(cutoff);
+
+  int failures = 0;
+  printf("%-6s %-9s %8s %10s %10s %10s %10s %10s\n", "status", "structure",
+         "atoms", "particles", "full/atom", "half/atom", "full us",
+         "half us");
+  for (size_t s = 0; s < structures.size(); ++s) {
+    for (size_t a = 0; a < atoms.size(); ++a) {
+      // the atoms only, in a cell that may be smaller than the cutoff;
+      // set_atoms makes the images
+      std::mt19937 random(12345);
+      Configuration const config = MakeStructure(
+          structures[s], atoi(atoms[a].c_str()), density, 2, 0.0, random);
+      int const N = config.numberContributing;
+      double const lattice[9] = {config.box[0], 0.0, 0.0,
+                                 tilt*config.box[0], config.box[1], 0.0,
+                                 0.0, 0.0, config.box[2]};
+      int periodic[DIM];
+      for (int d = 0; d < DIM; ++d) periodic[d] = config.periodic[d];
+
+      double const fullTime = TimeBuild(full, config, lattice, periodic,
+                                        false, pool, repeat);
+      double const halfTime = TimeBuild(half, config, lattice, periodic,
+                                        true, pool, repeat);
+      long const fullPairs = full.get_neighbors().size();
+      long const halfPairs = half.get_neighbors().size();
+      bool const pass = (2*halfPairs == fullPairs
+                         && IsSubsequence(full, half));
+      if (!pass) ++failures;
+      printf("%-6s %-9s %8d %10d %10.2f %10.2f %10.1f %10.1f\n",
+             pass ? "PASS" : "FAIL", structures[s].c_str(), N,
+             full.get_number_of_particles(), double(fullPairs)/N,
+             double(halfPairs)/N, fullTime, halfTime);
+    }
+  }
+
+  delete pool;
+  return (failures > 0) ? 2 : 0;
+}
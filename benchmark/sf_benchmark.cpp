@@ -0,0 +1,571 @@
+//
+// CDDL HEADER START
+//
+// The contents of this file are subject to the terms of the Common Development
+// and Distribution License Version 1.0 (the "License").
+//
+// You can obtain a copy of the license at
+// http://www.opensource.org/licenses/CDDL-1.0.  See the License for the
+// specific language governing permissions and limitations under the License.
+//
+// When distributing Covered Code, include this CDDL HEADER in each file and
+// include the License file in a prominent location with the name LICENSE.CDDL.
+// If applicable, add the following below this CDDL HEADER, with the fields
+// enclosed by brackets "[]" replaced with your own identifying information:
+//
+// Portions Copyright (c) [yyyy] [name of copyright owner]. All rights reserved.
+//
+// CDDL HEADER END
+//
+
+//
+// Copyright (c) 2017, Regents of the University of Minnesota.
+// All rights reserved.
+//
+// Contributors:
+//    Mingjian Wen
+//
+
+
+
+// Speed and accuracy of the symmetry functions of Descriptor
+//
+// Each row of the table is one kernel (cut_cos, d_cut_cos, sym_g1, ...,
+// sym_d_g5) with one parameter set, evaluated on a sweep of distances (two-
+// body functions) or of random triangles (three-body functions).  It gives
+// the evaluations per second of a single core, and the largest absolute
+// and relative errors of the value and of the derivative (d_ kernels) with
+// respect to a long double reference.  The reference derivatives are
+// computed by forward-mode automatic differentiation, independent of the
+// derivatives coded in Descriptor.  Relative errors are taken over the
+// points where the magnitude of the reference is at least 1e-6 times its
+// largest magnitude in the sweep, such that the values that vanish at the
+// cutoff do not dominate.
+//
+// A faster variant of a kernel (e.g. tabulated or single precision) can be
+// added as another row to compare it with the kernel it replaces.
+//
+// usage: sf_benchmark [--points N] [--time SECONDS] [--rcut RCUT]
+//                     [--format table|csv|json]
+//
+//   --points  distances or triangles per sweep.  Default: 1000.
+//   --time    minimum time of each throughput measurement.  Default: 0.1.
+//   --rcut    cutoff.  Default: 5.
+//   --format  output format.  Default: table.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "descriptor.h"
+
+
+// Number with its derivatives w.r.t. up to three variables
+struct Dual
+{
+  long double v;
+  long double d[3];
+
+  Dual(long double const value = 0.0L) : v(value), d{0.0L, 0.0L, 0.0L} {}
+  // variable k
+  Dual(long double const value, int const k) : v(value), d{0.0L, 0.0L, 0.0L}
+  {
+    d[k] = 1.0L;
+  }
+};
+
+Dual operator+(Dual const& a, Dual const& b)
+{
+  Dual c(a.v + b.v);
+  for (int k = 0; k < 3; ++k) c.d[k] = a.d[k] + b.d[k];
+  return c;
+}
+
+Dual operator-(Dual const& a, Dual const& b)
+{
+  Dual c(a.v - b.v);
+  for (int k = 0; k < 3; ++k) c.d[k] = a.d[k] - b.d[k];
+  return c;
+}
+
+Dual operator-(Dual const& a)
+{
+  return Dual(0.0L) - a;
+}
+
+Dual operator*(Dual const& a, Dual const& b)
+{
+  Dual c(a.v*b.v);
+  for (int k = 0; k < 3; ++k) c.d[k] = a.d[k]*b.v + a.v*b.d[k];
+  return c;
+}
+
+Dual operator/(Dual const& a, Dual const& b)
+{
+  Dual c(a.v/b.v);
+  for (int k = 0; k < 3; ++k) c.d[k] = (a.d[k] - c.v*b.d[k])/b.v;
+  return c;
+}
+
+// f(a) with f'(a) = df
+Dual Chain(Dual const& a, long double const f, long double const df)
+{
+  Dual c(f);
+  for (int k = 0; k < 3; ++k) c.d[k] = df*a.d[k];
+  return c;
+}
+
+Dual exp(Dual const& a)
+{
+  long double const e = std::exp(a.v);
+  return Chain(a, e, e);
+}
+
+Dual cos(Dual const& a)
+{
+  return Chain(a, std::cos(a.v), -std::sin(a.v));
+}
+
+Dual pow(Dual const& a, long double const p)
+{
+  long double const f = std::pow(a.v, p);
+  return Chain(a, f, p*f/a.v);
+}
+
+long double Value(long double const x) { return x; }
+long double Value(Dual const& x) { return x.v; }
+
+
+//==============================================================================
+//
+// Reference symmetry functions, for T = long double or Dual
+//
+//==============================================================================
+
+long double const PI = std::acos(-1.0L);
+
+template<class T>
+T RefCutCos(T const& r, long double const rcut)
+{
+  using std::cos;
+  if (Value(r) < rcut) return 0.5L*(cos(PI*r/rcut) + 1.0L);
+  return T(0.0L);
+}
+
+template<class T>
+T RefG2(long double const eta, long double const Rs, T const& r,
+        long double const rcut)
+{
+  using std::exp;
+  return exp(-eta*(r - Rs)*(r - Rs))*RefCutCos(r, rcut);
+}
+
+template<class T>
+T RefG3(long double const kappa, T const& r, long double const rcut)
+{
+  using std::cos;
+  return cos(kappa*r)*RefCutCos(r, rcut);
+}
+
+// g4 (withJK) or g5 of the triangle r = (rij, rik, rjk)
+template<class T>
+T RefThreeBody(long double const zeta, long double const lambda,
+               long double const eta, T const* const r,
+               long double const rcut, bool const withJK)
+{
+  using std::exp;
+  using std::pow;
+  if (Value(r[0]) > rcut || Value(r[1]) > rcut
+      || (withJK && Value(r[2]) > rcut)) {
+    return T(0.0L);
+  }
+  T const cosIJK = (r[0]*r[0] + r[1]*r[1] - r[2]*r[2])/(2.0L*r[0]*r[1]);
+  T const base = 1.0L + lambda*cosIJK;
+  if (Value(base) <= 0.0L) return T(0.0L);
+
+  T rsq = r[0]*r[0] + r[1]*r[1];
+  T fc = RefCutCos(r[0], rcut)*RefCutCos(r[1], rcut);
+  if (withJK) {
+    rsq = rsq + r[2]*r[2];
+    fc = fc*RefCutCos(r[2], rcut);
+  }
+  return std::pow(2.0L, 1.0L - zeta)*pow(base, zeta)*exp(-eta*rsq)*fc;
+}
+
+
+//==============================================================================
+//
+// Measurement
+//
+//==============================================================================
+
+struct Row
+{
+  std::string kernel;
+  std::string parameters;
+  bool hasDerivative;
+  double rate;      // evaluations per second
+  double absError;
+  double relError;
+  double dAbsError;
+  double dRelError;
+};
+
+// largest absolute and relative errors of `values' w.r.t. `refs'
+void Errors(std::vector<double> const& values,
+            std::vector<long double> const& refs,
+            double& absError, double& relError)
+{
+  long double scale = 0.0L;
+  for (size_t n = 0; n < refs.size(); ++n) {
+    scale = std::max(scale, std::fabs(refs[n]));
+  }
+  absError = 0.0;
+  relError = 0.0;
+  for (size_t n = 0; n < refs.size(); ++n) {
+    long double const err = std::fabs(values[n] - refs[n]);
+    absError = std::max(absError, double(err));
+    if (std::fabs(refs[n]) >= 1e-6L*scale && refs[n] != 0.0L) {
+      relError = std::max(relError, double(err/std::fabs(refs[n])));
+    }
+  }
+}
+
+// Sum of the values of the timed kernels, stored in a variable with external
+// linkage such that the compiler cannot drop the evaluations
+double rateSink = 0.0;
+
+// evaluations per second of kernel(n, sum) for n = 0, ..., points-1, repeated
+// for at least minSeconds
+template<class Kernel>
+double Rate(Kernel const& kernel, int const points, double const minSeconds)
+{
+  double sum = 0.0;
+  long evaluations = 0;
+  std::chrono::steady_clock::time_point const start
+      = std::chrono::steady_clock::now();
+  double seconds = 0.0;
+  do {
+    for (int n = 0; n < points; ++n) kernel(n, sum);
+    evaluations += points;
+    seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+  } while (seconds < minSeconds);
+  rateSink += sum;
+  return evaluations/seconds;
+}
+
+std::string Parameters(char const* const format, double const a,
+                       double const b = 0.0, double const c = 0.0)
+{
+  char buffer[128];
+  snprintf(buffer, sizeof(buffer), format, a, b, c);
+  return buffer;
+}
+
+
+//******************************************************************************
+int main(int argc, char* argv[])
+{
+  int points = 1000;
+  double minSeconds = 0.1;
+  double rcut = 5.0;
+  std::string format = "table";
+  for (int i = 1; i < argc; ++i) {
+    std::string const arg = argv[i];
+    if (arg == "--points" && i + 1 < argc) points = atoi(argv[++i]);
+    else if (arg == "--time" && i + 1 < argc) minSeconds = atof(argv[++i]);
+    else if (arg == "--rcut" && i + 1 < argc) rcut = atof(argv[++i]);
+    else if (arg == "--format" && i + 1 < argc) format = argv[++i];
+    else points = 0;
+  }
+  if (points <= 0 || rcut <= 0.0
+      || (format != "table" && format != "csv" && format != "json")) {
+    std::cerr << "usage: " << argv[0] << " [--points N] [--time SECONDS]"
+              << " [--rcut RCUT] [--format table|csv|json]" << std::endl;
+    return 1;
+  }
+
+  Descriptor descriptor;
+  char cutName[] = "cos";
+  descriptor.set_cutfunc(cutName);
+  std::vector<Row> rows;
+
+  // distances, including some beyond the cutoff
+  std::vector<double> r(points);
+  for (int n = 0; n < points; ++n) {
+    r[n] = 0.5 + (1.05*rcut - 0.5)*(n + 0.5)/points;
+  }
+  // random triangles (rij, rik, rjk)
+  std::mt19937 random(12345);
+  std::uniform_real_distribution<double> length(0.5, 1.05*rcut);
+  std::uniform_real_distribution<double> angle(0.0, MY_PI);
+  std::vector<double> tri(points*3);
+  for (int n = 0; n < points; ++n) {
+    double const rij = length(random);
+    double const rik = length(random);
+    double const theta = angle(random);
+    tri[n*3 + 0] = rij;
+    tri[n*3 + 1] = rik;
+    tri[n*3 + 2] = sqrt(rij*rij + rik*rik - 2*rij*rik*cos(theta));
+  }
+  double const rcuts[3] = {rcut, rcut, rcut};
+
+  std::vector<double> phi(points);
+  std::vector<double> dphi(points*3);
+  std::vector<long double> refPhi(points);
+  std::vector<long double> refDphi(points*3);
+
+  // Add the rows of a two-body kernel: value(n, phi, dphi) evaluates the
+  // kernel at r[n] and ref(x) the reference at Dual x.
+  auto twoBody = [&](std::string const& kernel, std::string const& params,
+                     bool const hasDerivative,
+                     std::function<void(int, double&, double&)> const& value,
+                     std::function<Dual(Dual const&)> const& ref,
+                     double const rate) {
+    for (int n = 0; n < points; ++n) {
+      value(n, phi[n], dphi[n]);
+      Dual const x = ref(Dual(r[n], 0));
+      refPhi[n] = x.v;
+      refDphi[n] = x.d[0];
+    }
+    Row row = {kernel, params, hasDerivative, rate, 0.0, 0.0, 0.0, 0.0};
+    Errors(phi, refPhi, row.absError, row.relError);
+    if (hasDerivative) {
+      std::vector<double> const d(dphi.begin(), dphi.begin() + points);
+      std::vector<long double> const dref(refDphi.begin(),
+                                          refDphi.begin() + points);
+      Errors(d, dref, row.dAbsError, row.dRelError);
+    }
+    rows.push_back(row);
+  };
+
+  // cutoff
+  twoBody("cut_cos", "", false,
+          [&](int n, double& p, double&) { p = cut_cos(r[n], rcut); },
+          [&](Dual const& x) { return RefCutCos(x, rcut); },
+          Rate([&](int n, double& s) { s += cut_cos(r[n], rcut); },
+               points, minSeconds));
+  twoBody("d_cut_cos", "", true,
+          [&](int n, double& p, double& dp) {
+            p = cut_cos(r[n], rcut);
+            dp = d_cut_cos(r[n], rcut);
+          },
+          [&](Dual const& x) { return RefCutCos(x, rcut); },
+          Rate([&](int n, double& s) { s += d_cut_cos(r[n], rcut); },
+               points, minSeconds));
+
+  // g1
+  twoBody("sym_g1", "", false,
+          [&](int n, double& p, double&) { descriptor.sym_g1(r[n], rcut, p); },
+          [&](Dual const& x) { return RefCutCos(x, rcut); },
+          Rate([&](int n, double& s) {
+                 double p;
+                 descriptor.sym_g1(r[n], rcut, p);
+                 s += p;
+               }, points, minSeconds));
+  twoBody("sym_d_g1", "", true,
+          [&](int n, double& p, double& dp) {
+            descriptor.sym_d_g1(r[n], rcut, p, dp);
+          },
+          [&](Dual const& x) { return RefCutCos(x, rcut); },
+          Rate([&](int n, double& s) {
+                 double p, dp;
+                 descriptor.sym_d_g1(r[n], rcut, p, dp);
+                 s += p + dp;
+               }, points, minSeconds));
+
+  // g2
+  double const etas2[] = {0.001, 0.01, 0.1, 1.0};
+  double const shifts[] = {0.0, 2.5};
+  for (double const eta : etas2) {
+    for (double const Rs : shifts) {
+      std::string const params = Parameters("eta=%g Rs=%g", eta, Rs);
+      auto const ref = [&](Dual const& x) { return RefG2(eta, Rs, x, rcut); };
+      twoBody("sym_g2", params, false,
+              [&](int n, double& p, double&) {
+                descriptor.sym_g2(eta, Rs, r[n], rcut, p);
+              }, ref,
+              Rate([&](int n, double& s) {
+                     double p;
+                     descriptor.sym_g2(eta, Rs, r[n], rcut, p);
+                     s += p;
+                   }, points, minSeconds));
+      twoBody("sym_d_g2", params, true,
+              [&](int n, double& p, double& dp) {
+                descriptor.sym_d_g2(eta, Rs, r[n], rcut, p, dp);
+              }, ref,
+              Rate([&](int n, double& s) {
+                     double p, dp;
+                     descriptor.sym_d_g2(eta, Rs, r[n], rcut, p, dp);
+                     s += p + dp;
+                   }, points, minSeconds));
+    }
+  }
+
+  // g3
+  double const kappas[] = {0.5, 1.0, 2.0};
+  for (double const kappa : kappas) {
+    std::string const params = Parameters("kappa=%g", kappa);
+    auto const ref = [&](Dual const& x) { return RefG3(kappa, x, rcut); };
+    twoBody("sym_g3", params, false,
+            [&](int n, double& p, double&) {
+              descriptor.sym_g3(kappa, r[n], rcut, p);
+            }, ref,
+            Rate([&](int n, double& s) {
+                   double p;
+                   descriptor.sym_g3(kappa, r[n], rcut, p);
+                   s += p;
+                 }, points, minSeconds));
+    twoBody("sym_d_g3", params, true,
+            [&](int n, double& p, double& dp) {
+              descriptor.sym_d_g3(kappa, r[n], rcut, p, dp);
+            }, ref,
+            Rate([&](int n, double& s) {
+                   double p, dp;
+                   descriptor.sym_d_g3(kappa, r[n], rcut, p, dp);
+                   s += p + dp;
+                 }, points, minSeconds));
+  }
+
+  // g4 and g5
+  double const zetas[] = {1.0, 2.0, 4.0, 16.0};
+  double const lambdas[] = {-1.0, 1.0};
+  double const etas3[] = {0.0, 0.005, 0.05};
+  for (int withJK = 1; withJK >= 0; --withJK) {
+    for (double const zeta : zetas) {
+      for (double const lambda : lambdas) {
+        for (double const eta : etas3) {
+          double const pre = pow(2.0, 1.0 - zeta);
+          std::string const params
+              = Parameters("zeta=%g lambda=%g eta=%g", zeta, lambda, eta);
+
+          // value and derivatives w.r.t. (rij, rik, rjk)
+          for (int n = 0; n < points; ++n) {
+            Dual const x[3] = {Dual(tri[n*3], 0), Dual(tri[n*3 + 1], 1),
+                               Dual(tri[n*3 + 2], 2)};
+            Dual const f = RefThreeBody(zeta, lambda, eta, x, rcut, withJK);
+            refPhi[n] = f.v;
+            for (int k = 0; k < 3; ++k) refDphi[n*3 + k] = f.d[k];
+          }
+
+          for (int derivative = 0; derivative <= 1; ++derivative) {
+            for (int n = 0; n < points; ++n) {
+              double const* const t = &tri[n*3];
+              if (withJK && derivative) {
+                descriptor.sym_d_g4(zeta, lambda, eta, pre, t, rcuts, phi[n],
+                                    &dphi[n*3]);
+              }
+              else if (withJK) {
+                descriptor.sym_g4(zeta, lambda, eta, pre, t, rcuts, phi[n]);
+              }
+              else if (derivative) {
+                descriptor.sym_d_g5(zeta, lambda, eta, pre, t, rcuts, phi[n],
+                                    &dphi[n*3]);
+              }
+              else {
+                descriptor.sym_g5(zeta, lambda, eta, pre, t, rcuts, phi[n]);
+              }
+            }
+
+            double rate;
+            if (derivative) {
+              rate = Rate([&](int n, double& s) {
+                  double p, dp[3];
+                  if (withJK) {
+                    descriptor.sym_d_g4(zeta, lambda, eta, pre, &tri[n*3],
+                                        rcuts, p, dp);
+                  }
+                  else {
+                    descriptor.sym_d_g5(zeta, lambda, eta, pre, &tri[n*3],
+                                        rcuts, p, dp);
+                  }
+                  s += p + dp[0] + dp[1] + dp[2];
+                }, points, minSeconds);
+            }
+            else {
+              rate = Rate([&](int n, double& s) {
+                  double p;
+                  if (withJK) {
+                    descriptor.sym_g4(zeta, lambda, eta, pre, &tri[n*3],
+                                      rcuts, p);
+                  }
+                  else {
+                    descriptor.sym_g5(zeta, lambda, eta, pre, &tri[n*3],
+                                      rcuts, p);
+                  }
+                  s += p;
+                }, points, minSeconds);
+            }
+
+            std::string const kernel = std::string(derivative ? "sym_d_" : "sym_")
+                + (withJK ? "g4" : "g5");
+            Row row = {kernel, params, bool(derivative), rate,
+                       0.0, 0.0, 0.0, 0.0};
+            Errors(phi, refPhi, row.absError, row.relError);
+            if (derivative) Errors(dphi, refDphi, row.dAbsError, row.dRelError);
+            rows.push_back(row);
+          }
+        }
+      }
+    }
+  }
+
+  // output
+  if (format == "table") {
+    printf("%-10s %-28s %12s %10s %10s %10s %10s\n", "kernel", "parameters",
+           "evals/s", "abs err", "rel err", "d abs err", "d rel err");
+  }
+  else if (format == "csv") {
+    printf("kernel,parameters,evaluations_per_second,abs_error,rel_error,"
+           "derivative_abs_error,derivative_rel_error\n");
+  }
+  else {
+    printf("[\n");
+  }
+  for (size_t i = 0; i < rows.size(); ++i) {
+    Row const& row = rows[i];
+    if (format == "table") {
+      printf("%-10s %-28s %12.4g %10.2e %10.2e", row.kernel.c_str(),
+             row.parameters.c_str(), row.rate, row.absError, row.relError);
+      if (row.hasDerivative) {
+        printf(" %10.2e %10.2e\n", row.dAbsError, row.dRelError);
+      }
+      else {
+        printf(" %10s %10s\n", "-", "-");
+      }
+    }
+    else if (format == "csv") {
+      printf("%s,%s,%.6g,%.3e,%.3e", row.kernel.c_str(),
+             row.parameters.c_str(), row.rate, row.absError, row.relError);
+      if (row.hasDerivative) {
+        printf(",%.3e,%.3e\n", row.dAbsError, row.dRelError);
+      }
+      else {
+        printf(",,\n");
+      }
+    }
+    else {
+      printf("  {\"kernel\": \"%s\", \"parameters\": \"%s\", "
+             "\"evaluations_per_second\": %.6g, \"abs_error\": %.3e, "
+             "\"rel_error\": %.3e", row.kernel.c_str(),
+             row.parameters.c_str(), row.rate, row.absError, row.relError);
+      if (row.hasDerivative) {
+        printf(", \"derivative_abs_error\": %.3e, "
+               "\"derivative_rel_error\": %.3e", row.dAbsError,
+               row.dRelError);
+      }
+      printf("}%s\n", (i + 1 < rows.size()) ? "," : "");
+    }
+  }
+  if (format == "json") printf("]\n");
+
+  return 0;
+}
@@ -0,0 +1,270 @@
+//
+// CDDL HEADER START
+//
+// The contents of this file are subject to the terms of the Common Development
+// and Distribution License Version 1.0 (the "License").
+//
+// You can obtain a copy of the license at
+// http://www.opensource.org/licenses/CDDL-1.0.  See the License for the
+// specific language governing permissions and limitations under the License.
+//
+// When distributing Covered Code, include this CDDL HEADER in each file and
+// include the License file in a prominent location with the name LICENSE.CDDL.
+// If applicable, add the following below this CDDL HEADER, with the fields
+// enclosed by brackets "[]" replaced with your own identifying information:
+//
+// Portions Copyright (c) [yyyy] [name of copyright owner]. All rights reserved.
+//
+// CDDL HEADER END
+//
+
+//
+// Copyright (c) 2017, Regents of the University of Minnesota.
+// All rights reserved.
+//
+// Contributors:
+//    Mingjian Wen
+//
+
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "KIM_API.h"
+#include "KIM_API_status.h"
+#include "neighbors.h"
+#include "structures.h"
+
+
+//******************************************************************************
+// KIM API get_neigh method, locator mode only
+int GetNeigh(void** kimmdl, int* mode, int* request, int* particle,
+             int* numnei, int** nei1particle, double** Rij)
+{
+  KIM_API_model* const pkim = *reinterpret_cast<KIM_API_model**>(kimmdl);
+  NeighborList const* const neighbors
+      = static_cast<NeighborList const*>(pkim->get_data("neighObject"));
+
+  if (*mode != 1) return KIM_STATUS_FAIL;
+  int const i = *request;
+  if (i < 0 || i >= neighbors->numberContributing) return KIM_STATUS_FAIL;
+
+  *particle = i;
+  *numnei = neighbors->start[i+1] - neighbors->start[i];
+  *nei1particle = const_cast<int*>(&neighbors->list[neighbors->start[i]]);
+  *Rij = 0;
+  return KIM_STATUS_OK;
+}
+
+//******************************************************************************
+// Add the periodic images of the atoms within `cutoff' of the box of the
+// configuration.  The box must be at least `cutoff' wide in its periodic
+// directions.
+void AddGhosts(double const cutoff, Configuration& config)
+{
+  int const N = config.numberContributing;
+  double const* const box = config.box;
+  bool const* const periodic = config.periodic;
+  for (int sx = -1; sx <= 1; ++sx) {
+    for (int sy = -1; sy <= 1; ++sy) {
+      for (int sz = -1; sz <= 1; ++sz) {
+        int const shift[DIM] = {sx, sy, sz};
+        bool skip = (sx == 0 && sy == 0 && sz == 0);
+        for (int d = 0; d < DIM; ++d) {
+          if (shift[d] != 0 && !periodic[d]) skip = true;
+        }
+        if (skip) continue;
+
+        for (int i = 0; i < N; ++i) {
+          double x[DIM];
+          bool inside = true;
+          for (int d = 0; d < DIM; ++d) {
+            x[d] = config.coordinates[i*DIM + d] + shift[d]*box[d];
+            if (x[d] < -cutoff || x[d] >= box[d] + cutoff) inside = false;
+          }
+          if (!inside) continue;
+          config.coordinates.insert(config.coordinates.end(), x, x + DIM);
+          config.species.push_back(config.species[i]);
+          config.status.push_back(0);
+          config.owner.push_back(i);
+        }
+      }
+    }
+  }
+}
+
+//******************************************************************************
+// Move the contributing atoms that left the box through a periodic face back
+// into it, and replace the ghosts by the images of the new positions
+void UpdateGhosts(double const cutoff, Configuration& config)
+{
+  int const N = config.numberContributing;
+  for (int i = 0; i < N; ++i) {
+    for (int d = 0; d < DIM; ++d) {
+      if (config.periodic[d]) {
+        double& x = config.coordinates[i*DIM + d];
+        x -= config.box[d]*std::floor(x/config.box[d]);
+      }
+    }
+  }
+  config.coordinates.resize(N*DIM);
+  config.species.resize(N);
+  config.status.resize(N);
+  config.owner.resize(N);
+  AddGhosts(cutoff, config);
+}
+
+//******************************************************************************
+// fcc crystal of about `atoms' atoms, with small random displacements; a
+// slab with two free surfaces normal to z if `surface', and with the species
+// of the L1_2 structure instead of random ones if `ordered'
+Configuration MakeCrystal(int const atoms, double const density,
+                          int const numberSpecies, double const cutoff,
+                          bool const surface, bool const ordered,
+                          std::mt19937& random)
+{
+  double const a = cbrt(4.0/density);
+  int const n = std::max(int(std::ceil(cutoff/a)),
+                         int(std::lround(cbrt(atoms/4.0))));
+  Configuration config;
+  double const box[DIM] = {n*a, n*a, n*a};
+  bool const periodic[DIM] = {true, true, !surface};
+  std::copy(box, box + DIM, config.box);
+  std::copy(periodic, periodic + DIM, config.periodic);
+  double const basis[4][DIM] = {{0.0, 0.0, 0.0}, {0.5, 0.5, 0.0},
+                                {0.5, 0.0, 0.5}, {0.0, 0.5, 0.5}};
+
+  std::uniform_real_distribution<double> displacement(-0.02*a, 0.02*a);
+  std::uniform_int_distribution<int> species(0, numberSpecies - 1);
+  for (int i = 0; i < n; ++i) {
+    for (int j = 0; j < n; ++j) {
+      for (int k = 0; k < n; ++k) {
+        for (int b = 0; b < 4; ++b) {
+          int const cell[DIM] = {i, j, k};
+          for (int d = 0; d < DIM; ++d) {
+            double x = (cell[d] + basis[b][d] + 0.25)*a + displacement(random);
+            if (periodic[d]) x = x - box[d]*std::floor(x/box[d]);
+            config.coordinates.push_back(x);
+          }
+          if (ordered) {
+            // L1_2: the second species at the corners, the first on the faces
+            config.species.push_back((b == 0 && numberSpecies > 1) ? 1 : 0);
+          }
+          else {
+            config.species.push_back(species(random));
+          }
+          config.status.push_back(1);
+          config.owner.push_back(config.owner.size());
+        }
+      }
+    }
+  }
+  config.numberContributing = config.species.size();
+  AddGhosts(cutoff, config);
+  return config;
+}
+
+//******************************************************************************
+// random packing of `atoms' atoms in a periodic cube, no two closer than
+// 0.8 times the mean spacing (random sequential addition)
+Configuration MakeLiquid(int const atoms, double const density,
+                         int const numberSpecies, double const cutoff,
+                         std::mt19937& random)
+{
+  double const L = std::max(cbrt(atoms/density), cutoff);
+  Configuration config;
+  for (int d = 0; d < DIM; ++d) {
+    config.box[d] = L;
+    config.periodic[d] = true;
+  }
+  double const minDistance = 0.8*cbrt(1.0/density);
+
+  // bins of at least minDistance, to find close atoms
+  int const nb = std::max(1, int(L/minDistance));
+  double const binSize = L/nb;
+  std::vector<std::vector<int> > bins(nb*nb*nb);
+
+  std::uniform_real_distribution<double> position(0.0, L);
+  std::uniform_int_distribution<int> species(0, numberSpecies - 1);
+  long attempts = 0;
+  while (int(config.species.size()) < atoms && attempts < 1000L*atoms) {
+    ++attempts;
+    double const x[DIM] = {position(random), position(random),
+                           position(random)};
+    int cell[DIM];
+    for (int d = 0; d < DIM; ++d) {
+      cell[d] = std::min(int(x[d]/binSize), nb - 1);
+    }
+
+    bool accept = true;
+    for (int a = -1; a <= 1 && accept; ++a) {
+      for (int b = -1; b <= 1 && accept; ++b) {
+        for (int c = -1; c <= 1 && accept; ++c) {
+          std::vector<int> const& bin
+              = bins[(((cell[0] + a + nb) % nb)*nb + (cell[1] + b + nb) % nb)*nb
+                     + (cell[2] + c + nb) % nb];
+          for (size_t m = 0; m < bin.size(); ++m) {
+            double rsq = 0.0;
+            for (int d = 0; d < DIM; ++d) {
+              double dx = config.coordinates[bin[m]*DIM + d] - x[d];
+              dx -= L*std::round(dx/L);
+              rsq += dx*dx;
+            }
+            if (rsq < minDistance*minDistance) {
+              accept = false;
+              break;
+            }
+          }
+        }
+      }
+    }
+    if (!accept) continue;
+
+    bins[(cell[0]*nb + cell[1])*nb + cell[2]].push_back(config.species.size());
+    config.coordinates.insert(config.coordinates.end(), x, x + DIM);
+    config.species.push_back(species(random));
+    config.status.push_back(1);
+    config.owner.push_back(config.owner.size());
+  }
+  config.numberContributing = config.species.size();
+  AddGhosts(cutoff, config);
+  return config;
+}
+
+//******************************************************************************
+// full neighbor lists of the contributing atoms with linked cells
+void BuildNeighborList(Configuration const& config, double const cutoff,
+                       NeighborList& neighbors)
+{
+  NeighborBuilder builder;
+  builder.set_cutoff(cutoff);
+  builder.set_particles(config.size(), config.numberContributing,
+                        &config.species[0], &config.coordinates[0]);
+  builder.build(false, 0);
+
+  std::vector<int> const& numNei = builder.get_num_neighbors();
+  std::vector<int> const& start = builder.get_neighbor_start();
+  std::vector<int> const& list = builder.get_neighbors();
+  neighbors.numberContributing = config.numberContributing;
+  neighbors.start.assign(1, 0);
+  neighbors.list.clear();
+  for (int i = 0; i < config.numberContributing; ++i) {
+    neighbors.list.insert(neighbors.list.end(), list.begin() + start[i],
+                          list.begin() + start[i] + numNei[i]);
+    neighbors.start.push_back(neighbors.list.size());
+  }
+}
+
+//******************************************************************************
+Configuration MakeStructure(std::string const& structure, int const atoms,
+                            double const density, int const numberSpecies,
+                            double const cutoff, std::mt19937& random)
+{
+  if (structure == "liquid") {
+    return MakeLiquid(atoms, density, numberSpecies, cutoff, random);
+  }
+  return MakeCrystal(atoms, density, numberSpecies, cutoff,
+                     structure == "surface", structure == "alloy", random);
+}
+
@@ -0,0 +1,88 @@
+//
+// CDDL HEADER START
+//
+// The contents of this file are subject to the terms of the Common Development
+// and Distribution License Version 1.0 (the "License").
+//
+// You can obtain a copy of the license at
+// http://www.opensource.org/licenses/CDDL-1.0.  See the License for the
+// specific language governing permissions and limitations under the License.
+//
+// When distributing Covered Code, include this CDDL HEADER in each file and
+// include the License file in a prominent location with the name LICENSE.CDDL.
+// If applicable, add the following below this CDDL HEADER, with the fields
+// enclosed by brackets "[]" replaced with your own identifying information:
+//
+// Portions Copyright (c) [yyyy] [name of copyright owner]. All rights reserved.
+//
+// CDDL HEADER END
+//
+
+//
+// Copyright (c) 2017, Regents of the University of Minnesota.
+// All rights reserved.
+//
+// Contributors:
+//    Mingjian Wen
+//
+
+
+
+// Synthetic configurations and neighbor lists for the programs that run the
+// driver through the stand-in of the KIM API (see ann_benchmark.cpp)
+
+#ifndef STRUCTURES_H_
+#define STRUCTURES_H_
+
+#include <random>
+#include <string>
+#include <vector>
+
+#define DIM 3
+
+// A configuration as handed to the driver: contributing atoms first, then
+// the periodic images (ghosts) within the neighbor cutoff of the box
+struct Configuration
+{
+  int numberContributing;
+  std::vector<double> coordinates;  // [numberOfParticles*DIM]
+  std::vector<int> species;
+  std::vector<int> status;
+  std::vector<int> owner;           // contributing atom of each particle
+  double box[DIM];                  // [0, box[0]) x [0, box[1]) x ...
+  bool periodic[DIM];
+
+  int size() const { return species.size(); }
+};
+
+// Full neighbor lists of the contributing atoms
+struct NeighborList
+{
+  int numberContributing;
+  std::vector<int> start;  // [numberContributing+1]
+  std::vector<int> list;
+};
+
+// KIM API get_neigh method for a NeighborList set as "neighObject"
+int GetNeigh(void** kimmdl, int* mode, int* request, int* particle,
+             int* numnei, int** nei1particle, double** Rij);
+
+// periodic fcc crystal of about `atoms' atoms; a slab if `surface', and L1_2
+// ordered species instead of random ones if `ordered'
+Configuration MakeCrystal(int atoms, double density, int numberSpecies,
+                          double cutoff, bool surface, bool ordered,
+                          std::mt19937& random);
+// periodic random packing of `atoms' atoms
+Configuration MakeLiquid(int atoms, double density, int numberSpecies,
+                         double cutoff, std::mt19937& random);
+// the structures above by name (bulk, surface, liquid or alloy)
+Configuration MakeStructure(std::string const& structure, int atoms,
+                            double density, int numberSpecies, double cutoff,
+                            std::mt19937& random);
+
+void AddGhosts(double cutoff, Configuration& config);
+void UpdateGhosts(double cutoff, Configuration& config);
+void BuildNeighborList(Configuration const& config, double cutoff,
+                       NeighborList& neighbors);
+
+#endif  // STRUCTURES_H_
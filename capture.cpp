@@ -0,0 +1,112 @@
+#include <cstring>
+#include <stdint.h>
+#include "capture.h"
+
+// the records are written as int32
+static_assert(sizeof(int) == sizeof(int32_t), "int must have 32 bits");
+
+namespace {
+
+char const CAPTURE_MAGIC[8] = {'A', 'N', 'N', 'C', 'A', 'P', '0', '1'};
+
+template<class T>
+bool write_array(FILE* const file, T const* const data, size_t const n)
+{
+  return fwrite(data, sizeof(T), n, file) == n;
+}
+
+template<class T>
+bool read_array(FILE* const file, std::vector<T>& data, size_t const n)
+{
+  data.resize(n);
+  return fread(data.data(), sizeof(T), n, file) == n;
+}
+
+}  // namespace
+
+//******************************************************************************
+int write_capture_header(FILE* const file, std::string& error)
+{
+  if (!write_array(file, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC))) {
+    error = "cannot write the capture file header";
+    return 1;
+  }
+  return 0;
+}
+
+//******************************************************************************
+int read_capture_header(FILE* const file, std::string& error)
+{
+  std::vector<char> magic;
+  if (!read_array(file, magic, sizeof(CAPTURE_MAGIC))
+      || memcmp(magic.data(), CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) != 0) {
+    error = "not a capture file (bad magic)";
+    return 1;
+  }
+  return 0;
+}
+
+//******************************************************************************
+int write_captured_call(FILE* const file, CapturedCall const& call,
+    std::string& error)
+{
+  int32_t const N = call.number_of_particles();
+  int32_t const M = call.number_of_lists();
+  int32_t const header[4] = {N, call.flags, M,
+                             static_cast<int32_t>(call.neighbors.size())};
+  bool const ok = write_array(file, header, 4)
+      && write_array(file, call.particleStatus.data(), N)
+      && write_array(file, call.particleSpecies.data(), N)
+      && write_array(file, call.coordinates.data(), 3*N)
+      && write_array(file, call.particle.data(), M)
+      && write_array(file, call.numNei.data(), M)
+      && write_array(file, call.neighbors.data(), call.neighbors.size());
+  if (!ok) {
+    error = "cannot write a record of the capture file";
+    return 1;
+  }
+  return 0;
+}
+
+//******************************************************************************
+int read_captured_call(FILE* const file, CapturedCall& call, bool& end,
+    std::string& error)
+{
+  end = false;
+  int32_t header[4];
+  size_t const n = fread(header, sizeof(int32_t), 4, file);
+  if (n == 0 && feof(file)) {
+    end = true;
+    return 0;
+  }
+  int32_t const N = header[0];
+  int32_t const M = header[2];
+  int32_t const K = header[3];
+  if (n != 4 || N < 0 || M < 0 || K < 0) {
+    error = "truncated or corrupt record in the capture file";
+    return 1;
+  }
+
+  call.flags = header[1];
+  bool const ok = read_array(file, call.particleStatus, N)
+      && read_array(file, call.particleSpecies, N)
+      && read_array(file, call.coordinates, 3*N)
+      && read_array(file, call.particle, M)
+      && read_array(file, call.numNei, M)
+      && read_array(file, call.neighbors, K);
+  if (!ok) {
+    error = "truncated record in the capture file";
+    return 1;
+  }
+
+  call.neighStart.resize(M + 1);
+  call.neighStart[0] = 0;
+  for (int m = 0; m < M; ++m) {
+    call.neighStart[m+1] = call.neighStart[m] + call.numNei[m];
+  }
+  if (call.neighStart[M] != K) {
+    error = "inconsistent neighbor counts in the capture file";
+    return 1;
+  }
+  return 0;
+}
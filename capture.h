@@ -0,0 +1,67 @@
+#ifndef CAPTURE_H_
+#define CAPTURE_H_
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Capture files: the inputs of a sequence of Compute calls
+//
+// The driver writes one record per Compute call when ANN_CAPTURE_FILE is set,
+// and benchmark/ann_replay repeats the calls from the file.  A file starts
+// with the 8 bytes "ANNCAP01", followed by the records:
+//
+//   int32   numberOfParticles N
+//   int32   flags (CAPTURE_* bits of the requested outputs and callbacks)
+//   int32   numberOfLists M (neighbor lists requested from get_neigh)
+//   int32   numberOfNeighbors K (summed over the lists)
+//   int32   particleStatus[N]
+//   int32   particleSpecies[N]
+//   float64 coordinates[N*3]
+//   int32   particle[M]    (particle returned for the m-th request)
+//   int32   numNei[M]
+//   int32   neighbors[K]   (the lists, one after the other)
+//
+// in the byte order of the machine that wrote it.  Particle indices are zero
+// based.
+//
+// The functions return 0 on success; otherwise a nonzero value is returned
+// and `error' describes the problem.
+
+enum CaptureFlag
+{
+  CAPTURE_ENERGY = 1,
+  CAPTURE_FORCES = 2,
+  CAPTURE_PARTICLE_ENERGY = 4,
+  CAPTURE_VIRIAL = 8,
+  CAPTURE_PARTICLE_VIRIAL = 16,
+  CAPTURE_PROCESS_DEDR = 32,
+  CAPTURE_PROCESS_D2EDR2 = 64
+};
+
+struct CapturedCall
+{
+  int flags;
+  std::vector<int> particleStatus;    // [numberOfParticles]
+  std::vector<int> particleSpecies;   // [numberOfParticles]
+  std::vector<double> coordinates;    // [numberOfParticles*3]
+  std::vector<int> particle;          // [numberOfLists]
+  std::vector<int> numNei;            // [numberOfLists]
+  std::vector<int> neighStart;        // [numberOfLists+1] start of each list
+  std::vector<int> neighbors;
+
+  int number_of_particles() const { return particleSpecies.size(); }
+  int number_of_lists() const { return particle.size(); }
+};
+
+int write_capture_header(FILE* file, std::string& error);
+// also checks the magic
+int read_capture_header(FILE* file, std::string& error);
+
+int write_captured_call(FILE* file, CapturedCall const& call,
+    std::string& error);
+// `end' is set if there are no more records
+int read_captured_call(FILE* file, CapturedCall& call, bool& end,
+    std::string& error);
+
+#endif // CAPTURE_H_
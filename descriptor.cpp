@@ -15,13 +15,16 @@ Descriptor::~Descriptor() {
 
 void Descriptor::set_cutfunc(char* name)
 {
+  cutoff_name = name;
 	if (strcmp(name, "cos") == 0) {
 		cutoff = &cut_cos;
 		d_cutoff = &d_cut_cos;
+		d2_cutoff = &d2_cut_cos;
 	}
 	else if (strcmp(name, "exp") == 0) {
 		cutoff = &cut_exp;
 		d_cutoff = &d_cut_exp;
+		d2_cutoff = &d2_cut_exp;
 	}
 }
 
@@ -40,7 +43,23 @@ void Descriptor::add_descriptor(char* name, double** values, int row, int col)
     index += num_param_sets[i];
   }
 
+  DescriptorType t = DESCRIPTOR_G1;
+  if (strcmp(name, "g2") == 0) t = DESCRIPTOR_G2;
+  else if (strcmp(name, "g3") == 0) t = DESCRIPTOR_G3;
+  else if (strcmp(name, "g4") == 0) t = DESCRIPTOR_G4;
+  else if (strcmp(name, "g5") == 0) t = DESCRIPTOR_G5;
+
+  // precompute constants of the parameter sets
+  std::vector<double> pre(row, 1.0);
+  if (t == DESCRIPTOR_G4 || t == DESCRIPTOR_G5) {
+    for (int i=0; i<row; i++) {
+      pre[i] = pow(2, 1-params[i][0]);
+    }
+  }
+
 	this->name.push_back(name);
+	type.push_back(t);
+	prefactor.push_back(pre);
 	this->params.push_back(params);
 	num_param_sets.push_back(row);
 	num_params.push_back(col);
@@ -62,7 +81,7 @@ void Descriptor::set_center_and_normalize(bool do_center_and_normalize, int size
 }
 
 
-int Descriptor::get_num_descriptors() {
+int Descriptor::get_num_descriptors() const {
   int N = 0;
   for (size_t i=0; i<num_param_sets.size(); i++) {
     N += num_param_sets.at(i);
@@ -75,21 +94,22 @@ int Descriptor::get_num_descriptors() {
 // Symmetry functions: Jorg Behler, J. Chem. Phys. 134, 074106, 2011.
 //*****************************************************************************
 
-void Descriptor::sym_g1(double r, double rcut, double &phi) {
+void Descriptor::sym_g1(double r, double rcut, double &phi) const {
   phi = cutoff(r, rcut);
 }
 
-void Descriptor::sym_d_g1(double r, double rcut, double &phi, double &dphi) {
+void Descriptor::sym_d_g1(double r, double rcut, double &phi, double &dphi) const {
   phi = cutoff(r, rcut);
   dphi = d_cutoff(r, rcut);
 }
 
-void Descriptor::sym_g2(double eta, double Rs, double r, double rcut, double &phi) {
+void Descriptor::sym_g2(double eta, double Rs, double r, double rcut,
+    double &phi) const {
   phi = exp(-eta*(r-Rs)*(r-Rs)) * cutoff(r, rcut);
 }
 
 void Descriptor::sym_d_g2(double eta, double Rs, double r, double rcut,
-    double &phi, double &dphi)
+    double &phi, double &dphi) const
 {
   double eterm = exp(-eta*(r-Rs)*(r-Rs));
   double determ = -2*eta*(r-Rs)*eterm;
@@ -100,12 +120,12 @@ void Descriptor::sym_d_g2(double eta, double Rs, double r, double rcut,
   dphi = determ*fc + eterm*dfc;
 }
 
-void Descriptor::sym_g3(double kappa, double r, double rcut, double &phi) {
+void Descriptor::sym_g3(double kappa, double r, double rcut, double &phi) const {
 	phi = cos(kappa*r) * cutoff(r, rcut);
 }
 
 void Descriptor::sym_d_g3(double kappa, double r, double rcut, double &phi,
-    double &dphi)
+    double &dphi) const
 {
   double costerm = cos(kappa*r);
   double dcosterm = -kappa*sin(kappa*r);
@@ -117,7 +137,7 @@ void Descriptor::sym_d_g3(double kappa, double r, double rcut, double &phi,
 }
 
 void Descriptor::sym_g4(double zeta, double lambda, double eta,
-    const double* r, const double* rcut, double &phi)
+    double prefactor, const double* r, const double* rcut, double &phi) const
 {
   double rij = r[0];
   double rik = r[1];
@@ -147,13 +167,14 @@ void Descriptor::sym_g4(double zeta, double lambda, double eta,
 
     double eterm = exp(-eta*(rijsq + riksq + rjksq));
 
-    phi = pow(2, 1-zeta) * costerm * eterm * cutoff(rij, rcutij)
+    phi = prefactor * costerm * eterm * cutoff(rij, rcutij)
       *cutoff(rik, rcutik) * cutoff(rjk, rcutjk);
   }
 }
 
 void Descriptor::sym_d_g4(double zeta, double lambda, double eta,
-    const double* r, const double* rcut, double &phi, double* const dphi)
+    double prefactor, const double* r, const double* rcut, double &phi,
+    double* const dphi) const
 {
   double rij = r[0];
   double rik = r[1];
@@ -187,7 +208,7 @@ void Descriptor::sym_d_g4(double zeta, double lambda, double eta,
     }
     else {
       costerm = pow(base, zeta);
-      dcosterm_dcos = zeta * pow(base, zeta-1) * lambda;
+      dcosterm_dcos = zeta * costerm / base * lambda;
     }
     double dcosterm_dij = dcosterm_dcos * dcos_dij;
     double dcosterm_dik = dcosterm_dcos * dcos_dik;
@@ -200,7 +221,7 @@ void Descriptor::sym_d_g4(double zeta, double lambda, double eta,
     double determ_djk = -2*eterm*eta*rjk;
 
     // power 2 term
-    double p2 = pow(2, 1-zeta);
+    double p2 = prefactor;
 
     // cutoff
     double fcij = cutoff(rij, rcutij);
@@ -226,7 +247,7 @@ void Descriptor::sym_d_g4(double zeta, double lambda, double eta,
 }
 
 void Descriptor::sym_g5(double zeta, double lambda, double eta,
-    const double* r, const double* rcut, double &phi)
+    double prefactor, const double* r, const double* rcut, double &phi) const
 {
   double rij = r[0];
   double rik = r[1];
@@ -255,12 +276,13 @@ void Descriptor::sym_g5(double zeta, double lambda, double eta,
 
     double eterm = exp(-eta*(rijsq + riksq));
 
-    phi = pow(2, 1-zeta)*costerm*eterm*cutoff(rij, rcutij)*cutoff(rik, rcutik);
+    phi = prefactor*costerm*eterm*cutoff(rij, rcutij)*cutoff(rik, rcutik);
   }
 }
 
 void Descriptor::sym_d_g5(double zeta, double lambda, double eta,
-    const double* r, const double* rcut, double &phi, double* const dphi)
+    double prefactor, const double* r, const double* rcut, double &phi,
+    double* const dphi) const
 {
   double rij = r[0];
   double rik = r[1];
@@ -293,7 +315,7 @@ void Descriptor::sym_d_g5(double zeta, double lambda, double eta,
     }
     else {
       costerm = pow(base, zeta);
-      dcosterm_dcos = zeta * pow(base, zeta-1) * lambda;
+      dcosterm_dcos = zeta * costerm / base * lambda;
     }
     double dcosterm_dij = dcosterm_dcos * dcos_dij;
     double dcosterm_dik = dcosterm_dcos * dcos_dik;
@@ -305,7 +327,7 @@ void Descriptor::sym_d_g5(double zeta, double lambda, double eta,
     double determ_dik = -2*eterm*eta*rik;
 
     // power 2 term
-    double p2 = pow(2, 1-zeta);
+    double p2 = prefactor;
 
     // cutoff
     double fcij = cutoff(rij, rcutij);
@@ -328,4 +350,185 @@ void Descriptor::sym_d_g5(double zeta, double lambda, double eta,
 }
 
 
+//*****************************************************************************
+// Second derivatives of the symmetry functions
+//*****************************************************************************
+
+void Descriptor::sym_d2_g1(double r, double rcut, double &phi, double &dphi,
+    double &d2phi) const
+{
+  phi = cutoff(r, rcut);
+  dphi = d_cutoff(r, rcut);
+  d2phi = d2_cutoff(r, rcut);
+}
+
+void Descriptor::sym_d2_g2(double eta, double Rs, double r, double rcut,
+    double &phi, double &dphi, double &d2phi) const
+{
+  double eterm = exp(-eta*(r-Rs)*(r-Rs));
+  double determ = -2*eta*(r-Rs)*eterm;
+  double d2eterm = (4*eta*eta*(r-Rs)*(r-Rs) - 2*eta)*eterm;
+  double fc = cutoff(r, rcut);
+  double dfc = d_cutoff(r, rcut);
+  double d2fc = d2_cutoff(r, rcut);
+
+  phi = eterm*fc;
+  dphi = determ*fc + eterm*dfc;
+  d2phi = d2eterm*fc + 2*determ*dfc + eterm*d2fc;
+}
+
+void Descriptor::sym_d2_g3(double kappa, double r, double rcut, double &phi,
+    double &dphi, double &d2phi) const
+{
+  double costerm = cos(kappa*r);
+  double dcosterm = -kappa*sin(kappa*r);
+  double d2costerm = -kappa*kappa*costerm;
+  double fc = cutoff(r, rcut);
+  double dfc = d_cutoff(r, rcut);
+  double d2fc = d2_cutoff(r, rcut);
+
+  phi = costerm*fc;
+  dphi = dcosterm*fc + costerm*dfc;
+  d2phi = d2costerm*fc + 2*dcosterm*dfc + costerm*d2fc;
+}
+
+void Descriptor::sym_d2_g4(double zeta, double lambda, double eta,
+    double prefactor, const double* r, const double* rcut, double &phi,
+    double* const dphi, double* const d2phi) const
+{
+  sym_d2_three_body(zeta, lambda, eta, prefactor, r, rcut, true, phi, dphi,
+      d2phi);
+}
+
+void Descriptor::sym_d2_g5(double zeta, double lambda, double eta,
+    double prefactor, const double* r, const double* rcut, double &phi,
+    double* const dphi, double* const d2phi) const
+{
+  sym_d2_three_body(zeta, lambda, eta, prefactor, r, rcut, false, phi, dphi,
+      d2phi);
+}
+
+// phi = prefactor * costerm * eterm * fcprod, where each of the three terms is
+// a function of (rij, rik, rjk); g5 does not depend on rjk through eterm and
+// fcprod.
+void Descriptor::sym_d2_three_body(double zeta, double lambda, double eta,
+    double prefactor, const double* r, const double* rcut, bool with_jk,
+    double &phi, double* const dphi, double* const d2phi) const
+{
+  double rij = r[0];
+  double rik = r[1];
+  double rjk = r[2];
+  double rijsq = rij*rij;
+  double riksq = rik*rik;
+  double rjksq = rjk*rjk;
+
+  phi = 0.0;
+  for (int a=0; a<3; a++) {
+    dphi[a] = 0.0;
+  }
+  for (int a=0; a<9; a++) {
+    d2phi[a] = 0.0;
+  }
+
+  if (rij > rcut[0] || rik > rcut[1] || (with_jk && rjk > rcut[2])) {
+    return;
+  }
+
+  // cosine term, i is the apex atom
+  double cos_ijk = (rijsq + riksq - rjksq)/(2*rij*rik);
+  double base = 1+lambda*cos_ijk;
+  if (base <= 0) { // prevent numerical unstability (when lambd=-1 and cos_ijk=1)
+    return;
+  }
+  double dcos[3];
+  dcos[0] = (rijsq - riksq + rjksq)/(2*rijsq*rik);
+  dcos[1] = (riksq - rijsq + rjksq)/(2*rij*riksq);
+  dcos[2] = -rjk/(rij*rik);
+  double d2cos[9];
+  d2cos[0] = (riksq - rjksq)/(rijsq*rij*rik);
+  d2cos[4] = (rijsq - rjksq)/(rij*riksq*rik);
+  d2cos[8] = -1/(rij*rik);
+  d2cos[1] = d2cos[3] = -(rijsq + riksq + rjksq)/(2*rijsq*riksq);
+  d2cos[2] = d2cos[6] = rjk/(rijsq*rik);
+  d2cos[5] = d2cos[7] = rjk/(rij*riksq);
+
+  double costerm = pow(base, zeta);
+  double dcosterm_dcos = zeta * costerm / base * lambda;
+  double d2costerm_dcos2 = zeta * (zeta-1) * costerm / (base*base)
+    * lambda * lambda;
+  double dcosterm[3];
+  double d2costerm[9];
+  for (int a=0; a<3; a++) {
+    dcosterm[a] = dcosterm_dcos * dcos[a];
+    for (int b=0; b<3; b++) {
+      d2costerm[a*3+b] = d2costerm_dcos2 * dcos[a] * dcos[b]
+        + dcosterm_dcos * d2cos[a*3+b];
+    }
+  }
+
+  // exponential term
+  double w[3] = {1.0, 1.0, with_jk ? 1.0 : 0.0};
+  double eterm = exp(-eta*(rijsq + riksq + w[2]*rjksq));
+  double determ[3];
+  double d2eterm[9];
+  for (int a=0; a<3; a++) {
+    determ[a] = -2*eterm*eta*w[a]*r[a];
+    for (int b=0; b<3; b++) {
+      d2eterm[a*3+b] = 4*eterm*eta*eta*w[a]*w[b]*r[a]*r[b];
+    }
+    d2eterm[a*3+a] -= 2*eterm*eta*w[a];
+  }
+
+  // cutoff
+  double fc[3];
+  double dfc[3];
+  double d2fc[3];
+  for (int a=0; a<3; a++) {
+    if (a < 2 || with_jk) {
+      fc[a] = cutoff(r[a], rcut[a]);
+      dfc[a] = d_cutoff(r[a], rcut[a]);
+      d2fc[a] = d2_cutoff(r[a], rcut[a]);
+    }
+    else {
+      fc[a] = 1.0;
+      dfc[a] = 0.0;
+      d2fc[a] = 0.0;
+    }
+  }
+  double fcprod = fc[0]*fc[1]*fc[2];
+  double dfcprod[3];
+  double d2fcprod[9];
+  for (int a=0; a<3; a++) {
+    double others = 1.0;
+    for (int c=0; c<3; c++) {
+      if (c != a) others *= fc[c];
+    }
+    dfcprod[a] = dfc[a]*others;
+    for (int b=0; b<3; b++) {
+      if (b == a) {
+        d2fcprod[a*3+b] = d2fc[a]*others;
+      }
+      else {
+        d2fcprod[a*3+b] = dfc[a]*dfc[b]*fc[3-a-b];
+      }
+    }
+  }
+
+  // power 2 term
+  double p2 = prefactor;
+
+  // phi and its derivatives by the product rule
+  phi = p2 * costerm * eterm * fcprod;
+  for (int a=0; a<3; a++) {
+    dphi[a] = p2 * (dcosterm[a]*eterm*fcprod + costerm*determ[a]*fcprod
+        + costerm*eterm*dfcprod[a]);
+    for (int b=0; b<3; b++) {
+      d2phi[a*3+b] = p2 * (d2costerm[a*3+b]*eterm*fcprod
+          + costerm*d2eterm[a*3+b]*fcprod + costerm*eterm*d2fcprod[a*3+b]
+          + (dcosterm[a]*determ[b] + dcosterm[b]*determ[a])*fcprod
+          + (dcosterm[a]*dfcprod[b] + dcosterm[b]*dfcprod[a])*eterm
+          + (determ[a]*dfcprod[b] + determ[b]*dfcprod[a])*costerm);
+    }
+  }
+}
 
@@ -10,10 +10,22 @@
 
 #define MY_PI 3.1415926535897932
 
+// descriptor types, stored in `type' so that the hot loops do not compare
+// names
+enum DescriptorType
+{
+  DESCRIPTOR_G1,
+  DESCRIPTOR_G2,
+  DESCRIPTOR_G3,
+  DESCRIPTOR_G4,
+  DESCRIPTOR_G5
+};
+
 // Symmetry functions taken from:
 
 typedef double (*CutoffFunction)(double r, double rcut);
 typedef double (*dCutoffFunction)(double r, double rcut);
+typedef double (*d2CutoffFunction)(double r, double rcut);
 
 
 class Descriptor
@@ -21,12 +33,16 @@ class Descriptor
   public:
 
 		std::vector<std::string> name;    // name of each descriptor
+		std::vector<DescriptorType> type; // type of each descriptor
 		std::vector<int> starting_index;  // starting index of each descriptor
                                       // in generalized coords
 		std::vector<double**> params;     // params of each descriptor
 		std::vector<int> num_param_sets;  // number of parameter sets of each descriptor
 		std::vector<int> num_params;      // size of parameters of each descriptor
+    // constant factor of each parameter set, 2^(1-zeta) for G4 and G5
+    std::vector<std::vector<double> > prefactor;
     bool has_three_body;
+    std::string cutoff_name;          // name of the cutoff function
 
     bool center_and_normalize;        // whether to center and normalize the data
     std::vector<double> features_mean;
@@ -42,25 +58,42 @@ class Descriptor
 		void set_center_and_normalize(bool do_center_and_normalize, int size,
         double* means, double* stds);
 
-    int get_num_descriptors();
+    int get_num_descriptors() const;
 
 		// symmetry functions
-    void sym_g1(double r, double rcut, double &phi);
-    void sym_g2(double eta, double Rs, double r, double rcut, double &phi);
-    void sym_g3(double kappa, double r, double rcut, double &phi);
-    void sym_g4(double zeta, double lambda, double eta,
-        const double* r, const double* rcut, double &phi);
-    void sym_g5(double zeta, double lambda, double eta,
-        const double* r, const double* rcut, double &phi);
-
-    void sym_d_g1(double r, double rcut, double &phi, double &dphi);
+    void sym_g1(double r, double rcut, double &phi) const;
+    void sym_g2(double eta, double Rs, double r, double rcut, double &phi) const;
+    void sym_g3(double kappa, double r, double rcut, double &phi) const;
+    void sym_g4(double zeta, double lambda, double eta, double prefactor,
+        const double* r, const double* rcut, double &phi) const;
+    void sym_g5(double zeta, double lambda, double eta, double prefactor,
+        const double* r, const double* rcut, double &phi) const;
+
+    void sym_d_g1(double r, double rcut, double &phi, double &dphi) const;
     void sym_d_g2(double eta, double Rs, double r, double rcut, double &phi,
-        double &dphi);
-    void sym_d_g3(double kappa, double r, double rcut, double &phi, double &dphi);
-    void sym_d_g4(double zeta, double lambda, double eta,
-        const double* r, const double* rcut, double &phi, double* const dphi);
-    void sym_d_g5(double zeta, double lambda, double eta,
-        const double* r, const double* rcut, double &phi, double* const dphi);
+        double &dphi) const;
+    void sym_d_g3(double kappa, double r, double rcut, double &phi, double &dphi) const;
+    void sym_d_g4(double zeta, double lambda, double eta, double prefactor,
+        const double* r, const double* rcut, double &phi,
+        double* const dphi) const;
+    void sym_d_g5(double zeta, double lambda, double eta, double prefactor,
+        const double* r, const double* rcut, double &phi,
+        double* const dphi) const;
+
+    // second derivatives; for the three-body functions d2phi is the 3 by 3
+    // (row major) matrix of derivatives w.r.t. (rij, rik, rjk)
+    void sym_d2_g1(double r, double rcut, double &phi, double &dphi,
+        double &d2phi) const;
+    void sym_d2_g2(double eta, double Rs, double r, double rcut, double &phi,
+        double &dphi, double &d2phi) const;
+    void sym_d2_g3(double kappa, double r, double rcut, double &phi,
+        double &dphi, double &d2phi) const;
+    void sym_d2_g4(double zeta, double lambda, double eta, double prefactor,
+        const double* r, const double* rcut, double &phi,
+        double* const dphi, double* const d2phi) const;
+    void sym_d2_g5(double zeta, double lambda, double eta, double prefactor,
+        const double* r, const double* rcut, double &phi,
+        double* const dphi, double* const d2phi) const;
 
 
 //TODO delete; for debug purpose
@@ -96,6 +129,12 @@ class Descriptor
 	private:
 		CutoffFunction cutoff;
 		dCutoffFunction d_cutoff;
+		d2CutoffFunction d2_cutoff;
+
+    // g4 (with_jk == true) or g5 and their first and second derivatives
+    void sym_d2_three_body(double zeta, double lambda, double eta,
+        double prefactor, const double* r, const double* rcut, bool with_jk,
+        double &phi, double* const dphi, double* const d2phi) const;
 };
 
 
@@ -114,6 +153,13 @@ inline double d_cut_cos(double r, double rcut) {
 		return 0.0;
 }
 
+inline double d2_cut_cos(double r, double rcut) {
+	if (r < rcut)
+		return -0.5*MY_PI*MY_PI/(rcut*rcut) * cos(MY_PI*r/rcut);
+	else
+		return 0.0;
+}
+
 
 //TODO correct it
 inline double cut_exp(double r, double rcut) {
@@ -130,6 +176,10 @@ inline double d_cut_exp(double r, double rcut) {
 		return 0.0;
 }
 
+inline double d2_cut_exp(double /*r*/, double /*rcut*/) {
+	return 0.0;
+}
+
 
 
 #endif // DESCRIPTOR_H_
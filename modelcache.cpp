@@ -0,0 +1,86 @@
+#include <sys/mman.h>
+#include "modelcache.h"
+
+#define HASH_BUFFER_SIZE 65536
+
+std::mutex ModelCache::mutex_;
+std::map<ModelCache::Key, std::weak_ptr<ANNModel const> > ModelCache::models_;
+
+
+ANNModel::~ANNModel()
+{
+  if (mapping != 0) {
+    munmap(mapping, mappingSize);
+  }
+}
+
+void ANNModel::compile()
+{
+  if (descriptor.center_and_normalize) {
+    network.fold_input_normalization(&descriptor.features_mean[0],
+        &descriptor.features_std[0]);
+  }
+  network.compile();
+}
+
+ModelCache::Key ModelCache::hash_file(FILE* file)
+{
+  Key const prime = 1099511628211ULL;
+  Key hash = 14695981039346656037ULL;
+  Key size = 0;
+
+  unsigned char buffer[HASH_BUFFER_SIZE];
+  size_t n;
+  rewind(file);
+  while ((n = fread(buffer, 1, HASH_BUFFER_SIZE, file)) > 0) {
+    for (size_t i=0; i<n; i++) {
+      hash ^= buffer[i];
+      hash *= prime;
+    }
+    size += n;
+  }
+  rewind(file);
+
+  // mix in the size
+  hash ^= size;
+  hash *= prime;
+
+  return hash;
+}
+
+std::shared_ptr<ANNModel const> ModelCache::find(Key key)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  std::map<Key, std::weak_ptr<ANNModel const> >::iterator it
+    = models_.find(key);
+  if (it == models_.end()) {
+    return std::shared_ptr<ANNModel const>();
+  }
+
+  std::shared_ptr<ANNModel const> model = it->second.lock();
+  if (!model) {  // all users are gone
+    models_.erase(it);
+  }
+  return model;
+}
+
+std::shared_ptr<ANNModel const> ModelCache::insert(Key key,
+    std::shared_ptr<ANNModel const> const& model)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  std::weak_ptr<ANNModel const>& entry = models_[key];
+  std::shared_ptr<ANNModel const> cached = entry.lock();
+  if (cached) {
+    return cached;
+  }
+  entry = model;
+  return model;
+}
+
+void ModelCache::remove(Key key)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  models_.erase(key);
+}
@@ -0,0 +1,80 @@
+#ifndef MODELCACHE_H_
+#define MODELCACHE_H_
+
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sys/types.h>
+#include "descriptor.h"
+#include "network.h"
+
+
+// Model data read from a parameter file.  It is not modified after the file
+// is processed, and is shared by all ANNImplementation objects created from
+// identical parameter files.
+class ANNModel
+{
+  public:
+    Descriptor descriptor;
+    NeuralNetwork network;
+    double cutoff;
+    // memory mapping of a binary parameter file that the network uses in
+    // place (see map_binary_model); released with the model.  The device
+    // and inode identify the mapped file.
+    void* mapping;
+    size_t mappingSize;
+    dev_t mappingDevice;
+    ino_t mappingInode;
+
+    ANNModel()
+      : cutoff(0.0), mapping(0), mappingSize(0), mappingDevice(0),
+        mappingInode(0) {}
+    ~ANNModel();
+
+    // Prepare the model read from a parameter file for evaluation: fold
+    // centering and normalization of the descriptors into the first network
+    // layer and precompute network data.  Called once after loading; the
+    // model is then no longer in the form of the parameter file.
+    void compile();
+
+  private:
+    // not copyable
+    ANNModel(ANNModel const&);
+    ANNModel& operator=(ANNModel const&);
+};
+
+
+// Process-wide cache of ANNModel objects keyed by the hash of the parameter
+// file content.
+//
+// The cache only holds weak references; a model is freed when the last
+// ANNImplementation using it is destroyed.
+class ModelCache
+{
+  public:
+    typedef unsigned long long Key;
+
+    // hash of the content of `file' (64-bit FNV-1a, combined with the file
+    // size); the file is rewound afterwards
+    static Key hash_file(FILE* file);
+
+    // the cached model for `key', or a null pointer if there is none
+    static std::shared_ptr<ANNModel const> find(Key key);
+
+    // cache `model' under `key'.  If another thread cached a model for the
+    // same key in the meantime, that one is returned instead.
+    static std::shared_ptr<ANNModel const> insert(Key key,
+        std::shared_ptr<ANNModel const> const& model);
+
+    // forget the model cached for `key', e.g. because its mapped file was
+    // modified such that it no longer has the content of the key
+    static void remove(Key key);
+
+  private:
+    static std::mutex mutex_;
+    static std::map<Key, std::weak_ptr<ANNModel const> > models_;
+};
+
+
+#endif // MODELCACHE_H_
@@ -0,0 +1,907 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "helper.h"
+#include "modelio.h"
+
+#define MAXLINE 1024
+#define TEXT_READER_BLOCK_SIZE 65536
+
+
+//*****************************************************************************
+// text format
+//*****************************************************************************
+
+// Streaming tokenizer of the text format.
+//
+// The file is read in blocks into a buffer that holds at least the current
+// line, growing when a line is longer than the buffer, so there is no limit
+// on the length of a line.  Blank lines and lines starting with `#' are
+// skipped, and everything after a `#' in a line is ignored.  Positions are
+// tracked so that errors can report the line and column.
+namespace {
+
+class TextModelReader
+{
+  public:
+    explicit TextModelReader(FILE* const file)
+        : file_(file), buffer_(TEXT_READER_BLOCK_SIZE + 1), begin_(0), end_(0),
+          pos_(0), dataEnd_(0), lineEnd_(0), lineBegin_(0), nextLineNumber_(1),
+          lineNumber_(0), eof_(false)
+    {
+      buffer_[0] = '\0';
+    }
+
+    // advance to the next data line; returns false at end of file
+    bool next_line()
+    {
+      begin_ = lineEnd_;
+      while (true) {
+        // find the end of the line starting at begin_, reading more of the file
+        // until it is in the buffer
+        char const* nl = 0;
+        size_t scanned = begin_;
+        while (true) {
+          nl = static_cast<char const*>(
+              memchr(&buffer_[scanned], '\n', end_ - scanned));
+          if (nl != 0 || eof_) break;
+          scanned = end_ - begin_;
+          fill();
+          scanned += begin_;
+        }
+        size_t const rawEnd = (nl != 0) ? (nl - &buffer_[0]) : end_;
+        if (nl == 0 && rawEnd == begin_) {
+          lineEnd_ = begin_;
+          return false;
+        }
+
+        lineBegin_ = begin_;
+        lineNumber_ = nextLineNumber_++;
+        lineEnd_ = (nl != 0) ? rawEnd + 1 : rawEnd;
+        begin_ = lineEnd_;
+
+        // strip comment and trailing `\r'
+        char const* hash = static_cast<char const*>(
+            memchr(&buffer_[lineBegin_], '#', rawEnd - lineBegin_));
+        dataEnd_ = (hash != 0) ? (hash - &buffer_[0]) : rawEnd;
+        pos_ = lineBegin_;
+        skip_space();
+        if (pos_ < dataEnd_) return true;
+      }
+    }
+
+    // whether all tokens of the current line have been consumed
+    bool end_of_line()
+    {
+      skip_space();
+      return pos_ >= dataEnd_;
+    }
+
+    bool read_word(std::string& word)
+    {
+      skip_space();
+      size_t const start = pos_;
+      while (pos_ < dataEnd_ && !is_space(buffer_[pos_])) pos_++;
+      word.assign(&buffer_[start], pos_ - start);
+      return pos_ > start;
+    }
+
+    // read a lower case word
+    bool read_name(std::string& name)
+    {
+      if (!read_word(name)) return false;
+      for (size_t i=0; i<name.size(); i++) {
+        name[i] = tolower(name[i]);
+      }
+      return true;
+    }
+
+    bool read_int(int& value)
+    {
+      skip_space();
+      size_t p = pos_;
+      bool negative = false;
+      if (p < dataEnd_ && (buffer_[p] == '-' || buffer_[p] == '+')) {
+        negative = (buffer_[p] == '-');
+        p++;
+      }
+      size_t const digits = p;
+      long long v = 0;
+      while (p < dataEnd_ && is_digit(buffer_[p])) {
+        v = 10*v + (buffer_[p] - '0');
+        if (v > 2147483647LL) return false;
+        p++;
+      }
+      if (p == digits || (p < dataEnd_ && !is_space(buffer_[p]))) return false;
+      value = static_cast<int>(negative ? -v : v);
+      pos_ = p;
+      return true;
+    }
+
+    // Decimal numbers with at most 19 significant digits and a small enough
+    // exponent are converted with one exact multiplication or division of
+    // two doubles, which is correctly rounded.  Anything else is passed to
+    // strtod, so the result always equals that of strtod.
+    bool read_double(double& value)
+    {
+      static double const powersOfTen[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+      skip_space();
+      size_t p = pos_;
+      bool negative = false;
+      if (p < dataEnd_ && (buffer_[p] == '-' || buffer_[p] == '+')) {
+        negative = (buffer_[p] == '-');
+        p++;
+      }
+
+      uint64_t mantissa = 0;
+      int numDigits = 0;    // significant digits in mantissa
+      int exponent = 0;
+      bool anyDigit = false;
+      bool exact = true;
+      while (p < dataEnd_ && is_digit(buffer_[p])) {
+        anyDigit = true;
+        if (numDigits < 19) {
+          mantissa = 10*mantissa + (buffer_[p] - '0');
+          if (mantissa != 0) numDigits++;
+        }
+        else {
+          exact = false;
+        }
+        p++;
+      }
+      if (p < dataEnd_ && buffer_[p] == '.') {
+        p++;
+        while (p < dataEnd_ && is_digit(buffer_[p])) {
+          anyDigit = true;
+          if (numDigits < 19) {
+            mantissa = 10*mantissa + (buffer_[p] - '0');
+            if (mantissa != 0) numDigits++;
+            exponent--;
+          }
+          else if (buffer_[p] != '0') {
+            exact = false;
+          }
+          p++;
+        }
+      }
+      if (!anyDigit) return read_double_slow(value);
+      if (p < dataEnd_ && (buffer_[p] == 'e' || buffer_[p] == 'E')) {
+        p++;
+        bool negativeExp = false;
+        if (p < dataEnd_ && (buffer_[p] == '-' || buffer_[p] == '+')) {
+          negativeExp = (buffer_[p] == '-');
+          p++;
+        }
+        if (p == dataEnd_ || !is_digit(buffer_[p])) {
+          return read_double_slow(value);
+        }
+        int e = 0;
+        while (p < dataEnd_ && is_digit(buffer_[p])) {
+          if (e < 100000) e = 10*e + (buffer_[p] - '0');
+          p++;
+        }
+        exponent += negativeExp ? -e : e;
+      }
+      if (p < dataEnd_ && !is_space(buffer_[p])) return read_double_slow(value);
+
+      // mantissa must be exactly representable (< 2^53)
+      if (!exact || mantissa > (uint64_t(1) << 53)
+          || exponent < -22 || exponent > 22) {
+        return read_double_slow(value);
+      }
+      double v = static_cast<double>(mantissa);
+      if (exponent < 0) v /= powersOfTen[-exponent];
+      else v *= powersOfTen[exponent];
+      value = negative ? -v : v;
+      pos_ = p;
+      return true;
+    }
+
+    // read exactly `n' values that make up the rest of the current line
+    bool read_doubles(int const n, double* const values)
+    {
+      for (int i=0; i<n; i++) {
+        if (!read_double(values[i])) return false;
+      }
+      return end_of_line();
+    }
+
+    bool read_ints(int const n, int* const values)
+    {
+      for (int i=0; i<n; i++) {
+        if (!read_int(values[i])) return false;
+      }
+      return end_of_line();
+    }
+
+    // `line L, column C' of the current read position
+    std::string location() const
+    {
+      char msg[MAXLINE];
+      if (lineNumber_ == 0) {
+        sprintf(msg, "end of file");
+      }
+      else {
+        sprintf(msg, "line %d, column %d", lineNumber_,
+            static_cast<int>(pos_ - lineBegin_) + 1);
+      }
+      return msg;
+    }
+
+  private:
+    FILE* const file_;
+    std::vector<char> buffer_;  // buffer_[end_] is always `\0'
+    size_t begin_;       // start of data not consumed yet
+    size_t end_;         // end of data read from file
+    size_t pos_;         // read position in the current line
+    size_t dataEnd_;     // end of the current line, excluding comment
+    size_t lineEnd_;     // start of the line after the current line
+    size_t lineBegin_;
+    int nextLineNumber_;
+    int lineNumber_;
+    bool eof_;
+
+    static bool is_space(char const c)
+    {
+      return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+    }
+
+    static bool is_digit(char const c)
+    {
+      return c >= '0' && c <= '9';
+    }
+
+    void skip_space()
+    {
+      while (pos_ < dataEnd_ && is_space(buffer_[pos_])) pos_++;
+    }
+
+    // discard consumed data, and append the next block of the file
+    void fill()
+    {
+      size_t const remaining = end_ - begin_;
+      if (begin_ > 0) {
+        memmove(&buffer_[0], &buffer_[begin_], remaining);
+        lineBegin_ -= std::min(lineBegin_, begin_);
+        lineEnd_ -= std::min(lineEnd_, begin_);
+        begin_ = 0;
+        end_ = remaining;
+      }
+      if (buffer_.size() < end_ + TEXT_READER_BLOCK_SIZE + 1) {
+        buffer_.resize(2*buffer_.size() + TEXT_READER_BLOCK_SIZE);
+      }
+      size_t const n = fread(&buffer_[end_], 1, TEXT_READER_BLOCK_SIZE, file_);
+      if (n == 0 || feof(file_) || ferror(file_)) eof_ = true;
+      end_ += n;
+      buffer_[end_] = '\0';
+    }
+
+    bool read_double_slow(double& value)
+    {
+      // the token is followed by a space, `#', `\n' or the `\0' at end_
+      char saved = buffer_[dataEnd_];
+      buffer_[dataEnd_] = '\0';
+      char* end;
+      value = strtod(&buffer_[pos_], &end);
+      buffer_[dataEnd_] = saved;
+      size_t const p = end - &buffer_[0];
+      if (p == pos_ || (p < dataEnd_ && !is_space(buffer_[p]))) return false;
+      pos_ = p;
+      return true;
+    }
+};
+
+// record a parse error at the current position of `reader'
+int parseError(TextModelReader const& reader, char const* const what,
+    std::string& error)
+{
+  error = "unable to read ";
+  error += what;
+  error += " at ";
+  error += reader.location();
+  error += ".\n";
+  return 1;
+}
+
+// advance to the next data line, which is expected to contain `what'
+bool nextLine(TextModelReader& reader, char const* const what,
+    std::string& error)
+{
+  if (reader.next_line()) return true;
+  error = "unexpected end of file while reading ";
+  error += what;
+  error += ".\n";
+  return false;
+}
+
+}  // namespace
+
+
+int read_text_model(FILE* const file, ANNModel& model, std::string& error)
+{
+  Descriptor* const descriptor = &model.descriptor;
+  NeuralNetwork* const network = &model.network;
+  TextModelReader reader(file);
+  char errorMsg[MAXLINE];
+  std::string name;
+  double cutoff;
+
+  // cutoff
+  if (!nextLine(reader, "cutoff", error)) return 1;
+  if (!reader.read_name(name) || !reader.read_double(cutoff)) {
+    return parseError(reader, "cutoff", error);
+  }
+
+  // register cutoff
+  if (name != "cos" && name != "exp") {
+    sprintf(errorMsg, "unsupported cutoff type. Expecting `cos', or `exp' "
+        "given %.64s.\n", name.c_str());
+    error = errorMsg;
+    return 1;
+  }
+  descriptor->set_cutfunc(&name[0]);
+  model.cutoff = cutoff;
+
+  // number of descriptor types
+  int numDescTypes;
+  if (!nextLine(reader, "number of descriptor types", error)) return 1;
+  if (!reader.read_int(numDescTypes)) {
+    return parseError(reader, "number of descriptor types", error);
+  }
+
+  // descriptor
+  for (int i=0; i<numDescTypes; i++) {
+    // descriptor name and parameter dimensions
+    if (!nextLine(reader, "descriptor", error)) return 1;
+    if (!reader.read_name(name)) {
+      return parseError(reader, "descriptor", error);
+    }
+
+    if (name == "g1") {
+      descriptor->add_descriptor(&name[0], nullptr, 1, 0);
+      continue;
+    }
+
+    int numParamSets;
+    int numParams;
+    int expected;
+    if (name == "g2") expected = 2;
+    else if (name == "g3") expected = 1;
+    else if (name == "g4" || name == "g5") expected = 3;
+    else {
+      sprintf(errorMsg, "unsupported descriptor `%.64s' at line:column %s.\n",
+          name.c_str(), reader.location().c_str());
+      error = errorMsg;
+      return 1;
+    }
+    if (!reader.read_int(numParamSets) || !reader.read_int(numParams)
+        || numParamSets < 1) {
+      return parseError(reader, "descriptor", error);
+    }
+    if (numParams != expected) {
+      sprintf(errorMsg, "number of params for descriptor %c%s is incorrect, "
+          "expecting %d, but given %d.\n", toupper(name[0]), name.c_str() + 1,
+          expected, numParams);
+      error = errorMsg;
+      return 1;
+    }
+
+    // read descriptor params
+    std::vector<double> params(numParamSets*numParams);
+    std::vector<double*> paramRows(numParamSets);
+    for (int j=0; j<numParamSets; j++) {
+      paramRows[j] = &params[j*numParams];
+      if (!nextLine(reader, "descriptor parameters", error)) return 1;
+      if (!reader.read_doubles(numParams, paramRows[j])) {
+        return parseError(reader, "descriptor parameters", error);
+      }
+    }
+
+    // copy data to Descriptor
+    descriptor->add_descriptor(&name[0], &paramRows[0], numParamSets,
+        numParams);
+  }
+  // number of descriptors
+  int const numDescs = descriptor->get_num_descriptors();
+
+
+  // centering and normalizing params
+  // flag, whether we use this feature
+  if (!nextLine(reader, "centering and normalization info", error)) return 1;
+  if (!reader.read_word(name) || !reader.read_name(name)) {
+    return parseError(reader, "centering and normalization info", error);
+  }
+  bool const do_center_and_normalize = (name == "true");
+
+  int size = 0;
+  std::vector<double> means;
+  std::vector<double> stds;
+  if (do_center_and_normalize)
+  {
+    // size of the data, this should be equal to numDescs
+    if (!nextLine(reader, "size of centering and normalization data", error)) {
+      return 1;
+    }
+    if (!reader.read_int(size)) {
+      return parseError(reader, "size of centering and normalization data",
+          error);
+    }
+    if (size != numDescs) {
+      sprintf(errorMsg, "Size of centering and normalizing data inconsistent with "
+          "the number of descriptors. Size = %d, num_descriptors=%d\n", size, numDescs);
+      error = errorMsg;
+      return 1;
+    }
+
+    // read means
+    means.resize(size);
+    for (int i=0; i<size; i++) {
+      if (!nextLine(reader, "`means'", error)) return 1;
+      if (!reader.read_double(means[i])) {
+        return parseError(reader, "`means'", error);
+      }
+    }
+
+    // read standard deviations
+    stds.resize(size);
+    for (int i=0; i<size; i++) {
+      if (!nextLine(reader, "`stds'", error)) return 1;
+      if (!reader.read_double(stds[i])) {
+        return parseError(reader, "`stds'", error);
+      }
+    }
+  }
+
+  // store info into descriptor class
+  descriptor->set_center_and_normalize(do_center_and_normalize, size,
+      means.empty() ? nullptr : &means[0], stds.empty() ? nullptr : &stds[0]);
+
+
+  // network structure
+  // number of layers
+  int numLayers;
+  if (!nextLine(reader, "number of layers", error)) return 1;
+  if (!reader.read_int(numLayers) || numLayers < 1) {
+    return parseError(reader, "number of layers", error);
+  }
+  // number of perceptrons in each layer
+  std::vector<int> numPerceptrons(numLayers);
+  if (!nextLine(reader, "number of perceptrons", error)) return 1;
+  if (!reader.read_ints(numLayers, &numPerceptrons[0])) {
+    return parseError(reader, "number of perceptrons", error);
+  }
+  for (int i=0; i<numLayers; i++) {
+    if (numPerceptrons[i] < 1) {
+      sprintf(errorMsg, "number of perceptrons of layer %d must be positive, "
+          "given %d.\n", i, numPerceptrons[i]);
+      error = errorMsg;
+      return 1;
+    }
+  }
+  // copy to network class
+  network->set_nn_structure(numDescs, numLayers, &numPerceptrons[0]);
+
+
+  // activation function
+  if (!nextLine(reader, "activation function", error)) return 1;
+  if (!reader.read_name(name)) {
+    return parseError(reader, "activation function", error);
+  }
+
+  // register activation function
+  if (name != "sigmoid" && name != "tanh" && name != "relu" && name != "elu")
+  {
+    sprintf(errorMsg, "unsupported activation function. Expecting `sigmoid', `tanh' "
+        " `relu' or `elu', given %.64s.\n", name.c_str());
+    error = errorMsg;
+    return 1;
+  }
+  network->set_activation(&name[0]);
+
+
+  // weights and biases
+  for (int i=0; i<numLayers; i++) {
+
+    // weights
+    int const row = (i == 0) ? numDescs : numPerceptrons[i-1];
+    int const col = numPerceptrons[i];
+
+    std::vector<double> weight(static_cast<size_t>(row)*col);
+    std::vector<double*> weightRows(row);
+    for (int j=0; j<row; j++) {
+      weightRows[j] = &weight[static_cast<size_t>(j)*col];
+      if (!nextLine(reader, "weight", error)) return 1;
+      if (!reader.read_doubles(col, weightRows[j])) {
+        return parseError(reader, "weight", error);
+      }
+    }
+
+    // bias
+    std::vector<double> bias(col);
+    if (!nextLine(reader, "bias", error)) return 1;
+    if (!reader.read_doubles(col, &bias[0])) {
+      return parseError(reader, "bias", error);
+    }
+
+    // copy to network class
+    network->add_weight_bias(&weightRows[0], &bias[0], i);
+  }
+
+  // everything is good
+  return 0;
+}
+
+
+//*****************************************************************************
+int load_model(FILE* const file, ANNModel& model, std::string& error)
+{
+  int ier;
+
+  // binary files are mapped into memory, text files are parsed
+  if (is_binary_model(file)) {
+    ier = map_binary_model(file, model, error);
+  }
+  else {
+    ier = read_text_model(file, model, error);
+  }
+  if (ier != 0) return ier;
+
+  model.compile();
+  return 0;
+}
+
+
+//*****************************************************************************
+// binary format
+//*****************************************************************************
+
+#define BINARY_MODEL_MAGIC "ANNMODEL"
+#define BINARY_MODEL_MAGIC_SIZE 8
+#define BINARY_MODEL_VERSION 1
+#define BINARY_MODEL_BYTE_ORDER 0x01020304
+#define BINARY_MODEL_ALIGNMENT 64
+#define BINARY_MODEL_NAME_SIZE 16
+
+// All offsets are in bytes from the start of the file, and all arrays of
+// doubles start at a multiple of BINARY_MODEL_ALIGNMENT.
+struct BinaryModelHeader
+{
+  char magic[BINARY_MODEL_MAGIC_SIZE];
+  uint32_t version;
+  uint32_t byteOrder;          // BINARY_MODEL_BYTE_ORDER as written
+  uint64_t fileSize;
+  double cutoff;
+  char cutoffName[BINARY_MODEL_NAME_SIZE];
+  char activation[BINARY_MODEL_NAME_SIZE];
+  int32_t numDescTypes;
+  int32_t numDescriptors;
+  int32_t centerAndNormalize;
+  int32_t numLayers;
+  uint64_t descriptorTable;    // BinaryModelDescriptor[numDescTypes]
+  uint64_t normalization;      // means[numDescriptors], stds[numDescriptors]
+  uint64_t layerTable;         // BinaryModelLayer[numLayers]
+};
+
+struct BinaryModelDescriptor
+{
+  char name[BINARY_MODEL_NAME_SIZE];
+  int32_t numParamSets;
+  int32_t numParams;
+  uint64_t params;             // double[numParamSets][numParams]
+};
+
+struct BinaryModelLayer
+{
+  int32_t rows;
+  int32_t cols;
+  uint64_t weight;             // double[rows][cols]
+  uint64_t bias;               // double[cols]
+};
+
+static uint64_t align(uint64_t offset)
+{
+  return (offset + BINARY_MODEL_ALIGNMENT - 1)
+    / BINARY_MODEL_ALIGNMENT * BINARY_MODEL_ALIGNMENT;
+}
+
+// copy a name into a fixed size, zero padded field
+static int set_name(char* field, std::string const& name)
+{
+  if (name.size() >= BINARY_MODEL_NAME_SIZE) return 1;
+  memset(field, 0, BINARY_MODEL_NAME_SIZE);
+  memcpy(field, name.c_str(), name.size());
+  return 0;
+}
+
+bool is_binary_model(FILE* const file)
+{
+  char magic[BINARY_MODEL_MAGIC_SIZE];
+  rewind(file);
+  size_t n = fread(magic, 1, BINARY_MODEL_MAGIC_SIZE, file);
+  rewind(file);
+  return n == BINARY_MODEL_MAGIC_SIZE
+    && memcmp(magic, BINARY_MODEL_MAGIC, BINARY_MODEL_MAGIC_SIZE) == 0;
+}
+
+int write_binary_model(FILE* const file, ANNModel const& model,
+    std::string& error)
+{
+  Descriptor const& descriptor = model.descriptor;
+  NeuralNetwork const& network = model.network;
+  int const numDescTypes = descriptor.name.size();
+  int const numDescs = descriptor.get_num_descriptors();
+  int const numLayers = network.get_num_layers();
+
+  // layout
+  BinaryModelHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, BINARY_MODEL_MAGIC, BINARY_MODEL_MAGIC_SIZE);
+  header.version = BINARY_MODEL_VERSION;
+  header.byteOrder = BINARY_MODEL_BYTE_ORDER;
+  header.cutoff = model.cutoff;
+  header.numDescTypes = numDescTypes;
+  header.numDescriptors = numDescs;
+  header.centerAndNormalize = descriptor.center_and_normalize;
+  header.numLayers = numLayers;
+  if (set_name(header.cutoffName, descriptor.cutoff_name) != 0
+      || set_name(header.activation, network.get_activation()) != 0) {
+    error = "cutoff or activation name too long for the binary format";
+    return 1;
+  }
+
+  uint64_t offset = align(sizeof(header));
+  header.descriptorTable = offset;
+  offset = align(offset + numDescTypes*sizeof(BinaryModelDescriptor));
+  std::vector<BinaryModelDescriptor> descTable(numDescTypes);
+  for (int p=0; p<numDescTypes; p++) {
+    memset(&descTable[p], 0, sizeof(BinaryModelDescriptor));
+    if (set_name(descTable[p].name, descriptor.name[p]) != 0) {
+      error = "descriptor name too long for the binary format";
+      return 1;
+    }
+    descTable[p].numParamSets = descriptor.num_param_sets[p];
+    descTable[p].numParams = descriptor.num_params[p];
+    descTable[p].params = offset;
+    offset = align(offset + sizeof(double)*descriptor.num_param_sets[p]
+        *descriptor.num_params[p]);
+  }
+  header.normalization = offset;
+  if (descriptor.center_and_normalize) {
+    offset = align(offset + 2*sizeof(double)*numDescs);
+  }
+  header.layerTable = offset;
+  offset = align(offset + numLayers*sizeof(BinaryModelLayer));
+  std::vector<BinaryModelLayer> layerTable(numLayers);
+  for (int i=0; i<numLayers; i++) {
+    layerTable[i].rows = (i == 0) ? network.get_input_size()
+      : network.get_layer_size(i-1);
+    layerTable[i].cols = network.get_layer_size(i);
+    layerTable[i].weight = offset;
+    offset = align(offset
+        + sizeof(double)*layerTable[i].rows*layerTable[i].cols);
+    layerTable[i].bias = offset;
+    offset = align(offset + sizeof(double)*layerTable[i].cols);
+  }
+  header.fileSize = offset;
+
+  // fill the image
+  std::vector<char> image(header.fileSize, 0);
+  memcpy(&image[0], &header, sizeof(header));
+  if (numDescTypes > 0) {
+    memcpy(&image[header.descriptorTable], &descTable[0],
+        numDescTypes*sizeof(BinaryModelDescriptor));
+  }
+  for (int p=0; p<numDescTypes; p++) {
+    double* params = reinterpret_cast<double*>(&image[descTable[p].params]);
+    for (int q=0; q<descTable[p].numParamSets; q++) {
+      for (int k=0; k<descTable[p].numParams; k++) {
+        *params++ = descriptor.params[p][q][k];
+      }
+    }
+  }
+  if (descriptor.center_and_normalize) {
+    double* norm = reinterpret_cast<double*>(&image[header.normalization]);
+    std::copy(descriptor.features_mean.begin(),
+        descriptor.features_mean.end(), norm);
+    std::copy(descriptor.features_std.begin(),
+        descriptor.features_std.end(), norm + numDescs);
+  }
+  if (numLayers > 0) {
+    memcpy(&image[header.layerTable], &layerTable[0],
+        numLayers*sizeof(BinaryModelLayer));
+  }
+  for (int i=0; i<numLayers; i++) {
+    int const size = layerTable[i].rows * layerTable[i].cols;
+    memcpy(&image[layerTable[i].weight], network.get_weight(i),
+        sizeof(double)*size);
+    memcpy(&image[layerTable[i].bias], network.get_bias(i),
+        sizeof(double)*layerTable[i].cols);
+  }
+
+  if (fwrite(&image[0], 1, image.size(), file) != image.size()) {
+    error = "unable to write binary model";
+    return 1;
+  }
+  return 0;
+}
+
+// check that an array of `size' bytes at `offset' lies within the file and
+// is aligned
+static bool valid_range(uint64_t offset, uint64_t size, uint64_t fileSize)
+{
+  return offset % BINARY_MODEL_ALIGNMENT == 0 && offset <= fileSize
+    && size <= fileSize - offset;
+}
+
+int map_binary_model(FILE* const file, ANNModel& model, std::string& error)
+{
+  Descriptor* const descriptor = &model.descriptor;
+  NeuralNetwork* const network = &model.network;
+
+  struct stat st;
+  if (fstat(fileno(file), &st) != 0
+      || st.st_size < (off_t) sizeof(BinaryModelHeader)) {
+    error = "unable to read binary model header";
+    return 1;
+  }
+  size_t const size = st.st_size;
+  void* const mapping = mmap(NULL, size, PROT_READ, MAP_SHARED, fileno(file),
+      0);
+  if (mapping == MAP_FAILED) {
+    error = "unable to map binary model into memory";
+    return 1;
+  }
+  // the mapping stays valid after the file is closed, and is released
+  // together with the model
+  model.mapping = mapping;
+  model.mappingSize = size;
+  model.mappingDevice = st.st_dev;
+  model.mappingInode = st.st_ino;
+  char const* const base = static_cast<char const*>(mapping);
+
+  // header
+  BinaryModelHeader const* const header
+    = reinterpret_cast<BinaryModelHeader const*>(base);
+  if (memcmp(header->magic, BINARY_MODEL_MAGIC, BINARY_MODEL_MAGIC_SIZE) != 0) {
+    error = "not a binary model file";
+    return 1;
+  }
+  if (header->byteOrder != BINARY_MODEL_BYTE_ORDER) {
+    error = "binary model written on a machine with different byte order";
+    return 1;
+  }
+  if (header->version != BINARY_MODEL_VERSION) {
+    char errorMsg[MAXLINE];
+    sprintf(errorMsg, "unsupported binary model version %u, expecting %d",
+        header->version, BINARY_MODEL_VERSION);
+    error = errorMsg;
+    return 1;
+  }
+  if (header->fileSize != size
+      || header->cutoffName[BINARY_MODEL_NAME_SIZE-1] != '\0'
+      || header->activation[BINARY_MODEL_NAME_SIZE-1] != '\0'
+      || header->numDescTypes < 0 || header->numDescriptors < 0
+      || header->numLayers < 1
+      || !valid_range(header->descriptorTable,
+        header->numDescTypes*sizeof(BinaryModelDescriptor), size)
+      || !valid_range(header->layerTable,
+        header->numLayers*sizeof(BinaryModelLayer), size)) {
+    error = "corrupted binary model header";
+    return 1;
+  }
+
+  // cutoff
+  char name[BINARY_MODEL_NAME_SIZE];
+  strcpy(name, header->cutoffName);
+  if (strcmp(name, "cos") != 0 && strcmp(name, "exp") != 0) {
+    error = std::string("unsupported cutoff type `") + name + "'";
+    return 1;
+  }
+  descriptor->set_cutfunc(name);
+  model.cutoff = header->cutoff;
+
+  // descriptors
+  BinaryModelDescriptor const* const descTable
+    = reinterpret_cast<BinaryModelDescriptor const*>(
+        base + header->descriptorTable);
+  for (int p=0; p<header->numDescTypes; p++) {
+    BinaryModelDescriptor const& desc = descTable[p];
+    if (desc.name[BINARY_MODEL_NAME_SIZE-1] != '\0'
+        || desc.numParamSets < 0 || desc.numParams < 0
+        || !valid_range(desc.params,
+          sizeof(double)*desc.numParamSets*desc.numParams, size)) {
+      error = "corrupted binary model descriptor table";
+      return 1;
+    }
+    strcpy(name, desc.name);
+    // the parameter dimensions checked by read_text_model
+    int expected;
+    if (strcmp(name, "g1") == 0) expected = 0;
+    else if (strcmp(name, "g2") == 0) expected = 2;
+    else if (strcmp(name, "g3") == 0) expected = 1;
+    else if (strcmp(name, "g4") == 0 || strcmp(name, "g5") == 0) expected = 3;
+    else {
+      error = std::string("unsupported descriptor `") + name + "'";
+      return 1;
+    }
+    if (desc.numParams != expected
+        || (expected == 0 ? desc.numParamSets != 1 : desc.numParamSets < 1)) {
+      error = "corrupted binary model descriptor table";
+      return 1;
+    }
+    double const* const params
+      = reinterpret_cast<double const*>(base + desc.params);
+    std::vector<double*> rows(desc.numParamSets);
+    for (int q=0; q<desc.numParamSets; q++) {
+      rows[q] = const_cast<double*>(params + q*desc.numParams);
+    }
+    descriptor->add_descriptor(name, rows.empty() ? nullptr : &rows[0],
+        desc.numParamSets, desc.numParams);
+  }
+  int const numDescs = descriptor->get_num_descriptors();
+  if (numDescs != header->numDescriptors) {
+    error = "inconsistent number of descriptors in binary model";
+    return 1;
+  }
+
+  // centering and normalization
+  if (header->centerAndNormalize) {
+    if (!valid_range(header->normalization, 2*sizeof(double)*numDescs,
+          size)) {
+      error = "corrupted binary model normalization data";
+      return 1;
+    }
+    double* const norm = const_cast<double*>(
+        reinterpret_cast<double const*>(base + header->normalization));
+    descriptor->set_center_and_normalize(true, numDescs, norm,
+        norm + numDescs);
+  }
+  else {
+    descriptor->set_center_and_normalize(false, 0, nullptr, nullptr);
+  }
+
+  // network structure
+  int const numLayers = header->numLayers;
+  BinaryModelLayer const* const layerTable
+    = reinterpret_cast<BinaryModelLayer const*>(base + header->layerTable);
+  std::vector<int> numPerceptrons(numLayers);
+  for (int i=0; i<numLayers; i++) {
+    BinaryModelLayer const& layer = layerTable[i];
+    int const rows = (i == 0) ? numDescs : layerTable[i-1].cols;
+    if (layer.rows != rows || layer.cols <= 0
+        || !valid_range(layer.weight, sizeof(double)*layer.rows*layer.cols,
+          size)
+        || !valid_range(layer.bias, sizeof(double)*layer.cols, size)) {
+      error = "corrupted binary model layer table";
+      return 1;
+    }
+    numPerceptrons[i] = layer.cols;
+  }
+  network->set_nn_structure(numDescs, numLayers, &numPerceptrons[0]);
+
+  // activation function
+  strcpy(name, header->activation);
+  if (strcmp(name, "sigmoid") != 0 && strcmp(name, "tanh") != 0
+      && strcmp(name, "relu") != 0 && strcmp(name, "elu") != 0) {
+    error = std::string("unsupported activation function `") + name + "'";
+    return 1;
+  }
+  network->set_activation(name);
+
+  // weights and biases are used in place
+  for (int i=0; i<numLayers; i++) {
+    network->set_weight_bias_view(
+        reinterpret_cast<double const*>(base + layerTable[i].weight),
+        reinterpret_cast<double const*>(base + layerTable[i].bias), i);
+  }
+
+  return 0;
+}
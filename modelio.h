@@ -0,0 +1,40 @@
+#ifndef MODELIO_H_
+#define MODELIO_H_
+
+#include <cstdio>
+#include <string>
+#include "modelcache.h"
+
+// Reading and writing of model parameter files
+//
+// Two formats are supported:
+//
+// - the text format (cutoff, descriptors, centering and normalization data,
+//   network structure, activation, weights and biases, one row per line)
+//
+// - a versioned binary format with the same content, in which all arrays are
+//   stored 64-byte aligned in native byte order.  A binary file is mapped
+//   read-only into memory and the network uses the weights in place, so
+//   loading costs no parsing or copying, and processes on a node that load
+//   the same file share its pages.
+//
+// The functions return 0 on success; otherwise a nonzero value is returned
+// and `error' describes the problem.
+
+// whether `file' starts with the binary format magic (the file is rewound)
+bool is_binary_model(FILE* file);
+
+// read a parameter file in either format, and compile the model for
+// evaluation (see ANNModel::compile)
+int load_model(FILE* file, ANNModel& model, std::string& error);
+
+int read_text_model(FILE* file, ANNModel& model, std::string& error);
+// The binary model is used in place, so its file must not be modified while
+// a model mapped from it exists: replace it by writing a new file and
+// renaming it over the old one (the mapping keeps the old file).  Rewriting
+// it in place changes the weights of the live model, and truncating it makes
+// accesses to the mapping fail (SIGBUS).
+int map_binary_model(FILE* file, ANNModel& model, std::string& error);
+int write_binary_model(FILE* file, ANNModel const& model, std::string& error);
+
+#endif // MODELIO_H_
@@ -0,0 +1,353 @@
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <stdint.h>
+#include "neighbors.h"
+#include "scheduler.h"
+
+#define DIM 3
+
+namespace {
+
+// at most 2^10 cells along each direction, and about 8 cells per particle
+int const MAX_CELLS_PER_DIM = 1024;
+int const MAX_CELLS_PER_PARTICLE = 8;
+
+// interleave the bits of the cell coordinates
+uint32_t morton_code(int const* const c)
+{
+  uint32_t code = 0;
+  for (int bit = 0; bit < 10; ++bit) {
+    for (int d = 0; d < DIM; ++d) {
+      code |= static_cast<uint32_t>((c[d] >> bit) & 1) << (DIM*bit + d);
+    }
+  }
+  return code;
+}
+
+}  // namespace
+
+//******************************************************************************
+NeighborBuilder::NeighborBuilder()
+    : numberSpecies_(0),
+      cutoff_(0.0),
+      numberContributing_(0),
+      volume_(0.0)
+{
+  for (int d = 0; d < DIM; ++d) {
+    numCells_[d] = 1;
+    lo_[d] = 0.0;
+    cellSize_[d] = 1.0;
+  }
+}
+
+//******************************************************************************
+void NeighborBuilder::set_cutoffs(int const numberSpecies,
+                                  double const* const* const cutoffsSq)
+{
+  numberSpecies_ = numberSpecies;
+  cutoffsSq_.resize(numberSpecies*numberSpecies);
+  double cutoffSq = 0.0;
+  for (int i = 0; i < numberSpecies; ++i) {
+    for (int j = 0; j < numberSpecies; ++j) {
+      cutoffsSq_[i*numberSpecies + j] = cutoffsSq[i][j];
+      cutoffSq = std::max(cutoffSq, cutoffsSq[i][j]);
+    }
+  }
+  cutoff_ = std::sqrt(cutoffSq);
+}
+
+//******************************************************************************
+void NeighborBuilder::set_cutoff(double const cutoff)
+{
+  numberSpecies_ = 0;
+  cutoffsSq_.clear();
+  cutoff_ = cutoff;
+}
+
+//******************************************************************************
+void NeighborBuilder::set_particles(int const numberParticles,
+                                    int const numberContributing,
+                                    int const* const species,
+                                    double const* const coordinates)
+{
+  numberContributing_ = numberContributing;
+  species_.assign(species, species + numberParticles);
+  coordinates_.assign(coordinates, coordinates + DIM*numberParticles);
+  owner_.resize(numberParticles);
+  for (int i = 0; i < numberParticles; ++i) {
+    owner_[i] = (i < numberContributing) ? i : -1;
+  }
+  shift_.assign(DIM*numberParticles, 0);
+  volume_ = 0.0;
+}
+
+//******************************************************************************
+int NeighborBuilder::set_atoms(int const numberAtoms,
+                               int const* const species,
+                               double const* const coordinates,
+                               double const* const lattice,
+                               int const* const periodic,
+                               std::string& error)
+{
+  int const N = numberAtoms;
+  numberContributing_ = N;
+  species_.assign(species, species + N);
+  coordinates_.assign(coordinates, coordinates + DIM*N);
+  owner_.resize(N);
+  for (int i = 0; i < N; ++i) owner_[i] = i;
+  shift_.assign(DIM*N, 0);
+  volume_ = 0.0;
+
+  bool isPeriodic[DIM];
+  bool anyPeriodic = false;
+  for (int d = 0; d < DIM; ++d) {
+    isPeriodic[d] = (periodic != 0 && periodic[d] != 0);
+    anyPeriodic = anyPeriodic || isPeriodic[d];
+  }
+  if (anyPeriodic == false) return 0;
+
+  // reciprocal vectors (rows of the inverse of the transposed lattice) and
+  // the distances between opposite faces of the cell
+  double const* const L = lattice;
+  double const volume
+      = L[0]*(L[4]*L[8] - L[5]*L[7]) - L[1]*(L[3]*L[8] - L[5]*L[6])
+      + L[2]*(L[3]*L[7] - L[4]*L[6]);
+  if (!(std::fabs(volume) > 1e-12)) {
+    error = "singular cell";
+    return 1;
+  }
+  double reciprocal[DIM][DIM];
+  double height[DIM];
+  for (int d = 0; d < DIM; ++d) {
+    double const* const b = &L[DIM*((d + 1) % DIM)];
+    double const* const c = &L[DIM*((d + 2) % DIM)];
+    reciprocal[d][0] = (b[1]*c[2] - b[2]*c[1])/volume;
+    reciprocal[d][1] = (b[2]*c[0] - b[0]*c[2])/volume;
+    reciprocal[d][2] = (b[0]*c[1] - b[1]*c[0])/volume;
+    height[d] = 1.0/std::sqrt(reciprocal[d][0]*reciprocal[d][0]
+                              + reciprocal[d][1]*reciprocal[d][1]
+                              + reciprocal[d][2]*reciprocal[d][2]);
+  }
+  if (isPeriodic[0] && isPeriodic[1] && isPeriodic[2]) {
+    volume_ = std::fabs(volume);
+  }
+
+  // fractional coordinates, wrapped along the periodic directions
+  std::vector<double> fractional(DIM*N);
+  for (int i = 0; i < N; ++i) {
+    double* const s = &fractional[DIM*i];
+    double const* const x = &coordinates[DIM*i];
+    for (int d = 0; d < DIM; ++d) {
+      s[d] = reciprocal[d][0]*x[0] + reciprocal[d][1]*x[1]
+          + reciprocal[d][2]*x[2];
+      if (isPeriodic[d]) s[d] -= std::floor(s[d]);
+    }
+    for (int d = 0; d < DIM; ++d) {
+      coordinates_[DIM*i + d] = s[0]*L[d] + s[1]*L[DIM + d]
+          + s[2]*L[2*DIM + d];
+    }
+  }
+
+  // images of the atoms shifted by n cell vectors that are within the cutoff
+  // of the cell
+  int range[DIM];
+  double margin[DIM];
+  for (int d = 0; d < DIM; ++d) {
+    margin[d] = cutoff_/height[d];
+    range[d] = isPeriodic[d] ? static_cast<int>(std::ceil(margin[d])) : 0;
+  }
+  for (int n0 = -range[0]; n0 <= range[0]; ++n0) {
+    for (int n1 = -range[1]; n1 <= range[1]; ++n1) {
+      for (int n2 = -range[2]; n2 <= range[2]; ++n2) {
+        if (n0 == 0 && n1 == 0 && n2 == 0) continue;
+        int const n[DIM] = {n0, n1, n2};
+        for (int i = 0; i < N; ++i) {
+          bool inside = true;
+          for (int d = 0; d < DIM && inside; ++d) {
+            if (!isPeriodic[d]) continue;
+            double const s = fractional[DIM*i + d] + n[d];
+            inside = (s >= -margin[d] && s < 1.0 + margin[d]);
+          }
+          if (!inside) continue;
+          for (int d = 0; d < DIM; ++d) {
+            coordinates_.push_back(coordinates_[DIM*i + d] + n0*L[d]
+                                   + n1*L[DIM + d] + n2*L[2*DIM + d]);
+          }
+          species_.push_back(species_[i]);
+          owner_.push_back(i);
+          shift_.insert(shift_.end(), n, n + DIM);
+        }
+      }
+    }
+  }
+  return 0;
+}
+
+//******************************************************************************
+// sort the particles into cells of at least the cutoff, which are ranked in
+// Morton order of their coordinates
+void NeighborBuilder::bin_particles()
+{
+  int const N = species_.size();
+  double const* const x = coordinates_.data();
+  double hi[DIM];
+  for (int d = 0; d < DIM; ++d) {
+    lo_[d] = hi[d] = (N > 0) ? x[d] : 0.0;
+    for (int i = 1; i < N; ++i) {
+      lo_[d] = std::min(lo_[d], x[i*DIM + d]);
+      hi[d] = std::max(hi[d], x[i*DIM + d]);
+    }
+    double const extent = hi[d] - lo_[d];
+    numCells_[d] = (cutoff_ > 0.0)
+        ? static_cast<int>(std::min<double>(extent/cutoff_, MAX_CELLS_PER_DIM))
+        : 1;
+    numCells_[d] = std::max(1, numCells_[d]);
+  }
+  // fewer, larger cells for sparse particles (e.g. far apart clusters)
+  while (static_cast<long>(numCells_[0])*numCells_[1]*numCells_[2]
+         > MAX_CELLS_PER_PARTICLE*static_cast<long>(std::max(N, 1))) {
+    int const d = std::max_element(numCells_, numCells_ + DIM) - numCells_;
+    numCells_[d] = (numCells_[d] + 1)/2;
+  }
+  for (int d = 0; d < DIM; ++d) {
+    cellSize_[d] = std::max(hi[d] - lo_[d], 1e-12)/numCells_[d];
+  }
+  int const Ncells = numCells_[0]*numCells_[1]*numCells_[2];
+
+  // Morton rank of each cell
+  std::vector<std::pair<uint32_t, int> > codes(Ncells);
+  for (int a = 0; a < numCells_[0]; ++a) {
+    for (int b = 0; b < numCells_[1]; ++b) {
+      for (int c = 0; c < numCells_[2]; ++c) {
+        int const cell[DIM] = {a, b, c};
+        int const index = (a*numCells_[1] + b)*numCells_[2] + c;
+        codes[index] = std::make_pair(morton_code(cell), index);
+      }
+    }
+  }
+  std::sort(codes.begin(), codes.end());
+  cellRank_.resize(Ncells);
+  for (int r = 0; r < Ncells; ++r) cellRank_[codes[r].second] = r;
+
+  // particles sorted by the rank of their cell, and by index within a cell
+  cellOf_.resize(N);
+  cellStart_.assign(Ncells + 1, 0);
+  for (int i = 0; i < N; ++i) {
+    int c[DIM];
+    for (int d = 0; d < DIM; ++d) {
+      c[d] = std::min(static_cast<int>((x[i*DIM + d] - lo_[d])/cellSize_[d]),
+                      numCells_[d] - 1);
+    }
+    cellOf_[i] = (c[0]*numCells_[1] + c[1])*numCells_[2] + c[2];
+    ++cellStart_[cellRank_[cellOf_[i]] + 1];
+  }
+  for (int r = 0; r < Ncells; ++r) cellStart_[r+1] += cellStart_[r];
+  std::vector<int> next(cellStart_.begin(), cellStart_.end() - 1);
+  cellParticles_.resize(N);
+  for (int i = 0; i < N; ++i) {
+    cellParticles_[next[cellRank_[cellOf_[i]]]++] = i;
+  }
+}
+
+//******************************************************************************
+// The pair of i and an image of atom k at shift n is also found as the pair of
+// k and the image of i at shift -n, so it is kept from the atom with the
+// smaller index, and from the positive shift if k is i.
+bool NeighborBuilder::is_half_neighbor(int const i, int const j) const
+{
+  int const owner = owner_[j];
+  if (owner < 0) return true;  // a ghost of set_particles
+  if (owner != i) return owner > i;
+  int const* const n = &shift_[DIM*j];
+  return n[0] > 0 || (n[0] == 0 && (n[1] > 0 || (n[1] == 0 && n[2] > 0)));
+}
+
+//******************************************************************************
+template<class F>
+void NeighborBuilder::for_each_neighbor(int const i, bool const half,
+                                        F const& f) const
+{
+  int const* const nc = numCells_;
+  int const ci = cellOf_[i];
+  int const c[DIM] = {ci/(nc[1]*nc[2]), (ci/nc[2]) % nc[1], ci % nc[2]};
+  double const* const x = coordinates_.data();
+  int const iSpecies = species_[i];
+  double const uniformSq = cutoff_*cutoff_;
+
+  for (int a = std::max(c[0] - 1, 0); a <= std::min(c[0] + 1, nc[0] - 1); ++a) {
+    for (int b = std::max(c[1] - 1, 0); b <= std::min(c[1] + 1, nc[1] - 1);
+         ++b) {
+      for (int e = std::max(c[2] - 1, 0); e <= std::min(c[2] + 1, nc[2] - 1);
+           ++e) {
+        int const rank = cellRank_[(a*nc[1] + b)*nc[2] + e];
+        for (int m = cellStart_[rank]; m < cellStart_[rank + 1]; ++m) {
+          int const j = cellParticles_[m];
+          if (j == i || (half && !is_half_neighbor(i, j))) continue;
+          double rsq = 0.0;
+          for (int d = 0; d < DIM; ++d) {
+            double const dx = x[j*DIM + d] - x[i*DIM + d];
+            rsq += dx*dx;
+          }
+          double const cutoffSq = (numberSpecies_ > 0)
+              ? cutoffsSq_[iSpecies*numberSpecies_ + species_[j]] : uniformSq;
+          if (rsq < cutoffSq) f(j);
+        }
+      }
+    }
+  }
+}
+
+//******************************************************************************
+void NeighborBuilder::build(bool const half, ThreadPool* const pool)
+{
+  bin_particles();
+  int const Ncontrib = numberContributing_;
+
+  // contributing particles in the order of their cells
+  std::vector<int> order;
+  order.reserve(Ncontrib);
+  for (size_t m = 0; m < cellParticles_.size(); ++m) {
+    if (cellParticles_[m] < Ncontrib) order.push_back(cellParticles_[m]);
+  }
+  int const Nparts = (pool != 0 && Ncontrib > 0)
+      ? std::min(4*pool->get_num_threads(), Ncontrib) : 1;
+  std::function<void(std::function<void(int)> const&)> const run
+      = [&](std::function<void(int)> const& task) {
+    if (pool != 0) {
+      pool->run(Nparts, task);
+    }
+    else {
+      task(0);
+    }
+  };
+
+  // count, then fill the lists of each particle at its place
+  numNei_.resize(Ncontrib);
+  start_.resize(Ncontrib);
+  run([&](int const part) {
+    int const first = static_cast<long>(Ncontrib)*part/Nparts;
+    int const last = static_cast<long>(Ncontrib)*(part + 1)/Nparts;
+    for (int m = first; m < last; ++m) {
+      int const i = order[m];
+      int count = 0;
+      for_each_neighbor(i, half, [&count](int) { ++count; });
+      numNei_[i] = count;
+    }
+  });
+  long total = 0;
+  for (int i = 0; i < Ncontrib; ++i) {
+    start_[i] = total;
+    total += numNei_[i];
+  }
+  list_.resize(total);
+  run([&](int const part) {
+    int const first = static_cast<long>(Ncontrib)*part/Nparts;
+    int const last = static_cast<long>(Ncontrib)*(part + 1)/Nparts;
+    for (int m = first; m < last; ++m) {
+      int const i = order[m];
+      int* next = list_.data() + start_[i];
+      for_each_neighbor(i, half, [&next](int const j) { *next++ = j; });
+    }
+  });
+}
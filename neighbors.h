@@ -0,0 +1,104 @@
+#ifndef NEIGHBORS_H_
+#define NEIGHBORS_H_
+
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+// Neighbor lists built by the driver, for callers without a get_neigh
+// (the standalone library, ann_trajectory and the benchmark programs)
+//
+// The particles are either given as they are (set_particles: contributing
+// particles first, then e.g. periodic images made by the caller), or made
+// from the atoms of a cell (set_atoms): the atoms, wrapped into the cell
+// along its periodic directions, followed by their periodic images within the
+// cutoff of the cell.  The cell may be triclinic.
+//
+// build() makes the lists of the contributing particles with linked cells,
+// in O(N): particle j is a neighbor of i if their distance is below the
+// cutoff of their species pair.  A full list holds all neighbors of i.  A
+// half list holds each pair once: a contributing neighbor j if j > i, an
+// image of set_atoms if the index of its atom is larger than i or, for the
+// images of i itself, if its shift is positive (the first nonzero one of its
+// numbers of cell vectors), and all ghosts of set_particles, whose pairs are
+// only listed from their contributing particle anyway.  With set_atoms, a
+// half list thus has half the entries of the full list.  The cells are
+// visited in Morton (Z) order, so that the particles of neighboring cells
+// are mostly close in memory, and the contributing particles are split among
+// the threads of a ThreadPool in that order.  The lists are stored compactly
+// (numNei, start and list, as NeighborArrays of the driver): the neighbors
+// of i are
+// list[start[i]], ..., list[start[i] + numNei[i] - 1], in an order that does
+// not depend on the number of threads.
+//
+// The functions returning int return 0 on success; otherwise a nonzero value
+// is returned and `error' describes the problem.
+class NeighborBuilder
+{
+ public:
+  NeighborBuilder();
+
+  // cutoffs of the species pairs, squared; cutoffsSq[i][j] for species i and
+  // j in 0, ..., numberSpecies-1
+  void set_cutoffs(int numberSpecies, double const* const* cutoffsSq);
+  // the same cutoff for all species
+  void set_cutoff(double cutoff);
+  double get_cutoff() const { return cutoff_; }
+
+  void set_particles(int numberParticles, int numberContributing,
+                     int const* species, double const* coordinates);
+  // lattice: rows are the cell vectors a, b and c; periodic[d] (0 or 1)
+  // along each of them.  Without a periodic direction the lattice is not
+  // used and may be null.
+  int set_atoms(int numberAtoms, int const* species, double const* coordinates,
+                double const* lattice, int const* periodic,
+                std::string& error);
+
+  // half or full lists, with the threads of `pool', if not null
+  void build(bool half, ThreadPool* pool);
+
+  int get_number_of_particles() const { return species_.size(); }
+  int get_number_contributing() const { return numberContributing_; }
+  std::vector<int> const& get_species() const { return species_; }
+  std::vector<double> const& get_coordinates() const { return coordinates_; }
+  // contributing particle of each particle (itself for contributing ones)
+  std::vector<int> const& get_owner() const { return owner_; }
+  std::vector<int> const& get_num_neighbors() const { return numNei_; }
+  std::vector<int> const& get_neighbor_start() const { return start_; }
+  std::vector<int> const& get_neighbors() const { return list_; }
+  // volume of the cell if it is periodic along all cell vectors, else 0
+  double get_volume() const { return volume_; }
+
+ private:
+  int numberSpecies_;                 // 0 for the same cutoff for all
+  std::vector<double> cutoffsSq_;     // [numberSpecies_*numberSpecies_]
+  double cutoff_;                     // largest cutoff
+  int numberContributing_;
+  std::vector<int> species_;          // [numberOfParticles]
+  std::vector<double> coordinates_;   // [numberOfParticles*3]
+  std::vector<int> owner_;
+  std::vector<int> shift_;            // [numberOfParticles*3] cell vectors
+                                      // from the owner to each image
+  double volume_;
+  std::vector<int> numNei_;           // [numberContributing]
+  std::vector<int> start_;            // [numberContributing]
+  std::vector<int> list_;
+  // linked cells, in Morton order
+  int numCells_[3];
+  double lo_[3];
+  double cellSize_[3];
+  std::vector<int> cellOf_;           // [numberOfParticles] linear index
+  std::vector<int> cellRank_;         // Morton rank of each linear index
+  std::vector<int> cellStart_;        // [number of cells + 1] by rank
+  std::vector<int> cellParticles_;    // particles sorted by cell rank
+
+  void bin_particles();
+  // whether the half list of contributing particle i holds particle j
+  bool is_half_neighbor(int i, int j) const;
+  // visit the neighbors j of contributing particle i in order
+  template<class F>
+  void for_each_neighbor(int i, bool half, F const& f) const;
+};
+
+#endif  // NEIGHBORS_H_
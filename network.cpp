@@ -17,25 +17,31 @@ void NeuralNetwork::set_nn_structure(int size_input, int num_layers,
 
   weights_.resize(Nlayers_);
   biases_.resize(Nlayers_);
-  preactiv_.resize(Nlayers_);
+  weightsStorage_.resize(Nlayers_);
+  biasesStorage_.resize(Nlayers_);
 }
 
 void NeuralNetwork::set_activation(char* name) {
+  activName_ = name;
   if (strcmp(name, "sigmoid") == 0) {
     activFunc_ = &sigmoid;
     activFuncDeriv_ = &sigmoid_derivative;
+    activFuncDeriv2_ = &sigmoid_second_derivative;
   }
   else if (strcmp(name, "tanh") == 0) {
     activFunc_ = &tanh;
     activFuncDeriv_ = &tanh_derivative;
+    activFuncDeriv2_ = &tanh_second_derivative;
   }
   else if (strcmp(name, "relu") == 0) {
     activFunc_ = &relu;
     activFuncDeriv_ = &relu_derivative;
+    activFuncDeriv2_ = &relu_second_derivative;
   }
   else if (strcmp(name, "elu") == 0) {
     activFunc_ = &elu;
     activFuncDeriv_ = &elu_derivative;
+    activFuncDeriv2_ = &elu_second_derivative;
   }
 }
 
@@ -66,50 +72,127 @@ void NeuralNetwork::add_weight_bias(double** weight, double* bias, int layer)
   }
 
   // store in vector
-  weights_[layer] = w;
-  biases_[layer] = b;
+  weightsStorage_[layer] = w;
+  biasesStorage_[layer] = b;
+  weights_[layer] = weightsStorage_[layer].data();
+  biases_[layer] = biasesStorage_[layer].data();
+}
+
+void NeuralNetwork::set_weight_bias_view(double const* weight,
+    double const* bias, int layer)
+{
+  weights_[layer] = weight;
+  biases_[layer] = bias;
+}
+
+void NeuralNetwork::fold_input_normalization(double const* mean,
+    double const* std)
+{
+  // W'(i,j) = W(i,j)/std(i),  b'(j) = b(j) - sum_i mean(i) W'(i,j)
+  RowMatrixXd w = weight(0);
+  RowVectorXd b = bias(0);
+  for (int i=0; i<inputSize_; i++) {
+    w.row(i) /= std[i];
+    b -= mean[i] * w.row(i);
+  }
 
+  weightsStorage_[0] = w;
+  biasesStorage_[0] = b;
+  weights_[0] = weightsStorage_[0].data();
+  biases_[0] = biasesStorage_[0].data();
 }
 
-void NeuralNetwork::forward(double * zeta, const int rows, const int cols)
+void NeuralNetwork::compile()
+{
+  weightsTransposed_.resize(Nlayers_);
+  for (int i=0; i<Nlayers_; i++) {
+    weightsTransposed_[i] = weight(i).transpose();
+  }
+}
+
+void NeuralNetwork::forward(double const* zeta, const int rows, const int cols,
+    NetworkWorkspace& ws) const
 {
   RowMatrixXd act;
+  std::vector<RowMatrixXd>& preactiv = ws.preactiv;
+  preactiv.resize(Nlayers_);
 
   // map raw C++ data into Matrix data
-  Map<RowMatrixXd> activation(zeta, rows, cols);
+  Map<const RowMatrixXd> activation(zeta, rows, cols);
 
   for (int i=0; i<Nlayers_; i++) {
-    preactiv_[i] = (activation * weights_[i]).rowwise() + biases_[i];
+    preactiv[i] = (activation * weight(i)).rowwise() + bias(i);
     if (i == Nlayers_ - 1) {  // output layer (no activation function applied)
-      activOutputLayer_ = preactiv_[i];
+      ws.activOutputLayer = preactiv[i];
     }
     else {
-      act = activFunc_(preactiv_[i]);
+      act = activFunc_(preactiv[i]);
       // cannot assign activFunc_(...) directly to activation.
       // Changing the mapped matrix `activation' does not invoke memory reallocation
-      new (&activation) Map<RowMatrixXd> (act.data(), act.rows(), act.cols());
+      new (&activation) Map<const RowMatrixXd> (act.data(), act.rows(), act.cols());
     }
   }
 }
 
-void NeuralNetwork::backward()
+void NeuralNetwork::backward(NetworkWorkspace& ws) const
 {
+  std::vector<RowMatrixXd> const& preactiv = ws.preactiv;
+
   // our cost (energy E) is the sum of activations at output layer, and no activation
   // function is employed in the output layer
-  int rows = preactiv_[Nlayers_-1].rows();
-  int cols  = preactiv_[Nlayers_-1].cols();
+  int rows = preactiv[Nlayers_-1].rows();
+  int cols  = preactiv[Nlayers_-1].cols();
 
   // error at output layer
-  RowMatrixXd delta_ = RowMatrixXd::Constant(rows, cols, 1.0);
+  RowMatrixXd delta = RowMatrixXd::Constant(rows, cols, 1.0);
 
   for (int i = Nlayers_ - 2; i>=0; i--) {
-    // eval() is used to prevent aliasing since delta_ is both lvalue and rvalue.
-    delta_ =  ( delta_ * weights_[i+1].transpose() ).eval()
-        .cwiseProduct( activFuncDeriv_(preactiv_[i]) )  ;
+    // eval() is used to prevent aliasing since delta is both lvalue and rvalue.
+    delta =  ( delta * weightsTransposed_[i+1] ).eval()
+        .cwiseProduct( activFuncDeriv_(preactiv[i]) )  ;
   }
 
   // derivative of cost (energy E) w.r.t to input (generalized coords)
-  gradInput_ = delta_ * weights_[0].transpose();
+  ws.gradInput = delta * weightsTransposed_[0];
+}
+
+void NeuralNetwork::backward_tangent(double const* dzeta, NetworkWorkspace& ws)
+  const
+{
+  std::vector<RowMatrixXd> const& preactiv = ws.preactiv;
+  std::vector<RowMatrixXd>& dpreactiv = ws.preactivTangent;
+  dpreactiv.resize(Nlayers_);
+
+  int rows = preactiv[Nlayers_-1].rows();
+  int cols  = preactiv[Nlayers_-1].cols();
+
+  // derivative of activation functions of the hidden layers
+  std::vector<RowMatrixXd> deriv(Nlayers_-1);
+  for (int i=0; i<Nlayers_-1; i++) {
+    deriv[i] = activFuncDeriv_(preactiv[i]);
+  }
+
+  // forward: derivative of the preactivations in direction dzeta
+  Map<const RowMatrixXd> dactivation(dzeta, rows, inputSize_);
+  dpreactiv[0] = dactivation * weight(0);
+  for (int i=1; i<Nlayers_; i++) {
+    dpreactiv[i] = dpreactiv[i-1].cwiseProduct(deriv[i-1]) * weight(i);
+  }
+
+  // backward: error and its derivative; the error at output layer is constant
+  RowMatrixXd delta = RowMatrixXd::Constant(rows, cols, 1.0);
+  RowMatrixXd ddelta = RowMatrixXd::Zero(rows, cols);
+
+  for (int i = Nlayers_ - 2; i>=0; i--) {
+    RowMatrixXd back = delta * weightsTransposed_[i+1];
+    RowMatrixXd dback = ddelta * weightsTransposed_[i+1];
+    delta = back.cwiseProduct(deriv[i]);
+    ddelta = dback.cwiseProduct(deriv[i]) + back.cwiseProduct(
+        activFuncDeriv2_(preactiv[i])).cwiseProduct(dpreactiv[i]);
+  }
+
+  ws.gradInput = delta * weightsTransposed_[0];
+  ws.gradInputTangent = ddelta * weightsTransposed_[0];
 }
 
 
@@ -140,6 +223,11 @@ RowMatrixXd relu_derivative(RowMatrixXd const& x)
   return deriv;
 }
 
+RowMatrixXd relu_second_derivative(RowMatrixXd const& x)
+{
+  return RowMatrixXd::Zero(x.rows(), x.cols());
+}
+
 RowMatrixXd elu(RowMatrixXd const& x)
 {
   double alpha = 1.0;
@@ -164,6 +252,22 @@ RowMatrixXd elu_derivative(RowMatrixXd const& x)
   return deriv;
 }
 
+RowMatrixXd elu_second_derivative(RowMatrixXd const& x)
+{
+  double alpha = 1.0;
+  RowMatrixXd deriv(x.rows(), x.cols());
+  for (int i=0; i<x.rows(); i++) {
+    for (int j=0; j<x.cols(); j++) {
+      if (x(i,j) < 0.) {
+        deriv(i,j) = alpha*exp(x(i,j));
+      } else {
+        deriv(i,j) = 0.;
+      }
+    }
+  }
+  return deriv;
+}
+
 RowMatrixXd tanh(RowMatrixXd const& x)
 {
   return (x.array().tanh()).matrix();
@@ -174,6 +278,12 @@ RowMatrixXd tanh_derivative(RowMatrixXd const& x)
   return (1.0 - x.array().tanh().square()).matrix();
 }
 
+RowMatrixXd tanh_second_derivative(RowMatrixXd const& x)
+{
+  RowMatrixXd t = tanh(x);
+  return (-2.0 * t.array() * (1.0 - t.array().square())).matrix();
+}
+
 RowMatrixXd sigmoid(RowMatrixXd const& x)
 {
   return (1.0 / ( 1.0 + (-x).array().exp() )).matrix();
@@ -185,5 +295,8 @@ RowMatrixXd sigmoid_derivative(RowMatrixXd const& x)
   return ( s.array() * (1.0 - s.array()) ).matrix();
 }
 
-
-
+RowMatrixXd sigmoid_second_derivative(RowMatrixXd const& x)
+{
+  RowMatrixXd s = sigmoid(x);
+  return ( s.array() * (1.0 - s.array()) * (1.0 - 2.0*s.array()) ).matrix();
+}
@@ -2,6 +2,7 @@
 #define NETWORK_H_
 
 #include <cmath>
+#include <string>
 #include <vector>
 #include <iostream>
 #include <Eigen/Core>
@@ -14,6 +15,41 @@ typedef Matrix<double, Dynamic, Dynamic, RowMajor> RowMatrixXd;
 
 typedef  RowMatrixXd(*ActivationFunction) (RowMatrixXd const& x);
 typedef  RowMatrixXd(*ActivationFunctionDerivative) (RowMatrixXd const& x);
+typedef  RowMatrixXd(*ActivationFunctionSecondDerivative) (RowMatrixXd const& x);
+
+
+// Scratch data of one evaluation of a NeuralNetwork.
+//
+// NeuralNetwork only holds the (read-only) weights and biases, and all data
+// produced by forward() and backward() is stored here, so any number of
+// threads can evaluate one network at the same time, each with its own
+// NetworkWorkspace.
+class NetworkWorkspace
+{
+  public:
+    std::vector<RowMatrixXd> preactiv;   // preactivation of each layer
+    RowMatrixXd activOutputLayer;
+    RowMatrixXd gradInput;
+    // derivatives in the direction given to backward_tangent()
+    std::vector<RowMatrixXd> preactivTangent;
+    RowMatrixXd gradInputTangent;
+
+    double get_sum_output() const {
+      return activOutputLayer.sum();
+    }
+
+    double const* get_output() const {
+      return activOutputLayer.data();
+    }
+
+    double const* get_grad_input() const {
+      return gradInput.data();
+    }
+
+    double const* get_grad_input_tangent() const {
+      return gradInputTangent.data();
+    }
+};
 
 
 class NeuralNetwork
@@ -25,19 +61,48 @@ class NeuralNetwork
     void set_nn_structure(int input_size, int num_layers, int* layer_sizes);
     void set_activation(char* name);
     void add_weight_bias(double** weight, double* bias, int layer);
-    void forward(double * zeta, const int rows, const int cols);
-    void backward();
+    // use weight (row major) and bias of `layer' stored in external memory
+    // that outlives the network, without copying them
+    void set_weight_bias_view(double const* weight, double const* bias,
+        int layer);
+    // Fold centering and normalization of the input, (x - mean)/std, into the
+    // weight and bias of the first layer, such that the network takes the
+    // raw input
+    void fold_input_normalization(double const* mean, double const* std);
+    // precompute data used by backward(); call after all weights are set
+    void compile();
+    void forward(double const* zeta, const int rows, const int cols,
+        NetworkWorkspace& ws) const;
+    void backward(NetworkWorkspace& ws) const;
+    // Forward-over-reverse pass: backward(), plus the derivative of gradInput
+    // when the input moves in direction `dzeta' (same shape as the input of
+    // the last forward()), i.e. the Hessian of each output w.r.t. its input
+    // row times the matching row of dzeta.  Call after forward().
+    void backward_tangent(double const* dzeta, NetworkWorkspace& ws) const;
+
+    int get_input_size() const {
+      return inputSize_;
+    }
+
+    int get_num_layers() const {
+      return Nlayers_;
+    }
+
+    int get_layer_size(int layer) const {
+      return layerSizes_[layer];
+    }
 
-    double get_sum_output() {
-      return activOutputLayer_.sum();
+    std::string const& get_activation() const {
+      return activName_;
     }
 
-    double* get_output() {
-      return activOutputLayer_.data();
+    // weight (row major) and bias of a layer
+    double const* get_weight(int layer) const {
+      return weights_[layer];
     }
 
-    double* get_grad_input() {
-      return gradInput_.data();
+    double const* get_bias(int layer) const {
+      return biases_[layer];
     }
 
 
@@ -55,8 +120,8 @@ class NeuralNetwork
 
       std::cout<<"weights and biases:"<<std::endl;
       for (size_t i=0; i<weights_.size(); i++) {
-        std::cout<<"w_"<<i<<std::endl<<weights_.at(i)<<std::endl;
-        std::cout<<"b_"<<i<<std::endl<<biases_.at(i)<<std::endl;
+        std::cout<<"w_"<<i<<std::endl<<weight(i)<<std::endl;
+        std::cout<<"b_"<<i<<std::endl<<bias(i)<<std::endl;
       }
     }
 
@@ -66,14 +131,30 @@ class NeuralNetwork
     int inputSize_;         // size of input layer
     int Nlayers_;           // number of layers, including output, excluding input
     std::vector<int> layerSizes_;  // number of perceptrons in each layer
+    std::string activName_;
     ActivationFunction activFunc_;
     ActivationFunctionDerivative activFuncDeriv_;
-    std::vector<RowMatrixXd> weights_;
-    std::vector<RowVectorXd> biases_;
-    std::vector<RowMatrixXd> preactiv_;
-    RowMatrixXd activOutputLayer_;
-    RowVectorXd delta_;
-    RowMatrixXd gradInput_;
+    ActivationFunctionSecondDerivative activFuncDeriv2_;
+    // data of weightsStorage_/biasesStorage_, or of external memory
+    std::vector<double const*> weights_;
+    std::vector<double const*> biases_;
+    std::vector<RowMatrixXd> weightsStorage_;
+    std::vector<RowVectorXd> biasesStorage_;
+    // transpose of weights_, used by backward()
+    std::vector<RowMatrixXd> weightsTransposed_;
+
+    int weight_rows(int layer) const {
+      return (layer == 0) ? inputSize_ : layerSizes_[layer-1];
+    }
+
+    Map<const RowMatrixXd> weight(int layer) const {
+      return Map<const RowMatrixXd>(weights_[layer], weight_rows(layer),
+          layerSizes_[layer]);
+    }
+
+    Map<const RowVectorXd> bias(int layer) const {
+      return Map<const RowVectorXd>(biases_[layer], layerSizes_[layer]);
+    }
 
 
 
@@ -83,12 +164,16 @@ class NeuralNetwork
 // activation fucntion and derivatives
 RowMatrixXd relu(RowMatrixXd const& x);
 RowMatrixXd relu_derivative(RowMatrixXd const& x);
+RowMatrixXd relu_second_derivative(RowMatrixXd const& x);
 RowMatrixXd elu(RowMatrixXd const& x);
 RowMatrixXd elu_derivative(RowMatrixXd const& x);
+RowMatrixXd elu_second_derivative(RowMatrixXd const& x);
 RowMatrixXd tanh(RowMatrixXd const& x);
 RowMatrixXd tanh_derivative(RowMatrixXd const& x);
+RowMatrixXd tanh_second_derivative(RowMatrixXd const& x);
 RowMatrixXd sigmoid(RowMatrixXd const& x);
 RowMatrixXd sigmoid_derivative(RowMatrixXd const& x);
+RowMatrixXd sigmoid_second_derivative(RowMatrixXd const& x);
 
 
 #endif // NETWORK_H_
@@ -0,0 +1,207 @@
+#include <algorithm>
+#include "scheduler.h"
+
+// weight of the old data when refining the cost model
+#define COST_MODEL_DECAY 0.9
+
+
+//*****************************************************************************
+// ThreadPool
+//*****************************************************************************
+
+ThreadPool::ThreadPool(int num_threads)
+  : numThreads_(std::max(num_threads, 1)),
+    task_(nullptr),
+    generation_(0),
+    numTasks_(0),
+    nextTask_(0),
+    remaining_(0),
+    stop_(false)
+{
+  // the calling thread of run() is the first thread
+  for (int i=1; i<numThreads_; i++) {
+    workers_.push_back(std::thread(&ThreadPool::work, this));
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  start_.notify_all();
+  for (size_t i=0; i<workers_.size(); i++) {
+    workers_[i].join();
+  }
+}
+
+void ThreadPool::run(int num_tasks, std::function<void(int)> const& task)
+{
+  if (numThreads_ == 1 || num_tasks <= 1) {
+    for (int t=0; t<num_tasks; t++) {
+      task(t);
+    }
+    return;
+  }
+
+  std::lock_guard<std::mutex> jobLock(jobMutex_);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    task_ = &task;
+    numTasks_ = num_tasks;
+    nextTask_ = 0;
+    remaining_ = num_tasks;
+    ++generation_;
+  }
+  start_.notify_all();
+
+  execute();
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (remaining_ > 0) done_.wait(lock);
+  task_ = nullptr;
+}
+
+void ThreadPool::start(int num_tasks, std::function<void(int)> const& task)
+{
+  // released by wait()
+  jobMutex_.lock();
+  startedTask_ = task;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    task_ = &startedTask_;
+    numTasks_ = num_tasks;
+    nextTask_ = 0;
+    remaining_ = num_tasks;
+    ++generation_;
+  }
+  start_.notify_all();
+}
+
+void ThreadPool::wait()
+{
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (remaining_ > 0) done_.wait(lock);
+    task_ = nullptr;
+  }
+  startedTask_ = nullptr;
+  jobMutex_.unlock();
+}
+
+void ThreadPool::work()
+{
+  unsigned long seen = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (!stop_ && generation_ == seen) start_.wait(lock);
+      if (stop_) return;
+      seen = generation_;
+    }
+    execute();
+  }
+}
+
+void ThreadPool::execute()
+{
+  while (true) {
+    int t;
+    std::function<void(int)> const* task;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (nextTask_ >= numTasks_) return;
+      t = nextTask_++;
+      task = task_;
+    }
+
+    (*task)(t);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--remaining_ == 0) done_.notify_all();
+  }
+}
+
+
+//*****************************************************************************
+// CostModel
+//*****************************************************************************
+
+CostModel::CostModel()
+  : numTwoBody_(0),
+    numThreeBody_(0),
+    pairCoeff_(1.0),
+    tripletCoeff_(2.0),  // a three-body term is about twice a two-body term
+    spp_(0.0), spt_(0.0), stt_(0.0), spy_(0.0), sty_(0.0)
+{}
+
+void CostModel::set_descriptor_sizes(int num_two_body, int num_three_body)
+{
+  numTwoBody_ = num_two_body;
+  numThreeBody_ = num_three_body;
+}
+
+double CostModel::estimate(int numnei) const
+{
+  double pairs = numnei * numTwoBody_;
+  double triplets = 0.5 * numnei * (numnei-1) * numThreeBody_;
+  // the constant accounts for the per-particle overhead
+  return 1.0 + pairCoeff_*pairs + tripletCoeff_*triplets;
+}
+
+void CostModel::partition(int const* numnei, int n, int num_parts,
+    std::vector<int>& bounds) const
+{
+  num_parts = std::max(1, std::min(num_parts, n));
+  bounds.assign(num_parts+1, n);
+  bounds[0] = 0;
+
+  double total = 0.0;
+  for (int i=0; i<n; i++) {
+    total += estimate(numnei[i]);
+  }
+
+  // cut where the prefix sum of cost passes p/num_parts of the total
+  double prefix = 0.0;
+  int p = 1;
+  for (int i=0; i<n && p<num_parts; i++) {
+    prefix += estimate(numnei[i]);
+    while (p < num_parts && prefix >= total * p / num_parts) {
+      bounds[p] = i+1;
+      p++;
+    }
+  }
+}
+
+void CostModel::update(int const* numnei, std::vector<int> const& bounds,
+    std::vector<double> const& seconds)
+{
+  for (size_t p=0; p+1<bounds.size(); p++) {
+    double pairs = 0.0;
+    double triplets = 0.0;
+    for (int i=bounds[p]; i<bounds[p+1]; i++) {
+      pairs += numnei[i] * numTwoBody_;
+      triplets += 0.5 * numnei[i] * (numnei[i]-1) * numThreeBody_;
+    }
+    double const y = seconds[p];
+
+    spp_ = COST_MODEL_DECAY*spp_ + pairs*pairs;
+    spt_ = COST_MODEL_DECAY*spt_ + pairs*triplets;
+    stt_ = COST_MODEL_DECAY*stt_ + triplets*triplets;
+    spy_ = COST_MODEL_DECAY*spy_ + pairs*y;
+    sty_ = COST_MODEL_DECAY*sty_ + triplets*y;
+  }
+
+  // Only the ratio of the coefficients matters for partitioning, so they are
+  // scaled such that pairCoeff_ is 1.  Keep the old values if the normal
+  // equations are (nearly) singular or the fit is unphysical.
+  double const det = spp_*stt_ - spt_*spt_;
+  if (det <= 1e-12 * spp_*stt_) return;
+  double const a = (spy_*stt_ - sty_*spt_) / det;
+  double const b = (spp_*sty_ - spt_*spy_) / det;
+  if (a > 0 && b > 0) {
+    tripletCoeff_ = b / a;
+    pairCoeff_ = 1.0;
+  }
+}
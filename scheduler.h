@@ -0,0 +1,96 @@
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Fixed set of worker threads that execute fork-join jobs
+class ThreadPool
+{
+  public:
+    explicit ThreadPool(int num_threads);
+    ~ThreadPool();
+
+    int get_num_threads() const {
+      return numThreads_;
+    }
+
+    // Run task(t) for t = 0, ..., num_tasks-1 and return when all are done.
+    // The calling thread takes part in the work.  Jobs submitted from
+    // different threads are executed one after another.
+    void run(int num_tasks, std::function<void(int)> const& task);
+
+    // Start task(t) for t = 0, ..., num_tasks-1 on the worker threads only
+    // and return at once, such that the calling thread can do other work;
+    // wait() returns when all are done.  Tasks that wait for each other need
+    // at least num_tasks workers.
+    void start(int num_tasks, std::function<void(int)> const& task);
+    void wait();
+
+  private:
+    int numThreads_;
+    std::vector<std::thread> workers_;
+    std::mutex jobMutex_;     // serializes jobs
+    std::mutex mutex_;        // protects the state below
+    std::condition_variable start_;
+    std::condition_variable done_;
+    std::function<void(int)> const* task_;
+    std::function<void(int)> startedTask_;  // of start()
+    unsigned long generation_;
+    int numTasks_;
+    int nextTask_;
+    int remaining_;
+    bool stop_;
+
+    void work();
+    void execute();
+
+    // not copyable
+    ThreadPool(ThreadPool const&);
+    ThreadPool& operator=(ThreadPool const&);
+};
+
+
+// Cost model of the per-particle work in Compute, used to split a chunk of
+// particles into partitions of about equal cost.
+//
+// The cost of particle i is estimated as
+//   pair_coeff * numnei * N2 + triplet_coeff * numnei*(numnei-1)/2 * N3,
+// where N2 (N3) is the number of two-body (three-body) descriptor parameter
+// sets.  The two coefficients are refined from measured partition times by
+// least squares with exponential forgetting, such that the model adapts
+// across MD steps.
+class CostModel
+{
+  public:
+    CostModel();
+
+    void set_descriptor_sizes(int num_two_body, int num_three_body);
+
+    double estimate(int numnei) const;
+
+    // split particles [0, n) with `numnei' neighbors into `num_parts'
+    // contiguous ranges [bounds[p], bounds[p+1]) of about equal cost
+    void partition(int const* numnei, int n, int num_parts,
+        std::vector<int>& bounds) const;
+
+    // refine the coefficients given the measured time (in seconds) of each
+    // partition
+    void update(int const* numnei, std::vector<int> const& bounds,
+        std::vector<double> const& seconds);
+
+  private:
+    int numTwoBody_;
+    int numThreeBody_;
+    double pairCoeff_;
+    double tripletCoeff_;
+    // decayed normal equations of the least squares fit
+    double spp_, spt_, stt_, spy_, sty_;
+};
+
+
+#endif // SCHEDULER_H_
@@ -0,0 +1,393 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <sstream>
+#include <stdint.h>
+#include "trajectory.h"
+
+// the frames are written as int32
+static_assert(sizeof(int) == sizeof(int32_t), "int must have 32 bits");
+
+namespace {
+
+char const TRAJECTORY_MAGIC[8] = {'A', 'N', 'N', 'T', 'R', 'J', '0', '1'};
+
+template<class T>
+bool write_array(FILE* const file, T const* const data, size_t const n)
+{
+  return fwrite(data, sizeof(T), n, file) == n;
+}
+
+template<class T>
+bool read_array(FILE* const file, std::vector<T>& data, size_t const n)
+{
+  data.resize(n);
+  return fread(data.data(), sizeof(T), n, file) == n;
+}
+
+// key=value pairs of an extended XYZ comment line; values may be quoted, and
+// keys are lower case.  A key without value is stored as "T".
+bool parse_comment(std::string const& line,
+                   std::map<std::string, std::string>& values)
+{
+  size_t p = 0;
+  while (p < line.size()) {
+    while (p < line.size() && isspace(line[p])) ++p;
+    if (p == line.size()) break;
+    size_t const keyStart = p;
+    while (p < line.size() && line[p] != '=' && !isspace(line[p])) ++p;
+    std::string key = line.substr(keyStart, p - keyStart);
+    for (size_t k = 0; k < key.size(); ++k) key[k] = tolower(key[k]);
+    if (p == line.size() || line[p] != '=') {
+      values[key] = "T";
+      continue;
+    }
+    ++p;
+    std::string value;
+    if (p < line.size() && (line[p] == '"' || line[p] == '\'')) {
+      char const quote = line[p++];
+      size_t const end = line.find(quote, p);
+      if (end == std::string::npos) return false;
+      value = line.substr(p, end - p);
+      p = end + 1;
+    }
+    else {
+      size_t const valueStart = p;
+      while (p < line.size() && !isspace(line[p])) ++p;
+      value = line.substr(valueStart, p - valueStart);
+    }
+    values[key] = value;
+  }
+  return true;
+}
+
+bool parse_bool(std::string const& word, bool& value)
+{
+  if (word == "T" || word == "True" || word == "true" || word == "1") {
+    value = true;
+    return true;
+  }
+  if (word == "F" || word == "False" || word == "false" || word == "0") {
+    value = false;
+    return true;
+  }
+  return false;
+}
+
+}  // namespace
+
+//******************************************************************************
+TrajectoryReader::TrajectoryReader()
+    : file_(0),
+      binary_(false),
+      line_(0)
+{}
+
+//******************************************************************************
+TrajectoryReader::~TrajectoryReader()
+{
+  if (file_ != 0 && file_ != stdin) fclose(file_);
+}
+
+//******************************************************************************
+int TrajectoryReader::open(std::string const& path,
+                           std::vector<std::string> const& speciesNames,
+                           std::string& error)
+{
+  file_ = (path == "-") ? stdin : fopen(path.c_str(), "rb");
+  if (file_ == 0) {
+    error = "cannot open `" + path + "'";
+    return 1;
+  }
+  speciesNames_ = speciesNames;
+  line_ = 0;
+
+  // binary files start with the magic, extended XYZ files with a number
+  int const c = fgetc(file_);
+  binary_ = (c == TRAJECTORY_MAGIC[0]);
+  if (binary_ == false) {
+    if (c != EOF) ungetc(c, file_);
+    return 0;
+  }
+
+  std::vector<char> magic;
+  std::vector<int32_t> number;
+  if (!read_array(file_, magic, sizeof(TRAJECTORY_MAGIC) - 1)
+      || memcmp(magic.data(), TRAJECTORY_MAGIC + 1,
+                sizeof(TRAJECTORY_MAGIC) - 1) != 0
+      || !read_array(file_, number, 1) || number[0] < 0) {
+    error = "not a trajectory file (bad header)";
+    return 1;
+  }
+  std::vector<std::string> names;
+  for (int s = 0; s < number[0]; ++s) {
+    std::vector<int32_t> length;
+    std::vector<char> name;
+    if (!read_array(file_, length, 1) || length[0] < 0
+        || !read_array(file_, name, length[0])) {
+      error = "cannot read the species names of the trajectory file";
+      return 1;
+    }
+    names.push_back(std::string(name.begin(), name.end()));
+  }
+  if (!speciesNames_.empty() && speciesNames_ != names) {
+    error = "the species of the trajectory file are not the given ones";
+    return 1;
+  }
+  speciesNames_ = names;
+  return 0;
+}
+
+//******************************************************************************
+int TrajectoryReader::read(TrajectoryFrame& frame, bool& done,
+                           std::string& error)
+{
+  done = false;
+  frame.flags = 0;
+  frame.energy = 0.0;
+  for (int k = 0; k < 9; ++k) frame.lattice[k] = 0.0;
+  frame.forces.clear();
+  if (binary_) return read_binary(frame, done, error);
+  return read_xyz(frame, done, error);
+}
+
+//******************************************************************************
+bool TrajectoryReader::read_line(std::string& line)
+{
+  line.clear();
+  char buffer[4096];
+  while (fgets(buffer, sizeof(buffer), file_) != NULL) {
+    line += buffer;
+    if (!line.empty() && line[line.size() - 1] == '\n') break;
+  }
+  if (line.empty()) return false;
+  ++line_;
+  while (!line.empty() && isspace(line[line.size() - 1])) {
+    line.erase(line.size() - 1);
+  }
+  return true;
+}
+
+//******************************************************************************
+int TrajectoryReader::read_xyz(TrajectoryFrame& frame, bool& done,
+                               std::string& error)
+{
+  std::ostringstream where;
+  std::string line;
+
+  // number of atoms; blank lines between frames are skipped
+  do {
+    if (!read_line(line)) {
+      done = true;
+      return 0;
+    }
+  } while (line.find_first_not_of(" \t") == std::string::npos);
+  where << "line " << line_ << ": ";
+  char* end;
+  long const N = strtol(line.c_str(), &end, 10);
+  if (end == line.c_str() || N < 0) {
+    error = where.str() + "expected the number of atoms";
+    return 1;
+  }
+
+  // comment line
+  std::map<std::string, std::string> values;
+  if (!read_line(line) || !parse_comment(line, values)) {
+    error = where.str() + "bad comment line";
+    return 1;
+  }
+  bool const hasLattice = (values.count("lattice") != 0);
+  if (hasLattice) {
+    std::istringstream stream(values["lattice"]);
+    for (int k = 0; k < 9; ++k) stream >> frame.lattice[k];
+    if (!stream) {
+      error = where.str() + "Lattice needs 9 numbers";
+      return 1;
+    }
+    frame.flags |= TRAJECTORY_PBC_A | TRAJECTORY_PBC_B | TRAJECTORY_PBC_C;
+  }
+  if (values.count("pbc") != 0) {
+    std::istringstream stream(values["pbc"]);
+    frame.flags &= ~(TRAJECTORY_PBC_A | TRAJECTORY_PBC_B | TRAJECTORY_PBC_C);
+    for (int d = 0; d < 3; ++d) {
+      std::string word;
+      bool periodic;
+      if (!(stream >> word) || !parse_bool(word, periodic)) {
+        error = where.str() + "pbc needs 3 booleans";
+        return 1;
+      }
+      if (periodic) frame.flags |= (1 << d);
+    }
+    if (hasLattice == false
+        && (frame.flags & (TRAJECTORY_PBC_A | TRAJECTORY_PBC_B
+                           | TRAJECTORY_PBC_C)) != 0) {
+      error = where.str() + "periodic frame without Lattice";
+      return 1;
+    }
+  }
+  if (values.count("energy") != 0) {
+    frame.energy = strtod(values["energy"].c_str(), &end);
+    if (end == values["energy"].c_str()) {
+      error = where.str() + "bad energy";
+      return 1;
+    }
+    frame.flags |= TRAJECTORY_ENERGY;
+  }
+
+  // columns of the species, positions and reference forces
+  std::string properties = "species:S:1:pos:R:3";
+  if (values.count("properties") != 0) properties = values["properties"];
+  int speciesColumn = -1;
+  int positionColumn = -1;
+  int forceColumn = -1;
+  int numberColumns = 0;
+  {
+    std::istringstream stream(properties);
+    std::string name, type, count;
+    while (std::getline(stream, name, ':') && std::getline(stream, type, ':')
+           && std::getline(stream, count, ':')) {
+      int const n = atoi(count.c_str());
+      if (name == "species" && n == 1) speciesColumn = numberColumns;
+      if (name == "pos" && type == "R" && n == 3) {
+        positionColumn = numberColumns;
+      }
+      if ((name == "forces" || name == "force") && type == "R" && n == 3) {
+        forceColumn = numberColumns;
+      }
+      numberColumns += n;
+    }
+  }
+  if (speciesColumn < 0 || positionColumn < 0) {
+    error = where.str() + "Properties without species or pos";
+    return 1;
+  }
+  if (forceColumn >= 0) frame.flags |= TRAJECTORY_FORCES;
+
+  frame.species.resize(N);
+  frame.positions.resize(3*N);
+  if (forceColumn >= 0) frame.forces.resize(3*N);
+  std::vector<std::string> columns(numberColumns);
+  for (long i = 0; i < N; ++i) {
+    std::istringstream stream;
+    if (read_line(line)) stream.str(line);
+    for (int k = 0; k < numberColumns; ++k) stream >> columns[k];
+    if (!stream) {
+      std::ostringstream message;
+      message << "line " << line_ << ": expected " << numberColumns
+              << " columns";
+      error = message.str();
+      return 1;
+    }
+
+    std::string const& symbol = columns[speciesColumn];
+    int species = -1;
+    if (speciesNames_.empty()) {
+      species = strtol(symbol.c_str(), &end, 10);
+      if (*end != '\0') species = -1;
+    }
+    else {
+      for (size_t s = 0; s < speciesNames_.size(); ++s) {
+        if (speciesNames_[s] == symbol) species = s;
+      }
+    }
+    if (species < 0) {
+      std::ostringstream message;
+      message << "line " << line_ << ": unknown species `" << symbol << "'";
+      error = message.str();
+      return 1;
+    }
+    frame.species[i] = species;
+    for (int d = 0; d < 3; ++d) {
+      frame.positions[3*i + d] = atof(columns[positionColumn + d].c_str());
+      if (forceColumn >= 0) {
+        frame.forces[3*i + d] = atof(columns[forceColumn + d].c_str());
+      }
+    }
+  }
+  return 0;
+}
+
+//******************************************************************************
+int TrajectoryReader::read_binary(TrajectoryFrame& frame, bool& done,
+                                  std::string& error)
+{
+  int32_t header[2];
+  size_t const n = fread(header, sizeof(int32_t), 2, file_);
+  if (n == 0 && feof(file_)) {
+    done = true;
+    return 0;
+  }
+  std::vector<double> lattice;
+  if (n != 2 || header[0] < 0 || !read_array(file_, lattice, 9)) {
+    error = "truncated frame in the trajectory file";
+    return 1;
+  }
+  int const N = header[0];
+  frame.flags = header[1];
+  std::copy(lattice.begin(), lattice.end(), frame.lattice);
+  bool ok = read_array(file_, frame.species, N)
+      && read_array(file_, frame.positions, 3*N);
+  if (ok && (frame.flags & TRAJECTORY_ENERGY) != 0) {
+    ok = (fread(&frame.energy, sizeof(double), 1, file_) == 1);
+  }
+  if (ok && (frame.flags & TRAJECTORY_FORCES) != 0) {
+    ok = read_array(file_, frame.forces, 3*N);
+  }
+  if (!ok) {
+    error = "truncated frame in the trajectory file";
+    return 1;
+  }
+  for (int i = 0; i < N; ++i) {
+    if (frame.species[i] < 0
+        || frame.species[i] >= static_cast<int>(speciesNames_.size())) {
+      error = "bad species in the trajectory file";
+      return 1;
+    }
+  }
+  return 0;
+}
+
+//******************************************************************************
+int write_trajectory_header(FILE* const file,
+                            std::vector<std::string> const& speciesNames,
+                            std::string& error)
+{
+  int32_t const number = speciesNames.size();
+  bool ok = write_array(file, TRAJECTORY_MAGIC, sizeof(TRAJECTORY_MAGIC))
+      && write_array(file, &number, 1);
+  for (int s = 0; ok && s < number; ++s) {
+    int32_t const length = speciesNames[s].size();
+    ok = write_array(file, &length, 1)
+        && write_array(file, speciesNames[s].data(), length);
+  }
+  if (!ok) {
+    error = "cannot write the trajectory file header";
+    return 1;
+  }
+  return 0;
+}
+
+//******************************************************************************
+int write_trajectory_frame(FILE* const file, TrajectoryFrame const& frame,
+                           std::string& error)
+{
+  int32_t const N = frame.number_of_atoms();
+  int32_t const header[2] = {N, frame.flags};
+  bool ok = write_array(file, header, 2)
+      && write_array(file, frame.lattice, 9)
+      && write_array(file, frame.species.data(), N)
+      && write_array(file, frame.positions.data(), 3*N);
+  if (ok && (frame.flags & TRAJECTORY_ENERGY) != 0) {
+    ok = write_array(file, &frame.energy, 1);
+  }
+  if (ok && (frame.flags & TRAJECTORY_FORCES) != 0) {
+    ok = write_array(file, frame.forces.data(), 3*N);
+  }
+  if (!ok) {
+    error = "cannot write a frame of the trajectory file";
+    return 1;
+  }
+  return 0;
+}
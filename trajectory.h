@@ -0,0 +1,95 @@
+#ifndef TRAJECTORY_H_
+#define TRAJECTORY_H_
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Trajectory files read by ann_trajectory
+//
+// Extended XYZ (as written by ASE, ...): each frame is the number of atoms N,
+// a comment line of key=value pairs, and N lines of columns as given by the
+// Properties key (default species:S:1:pos:R:3).  The keys used are Lattice
+// (the cell vectors a, b and c, "ax ay az bx by bz cx cy cz"), pbc
+// ("T T T" by default if Lattice is given, "F F F" otherwise), energy, and
+// the property forces (or force), the last two as reference values.
+//
+// Binary: the 8 bytes "ANNTRJ01", the number of species S, and the name of
+// each species (int32 length, characters), followed by the frames:
+//
+//   int32   numberOfAtoms N
+//   int32   flags (TRAJECTORY_* bits)
+//   float64 lattice[9]
+//   int32   species[N]       (index of the species name)
+//   float64 positions[N*3]
+//   float64 energy           (if TRAJECTORY_ENERGY)
+//   float64 forces[N*3]      (if TRAJECTORY_FORCES)
+//
+// in the byte order of the machine that wrote it.
+//
+// The functions return 0 on success; otherwise a nonzero value is returned
+// and `error' describes the problem.
+
+enum TrajectoryFlag
+{
+  TRAJECTORY_PBC_A = 1,     // periodic along the cell vectors a, b, c
+  TRAJECTORY_PBC_B = 2,
+  TRAJECTORY_PBC_C = 4,
+  TRAJECTORY_ENERGY = 8,    // reference energy
+  TRAJECTORY_FORCES = 16    // reference forces
+};
+
+struct TrajectoryFrame
+{
+  int flags;
+  double lattice[9];               // rows are the cell vectors
+  std::vector<int> species;        // [numberOfAtoms]
+  std::vector<double> positions;   // [numberOfAtoms*3]
+  double energy;                   // reference energy
+  std::vector<double> forces;      // [numberOfAtoms*3] reference forces
+
+  int number_of_atoms() const { return species.size(); }
+  bool is_periodic(int const d) const { return (flags & (1 << d)) != 0; }
+};
+
+class TrajectoryReader
+{
+ public:
+  TrajectoryReader();
+  ~TrajectoryReader();
+
+  // Open `path' ("-" is the standard input) and detect its format.  The
+  // species symbols of an extended XYZ file are looked up in `speciesNames';
+  // if it is empty, they must be species indices.  A binary file has its own
+  // species names, which must agree with `speciesNames' if it is not empty.
+  int open(std::string const& path,
+           std::vector<std::string> const& speciesNames, std::string& error);
+  // read the next frame; `done' is set at the end of the file instead
+  int read(TrajectoryFrame& frame, bool& done, std::string& error);
+
+  std::vector<std::string> const& get_species_names() const {
+    return speciesNames_;
+  }
+
+ private:
+  FILE* file_;
+  bool binary_;
+  long line_;  // lines read from an extended XYZ file
+  std::vector<std::string> speciesNames_;
+
+  int read_xyz(TrajectoryFrame& frame, bool& done, std::string& error);
+  int read_binary(TrajectoryFrame& frame, bool& done, std::string& error);
+  bool read_line(std::string& line);
+
+  // not copyable
+  TrajectoryReader(TrajectoryReader const&);
+  TrajectoryReader& operator=(TrajectoryReader const&);
+};
+
+int write_trajectory_header(FILE* file,
+                            std::vector<std::string> const& speciesNames,
+                            std::string& error);
+int write_trajectory_frame(FILE* file, TrajectoryFrame const& frame,
+                           std::string& error);
+
+#endif  // TRAJECTORY_H_